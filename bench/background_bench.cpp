@@ -0,0 +1,106 @@
+#include "bench.h"
+#include "nvim/synthetic_workload.h"
+#include "nvim/trace.h"
+#include "renderer/background_planner.h"
+#include "renderer/grid_model.h"
+
+constexpr const char *BACKGROUND_BENCH_WORKLOADS[] { "repaint", "scroll", "highlight", "wide" };
+
+// Stands in for the renderer at flush, planning the backgrounds of every
+// row that changed
+struct BackgroundBenchContext {
+	GridModel *model;
+	BackgroundPlanner planner;
+	uint64_t drawn_grid_version;
+	uint64_t frames;
+	uint64_t rows;
+	uint64_t runs;
+	uint64_t rects;
+	uint64_t color_changes;
+	uint64_t plan_ns;
+};
+
+// As CreateBackgroundColor in renderer.cpp
+static uint32_t BackgroundBenchColor(GridModel *model, uint16_t hl_attrib_id) {
+	const HighlightAttributes *hl_attribs = &model->hl_attribs[hl_attrib_id];
+	if (hl_attribs->flags & HL_ATTRIB_REVERSE) {
+		return hl_attribs->foreground == DEFAULT_COLOR ? model->hl_attribs[0].foreground : hl_attribs->foreground;
+	}
+	return hl_attribs->background == DEFAULT_COLOR ? model->hl_attribs[0].background : hl_attribs->background;
+}
+
+static void BackgroundBenchFlush(void *context) {
+	auto bench = static_cast<BackgroundBenchContext *>(context);
+	GridModel *model = bench->model;
+
+	uint64_t start = BenchNowNs();
+	BackgroundPlannerBegin(&bench->planner);
+	for (int row = 0; row < model->grid_rows; ++row) {
+		if (model->grid_row_versions[row] <= bench->drawn_grid_version) {
+			continue;
+		}
+		// One run per highlight run, as PlanGridLineBackground does
+		const GridCell *cells = model->grid_row_cells[row];
+		int col_offset = 0;
+		for (int col = 1; col <= model->grid_cols; ++col) {
+			if (col == model->grid_cols || cells[col].hl_attrib_id != cells[col_offset].hl_attrib_id) {
+				BackgroundPlannerAddRun(&bench->planner, row, col_offset, col,
+					BackgroundBenchColor(model, cells[col_offset].hl_attrib_id));
+				bench->runs++;
+				col_offset = col;
+			}
+		}
+		bench->rows++;
+	}
+	BackgroundPlannerFinish(&bench->planner);
+	bench->plan_ns += BenchNowNs() - start;
+
+	const BackgroundPlanner *planner = &bench->planner;
+	for (uint32_t i = 0; i < planner->rect_count; ++i) {
+		if (i == 0 || planner->rects[i].color != planner->rects[i - 1].color) {
+			bench->color_changes++;
+		}
+	}
+	bench->rects += planner->rect_count;
+	bench->frames++;
+	bench->drawn_grid_version = model->grid_version;
+}
+
+// Background fills per frame over the synthetic workloads, one per
+// highlight run as before the planner against the planned rects, and the
+// brush changes left once those are sorted by color
+void BackgroundBench() {
+	printf("%-10s %10s %10s %10s %12s %12s\n", "workload", "rows/frame", "runs/frame", "rects/frame", "colors/frame", "us/frame");
+	for (const char *workload : BACKGROUND_BENCH_WORKLOADS) {
+		Vec<char> trace;
+		SyntheticWorkloadGenerate(SyntheticWorkloadLookup(workload), &trace);
+
+		GridModel model {};
+		BackgroundBenchContext bench {};
+		bench.model = &model;
+		GridModelHooks hooks {};
+		hooks.context = &bench;
+		hooks.flush = BackgroundBenchFlush;
+		GridModelInitialize(&model, &hooks);
+
+		TraceReader trace_reader;
+		TraceReaderOpenMemory(&trace_reader, trace.data(), trace.size());
+		TraceMessage message;
+		while (TraceReaderNext(&trace_reader, &message)) {
+			mpack_reader_t reader;
+			mpack_reader_init_data(&reader, message.data, message.size);
+			MPackExtractMessageResult(&reader);
+			GridModelRedraw(&model, &reader);
+			mpack_reader_destroy(&reader);
+		}
+
+		double frames = bench.frames ? static_cast<double>(bench.frames) : 1.0;
+		printf("%-10s %10.1f %10.1f %11.1f %12.1f %12.2f\n", workload,
+			bench.rows / frames, bench.runs / frames, bench.rects / frames,
+			bench.color_changes / frames, bench.plan_ns / frames / 1e3);
+
+		TraceReaderClose(&trace_reader);
+		BackgroundPlannerShutdown(&bench.planner);
+		GridModelShutdown(&model);
+	}
+}
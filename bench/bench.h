@@ -0,0 +1,23 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+inline uint64_t BenchNowNs() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Keeps the compiler from dropping work whose result is never used
+template<typename T>
+inline void BenchKeep(const T &value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Each benchmark is a plain function printing its own results, registered
+// in BENCHMARKS in bench_main.cpp
+typedef void (*BenchFunction)();
+struct Benchmark {
+	const char *name;
+	BenchFunction run;
+};
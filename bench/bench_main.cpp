@@ -0,0 +1,60 @@
+#include <cstring>
+
+#include "bench.h"
+
+void BackgroundBench();
+void DispatchBench();
+void GridCellsBench();
+void InputBytesBench();
+void InputKeyBench();
+void LayoutCacheBench();
+void RowPrepBench();
+void RpcParseBench();
+void RpcWriterBench();
+void ScrollBench();
+void Utf8Bench();
+void WorkloadBench();
+
+constexpr Benchmark BENCHMARKS[] {
+	{ "backgrounds", BackgroundBench },
+	{ "dispatch", DispatchBench },
+	{ "grid_cells", GridCellsBench },
+	{ "input_bytes", InputBytesBench },
+	{ "input_keys", InputKeyBench },
+	{ "layout_cache", LayoutCacheBench },
+	{ "row_prep", RowPrepBench },
+	{ "rpc_parse", RpcParseBench },
+	{ "rpc_writer", RpcWriterBench },
+	{ "scroll", ScrollBench },
+	{ "utf8", Utf8Bench },
+	{ "workloads", WorkloadBench }
+};
+
+// Runs the benchmarks named on the command line, or all of them
+int main(int argc, char **argv) {
+	int benchmarks_run = 0;
+	for (const Benchmark &benchmark : BENCHMARKS) {
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; ++i) {
+			selected |= strcmp(argv[i], benchmark.name) == 0;
+		}
+		if (!selected) {
+			continue;
+		}
+
+		printf("== %s\n", benchmark.name);
+		benchmark.run();
+		fflush(stdout);
+		benchmarks_run++;
+	}
+
+	if (benchmarks_run == 0) {
+		fprintf(stderr, "No benchmark matched, they are:");
+		for (const Benchmark &benchmark : BENCHMARKS) {
+			fprintf(stderr, " %s", benchmark.name);
+		}
+		fprintf(stderr, "\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include "bench.h"
+#include "common/mpack_helper.h"
+#include "renderer/grid_model.h"
+
+constexpr int DISPATCH_BENCH_LOOKUPS = 10'000'000;
+constexpr StringDispatchTable DISPATCH_BENCH_TABLE(REDRAW_EVENTS, RedrawEvent::Unknown);
+
+// Roughly what a redraw notification carries: mostly grid_line and flush,
+// some events nvy doesn't handle and the odd rare one near the end of the chain
+constexpr const char *DISPATCH_BENCH_NAMES[] {
+	"grid_line", "grid_line", "grid_line", "grid_line", "grid_cursor_goto",
+	"flush", "win_viewport", "grid_scroll", "hl_attr_define", "msg_showmode",
+	"grid_line", "mode_change", "flush", "busy_start", "busy_stop", "grid_line"
+};
+
+// What RendererRedraw did before the table, compare each name in turn
+static RedrawEvent DispatchBenchChain(MPackString name) {
+	for (const StringDispatchEntry<RedrawEvent> &entry : REDRAW_EVENTS) {
+		if (MPackMatchString(name, entry.name)) {
+			return entry.value;
+		}
+	}
+	return RedrawEvent::Unknown;
+}
+
+// Redraw event names through the perfect hash table against the compare chain
+void DispatchBench() {
+	constexpr size_t name_count = sizeof(DISPATCH_BENCH_NAMES) / sizeof(DISPATCH_BENCH_NAMES[0]);
+	MPackString names[name_count];
+	for (size_t i = 0; i < name_count; ++i) {
+		names[i] = MPackString { .data = DISPATCH_BENCH_NAMES[i], .length = strlen(DISPATCH_BENCH_NAMES[i]) };
+	}
+
+	uint64_t start = BenchNowNs();
+	uint32_t sum = 0;
+	for (int i = 0; i < DISPATCH_BENCH_LOOKUPS; ++i) {
+		MPackString name = names[i % name_count];
+		sum += static_cast<uint32_t>(DISPATCH_BENCH_TABLE.Lookup(name.data, name.length));
+	}
+	BenchKeep(sum);
+	uint64_t table_ns = BenchNowNs() - start;
+
+	start = BenchNowNs();
+	uint32_t chain_sum = 0;
+	for (int i = 0; i < DISPATCH_BENCH_LOOKUPS; ++i) {
+		chain_sum += static_cast<uint32_t>(DispatchBenchChain(names[i % name_count]));
+	}
+	BenchKeep(chain_sum);
+	uint64_t chain_ns = BenchNowNs() - start;
+
+	if (sum != chain_sum) {
+		printf("table and chain disagree\n");
+		return;
+	}
+	printf("%-8s %10s\n", "lookup", "ns/name");
+	printf("%-8s %10.2f\n", "table", static_cast<double>(table_ns) / DISPATCH_BENCH_LOOKUPS);
+	printf("%-8s %10.2f\n", "chain", static_cast<double>(chain_ns) / DISPATCH_BENCH_LOOKUPS);
+}
@@ -0,0 +1,188 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "bench.h"
+#include "renderer/grid_model.h"
+
+// The layout before GridCell, codepoints and properties in parallel arrays
+struct CellsBenchProperty {
+	uint16_t hl_attrib_id;
+	bool is_wide_char;
+};
+struct CellsBenchTwoArrays {
+	uint32_t *chars;
+	CellsBenchProperty *properties;
+};
+
+struct CellsBenchSize {
+	int rows;
+	int cols;
+};
+constexpr CellsBenchSize CELLS_BENCH_SIZES[] {
+	{ 50, 120 },
+	{ 100, 300 },
+	{ 300, 400 }
+};
+// Every pass touches each cell once
+constexpr uint64_t CELLS_BENCH_CELLS_PER_CASE = 100'000'000;
+// grid_line runs, a highlight and then a repeated or per-cell stretch of text
+constexpr int CELLS_BENCH_RUN_LENGTH = 8;
+constexpr int CELLS_BENCH_LOOKUPS = 20'000'000;
+
+static uint32_t CellsBenchText(int row, int col) {
+	// Mostly ASCII, a wide char now and then
+	return (row * 31 + col) % 97 == 0 ? 0x4E2D : 'a' + static_cast<uint32_t>((row + col) % 26);
+}
+
+// grid_line writes runs of cells with one highlight each, half of them repeats
+static uint64_t CellsBenchWritePacked(GridCell *cells, CellsBenchSize size, int passes) {
+	uint64_t start = BenchNowNs();
+	for (int pass = 0; pass < passes; ++pass) {
+		for (int row = 0; row < size.rows; ++row) {
+			GridCell *row_cells = &cells[static_cast<size_t>(row) * size.cols];
+			for (int col = 0; col + CELLS_BENCH_RUN_LENGTH <= size.cols; col += CELLS_BENCH_RUN_LENGTH) {
+				uint16_t hl_attrib_id = static_cast<uint16_t>((col / CELLS_BENCH_RUN_LENGTH + pass) & 63);
+				if ((col / CELLS_BENCH_RUN_LENGTH) & 1) {
+					FillGridCells(&row_cells[col], GridCell { .text = ' ', .hl_attrib_id = hl_attrib_id, .flags = 0 },
+						CELLS_BENCH_RUN_LENGTH);
+					continue;
+				}
+				for (int i = col; i < col + CELLS_BENCH_RUN_LENGTH; ++i) {
+					uint32_t text = CellsBenchText(row, i);
+					row_cells[i] = GridCell {
+						.text = text,
+						.hl_attrib_id = hl_attrib_id,
+						.flags = static_cast<uint16_t>(text > 0xFF ? CELL_WIDE_CHAR : 0)
+					};
+				}
+			}
+		}
+		BenchKeep(cells[pass % size.cols]);
+	}
+	return BenchNowNs() - start;
+}
+
+static uint64_t CellsBenchWriteTwoArrays(CellsBenchTwoArrays grid, CellsBenchSize size, int passes) {
+	uint64_t start = BenchNowNs();
+	for (int pass = 0; pass < passes; ++pass) {
+		for (int row = 0; row < size.rows; ++row) {
+			size_t base = static_cast<size_t>(row) * size.cols;
+			for (int col = 0; col + CELLS_BENCH_RUN_LENGTH <= size.cols; col += CELLS_BENCH_RUN_LENGTH) {
+				uint16_t hl_attrib_id = static_cast<uint16_t>((col / CELLS_BENCH_RUN_LENGTH + pass) & 63);
+				bool repeat = (col / CELLS_BENCH_RUN_LENGTH) & 1;
+				for (int i = col; i < col + CELLS_BENCH_RUN_LENGTH; ++i) {
+					uint32_t text = repeat ? ' ' : CellsBenchText(row, i);
+					grid.chars[base + i] = text;
+					grid.properties[base + i] = CellsBenchProperty { .hl_attrib_id = hl_attrib_id, .is_wide_char = text > 0xFF };
+				}
+			}
+		}
+		BenchKeep(grid.chars[pass % size.cols]);
+	}
+	return BenchNowNs() - start;
+}
+
+// A row read the way layout does, counting highlight runs and wide chars
+static uint64_t CellsBenchScanPacked(const GridCell *cells, CellsBenchSize size, int passes) {
+	uint64_t start = BenchNowNs();
+	uint64_t checksum = 0;
+	for (int pass = 0; pass < passes; ++pass) {
+		for (int row = 0; row < size.rows; ++row) {
+			const GridCell *row_cells = &cells[static_cast<size_t>(row) * size.cols];
+			uint16_t hl_attrib_id = row_cells[0].hl_attrib_id;
+			for (int col = 0; col < size.cols; ++col) {
+				checksum += row_cells[col].text;
+				checksum += (row_cells[col].flags & CELL_WIDE_CHAR) != 0;
+				if (row_cells[col].hl_attrib_id != hl_attrib_id) {
+					hl_attrib_id = row_cells[col].hl_attrib_id;
+					checksum++;
+				}
+			}
+		}
+	}
+	BenchKeep(checksum);
+	return BenchNowNs() - start;
+}
+
+static uint64_t CellsBenchScanTwoArrays(CellsBenchTwoArrays grid, CellsBenchSize size, int passes) {
+	uint64_t start = BenchNowNs();
+	uint64_t checksum = 0;
+	for (int pass = 0; pass < passes; ++pass) {
+		for (int row = 0; row < size.rows; ++row) {
+			size_t base = static_cast<size_t>(row) * size.cols;
+			uint16_t hl_attrib_id = grid.properties[base].hl_attrib_id;
+			for (int col = 0; col < size.cols; ++col) {
+				checksum += grid.chars[base + col];
+				checksum += grid.properties[base + col].is_wide_char;
+				if (grid.properties[base + col].hl_attrib_id != hl_attrib_id) {
+					hl_attrib_id = grid.properties[base + col].hl_attrib_id;
+					checksum++;
+				}
+			}
+		}
+	}
+	BenchKeep(checksum);
+	return BenchNowNs() - start;
+}
+
+// Single cells at scattered positions, like the cursor and mouse lookups
+static uint64_t CellsBenchLookupPacked(const GridCell *cells, size_t cell_count) {
+	uint64_t start = BenchNowNs();
+	uint64_t checksum = 0;
+	size_t index = 0;
+	for (int i = 0; i < CELLS_BENCH_LOOKUPS; ++i) {
+		index += 4099; // Prime and below the smallest grid
+		if (index >= cell_count) index -= cell_count;
+		checksum += cells[index].text + cells[index].hl_attrib_id;
+	}
+	BenchKeep(checksum);
+	return BenchNowNs() - start;
+}
+
+static uint64_t CellsBenchLookupTwoArrays(CellsBenchTwoArrays grid, size_t cell_count) {
+	uint64_t start = BenchNowNs();
+	uint64_t checksum = 0;
+	size_t index = 0;
+	for (int i = 0; i < CELLS_BENCH_LOOKUPS; ++i) {
+		index += 4099; // Prime and below the smallest grid
+		if (index >= cell_count) index -= cell_count;
+		checksum += grid.chars[index] + grid.properties[index].hl_attrib_id;
+	}
+	BenchKeep(checksum);
+	return BenchNowNs() - start;
+}
+
+// Packed GridCells against the two arrays they replaced, per cell written,
+// scanned and looked up
+void GridCellsBench() {
+	printf("%-10s %-8s %10s %10s %12s\n", "grid", "layout", "write ns", "scan ns", "lookup ns");
+	for (const CellsBenchSize &size : CELLS_BENCH_SIZES) {
+		size_t cell_count = static_cast<size_t>(size.rows) * size.cols;
+		int passes = static_cast<int>(CELLS_BENCH_CELLS_PER_CASE / cell_count);
+		double cells = static_cast<double>(cell_count) * passes;
+
+		GridCell *packed = static_cast<GridCell *>(calloc(cell_count, sizeof(GridCell)));
+		CellsBenchTwoArrays two_arrays {
+			.chars = static_cast<uint32_t *>(calloc(cell_count, sizeof(uint32_t))),
+			.properties = static_cast<CellsBenchProperty *>(calloc(cell_count, sizeof(CellsBenchProperty)))
+		};
+
+		char name[32];
+		snprintf(name, sizeof(name), "%dx%d", size.rows, size.cols);
+		uint64_t write_ns = CellsBenchWritePacked(packed, size, passes);
+		uint64_t scan_ns = CellsBenchScanPacked(packed, size, passes);
+		uint64_t lookup_ns = CellsBenchLookupPacked(packed, cell_count);
+		printf("%-10s %-8s %10.2f %10.2f %12.2f\n", name, "packed",
+			write_ns / cells, scan_ns / cells, static_cast<double>(lookup_ns) / CELLS_BENCH_LOOKUPS);
+
+		write_ns = CellsBenchWriteTwoArrays(two_arrays, size, passes);
+		scan_ns = CellsBenchScanTwoArrays(two_arrays, size, passes);
+		lookup_ns = CellsBenchLookupTwoArrays(two_arrays, cell_count);
+		printf("%-10s %-8s %10.2f %10.2f %12.2f\n", name, "2 arrays",
+			write_ns / cells, scan_ns / cells, static_cast<double>(lookup_ns) / CELLS_BENCH_LOOKUPS);
+
+		free(packed);
+		free(two_arrays.chars);
+		free(two_arrays.properties);
+	}
+}
@@ -0,0 +1,146 @@
+#include <cstring>
+
+#include "bench.h"
+#include "nvim/input_encoder.h"
+
+// What typing looks like in key notation, plain keys with the odd special one
+constexpr const char *INPUT_BENCH_KEYS[] {
+	"i", "f", " ", "(", "x", "<C-w>", "j", "<Esc>", "k", "\xC3\xA4", "<CR>", "w", "<BS>", "e", "<Space>", "d"
+};
+constexpr size_t INPUT_BENCH_KEY_COUNT = sizeof(INPUT_BENCH_KEYS) / sizeof(INPUT_BENCH_KEYS[0]);
+constexpr int INPUT_BENCH_KEYSTROKES = 100'000;
+
+struct InputBytesResult {
+	uint64_t outbound_bytes;
+	uint64_t inbound_bytes;
+	uint64_t messages;
+};
+
+// How keys went out before, an nvim_input request per key that nvim answers
+static InputBytesResult InputBytesRequests() {
+	InputBytesResult result {};
+	char buffer[256];
+	for (int i = 0; i < INPUT_BENCH_KEYSTROKES; ++i) {
+		const char *key = INPUT_BENCH_KEYS[i % INPUT_BENCH_KEY_COUNT];
+		mpack_writer_t writer;
+		mpack_writer_init(&writer, buffer, sizeof(buffer));
+		MPackStartRequest(i, "nvim_input", &writer);
+		mpack_start_array(&writer, 1);
+		mpack_write_cstr(&writer, key);
+		mpack_finish_array(&writer);
+		mpack_finish_array(&writer);
+		result.outbound_bytes += mpack_writer_buffer_used(&writer);
+		mpack_writer_destroy(&writer);
+
+		// [1, msgid, nil, bytes consumed]
+		mpack_writer_init(&writer, buffer, sizeof(buffer));
+		mpack_start_array(&writer, 4);
+		mpack_write_i64(&writer, 1);
+		mpack_write_i64(&writer, i);
+		mpack_write_nil(&writer);
+		mpack_write_i64(&writer, static_cast<int64_t>(strlen(key)));
+		mpack_finish_array(&writer);
+		result.inbound_bytes += mpack_writer_buffer_used(&writer);
+		mpack_writer_destroy(&writer);
+		result.messages++;
+	}
+	return result;
+}
+
+// Keys arrive in bursts of burst_size, each burst goes out as one notification
+static InputBytesResult InputBytesNotifications(int burst_size) {
+	InputEncoder encoder {};
+	InputBytesResult result {};
+	for (int i = 0; i < INPUT_BENCH_KEYSTROKES; ++i) {
+		const char *key = INPUT_BENCH_KEYS[i % INPUT_BENCH_KEY_COUNT];
+		InputEncoderAppend(&encoder, key, strlen(key));
+		if ((i + 1) % burst_size == 0) {
+			const char *data;
+			result.outbound_bytes += InputEncoderFinish(&encoder, &data);
+		}
+	}
+	const char *data;
+	result.outbound_bytes += InputEncoderFinish(&encoder, &data);
+	result.messages = encoder.message_count;
+	return result;
+}
+
+static void InputBytesPrint(const char *mode, InputBytesResult result) {
+	printf("%-18s %12.2f %12.2f %12.3f\n", mode,
+		static_cast<double>(result.outbound_bytes) / INPUT_BENCH_KEYSTROKES,
+		static_cast<double>(result.inbound_bytes) / INPUT_BENCH_KEYSTROKES,
+		static_cast<double>(result.messages) / INPUT_BENCH_KEYSTROKES);
+}
+
+// Wire bytes per keystroke for requests against batched notifications
+void InputBytesBench() {
+	printf("%-18s %12s %12s %12s\n", "mode", "out B/key", "in B/key", "msgs/key");
+	InputBytesPrint("request per key", InputBytesRequests());
+	InputBytesPrint("notify, burst 1", InputBytesNotifications(1));
+	InputBytesPrint("notify, burst 4", InputBytesNotifications(4));
+	InputBytesPrint("notify, burst 32", InputBytesNotifications(32));
+}
+
+// Special keys by made up key codes, the table is built the same way as
+// the virtual key one in nvim.cpp
+constexpr KeyNotationName INPUT_BENCH_KEY_NAMES[] {
+	{ 8, "BS" }, { 9, "Tab" }, { 13, "CR" }, { 27, "Esc" }, { 33, "PageUp" }, { 34, "PageDown" },
+	{ 35, "End" }, { 36, "Home" }, { 37, "Left" }, { 38, "Up" }, { 39, "Right" }, { 40, "Down" },
+	{ 45, "Insert" }, { 46, "Del" }, { 112, "F1" }, { 113, "F2" }
+};
+constexpr KeyNotationTable INPUT_BENCH_KEY_TABLE = BuildKeyNotationTable(INPUT_BENCH_KEY_NAMES);
+constexpr size_t INPUT_BENCH_NAME_COUNT = sizeof(INPUT_BENCH_KEY_NAMES) / sizeof(INPUT_BENCH_KEY_NAMES[0]);
+constexpr int INPUT_BENCH_KEY_RUNS = 5'000'000;
+
+// How a modified key was encoded before the tables: snprintf the notation,
+// then encode a request around it with mpack_writer
+static uint64_t InputKeySnprintf(int key_count) {
+	char data[4096];
+	uint64_t bytes = 0;
+	uint64_t start = BenchNowNs();
+	for (int i = 0; i < key_count; ++i) {
+		const KeyNotationName &entry = INPUT_BENCH_KEY_NAMES[i % INPUT_BENCH_NAME_COUNT];
+		uint8_t modifiers = static_cast<uint8_t>(i & 7);
+		char input_string[64];
+		snprintf(input_string, sizeof(input_string), "<%s%s%s%s>",
+			(modifiers & KEY_MODIFIER_CTRL) ? "C-" : "", (modifiers & KEY_MODIFIER_SHIFT) ? "S-" : "",
+			(modifiers & KEY_MODIFIER_ALT) ? "M-" : "", entry.name);
+
+		mpack_writer_t writer;
+		mpack_writer_init(&writer, data, sizeof(data));
+		MPackStartRequest(i, "nvim_input", &writer);
+		mpack_start_array(&writer, 1);
+		mpack_write_cstr(&writer, input_string);
+		mpack_finish_array(&writer);
+		mpack_finish_array(&writer);
+		bytes += mpack_writer_buffer_used(&writer);
+		mpack_writer_destroy(&writer);
+	}
+	BenchKeep(bytes);
+	return BenchNowNs() - start;
+}
+
+// Table lookup and prefix memcpys into the notification, finished every burst_size keys
+static uint64_t InputKeyTables(int key_count, int burst_size) {
+	InputEncoder encoder {};
+	uint64_t bytes = 0;
+	uint64_t start = BenchNowNs();
+	for (int i = 0; i < key_count; ++i) {
+		const KeyName &key = INPUT_BENCH_KEY_TABLE.keys[INPUT_BENCH_KEY_NAMES[i % INPUT_BENCH_NAME_COUNT].key];
+		InputEncoderAppendModified(&encoder, static_cast<uint8_t>(i & 7), key.name, key.length);
+		if ((i + 1) % burst_size == 0) {
+			const char *data;
+			bytes += InputEncoderFinish(&encoder, &data);
+		}
+	}
+	BenchKeep(bytes);
+	return BenchNowNs() - start;
+}
+
+// Encoding cost per modified special key, e.g. <C-S-PageDown>
+void InputKeyBench() {
+	printf("%-18s %10s\n", "mode", "ns/key");
+	printf("%-18s %10.1f\n", "snprintf request", static_cast<double>(InputKeySnprintf(INPUT_BENCH_KEY_RUNS)) / INPUT_BENCH_KEY_RUNS);
+	printf("%-18s %10.1f\n", "tables, burst 1", static_cast<double>(InputKeyTables(INPUT_BENCH_KEY_RUNS, 1)) / INPUT_BENCH_KEY_RUNS);
+	printf("%-18s %10.1f\n", "tables, burst 16", static_cast<double>(InputKeyTables(INPUT_BENCH_KEY_RUNS, 16)) / INPUT_BENCH_KEY_RUNS);
+}
@@ -0,0 +1,101 @@
+#include <cstdlib>
+
+#include "bench.h"
+#include "nvim/synthetic_workload.h"
+#include "nvim/trace.h"
+#include "renderer/grid_model.h"
+#include "renderer/layout_cache.h"
+
+constexpr const char *LAYOUT_BENCH_WORKLOADS[] { "repaint", "scroll", "highlight", "wide" };
+// The renderer's capacity is 1024, smaller ones show how much of it is used
+constexpr uint32_t LAYOUT_BENCH_CAPACITIES[] { 64, 256, 1024 };
+// As LAYOUT_CACHE_BUDGET and LAYOUT_CACHE_COST_PER_CHAR in renderer.h
+constexpr size_t LAYOUT_BENCH_BUDGET = 32 * 1024 * 1024;
+constexpr size_t LAYOUT_BENCH_COST_PER_CELL = 96;
+
+// Stands in for the renderer at flush, looking up every row that changed
+// and inserting the ones that miss
+struct LayoutBenchContext {
+	GridModel *model;
+	LayoutCache cache;
+	uint64_t drawn_grid_version;
+	uint64_t drawn_hl_style_version;
+	uint64_t rows_drawn;
+	uint64_t lookup_ns;
+};
+
+static void LayoutBenchRelease(void *) {
+}
+
+static void LayoutBenchFlush(void *context) {
+	auto bench = static_cast<LayoutBenchContext *>(context);
+	GridModel *model = bench->model;
+	if (model->hl_style_version != bench->drawn_hl_style_version) {
+		LayoutCacheClear(&bench->cache);
+		bench->drawn_hl_style_version = model->hl_style_version;
+	}
+
+	size_t key_size = static_cast<size_t>(model->grid_cols) * sizeof(GridCell);
+	uint64_t start = BenchNowNs();
+	for (int row = 0; row < model->grid_rows; ++row) {
+		if (model->grid_row_versions[row] <= bench->drawn_grid_version) {
+			continue;
+		}
+		GridCell *cells = model->grid_row_cells[row];
+		uint64_t hash = LayoutCacheHash(cells, key_size);
+		if (!LayoutCacheLookup(&bench->cache, hash, cells, key_size)) {
+			// Any non-null value will do, nothing is released
+			LayoutCacheInsert(&bench->cache, hash, cells, key_size, cells, model->grid_cols * LAYOUT_BENCH_COST_PER_CELL);
+		}
+		bench->rows_drawn++;
+	}
+	bench->lookup_ns += BenchNowNs() - start;
+	bench->drawn_grid_version = model->grid_version;
+}
+
+static void LayoutBenchRun(const char *workload, Vec<char> *trace, uint32_t capacity) {
+	GridModel model {};
+	LayoutBenchContext bench {};
+	bench.model = &model;
+	LayoutCacheInitialize(&bench.cache, capacity, LAYOUT_BENCH_BUDGET, LayoutBenchRelease);
+	GridModelHooks hooks {};
+	hooks.context = &bench;
+	hooks.flush = LayoutBenchFlush;
+	GridModelInitialize(&model, &hooks);
+
+	TraceReader trace_reader;
+	TraceReaderOpenMemory(&trace_reader, trace->data(), trace->size());
+	TraceMessage message;
+	while (TraceReaderNext(&trace_reader, &message)) {
+		mpack_reader_t reader;
+		mpack_reader_init_data(&reader, message.data, message.size);
+		MPackExtractMessageResult(&reader);
+		GridModelRedraw(&model, &reader);
+		mpack_reader_destroy(&reader);
+	}
+
+	uint64_t lookups = bench.cache.hit_count + bench.cache.miss_count;
+	printf("%-10s %8u %10llu %8.1f%% %10llu %10.0f\n", workload, capacity,
+		static_cast<unsigned long long>(bench.rows_drawn),
+		lookups ? 100.0 * bench.cache.hit_count / lookups : 0.0,
+		static_cast<unsigned long long>(bench.cache.eviction_count),
+		bench.rows_drawn ? static_cast<double>(bench.lookup_ns) / bench.rows_drawn : 0.0);
+
+	TraceReaderClose(&trace_reader);
+	GridModelShutdown(&model);
+	LayoutCacheShutdown(&bench.cache);
+}
+
+// Layout cache hit rate over the synthetic workloads, looked up the way the
+// renderer does for each row redrawn at flush, and the cost of hashing the
+// row and looking it up or inserting it
+void LayoutCacheBench() {
+	printf("%-10s %8s %10s %9s %10s %10s\n", "workload", "capacity", "rows", "hit rate", "evictions", "ns/row");
+	for (const char *workload : LAYOUT_BENCH_WORKLOADS) {
+		Vec<char> trace;
+		SyntheticWorkloadGenerate(SyntheticWorkloadLookup(workload), &trace);
+		for (uint32_t capacity : LAYOUT_BENCH_CAPACITIES) {
+			LayoutBenchRun(workload, &trace, capacity);
+		}
+	}
+}
@@ -0,0 +1,151 @@
+#include <cstdlib>
+#include <thread>
+
+#include "bench.h"
+#include "common/work_pool.h"
+#include "nvim/synthetic_workload.h"
+#include "nvim/trace.h"
+#include "renderer/grid_model.h"
+#include "renderer/row_prep.h"
+
+constexpr const char *ROW_BENCH_WORKLOADS[] { "repaint", "highlight", "wide" };
+constexpr int ROW_BENCH_FRAMES = 300;
+constexpr int ROW_BENCH_WARMUP_FRAMES = 20;
+constexpr float ROW_BENCH_FONT_WIDTH = 8.0f;
+
+// Every row of one screen prepared at once, as after default_colors_set
+// or a font change
+struct RowBenchContext {
+	GridModel *model; // Only while loading the workload
+	GridSnapshot frame;
+	GlyphMetricsCache glyph_metrics;
+	RowDrawDesc *descs;
+};
+
+static void RowBenchFlush(void *context) {
+	auto bench = static_cast<RowBenchContext *>(context);
+	GridSnapshotSource source = GridModelSnapshotSource(bench->model);
+	GridSnapshotUpdate(&bench->frame, &source);
+}
+
+// The last screen of the workload, with made up advances for every
+// codepoint on it: wide chars a bit narrower than two cells and every
+// seventh codepoint missing from the font, so rows get spacings too
+static void RowBenchLoad(RowBenchContext *bench, const char *workload) {
+	Vec<char> trace;
+	SyntheticWorkloadGenerate(SyntheticWorkloadLookup(workload), &trace);
+
+	GridModel model {};
+	bench->model = &model;
+	GridModelHooks hooks {};
+	hooks.context = bench;
+	hooks.flush = RowBenchFlush;
+	GridModelInitialize(&model, &hooks);
+
+	TraceReader trace_reader;
+	TraceReaderOpenMemory(&trace_reader, trace.data(), trace.size());
+	TraceMessage message;
+	while (TraceReaderNext(&trace_reader, &message)) {
+		mpack_reader_t reader;
+		mpack_reader_init_data(&reader, message.data, message.size);
+		MPackExtractMessageResult(&reader);
+		GridModelRedraw(&model, &reader);
+		mpack_reader_destroy(&reader);
+	}
+	TraceReaderClose(&trace_reader);
+	GridModelShutdown(&model);
+	bench->model = nullptr;
+
+	GridSnapshot *frame = &bench->frame;
+	for (int row = 0; row < frame->rows; ++row) {
+		const GridCell *cells = GridSnapshotRow(frame, row);
+		for (int col = 0; col < frame->cols; ++col) {
+			GlyphMetrics *metrics = GlyphMetricsFind(&bench->glyph_metrics, cells[col].text);
+			bool wide_char = cells[col].flags & CELL_WIDE_CHAR;
+			metrics->advance = ROW_BENCH_FONT_WIDTH * (wide_char ? 1.875f : 1.0f);
+			metrics->flags = GLYPH_METRICS_MEASURED | (cells[col].text % 7 ? GLYPH_METRICS_COVERED : 0u);
+		}
+	}
+
+	if (frame->rows <= 0) {
+		return;
+	}
+	bench->descs = static_cast<RowDrawDesc *>(calloc(frame->rows, sizeof(RowDrawDesc)));
+	for (int row = 0; row < frame->rows; ++row) {
+		RowDrawDescReserve(&bench->descs[row], frame->cols);
+		bench->descs[row].row = row;
+	}
+}
+
+static void RowBenchTask(void *context, uint32_t index, uint32_t) {
+	auto bench = static_cast<RowBenchContext *>(context);
+	RowDrawDesc *desc = &bench->descs[index];
+	desc->prepared = RowPrepare(desc, &bench->frame, &bench->glyph_metrics, ROW_BENCH_FONT_WIDTH, nullptr, nullptr);
+}
+
+// What a frame's descs add up to, the same whichever thread prepared
+// them. Rows RowPrepare gave up on would make the timings meaningless.
+static uint64_t RowBenchChecksum(RowBenchContext *bench, int *unprepared_rows) {
+	uint64_t checksum = 0;
+	*unprepared_rows = 0;
+	for (int row = 0; row < bench->frame.rows; ++row) {
+		const RowDrawDesc *desc = &bench->descs[row];
+		*unprepared_rows += !desc->prepared;
+		checksum = checksum * 31 + desc->text_length;
+		checksum = checksum * 31 + desc->spacing_count;
+		checksum = checksum * 31 + desc->run_count;
+	}
+	return checksum;
+}
+
+// Full screen row preparation on the row pool from one worker, the caller
+// alone, up to every hardware thread. Past the hardware threads the pool
+// is oversubscribed and only its overhead shows.
+void RowPrepBench() {
+	uint32_t hardware_threads = std::thread::hardware_concurrency();
+	uint32_t max_workers = hardware_threads > 4 ? hardware_threads : 4;
+	printf("%u hardware threads\n", hardware_threads);
+	printf("%-10s %8s %10s %8s %12s %8s\n", "workload", "workers", "us/frame", "speedup", "steals/frame", "match");
+	for (const char *workload : ROW_BENCH_WORKLOADS) {
+		RowBenchContext bench {};
+		RowBenchLoad(&bench, workload);
+
+		double serial_us = 0.0;
+		uint64_t serial_checksum = 0;
+		for (uint32_t step = 1; ; step *= 2) {
+			uint32_t workers = step < max_workers ? step : max_workers;
+			WorkPool pool {};
+			WorkPoolInitialize(&pool, workers - 1);
+			for (int i = 0; i < ROW_BENCH_WARMUP_FRAMES; ++i) {
+				WorkPoolRun(&pool, bench.frame.rows, RowBenchTask, &bench);
+			}
+			uint64_t steals_before = WorkPoolGetStats(&pool).steals;
+			uint64_t start = BenchNowNs();
+			for (int i = 0; i < ROW_BENCH_FRAMES; ++i) {
+				WorkPoolRun(&pool, bench.frame.rows, RowBenchTask, &bench);
+			}
+			double us = static_cast<double>(BenchNowNs() - start) / ROW_BENCH_FRAMES / 1e3;
+			uint64_t steals = WorkPoolGetStats(&pool).steals - steals_before;
+			WorkPoolShutdown(&pool);
+
+			int unprepared_rows;
+			uint64_t checksum = RowBenchChecksum(&bench, &unprepared_rows);
+			if (workers == 1) {
+				serial_us = us;
+				serial_checksum = checksum;
+			}
+			printf("%-10s %8u %10.1f %7.2fx %12.1f %8s\n", workload, workers, us, serial_us / us,
+				static_cast<double>(steals) / ROW_BENCH_FRAMES, checksum == serial_checksum && unprepared_rows == 0 ? "yes" : "NO");
+			if (workers == max_workers) {
+				break;
+			}
+		}
+
+		for (int row = 0; row < bench.frame.rows; ++row) {
+			RowDrawDescFree(&bench.descs[row]);
+		}
+		free(bench.descs);
+		GlyphMetricsCacheShutdown(&bench.glyph_metrics);
+		GridSnapshotShutdown(&bench.frame);
+	}
+}
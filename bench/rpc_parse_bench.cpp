@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <cstring>
+
+#include "bench.h"
+#include "common/mpack_helper.h"
+#include "nvim/synthetic_workload.h"
+#include "nvim/trace.h"
+
+constexpr const char *PARSE_BENCH_WORKLOADS[] { "repaint", "scroll", "highlight", "wide" };
+constexpr int PARSE_BENCH_RUNS = 5;
+// Same as NVIM_READ_CHUNK_SIZE, the stream arrives in pipe sized reads
+constexpr size_t PARSE_BENCH_CHUNK_SIZE = 256 * 1024;
+
+// The messages of a trace back to back, as nvim writes them to the pipe
+static void ParseBenchStream(Vec<char> *trace, Vec<char> *stream_out) {
+	TraceReader trace_reader;
+	TraceReaderOpenMemory(&trace_reader, trace->data(), trace->size());
+	TraceMessage message;
+	while (TraceReaderNext(&trace_reader, &message)) {
+		size_t size = stream_out->size();
+		stream_out->resize(size + message.size);
+		memcpy(stream_out->data() + size, message.data, message.size);
+	}
+	TraceReaderClose(&trace_reader);
+}
+
+struct ParseBenchInput {
+	const char *data;
+	size_t size;
+	size_t offset;
+};
+
+static size_t ParseBenchRead(ParseBenchInput *input, char *buffer, size_t count) {
+	size_t length = input->size - input->offset;
+	if (length > count) length = count;
+	if (length > PARSE_BENCH_CHUNK_SIZE) length = PARSE_BENCH_CHUNK_SIZE;
+	memcpy(buffer, input->data + input->offset, length);
+	input->offset += length;
+	return length;
+}
+
+// How the reader thread used to do it, a node tree per message
+static size_t ParseBenchTreeRead(mpack_tree_t *tree, char *buffer, size_t count) {
+	return ParseBenchRead(static_cast<ParseBenchInput *>(mpack_tree_context(tree)), buffer, count);
+}
+
+// Visits every node the way the old redraw code read them, so both sides
+// end up having looked at every element
+static uint64_t ParseBenchWalk(mpack_node_t node) {
+	switch (mpack_node_type(node)) {
+	case mpack_type_array: {
+		uint64_t sum = 0;
+		size_t count = mpack_node_array_length(node);
+		for (size_t i = 0; i < count; ++i) {
+			sum += ParseBenchWalk(mpack_node_array_at(node, i));
+		}
+		return sum;
+	}
+	case mpack_type_map: {
+		uint64_t sum = 0;
+		size_t count = mpack_node_map_count(node);
+		for (size_t i = 0; i < count; ++i) {
+			sum += ParseBenchWalk(mpack_node_map_key_at(node, i));
+			sum += ParseBenchWalk(mpack_node_map_value_at(node, i));
+		}
+		return sum;
+	}
+	case mpack_type_str:
+		return mpack_node_strlen(node);
+	case mpack_type_int:
+	case mpack_type_uint:
+		return node.data->value.u;
+	default:
+		return mpack_node_type(node);
+	}
+}
+
+// The same visit with a pull reader straight from the framed bytes
+static uint64_t ParseBenchPull(mpack_reader_t *reader) {
+	mpack_tag_t tag = mpack_read_tag(reader);
+	if (mpack_reader_error(reader) != mpack_ok) return 0;
+	switch (tag.type) {
+	case mpack_type_array: {
+		uint64_t sum = 0;
+		for (uint32_t i = 0; i < tag.v.n; ++i) {
+			sum += ParseBenchPull(reader);
+		}
+		mpack_done_array(reader);
+		return sum;
+	}
+	case mpack_type_map: {
+		uint64_t sum = 0;
+		for (uint32_t i = 0; i < tag.v.n; ++i) {
+			sum += ParseBenchPull(reader);
+			sum += ParseBenchPull(reader);
+		}
+		mpack_done_map(reader);
+		return sum;
+	}
+	case mpack_type_str:
+		mpack_skip_bytes(reader, tag.v.l);
+		mpack_done_str(reader);
+		return tag.v.l;
+	case mpack_type_bin:
+		mpack_skip_bytes(reader, tag.v.l);
+		mpack_done_bin(reader);
+		return tag.type;
+	case mpack_type_ext:
+		mpack_skip_bytes(reader, tag.v.l);
+		mpack_done_ext(reader);
+		return tag.type;
+	case mpack_type_int:
+	case mpack_type_uint:
+		return tag.v.u;
+	default:
+		return tag.type;
+	}
+}
+
+// Which thread does which part: the tree was parsed on the reader thread
+// and walked by the redraw code, now the reader thread only frames and the
+// UI thread pulls the elements. Clock reads per message are in both sides.
+struct ParseBenchTimes {
+	uint64_t reader_ns;
+	uint64_t ui_ns;
+	uint64_t message_count;
+	uint64_t checksum;
+};
+
+static ParseBenchTimes ParseBenchTree(Vec<char> *stream) {
+	ParseBenchTimes times {};
+	ParseBenchInput input { .data = stream->data(), .size = stream->size(), .offset = 0 };
+	uint64_t start = BenchNowNs();
+	mpack_tree_t tree;
+	mpack_tree_init_stream(&tree, ParseBenchTreeRead, &input, MEGABYTES(20), 1'048'576);
+	while (true) {
+		// Flags an error once the stream runs dry
+		mpack_tree_parse(&tree);
+		if (mpack_tree_error(&tree) != mpack_ok) break;
+		uint64_t walk_start = BenchNowNs();
+		times.checksum += ParseBenchWalk(mpack_tree_root(&tree));
+		times.ui_ns += BenchNowNs() - walk_start;
+		times.message_count++;
+	}
+	mpack_tree_destroy(&tree);
+	times.reader_ns = BenchNowNs() - start - times.ui_ns;
+	return times;
+}
+
+// How NvimReadMessage frames, then each message pulled as the UI thread does
+static ParseBenchTimes ParseBenchStreaming(Vec<char> *stream) {
+	ParseBenchTimes times {};
+	ParseBenchInput input { .data = stream->data(), .size = stream->size(), .offset = 0 };
+	uint64_t start = BenchNowNs();
+	Vec<char> buffer;
+	size_t message_start = 0;
+	MPackFramer framer;
+	MPackFramerReset(&framer);
+	while (true) {
+		char *message = buffer.data() + message_start;
+		size_t available = buffer.size() - message_start;
+		size_t message_size = MPackFramerScan(&framer, message, available);
+		if (message_size == SIZE_MAX) break;
+		if (message_size != 0) {
+			uint64_t pull_start = BenchNowNs();
+			mpack_reader_t reader;
+			mpack_reader_init_data(&reader, message, message_size);
+			times.checksum += ParseBenchPull(&reader);
+			BenchKeep(mpack_reader_destroy(&reader));
+			times.ui_ns += BenchNowNs() - pull_start;
+			message_start += message_size;
+			MPackFramerReset(&framer);
+			times.message_count++;
+			continue;
+		}
+
+		if (message_start != 0) {
+			memmove(buffer.data(), message, available);
+			buffer.resize(available);
+			message_start = 0;
+		}
+		size_t size = buffer.size();
+		buffer.resize(size + PARSE_BENCH_CHUNK_SIZE);
+		size_t bytes_read = ParseBenchRead(&input, buffer.data() + size, PARSE_BENCH_CHUNK_SIZE);
+		buffer.resize(size + bytes_read);
+		if (bytes_read == 0) break;
+	}
+	times.reader_ns = BenchNowNs() - start - times.ui_ns;
+	return times;
+}
+
+// The mpack tree the client used to build for every message against framing
+// plus a pull reader, over the synthetic workloads. Each thread's share is
+// reported on its own, the UI thread columns are the ones redraws wait on.
+void RpcParseBench() {
+	printf("%-10s %8s %-7s %12s %12s %12s %12s\n", "workload", "MB", "path", "reader MB/s", "ui MB/s",
+		"reader ns/msg", "ui ns/msg");
+	for (const char *name : PARSE_BENCH_WORKLOADS) {
+		Vec<char> trace;
+		SyntheticWorkloadGenerate(SyntheticWorkloadLookup(name), &trace);
+		Vec<char> stream;
+		ParseBenchStream(&trace, &stream);
+
+		// Best of each column on its own, runs vary in where the noise lands
+		ParseBenchTimes best[2];
+		for (ParseBenchTimes &times : best) {
+			times = ParseBenchTimes { .reader_ns = UINT64_MAX, .ui_ns = UINT64_MAX, .message_count = 0, .checksum = 0 };
+		}
+		for (int i = 0; i < PARSE_BENCH_RUNS; ++i) {
+			ParseBenchTimes runs[2] { ParseBenchTree(&stream), ParseBenchStreaming(&stream) };
+			for (int path = 0; path < 2; ++path) {
+				best[path].reader_ns = std::min(best[path].reader_ns, runs[path].reader_ns);
+				best[path].ui_ns = std::min(best[path].ui_ns, runs[path].ui_ns);
+				best[path].message_count = runs[path].message_count;
+				best[path].checksum = runs[path].checksum;
+			}
+		}
+		if (best[0].message_count != best[1].message_count || best[0].checksum != best[1].checksum) {
+			printf("%-10s tree and stream disagree, %llu and %llu messages\n", name,
+				static_cast<unsigned long long>(best[0].message_count), static_cast<unsigned long long>(best[1].message_count));
+			continue;
+		}
+
+		double megabytes = stream.size() / 1e6;
+		const char *const PATHS[] { "tree", "stream" };
+		for (int path = 0; path < 2; ++path) {
+			printf("%-10s %8.1f %-7s %12.0f %12.0f %12.0f %12.0f\n", name, megabytes, PATHS[path],
+				megabytes / (best[path].reader_ns / 1e9), megabytes / (best[path].ui_ns / 1e9),
+				static_cast<double>(best[path].reader_ns) / best[path].message_count,
+				static_cast<double>(best[path].ui_ns) / best[path].message_count);
+		}
+	}
+}
@@ -0,0 +1,120 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "bench.h"
+#include "nvim/rpc_writer.h"
+
+struct WriterBenchCase {
+	const char *name;
+	size_t payload_size;
+	uint32_t message_count;
+};
+constexpr WriterBenchCase WRITER_BENCH_CASES[] {
+	// A keystroke, the common case
+	{ "input", 6, 1'000'000 },
+	// A line of text, e.g. a paste
+	{ "line", 120, 200'000 },
+	// Past the old 4 KB message buffer
+	{ "64k", 64 * 1024, 4'000 }
+};
+
+struct WriterBenchResult {
+	uint64_t elapsed_ns;
+	uint64_t bytes;
+	uint64_t writes;
+};
+
+static void WriterBenchEncode(mpack_writer_t *writer, const char *payload, size_t payload_size) {
+	MPackStartNotification("nvim_input", writer);
+	mpack_start_array(writer, 1);
+	mpack_write_str(writer, payload, static_cast<uint32_t>(payload_size));
+	mpack_finish_array(writer);
+}
+
+// nvim stands in as a process that reads and drops everything
+static bool WriterBenchSpawn(Transport *transport) {
+	char *const argv[] {
+		const_cast<char *>("sh"), const_cast<char *>("-c"), const_cast<char *>("exec cat > /dev/null"), nullptr
+	};
+	return TransportSpawn(transport, argv);
+}
+
+// Encoded on this thread, written in batches by the writer thread
+static WriterBenchResult WriterBenchBatched(Transport *transport, const WriterBenchCase *bench_case, const char *payload) {
+	RpcWriter rpc_writer {};
+	RpcWriterInitialize(&rpc_writer, transport);
+
+	uint64_t start = BenchNowNs();
+	uint64_t bytes = 0;
+	for (uint32_t i = 0; i < bench_case->message_count; ++i) {
+		WriterBenchEncode(RpcWriterBegin(&rpc_writer), payload, bench_case->payload_size);
+		RpcWriterCommit(&rpc_writer);
+		bytes += rpc_writer.staging.size();
+	}
+	// Shutdown only waits so long, be sure everything is out first
+	while (rpc_writer.bytes_written.load() < bytes) {
+		std::this_thread::yield();
+	}
+	uint64_t elapsed_ns = BenchNowNs() - start;
+
+	RpcWriterShutdown(&rpc_writer);
+	return WriterBenchResult {
+		.elapsed_ns = elapsed_ns,
+		.bytes = bytes,
+		.writes = RpcWriterGetStats(&rpc_writer).writes
+	};
+}
+
+// How messages went out before the writer thread, one write per message
+static WriterBenchResult WriterBenchDirect(Transport *transport, const WriterBenchCase *bench_case, const char *payload) {
+	static char buffer[128 * 1024];
+	uint64_t start = BenchNowNs();
+	uint64_t bytes = 0;
+	for (uint32_t i = 0; i < bench_case->message_count; ++i) {
+		mpack_writer_t writer;
+		mpack_writer_init(&writer, buffer, sizeof(buffer));
+		WriterBenchEncode(&writer, payload, bench_case->payload_size);
+		mpack_finish_array(&writer);
+		size_t size = mpack_writer_buffer_used(&writer);
+		if (mpack_writer_destroy(&writer) != mpack_ok) {
+			break;
+		}
+		TransportWrite(transport, buffer, size);
+		bytes += size;
+	}
+	return WriterBenchResult {
+		.elapsed_ns = BenchNowNs() - start,
+		.bytes = bytes,
+		.writes = bench_case->message_count
+	};
+}
+
+static void WriterBenchPrint(const char *name, const char *mode, const WriterBenchCase *bench_case, WriterBenchResult result) {
+	double elapsed_s = result.elapsed_ns / 1e9;
+	printf("%-6s %-8s %14.0f %10.1f %10llu %12.1f\n", name, mode,
+		bench_case->message_count / elapsed_s,
+		result.bytes / 1e6 / elapsed_s,
+		static_cast<unsigned long long>(result.writes),
+		static_cast<double>(bench_case->message_count) / result.writes);
+}
+
+// Outbound messages through the batching writer against a write per message,
+// into a pipe that a child process drains
+void RpcWriterBench() {
+	printf("%-6s %-8s %14s %10s %10s %12s\n", "case", "mode", "messages/s", "MB/s", "writes", "msgs/write");
+	for (const WriterBenchCase &bench_case : WRITER_BENCH_CASES) {
+		char *payload = static_cast<char *>(malloc(bench_case.payload_size));
+		memset(payload, 'x', bench_case.payload_size);
+
+		Transport transport {};
+		if (!WriterBenchSpawn(&transport)) {
+			printf("can't spawn sh\n");
+			free(payload);
+			return;
+		}
+		WriterBenchPrint(bench_case.name, "batched", &bench_case, WriterBenchBatched(&transport, &bench_case, payload));
+		WriterBenchPrint(bench_case.name, "direct", &bench_case, WriterBenchDirect(&transport, &bench_case, payload));
+		TransportClose(&transport);
+		free(payload);
+	}
+}
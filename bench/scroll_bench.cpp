@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "bench.h"
+#include "renderer/grid_model.h"
+
+constexpr int SCROLL_BENCH_ROW_COUNTS[] { 100, 200, 300 };
+constexpr int SCROLL_BENCH_COLS = 200;
+constexpr int SCROLL_BENCH_SCROLLS = 20'000;
+constexpr int SCROLL_BENCH_RUNS = 5;
+
+struct ScrollBenchMessage {
+	char *data;
+	size_t size;
+	mpack_writer_t writer;
+};
+
+static mpack_writer_t *ScrollBenchBegin(ScrollBenchMessage *message, uint32_t event_count) {
+	mpack_writer_init_growable(&message->writer, &message->data, &message->size);
+	MPackStartNotification("redraw", &message->writer);
+	mpack_start_array(&message->writer, event_count);
+	return &message->writer;
+}
+
+// Left empty if encoding failed, which the model reads as nothing
+static void ScrollBenchFinish(ScrollBenchMessage *message) {
+	mpack_finish_array(&message->writer);
+	if (MPackFinishMessage(&message->writer) != mpack_ok) {
+		message->data = nullptr;
+		message->size = 0;
+	}
+}
+
+static void ScrollBenchWriteEvent(mpack_writer_t *writer, const char *name, uint32_t arg_length) {
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, name);
+	mpack_start_array(writer, arg_length);
+}
+
+static void ScrollBenchFinishEvent(mpack_writer_t *writer) {
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+}
+
+static ScrollBenchMessage ScrollBenchResize(int rows) {
+	ScrollBenchMessage message;
+	mpack_writer_t *writer = ScrollBenchBegin(&message, 1);
+	ScrollBenchWriteEvent(writer, "grid_resize", 3);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, SCROLL_BENCH_COLS);
+	mpack_write_int(writer, rows);
+	ScrollBenchFinishEvent(writer);
+	ScrollBenchFinish(&message);
+	return message;
+}
+
+// A one line scroll of the region [0, rows) x [0, right), the line
+// scrolled in and a flush, what nvim sends for <C-e>
+static ScrollBenchMessage ScrollBenchStep(int rows, int right) {
+	ScrollBenchMessage message;
+	mpack_writer_t *writer = ScrollBenchBegin(&message, 3);
+
+	ScrollBenchWriteEvent(writer, "grid_scroll", 7);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, 0);
+	mpack_write_int(writer, rows);
+	mpack_write_int(writer, 0);
+	mpack_write_int(writer, right);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, 0);
+	ScrollBenchFinishEvent(writer);
+
+	ScrollBenchWriteEvent(writer, "grid_line", 1);
+	mpack_start_array(writer, 4);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, rows - 1);
+	mpack_write_int(writer, 0);
+	mpack_start_array(writer, 2);
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "x");
+	mpack_write_int(writer, 0);
+	mpack_finish_array(writer);
+	mpack_start_array(writer, 3);
+	mpack_write_cstr(writer, " ");
+	mpack_write_int(writer, 0);
+	mpack_write_int(writer, right - 1);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+	ScrollBenchFinishEvent(writer);
+
+	ScrollBenchWriteEvent(writer, "flush", 0);
+	ScrollBenchFinishEvent(writer);
+
+	ScrollBenchFinish(&message);
+	return message;
+}
+
+static void ScrollBenchApply(GridModel *model, const ScrollBenchMessage *message) {
+	mpack_reader_t reader;
+	mpack_reader_init_data(&reader, message->data, message->size);
+	MPackExtractMessageResult(&reader);
+	GridModelRedraw(model, &reader);
+	mpack_reader_destroy(&reader);
+}
+
+// Nanoseconds per scroll step, region right edge at right
+static double ScrollBenchTime(int rows, int right) {
+	GridModel model {};
+	GridModelHooks hooks {};
+	GridModelInitialize(&model, &hooks);
+	ScrollBenchMessage resize = ScrollBenchResize(rows);
+	ScrollBenchApply(&model, &resize);
+	ScrollBenchMessage step = ScrollBenchStep(rows, right);
+
+	uint64_t start = BenchNowNs();
+	for (int i = 0; i < SCROLL_BENCH_SCROLLS; ++i) {
+		ScrollBenchApply(&model, &step);
+	}
+	uint64_t elapsed_ns = BenchNowNs() - start;
+	BenchKeep(model.grid_version);
+
+	free(resize.data);
+	free(step.data);
+	GridModelShutdown(&model);
+	return static_cast<double>(elapsed_ns) / SCROLL_BENCH_SCROLLS;
+}
+
+static double ScrollBenchBest(int rows, int right) {
+	double best_ns = ScrollBenchTime(rows, right);
+	for (int i = 1; i < SCROLL_BENCH_RUNS; ++i) {
+		best_ns = std::min(best_ns, ScrollBenchTime(rows, right));
+	}
+	return best_ns;
+}
+
+// One line scrolls through the grid model, full width regions rotating row
+// pointers against a region one column short, which still copies every
+// row the way all scrolls did before. Best of several runs.
+void ScrollBench() {
+	printf("%-6s %-12s %12s %12s\n", "rows", "region", "ns/scroll", "scrolls/s");
+	for (int rows : SCROLL_BENCH_ROW_COUNTS) {
+		double rotate_ns = ScrollBenchBest(rows, SCROLL_BENCH_COLS);
+		double copy_ns = ScrollBenchBest(rows, SCROLL_BENCH_COLS - 1);
+		printf("%-6d %-12s %12.0f %12.0f\n", rows, "full, rotate", rotate_ns, 1e9 / rotate_ns);
+		printf("%-6d %-12s %12.0f %12.0f\n", rows, "part, copy", copy_ns, 1e9 / copy_ns);
+	}
+}
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <clocale>
+#include <cstring>
+#include <cwchar>
+
+#include "bench.h"
+#include "common/utf8.h"
+#include "renderer/grid_model.h"
+
+constexpr int UTF8_BENCH_COLS = 400;
+constexpr int UTF8_BENCH_LINES = 2000;
+constexpr int UTF8_BENCH_PASSES = 20;
+
+// One [text, hl_id, repeat] entry of a grid_line, its text in the
+// input's byte buffer. 16 bytes, Vec needs a size that divides its pages.
+struct Utf8BenchCell {
+	uint32_t offset;
+	uint32_t length;
+	uint32_t hl_attrib_id;
+	uint32_t repeat;
+};
+
+struct Utf8BenchInput {
+	Vec<char> text;
+	Vec<Utf8BenchCell> cells;
+	Vec<uint32_t> line_ends; // One past each line's last cell
+	uint64_t cell_count; // Repeats included
+};
+
+enum class Utf8BenchText {
+	Ascii, // Words and runs of repeated spaces and dashes
+	Mixed, // Latin-1, Cyrillic and Greek, CJK with its empty right halves
+	Clusters // Emoji and combining marks, half of them interned
+};
+
+static uint32_t Utf8BenchRandom(uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+static void Utf8BenchAdd(Utf8BenchInput *input, const char *text, uint32_t repeat, int *col) {
+	uint32_t length = static_cast<uint32_t>(strlen(text));
+	uint32_t offset = static_cast<uint32_t>(input->text.size());
+	input->text.resize(offset + length);
+	memcpy(input->text.data() + offset, text, length);
+	input->cells.push_back(Utf8BenchCell {
+		.offset = offset,
+		.length = length,
+		.hl_attrib_id = static_cast<uint32_t>(input->cells.size() / 7 % 64),
+		.repeat = repeat
+	});
+	input->cell_count += repeat;
+	*col += static_cast<int>(repeat);
+}
+
+// A double width char is followed by the empty text of its right half
+static void Utf8BenchAddWide(Utf8BenchInput *input, const char *text, int *col) {
+	Utf8BenchAdd(input, text, 1, col);
+	Utf8BenchAdd(input, "", 1, col);
+}
+
+static void Utf8BenchGenerate(Utf8BenchText kind, Utf8BenchInput *input) {
+	static const char *const NARROW[] { "\xC3\xA9", "\xC3\xBC", "\xD0\xB4", "\xD0\xAF", "\xCE\xBB", "\xE2\x94\x80" };
+	static const char *const WIDE[] { "\xE4\xB8\xAD", "\xE6\x96\x87", "\xED\x95\x9C", "\xE3\x81\x82" };
+	static const char *const EMOJI[] { "\xF0\x9F\x98\x80", "\xF0\x9F\x9A\x80", "\xF0\x9F\x8E\x89" };
+	static const char *const CLUSTERS[] { "e\xCC\x81", "a\xCC\x88\xCC\xA3", "\xF0\x9F\x91\x8D\xF0\x9F\x8F\xBD" };
+
+	uint32_t state = 2024;
+	for (int line = 0; line < UTF8_BENCH_LINES; ++line) {
+		int col = 0;
+		while (col < UTF8_BENCH_COLS - 2) {
+			uint32_t choice = Utf8BenchRandom(&state) % 8;
+			int left = UTF8_BENCH_COLS - col;
+			if (choice == 0) {
+				uint32_t repeat = 1 + Utf8BenchRandom(&state) % 40;
+				Utf8BenchAdd(input, Utf8BenchRandom(&state) % 4 ? " " : "-", repeat < static_cast<uint32_t>(left) ? repeat : left, &col);
+				continue;
+			}
+			if (kind == Utf8BenchText::Ascii || choice < 4) {
+				char letter[2] { static_cast<char>('a' + Utf8BenchRandom(&state) % 26), '\0' };
+				Utf8BenchAdd(input, letter, 1, &col);
+			}
+			else if (kind == Utf8BenchText::Mixed) {
+				if (choice < 6) {
+					Utf8BenchAdd(input, NARROW[Utf8BenchRandom(&state) % 6], 1, &col);
+				}
+				else {
+					Utf8BenchAddWide(input, WIDE[Utf8BenchRandom(&state) % 4], &col);
+				}
+			}
+			else if (choice < 6) {
+				Utf8BenchAddWide(input, EMOJI[Utf8BenchRandom(&state) % 3], &col);
+			}
+			else {
+				Utf8BenchAdd(input, CLUSTERS[Utf8BenchRandom(&state) % 3], 1, &col);
+			}
+		}
+		input->line_ends.push_back(static_cast<uint32_t>(input->cells.size()));
+	}
+}
+
+// As grid_line does now, each cell decoded once and its repeats filled
+static void Utf8BenchDecodeCells(Utf8BenchInput *input, GraphemeTable *graphemes, GridCell *row) {
+	uint32_t first = 0;
+	for (size_t line = 0; line < input->line_ends.size(); ++line) {
+		size_t offset = 0;
+		for (uint32_t i = first; i < input->line_ends[line]; ++i) {
+			const Utf8BenchCell &cell = input->cells[i];
+			const char *text = input->text.data() + cell.offset;
+			uint32_t codepoint = Utf8DecodeCell(text, cell.length);
+			if (codepoint == UTF8_MULTIPLE_CODEPOINTS) {
+				codepoint = GraphemeIntern(graphemes, text, cell.length);
+			}
+			FillGridCells(&row[offset], GridCell { .text = codepoint, .hl_attrib_id = static_cast<uint16_t>(cell.hl_attrib_id), .flags = 0 }, cell.repeat);
+			offset += cell.repeat;
+		}
+		first = input->line_ends[line];
+		BenchKeep(row[line % UTF8_BENCH_COLS]);
+	}
+}
+
+// As grid_line did before, every repeat converted on its own the way
+// MultiByteToWideChar goes over the text, clusters shown as U+25A1
+static void Utf8BenchConvertScalar(Utf8BenchInput *input, GridCell *row) {
+	uint32_t first = 0;
+	for (size_t line = 0; line < input->line_ends.size(); ++line) {
+		size_t offset = 0;
+		for (uint32_t i = first; i < input->line_ends[line]; ++i) {
+			const Utf8BenchCell &cell = input->cells[i];
+			const uint8_t *text = reinterpret_cast<const uint8_t *>(input->text.data() + cell.offset);
+			for (uint32_t r = 0; r < cell.repeat; ++r) {
+				uint32_t codepoint = 0;
+				uint32_t codepoint_count = 0;
+				for (uint32_t consumed = 0; consumed < cell.length; codepoint_count++) {
+					consumed += Utf8DecodeCodepoint(text + consumed, cell.length - consumed, &codepoint);
+				}
+				row[offset++] = GridCell {
+					.text = codepoint_count > 1 ? UTF8_UNSUPPORTED_CELL : codepoint,
+					.hl_attrib_id = static_cast<uint16_t>(cell.hl_attrib_id),
+					.flags = 0
+				};
+			}
+		}
+		first = input->line_ends[line];
+		BenchKeep(row[line % UTF8_BENCH_COLS]);
+	}
+}
+
+// The same with the C library's converter standing in for the Win32 one
+static void Utf8BenchConvertLibrary(Utf8BenchInput *input, GridCell *row) {
+	uint32_t first = 0;
+	for (size_t line = 0; line < input->line_ends.size(); ++line) {
+		size_t offset = 0;
+		for (uint32_t i = first; i < input->line_ends[line]; ++i) {
+			const Utf8BenchCell &cell = input->cells[i];
+			const char *text = input->text.data() + cell.offset;
+			for (uint32_t r = 0; r < cell.repeat; ++r) {
+				mbstate_t state {};
+				wchar_t wide = 0;
+				uint32_t codepoint_count = 0;
+				for (size_t consumed = 0; consumed < cell.length; codepoint_count++) {
+					size_t result = mbrtowc(&wide, text + consumed, cell.length - consumed, &state);
+					if (result == static_cast<size_t>(-1) || result == static_cast<size_t>(-2)) {
+						wide = static_cast<wchar_t>(UTF8_REPLACEMENT_CHAR);
+						result = 1;
+						state = mbstate_t {};
+					}
+					consumed += result;
+				}
+				row[offset++] = GridCell {
+					.text = codepoint_count > 1 ? UTF8_UNSUPPORTED_CELL : static_cast<uint32_t>(wide),
+					.hl_attrib_id = static_cast<uint16_t>(cell.hl_attrib_id),
+					.flags = 0
+				};
+			}
+		}
+		first = input->line_ends[line];
+		BenchKeep(row[line % UTF8_BENCH_COLS]);
+	}
+}
+
+static void Utf8BenchReport(const char *text, const char *path, Utf8BenchInput *input, uint64_t best_ns) {
+	printf("%-10s %-14s %10.1f %8.2f\n", text, path,
+		static_cast<double>(input->text.size()) / (best_ns / 1e9) / 1e6,
+		static_cast<double>(best_ns) / input->cell_count);
+}
+
+// grid_line cell text to grid cells, decoded once per cell and filled for
+// its repeats against converting every repeated cell separately. MB/s is
+// of the cell text as nvim sends it, repeated cells counting once.
+void Utf8Bench() {
+	bool have_locale = setlocale(LC_CTYPE, "C.UTF-8") != nullptr;
+	if (!have_locale) {
+		fprintf(stderr, "No C.UTF-8 locale, skipping mbrtowc\n");
+	}
+
+	struct {
+		const char *name;
+		Utf8BenchText kind;
+	} const TEXTS[] {
+		{ "ascii", Utf8BenchText::Ascii },
+		{ "mixed", Utf8BenchText::Mixed },
+		{ "clusters", Utf8BenchText::Clusters }
+	};
+	printf("%-10s %-14s %10s %8s\n", "text", "path", "MB/s", "ns/cell");
+	static GridCell row[UTF8_BENCH_COLS];
+	for (const auto &text : TEXTS) {
+		Utf8BenchInput input {};
+		Utf8BenchGenerate(text.kind, &input);
+		GraphemeTable graphemes;
+		GraphemeTableInitialize(&graphemes);
+
+		uint64_t best[3] { ~0ull, ~0ull, ~0ull };
+		for (int pass = 0; pass < UTF8_BENCH_PASSES; ++pass) {
+			uint64_t start = BenchNowNs();
+			Utf8BenchDecodeCells(&input, &graphemes, row);
+			uint64_t decode_end = BenchNowNs();
+			Utf8BenchConvertScalar(&input, row);
+			uint64_t scalar_end = BenchNowNs();
+			if (have_locale) {
+				Utf8BenchConvertLibrary(&input, row);
+			}
+			uint64_t library_end = BenchNowNs();
+
+			best[0] = std::min(best[0], decode_end - start);
+			best[1] = std::min(best[1], scalar_end - decode_end);
+			best[2] = std::min(best[2], library_end - scalar_end);
+		}
+		Utf8BenchReport(text.name, "decode + fill", &input, best[0]);
+		Utf8BenchReport(text.name, "per cell", &input, best[1]);
+		if (have_locale) {
+			Utf8BenchReport(text.name, "mbrtowc", &input, best[2]);
+		}
+		GraphemeTableShutdown(&graphemes);
+	}
+	setlocale(LC_CTYPE, "C");
+}
@@ -0,0 +1,64 @@
+#include "bench.h"
+#include "nvim/synthetic_workload.h"
+#include "nvim/trace.h"
+#include "renderer/grid_model.h"
+
+constexpr const char *BENCH_WORKLOADS[] { "repaint", "scroll", "highlight", "wide" };
+constexpr int WORKLOAD_BENCH_RUNS = 5;
+
+struct WorkloadResult {
+	uint64_t elapsed_ns;
+	uint64_t event_count;
+	uint64_t cell_count;
+	uint64_t flush_count;
+};
+
+// One pass over the trace into a fresh model, decoding included
+static WorkloadResult WorkloadRun(Vec<char> *trace) {
+	GridModel model {};
+	GridModelHooks hooks {};
+	GridModelInitialize(&model, &hooks);
+
+	TraceReader trace_reader;
+	TraceReaderOpenMemory(&trace_reader, trace->data(), trace->size());
+	uint64_t start = BenchNowNs();
+	TraceMessage message;
+	while (TraceReaderNext(&trace_reader, &message)) {
+		mpack_reader_t reader;
+		mpack_reader_init_data(&reader, message.data, message.size);
+		MPackExtractMessageResult(&reader);
+		GridModelRedraw(&model, &reader);
+		mpack_reader_destroy(&reader);
+	}
+	WorkloadResult result {
+		.elapsed_ns = BenchNowNs() - start,
+		.event_count = model.redraw_event_count,
+		.cell_count = model.grid_cell_count,
+		.flush_count = model.flush_count
+	};
+	TraceReaderClose(&trace_reader);
+	GridModelShutdown(&model);
+	return result;
+}
+
+// The synthetic workloads against the grid model alone, best of several runs
+void WorkloadBench() {
+	printf("%-10s %14s %14s %12s\n", "workload", "events/s", "cells/s", "ns/flush");
+	for (const char *name : BENCH_WORKLOADS) {
+		Vec<char> trace;
+		SyntheticWorkloadGenerate(SyntheticWorkloadLookup(name), &trace);
+
+		WorkloadResult best { .elapsed_ns = UINT64_MAX, .event_count = 0, .cell_count = 0, .flush_count = 0 };
+		for (int i = 0; i < WORKLOAD_BENCH_RUNS; ++i) {
+			WorkloadResult result = WorkloadRun(&trace);
+			if (result.elapsed_ns < best.elapsed_ns) {
+				best = result;
+			}
+		}
+		double elapsed_s = best.elapsed_ns / 1e9;
+		printf("%-10s %14.0f %14.0f %12.0f\n", name,
+			best.event_count / elapsed_s,
+			best.cell_count / elapsed_s,
+			best.flush_count ? static_cast<double>(best.elapsed_ns) / best.flush_count : 0.0);
+	}
+}
@@ -1,15 +1,155 @@
 #pragma once
 #include <cassert>
+#include <cstring>
+#include "common/string_dispatch.h"
 #include "third_party/mpack/mpack.h"
 
-inline int MPackIntFromArray(mpack_node_t arr, int index) {
-	return static_cast<int>(mpack_node_array_at(arr, index).data->value.i);
+struct MPackString {
+	const char *data;
+	size_t length;
+};
+
+inline bool MPackMatchString(MPackString str, const char *str_to_match) {
+	size_t match_length = strlen(str_to_match);
+	return str.length == match_length && memcmp(str.data, str_to_match, match_length) == 0;
+}
+
+// Pull-style helpers on top of mpack_reader_t. The reader is always initialized
+// on a complete message in memory, so strings are returned in place without copying.
+inline uint32_t MPackReadArray(mpack_reader_t *reader) {
+	return mpack_expect_array(reader);
+}
+
+inline uint32_t MPackReadMap(mpack_reader_t *reader) {
+	return mpack_expect_map(reader);
+}
+
+inline int64_t MPackReadInt(mpack_reader_t *reader) {
+	return mpack_expect_i64(reader);
+}
+
+inline bool MPackReadBool(mpack_reader_t *reader) {
+	return mpack_expect_bool(reader);
+}
+
+// Colors are sent as unsigned 24-bit values, or -1 when unset
+inline uint32_t MPackReadColor(mpack_reader_t *reader) {
+	return static_cast<uint32_t>(mpack_expect_i64(reader));
+}
+
+inline MPackString MPackReadString(mpack_reader_t *reader) {
+	uint32_t length = mpack_expect_str(reader);
+	const char *data = mpack_read_bytes_inplace(reader, length);
+	mpack_done_str(reader);
+	if (mpack_reader_error(reader) != mpack_ok) {
+		return MPackString { .data = "", .length = 0 };
+	}
+	return MPackString { .data = data, .length = length };
+}
+
+inline void MPackSkip(mpack_reader_t *reader, size_t count = 1) {
+	for (size_t i = 0; i < count; ++i) {
+		mpack_discard(reader);
+	}
+}
+
+// Finishes an array of which `read` elements have been consumed, skipping the rest
+inline void MPackFinishArray(mpack_reader_t *reader, uint32_t length, uint32_t read) {
+	if (read < length) {
+		MPackSkip(reader, length - read);
+	}
+	mpack_done_array(reader);
+}
+
+// Incrementally finds the boundary of one msgpack object in a byte stream without
+// decoding it. Scanning can be resumed as more data arrives, so a message of any
+// size is framed in a single pass over its bytes.
+struct MPackFramer {
+	size_t offset;
+	uint64_t pending_objects;
+};
+
+inline void MPackFramerReset(MPackFramer *framer) {
+	framer->offset = 0;
+	framer->pending_objects = 1;
 }
 
-inline bool MPackMatchString(mpack_node_t node, const char *str_to_match) {
-	assert(node.data->type == mpack_type_str);
-	const char *str = mpack_node_str(node);
-	return strncmp(str, str_to_match, mpack_node_strlen(node)) == 0;
+// Returns the length of the message starting at data[0] once it is complete,
+// otherwise 0. Returns SIZE_MAX if the stream is not valid msgpack.
+inline size_t MPackFramerScan(MPackFramer *framer, const char *data, size_t size) {
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+	const auto ReadBE = [&](size_t at, int count) {
+		uint32_t value = 0;
+		for (int i = 0; i < count; ++i) {
+			value = (value << 8) | bytes[at + i];
+		}
+		return value;
+	};
+
+	while (framer->pending_objects > 0) {
+		size_t at = framer->offset;
+		if (at >= size) return 0;
+
+		uint8_t type = bytes[at];
+		size_t header = 1;
+		size_t length_bytes = 0;
+		uint64_t payload = 0;
+		uint64_t children = 0;
+		int children_per_entry = 1;
+
+		if (type <= 0x7f || type >= 0xe0 || type == 0xc0 || type == 0xc2 || type == 0xc3) {}
+		else if (type <= 0x8f) { children = type & 0x0f; children_per_entry = 2; }
+		else if (type <= 0x9f) { children = type & 0x0f; }
+		else if (type <= 0xbf) { payload = type & 0x1f; }
+		else {
+			switch (type) {
+			case 0xc4: case 0xd9: length_bytes = 1; break;
+			case 0xc5: case 0xda: length_bytes = 2; break;
+			case 0xc6: case 0xdb: length_bytes = 4; break;
+			case 0xc7: length_bytes = 1; payload = 1; break;
+			case 0xc8: length_bytes = 2; payload = 1; break;
+			case 0xc9: length_bytes = 4; payload = 1; break;
+			case 0xca: payload = 4; break;
+			case 0xcb: payload = 8; break;
+			case 0xcc: case 0xd0: payload = 1; break;
+			case 0xcd: case 0xd1: payload = 2; break;
+			case 0xce: case 0xd2: payload = 4; break;
+			case 0xcf: case 0xd3: payload = 8; break;
+			case 0xd4: payload = 2; break;
+			case 0xd5: payload = 3; break;
+			case 0xd6: payload = 5; break;
+			case 0xd7: payload = 9; break;
+			case 0xd8: payload = 17; break;
+			case 0xdc: length_bytes = 2; children = 1; break;
+			case 0xdd: length_bytes = 4; children = 1; break;
+			case 0xde: length_bytes = 2; children = 1; children_per_entry = 2; break;
+			case 0xdf: length_bytes = 4; children = 1; children_per_entry = 2; break;
+			default: return SIZE_MAX;
+			}
+		}
+
+		if (length_bytes) {
+			if (at + 1 + length_bytes > size) return 0;
+			uint32_t length = ReadBE(at + 1, static_cast<int>(length_bytes));
+			header += length_bytes;
+			// For arrays and maps the length is an element count, otherwise a byte count
+			if (children) {
+				children = length;
+			}
+			else {
+				payload += length;
+			}
+		}
+
+		uint64_t object_size = header + payload;
+		if (at + object_size > size) return 0;
+
+		framer->offset = at + object_size;
+		framer->pending_objects += children * children_per_entry;
+		framer->pending_objects -= 1;
+	}
+
+	return framer->offset;
 }
 
 enum class MPackMessageType {
@@ -18,19 +158,19 @@ enum class MPackMessageType {
 	Notification = 2
 };
 struct MPackRequest {
-	mpack_node_t method;
+	MPackString method;
 	int64_t msg_id;
 };
 struct MPackResponse {
-	mpack_node_t error;
+	bool has_error;
+	MPackString error_message;
 	int64_t msg_id;
 };
 struct MPackNotification {
-	mpack_node_t name;
+	MPackString name;
 };
 struct MPackMessageResult {
 	MPackMessageType type;
-	mpack_node_t params;
 	union {
 		MPackRequest request;
 		MPackResponse response;
@@ -51,58 +191,114 @@ inline void MPackStartNotification(const char *notification, mpack_writer_t *wri
 	mpack_write_cstr(writer, notification);
 }
 
-[[nodiscard]] inline size_t MPackFinishMessage(mpack_writer_t *writer) {
+// The bytes of a notification up to its params, [2, "name", [ with param_count
+// params to follow. Built at compile time so hot paths only append the params.
+constexpr size_t MPACK_MAX_PREFIX_SIZE = 48;
+struct MPackPrefix {
+	char data[MPACK_MAX_PREFIX_SIZE];
+	size_t size;
+};
+
+constexpr MPackPrefix MPackEncodeNotificationPrefix(const char *notification, uint32_t param_count) {
+	MPackPrefix prefix {};
+	size_t length = ConstexprStrlen(notification);
+	// Only fixarray and fixstr headers, enough for nvim api names
+	if (length > 31 || param_count > 15 || 4 + length > MPACK_MAX_PREFIX_SIZE) {
+		return prefix;
+	}
+
+	prefix.data[prefix.size++] = static_cast<char>(0x93);
+	prefix.data[prefix.size++] = static_cast<char>(MPackMessageType::Notification);
+	prefix.data[prefix.size++] = static_cast<char>(0xa0 | length);
+	for (size_t i = 0; i < length; ++i) {
+		prefix.data[prefix.size++] = notification[i];
+	}
+	prefix.data[prefix.size++] = static_cast<char>(0x90 | param_count);
+	return prefix;
+}
+
+// Always the 5 byte str32 form so the length can be patched in after the fact
+constexpr size_t MPACK_STR32_HEADER_SIZE = 5;
+inline void MPackEncodeStr32Header(char *out, uint32_t length) {
+	out[0] = static_cast<char>(0xdb);
+	out[1] = static_cast<char>(length >> 24);
+	out[2] = static_cast<char>(length >> 16);
+	out[3] = static_cast<char>(length >> 8);
+	out[4] = static_cast<char>(length);
+}
+
+// Closes the top level array and releases the writer, flushing whatever is left
+[[nodiscard]] inline mpack_error_t MPackFinishMessage(mpack_writer_t *writer) {
 	mpack_finish_array(writer);
-	size_t size = mpack_writer_buffer_used(writer);
-	mpack_error_t err = mpack_writer_destroy(writer);
-	assert(err == mpack_ok);
-	return size;
+	return mpack_writer_destroy(writer);
 }
 
-inline bool MPackSendData(HANDLE handle, void *buffer, size_t size) {
-	DWORD bytes_written;
-	return WriteFile(handle, buffer, static_cast<DWORD>(size), &bytes_written, nullptr) != 0;
+// nvim sends errors as [type, message]
+inline MPackString MPackReadError(mpack_reader_t *reader) {
+	MPackString message { .data = "", .length = 0 };
+	if (mpack_peek_tag(reader).type != mpack_type_array) {
+		MPackSkip(reader);
+		return message;
+	}
+
+	uint32_t length = MPackReadArray(reader);
+	uint32_t read = 0;
+	if (length >= 2) {
+		MPackSkip(reader);
+		if (mpack_peek_tag(reader).type == mpack_type_str) {
+			message = MPackReadString(reader);
+		}
+		else {
+			MPackSkip(reader);
+		}
+		read = 2;
+	}
+	MPackFinishArray(reader, length, read);
+	return message;
 }
 
-inline MPackMessageResult MPackExtractMessageResult(mpack_tree_t *tree) {
-	mpack_node_t root = mpack_tree_root(tree);
-	assert(mpack_node_array_at(root, 0).data->type == mpack_type_uint);
+// Reads the message envelope, leaving the reader positioned at the
+// params (requests and notifications) or the result (responses)
+inline MPackMessageResult MPackExtractMessageResult(mpack_reader_t *reader) {
+	uint32_t length = MPackReadArray(reader);
+	assert(length == 3 || length == 4);
 
-	MPackMessageType message_type = static_cast<MPackMessageType>(mpack_node_array_at(root, 0).data->value.i);
+	MPackMessageType message_type = static_cast<MPackMessageType>(MPackReadInt(reader));
 	if (message_type == MPackMessageType::Request) {
-		assert(mpack_node_array_at(root, 1).data->type == mpack_type_uint);
-		assert(mpack_node_array_at(root, 2).data->type == mpack_type_str);
-		
+		int64_t msg_id = MPackReadInt(reader);
 		return MPackMessageResult {
 			.type = message_type,
-			.params = mpack_node_array_at(root, 3),
 			.request = {
-				.method = mpack_node_array_at(root, 2),
-				.msg_id = mpack_node_array_at(root, 1).data->value.i
+				.method = MPackReadString(reader),
+				.msg_id = msg_id
 			}
 		};
 	}
 	else if (message_type == MPackMessageType::Response) {
-		assert(mpack_node_array_at(root, 1).data->type == mpack_type_uint);
+		int64_t msg_id = MPackReadInt(reader);
+		bool has_error = mpack_peek_tag(reader).type != mpack_type_nil;
+		MPackString error_message { .data = "", .length = 0 };
+		if (has_error) {
+			error_message = MPackReadError(reader);
+		}
+		else {
+			MPackSkip(reader);
+		}
 
 		return MPackMessageResult {
 			.type = message_type,
-			.params = mpack_node_array_at(root, 3),
 			.response {
-				.error = mpack_node_array_at(root, 2),
-				.msg_id = mpack_node_array_at(root, 1).data->value.i
+				.has_error = has_error,
+				.error_message = error_message,
+				.msg_id = msg_id
 			}
 		};
 	}
 	else if (message_type == MPackMessageType::Notification) {
-		assert(mpack_node_array_at(root, 1).data->type == mpack_type_str);
-		assert(mpack_node_array_at(root, 2).data->type == mpack_type_array);
-
 		return MPackMessageResult {
 			.type = message_type,
-			.params = mpack_node_array_at(root, 2),
 			.notification = {
-				.name = mpack_node_array_at(root, 1)
+				.name = MPackReadString(reader)
 			}
 		};
 	}
@@ -0,0 +1,148 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// Slot buffers that grew past this for a single large message are
+// shrunk again once they get reused for a small one
+constexpr size_t SPSC_SLOT_SHRINK_THRESHOLD = 1024 * 1024;
+constexpr size_t SPSC_SLOT_MIN_CAPACITY = 4096;
+
+struct SpscSlot {
+	char *data;
+	size_t size;
+	size_t capacity;
+};
+
+struct SpscQueueStats {
+	uint64_t pushed;
+	uint64_t popped;
+	// Times the producer found the queue full and had to wait for the consumer
+	uint64_t producer_stalls;
+	uint64_t max_depth;
+};
+
+// A bounded single-producer/single-consumer ring of byte messages. Each slot
+// owns a buffer that is reused across messages, so in steady state pushing
+// and popping does not allocate. The producer blocks while the ring is full.
+template<size_t N>
+struct SpscQueue {
+	static_assert((N & (N - 1)) == 0, "Queue capacity must be a power of two");
+
+	SpscSlot slots[N];
+	alignas(64) std::atomic<uint64_t> head; // Next slot the producer writes
+	alignas(64) std::atomic<uint64_t> tail; // Next slot the consumer reads
+	// Bumped on every pop and on close, the producer waits on it while full
+	alignas(64) std::atomic<uint32_t> consumer_signal;
+	std::atomic<bool> closed;
+
+	std::atomic<uint64_t> pushed;
+	std::atomic<uint64_t> popped;
+	std::atomic<uint64_t> producer_stalls;
+	std::atomic<uint64_t> max_depth;
+};
+
+template<size_t N>
+inline size_t SpscQueueSize(SpscQueue<N> *queue) {
+	return static_cast<size_t>(queue->head.load() - queue->tail.load());
+}
+
+template<size_t N>
+inline bool SpscQueueEmpty(SpscQueue<N> *queue) {
+	return SpscQueueSize(queue) == 0;
+}
+
+// Producer side. Copies the message into the next free slot, waiting while
+// the queue is full. Returns false if the queue was closed in the meantime.
+template<size_t N>
+inline bool SpscQueuePush(SpscQueue<N> *queue, const char *data, size_t size) {
+	uint64_t head = queue->head.load(std::memory_order_relaxed);
+	uint64_t tail = queue->tail.load();
+	if (head - tail == N) {
+		queue->producer_stalls.fetch_add(1, std::memory_order_relaxed);
+		while (true) {
+			uint32_t signal = queue->consumer_signal.load();
+			if (queue->closed.load()) {
+				return false;
+			}
+			tail = queue->tail.load();
+			if (head - tail < N) {
+				break;
+			}
+			queue->consumer_signal.wait(signal);
+		}
+	}
+	if (queue->closed.load(std::memory_order_relaxed)) {
+		return false;
+	}
+
+	SpscSlot *slot = &queue->slots[head & (N - 1)];
+	bool needs_grow = slot->capacity < size;
+	bool should_shrink = slot->capacity > SPSC_SLOT_SHRINK_THRESHOLD && size < slot->capacity / 4;
+	if (needs_grow || should_shrink) {
+		size_t new_capacity = SPSC_SLOT_MIN_CAPACITY;
+		while (new_capacity < size) {
+			new_capacity *= 2;
+		}
+		free(slot->data);
+		slot->data = static_cast<char *>(malloc(new_capacity));
+		slot->capacity = new_capacity;
+	}
+	memcpy(slot->data, data, size);
+	slot->size = size;
+
+	queue->head.store(head + 1);
+	queue->pushed.fetch_add(1, std::memory_order_relaxed);
+	if (head + 1 - tail > queue->max_depth.load(std::memory_order_relaxed)) {
+		queue->max_depth.store(head + 1 - tail, std::memory_order_relaxed);
+	}
+	return true;
+}
+
+// Consumer side. Returns the oldest message, or nullptr if the queue is empty.
+// The slot stays valid until SpscQueuePop is called.
+template<size_t N>
+inline SpscSlot *SpscQueueFront(SpscQueue<N> *queue) {
+	uint64_t tail = queue->tail.load(std::memory_order_relaxed);
+	if (queue->head.load() == tail) {
+		return nullptr;
+	}
+	return &queue->slots[tail & (N - 1)];
+}
+
+template<size_t N>
+inline void SpscQueuePop(SpscQueue<N> *queue) {
+	queue->tail.fetch_add(1);
+	queue->popped.fetch_add(1, std::memory_order_relaxed);
+	queue->consumer_signal.fetch_add(1);
+	queue->consumer_signal.notify_one();
+}
+
+// Wakes up a producer blocked on a full queue, further pushes fail
+template<size_t N>
+inline void SpscQueueClose(SpscQueue<N> *queue) {
+	queue->closed.store(true);
+	queue->consumer_signal.fetch_add(1);
+	queue->consumer_signal.notify_all();
+}
+
+// Approximate while both sides are running
+template<size_t N>
+inline SpscQueueStats SpscQueueGetStats(SpscQueue<N> *queue) {
+	return SpscQueueStats {
+		.pushed = queue->pushed.load(std::memory_order_relaxed),
+		.popped = queue->popped.load(std::memory_order_relaxed),
+		.producer_stalls = queue->producer_stalls.load(std::memory_order_relaxed),
+		.max_depth = queue->max_depth.load(std::memory_order_relaxed)
+	};
+}
+
+// Only safe once neither side touches the queue anymore
+template<size_t N>
+inline void SpscQueueDestroy(SpscQueue<N> *queue) {
+	for (size_t i = 0; i < N; ++i) {
+		free(queue->slots[i].data);
+		queue->slots[i] = SpscSlot {};
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// FNV-1a, seeded through the offset basis so that a perfect hash
+// can be searched for at compile time
+constexpr uint32_t HashString(const char *str, size_t length, uint32_t seed) {
+	uint32_t hash = 2166136261u ^ seed;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= static_cast<uint8_t>(str[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+constexpr size_t ConstexprStrlen(const char *str) {
+	size_t length = 0;
+	while (str[length]) {
+		++length;
+	}
+	return length;
+}
+
+template<typename T>
+struct StringDispatchEntry {
+	const char *name;
+	T value;
+};
+
+// Maps a fixed set of strings to values in O(1). The seed is searched at
+// compile time so that every name hashes to its own slot, a lookup is then
+// a single hash, one slot load and one memcmp to reject unknown strings.
+template<typename T, size_t N>
+struct StringDispatchTable {
+	static_assert(N > 0 && N < 0xFF);
+	static constexpr size_t SlotCount() {
+		size_t slot_count = 1;
+		while (slot_count < N * 4) {
+			slot_count <<= 1;
+		}
+		return slot_count;
+	}
+	static constexpr size_t SLOT_COUNT = SlotCount();
+	static constexpr uint32_t MAX_SEED_ATTEMPTS = 100'000;
+
+	StringDispatchEntry<T> entries[N] {};
+	uint32_t lengths[N] {};
+	// Index + 1 into entries, 0 marks an empty slot
+	uint8_t slots[SLOT_COUNT] {};
+	uint32_t seed = 0;
+	bool valid = false;
+	T fallback {};
+
+	constexpr StringDispatchTable(const StringDispatchEntry<T> (&entries_in)[N], T fallback_value) {
+		fallback = fallback_value;
+		for (size_t i = 0; i < N; ++i) {
+			entries[i] = entries_in[i];
+			lengths[i] = static_cast<uint32_t>(ConstexprStrlen(entries_in[i].name));
+		}
+
+		for (uint32_t candidate = 0; candidate < MAX_SEED_ATTEMPTS && !valid; ++candidate) {
+			for (size_t i = 0; i < SLOT_COUNT; ++i) {
+				slots[i] = 0;
+			}
+
+			valid = true;
+			for (size_t i = 0; i < N; ++i) {
+				size_t slot = HashString(entries[i].name, lengths[i], candidate) & (SLOT_COUNT - 1);
+				if (slots[slot] != 0) {
+					valid = false;
+					break;
+				}
+				slots[slot] = static_cast<uint8_t>(i + 1);
+			}
+			seed = candidate;
+		}
+	}
+
+	inline T Lookup(const char *str, size_t length) const {
+		uint8_t index = slots[HashString(str, length, seed) & (SLOT_COUNT - 1)];
+		if (index == 0) {
+			return fallback;
+		}
+
+		const StringDispatchEntry<T> &entry = entries[index - 1];
+		if (lengths[index - 1] != length || memcmp(entry.name, str, length) != 0) {
+			return fallback;
+		}
+		return entry.value;
+	}
+};
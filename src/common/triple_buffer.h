@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+constexpr uint32_t TRIPLE_BUFFER_INDEX_MASK = 0x3;
+// Set on the shared slot index while it holds a value the consumer hasn't taken
+constexpr uint32_t TRIPLE_BUFFER_FRESH = 0x4;
+
+struct TripleBufferStats {
+	uint64_t published;
+	uint64_t consumed;
+	// Values published over before the consumer got to them
+	uint64_t dropped;
+};
+
+// Hands the latest of a stream of values from one producer thread to one
+// consumer thread. The producer fills its own slot and publishes it by
+// swapping it with the shared one, the consumer swaps the shared slot with
+// the one it is done with. Neither side ever waits on the other, and a
+// value published over before the consumer took it is simply dropped.
+// Slots are reused, so the producer gets back whatever a slot last held.
+template<typename T>
+struct TripleBuffer {
+	T slots[3];
+	uint32_t write_index; // Producer only
+	uint32_t read_index; // Consumer only
+	alignas(64) std::atomic<uint32_t> shared_index;
+	// Bumped on every publish and on close, the consumer waits on it
+	alignas(64) std::atomic<uint32_t> publish_signal;
+	std::atomic<bool> closed;
+
+	std::atomic<uint64_t> published;
+	std::atomic<uint64_t> consumed;
+	std::atomic<uint64_t> dropped;
+};
+
+template<typename T>
+inline void TripleBufferInitialize(TripleBuffer<T> *buffer) {
+	buffer->write_index = 0;
+	buffer->shared_index.store(1);
+	buffer->read_index = 2;
+	buffer->closed.store(false);
+}
+
+// Producer side. The slot to fill in before publishing.
+template<typename T>
+inline T *TripleBufferWriteSlot(TripleBuffer<T> *buffer) {
+	return &buffer->slots[buffer->write_index];
+}
+
+// Producer side. Makes the write slot the latest value. Returns true if that
+// dropped a value the consumer never took.
+template<typename T>
+inline bool TripleBufferPublish(TripleBuffer<T> *buffer) {
+	uint32_t previous = buffer->shared_index.exchange(buffer->write_index | TRIPLE_BUFFER_FRESH);
+	buffer->write_index = previous & TRIPLE_BUFFER_INDEX_MASK;
+
+	bool dropped = (previous & TRIPLE_BUFFER_FRESH) != 0;
+	buffer->published.fetch_add(1, std::memory_order_relaxed);
+	if (dropped) {
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+	buffer->publish_signal.fetch_add(1);
+	buffer->publish_signal.notify_one();
+	return dropped;
+}
+
+// Consumer side. Returns the latest value if one was published since the
+// last call, nullptr otherwise. It stays valid until the next call.
+template<typename T>
+inline T *TripleBufferAcquire(TripleBuffer<T> *buffer) {
+	if (!(buffer->shared_index.load() & TRIPLE_BUFFER_FRESH)) {
+		return nullptr;
+	}
+	uint32_t previous = buffer->shared_index.exchange(buffer->read_index);
+	buffer->read_index = previous & TRIPLE_BUFFER_INDEX_MASK;
+	buffer->consumed.fetch_add(1, std::memory_order_relaxed);
+	return &buffer->slots[buffer->read_index];
+}
+
+// Consumer side. Waits until there is a value to take, false once closed.
+template<typename T>
+inline bool TripleBufferWait(TripleBuffer<T> *buffer) {
+	while (true) {
+		uint32_t signal = buffer->publish_signal.load();
+		if (buffer->closed.load()) {
+			return false;
+		}
+		if (buffer->shared_index.load() & TRIPLE_BUFFER_FRESH) {
+			return true;
+		}
+		buffer->publish_signal.wait(signal);
+	}
+}
+
+// Wakes up a waiting consumer for good
+template<typename T>
+inline void TripleBufferClose(TripleBuffer<T> *buffer) {
+	buffer->closed.store(true);
+	buffer->publish_signal.fetch_add(1);
+	buffer->publish_signal.notify_all();
+}
+
+// Approximate while both sides are running
+template<typename T>
+inline TripleBufferStats TripleBufferGetStats(TripleBuffer<T> *buffer) {
+	return TripleBufferStats {
+		.published = buffer->published.load(std::memory_order_relaxed),
+		.consumed = buffer->consumed.load(std::memory_order_relaxed),
+		.dropped = buffer->dropped.load(std::memory_order_relaxed)
+	};
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint32_t UTF8_REPLACEMENT_CHAR = 0xFFFD;
+// Shown for cells whose text can't be stored
+constexpr uint32_t UTF8_UNSUPPORTED_CELL = 0x25A1;
+// Returned for cell text made up of more than one codepoint, never a valid codepoint
+constexpr uint32_t UTF8_MULTIPLE_CODEPOINTS = 0xFFFFFFFF;
+
+// Returns the sequence length for a lead byte, 0 if it can't start one
+inline uint32_t Utf8SequenceLength(uint8_t lead) {
+	if (lead < 0x80) return 1;
+	if (lead < 0xC2) return 0;
+	if (lead < 0xE0) return 2;
+	if (lead < 0xF0) return 3;
+	if (lead < 0xF5) return 4;
+	return 0;
+}
+
+// Decodes the sequence at text, returns the number of bytes consumed.
+// Malformed input consumes one byte and yields U+FFFD.
+inline uint32_t Utf8DecodeCodepoint(const uint8_t *text, size_t length, uint32_t *codepoint_out) {
+	uint8_t lead = text[0];
+	uint32_t sequence_length = Utf8SequenceLength(lead);
+	if (sequence_length == 1) {
+		*codepoint_out = lead;
+		return 1;
+	}
+
+	*codepoint_out = UTF8_REPLACEMENT_CHAR;
+	if (sequence_length == 0 || sequence_length > length) {
+		return 1;
+	}
+
+	uint32_t codepoint = lead & (0x7F >> sequence_length);
+	for (uint32_t i = 1; i < sequence_length; ++i) {
+		if ((text[i] & 0xC0) != 0x80) {
+			return 1;
+		}
+		codepoint = (codepoint << 6) | (text[i] & 0x3F);
+	}
+
+	// Reject overlong encodings, surrogates and anything past U+10FFFF
+	constexpr uint32_t MIN_CODEPOINT[] { 0, 0, 0x80, 0x800, 0x10000 };
+	if (codepoint < MIN_CODEPOINT[sequence_length] || codepoint > 0x10FFFF ||
+		(codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+		return 1;
+	}
+
+	*codepoint_out = codepoint;
+	return sequence_length;
+}
+
+// The codepoint of a grid cell's text, or UTF8_MULTIPLE_CODEPOINTS for a
+// grapheme cluster. Nearly every cell is a single ASCII byte, which skips
+// decoding entirely. Empty text is the right half of a double width char
+// and decodes to 0.
+inline uint32_t Utf8DecodeCell(const char *text, size_t length) {
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(text);
+	if (length == 1 && bytes[0] < 0x80) {
+		return bytes[0];
+	}
+	if (length == 0) {
+		return 0;
+	}
+
+	uint32_t codepoint;
+	uint32_t consumed = Utf8DecodeCodepoint(bytes, length, &codepoint);
+	return consumed == length ? codepoint : UTF8_MULTIPLE_CODEPOINTS;
+}
+
+// Number of UTF-16 units needed for a codepoint
+inline uint32_t Utf16Length(uint32_t codepoint) {
+	return codepoint > 0xFFFF ? 2 : 1;
+}
+
+// Returns the number of units written, 1 or 2
+inline uint32_t Utf16Encode(uint32_t codepoint, wchar_t *out) {
+	if (codepoint > 0xFFFF) {
+		codepoint -= 0x10000;
+		out[0] = static_cast<wchar_t>(0xD800 + (codepoint >> 10));
+		out[1] = static_cast<wchar_t>(0xDC00 + (codepoint & 0x3FF));
+		return 2;
+	}
+	out[0] = static_cast<wchar_t>(codepoint);
+	return 1;
+}
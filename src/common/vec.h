@@ -1,6 +1,10 @@
 #pragma once
 #include <cstdint>
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 constexpr uint32_t PAGE_SIZE = 0x1000;
 constexpr size_t MEGABYTES(size_t n) {
@@ -10,6 +14,35 @@ constexpr size_t MEGABYTES(size_t n) {
 // A heap-allocated vector, reserves 1GB of virtual memory,
 // commits as necessary. Ensures no reallocations.
 constexpr size_t VEC_MAX_SIZE = MEGABYTES(1024);
+
+#ifdef _WIN32
+inline void *VecReserve(size_t size) {
+	return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+inline void VecCommit(void *address, size_t size) {
+	VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE);
+}
+// Discards the contents, the pages stay committed
+inline void VecReset(void *address, size_t size) {
+	VirtualAlloc(address, size, MEM_RESET, PAGE_NOACCESS);
+}
+inline void VecRelease(void *address, size_t) {
+	VirtualFree(address, 0, MEM_RELEASE);
+}
+#else
+inline void *VecReserve(size_t size) {
+	return mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+}
+inline void VecCommit(void *address, size_t size) {
+	mprotect(address, size, PROT_READ | PROT_WRITE);
+}
+inline void VecReset(void *address, size_t size) {
+	madvise(address, size, MADV_DONTNEED);
+}
+inline void VecRelease(void *address, size_t size) {
+	munmap(address, size);
+}
+#endif
 template<typename T>
 struct Vec {
 	T *data_begin;
@@ -17,14 +50,14 @@ struct Vec {
 	T *alloc_end;
 
 	Vec() {
-		data_begin = reinterpret_cast<T *>(VirtualAlloc(nullptr, VEC_MAX_SIZE, MEM_RESERVE, PAGE_NOACCESS));
+		data_begin = reinterpret_cast<T *>(VecReserve(VEC_MAX_SIZE));
 		data_end = data_begin;
-		VirtualAlloc(data_begin, PAGE_SIZE * 4, MEM_COMMIT, PAGE_READWRITE);
+		VecCommit(data_begin, PAGE_SIZE * 4);
 		alloc_end = reinterpret_cast<T *>(reinterpret_cast<uint8_t *>(data_begin) + PAGE_SIZE * 4);
 	}
 
 	~Vec() {
-		VirtualFree(data_begin, 0, MEM_RELEASE);
+		VecRelease(data_begin, VEC_MAX_SIZE);
 	}
 
 	inline T operator[](size_t i) const {
@@ -74,20 +107,33 @@ struct Vec {
 
 	inline void grow() {
 		size_t byte_capacity = reinterpret_cast<uint8_t *>(alloc_end) - reinterpret_cast<uint8_t *>(data_begin);
-		VirtualAlloc(alloc_end, byte_capacity, MEM_COMMIT, PAGE_READWRITE);
+		VecCommit(alloc_end, byte_capacity);
 		alloc_end = reinterpret_cast<T *>(reinterpret_cast<uint8_t *>(alloc_end) + byte_capacity);
 	}
 
+	// Exchanges contents without copying, both vecs keep their reservations
+	inline void swap(Vec &other) {
+		T *other_begin = other.data_begin;
+		T *other_end = other.data_end;
+		T *other_alloc_end = other.alloc_end;
+		other.data_begin = data_begin;
+		other.data_end = data_end;
+		other.alloc_end = alloc_end;
+		data_begin = other_begin;
+		data_end = other_end;
+		alloc_end = other_alloc_end;
+	}
+
 	inline void clear() {
 		uint64_t byte_capacity = reinterpret_cast<uint8_t *>(alloc_end) - reinterpret_cast<uint8_t *>(data_begin);
-		VirtualAlloc(data_begin, byte_capacity, MEM_RESET, PAGE_NOACCESS);
+		VecReset(data_begin, byte_capacity);
 		data_end = data_begin;
-		VirtualAlloc(data_begin, PAGE_SIZE * 4, MEM_COMMIT, PAGE_READWRITE);
+		VecCommit(data_begin, PAGE_SIZE * 4);
 		alloc_end = reinterpret_cast<T *>(reinterpret_cast<uint8_t *>(data_begin) + PAGE_SIZE * 4);
 	}
 
 	using iterator = T *;
-	using const_iterator = T *const;
+	using const_iterator = const T *;
 	inline iterator begin() {
 		return data_begin;
 	}
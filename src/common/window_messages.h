@@ -1,7 +1,11 @@
 #pragma once
 
-// WPARAM: mpack_tree_t *, LPARAM: none
+// WPARAM: none, LPARAM: none
+// Posted by the reader thread when Nvim::message_queue has new messages
 #define WM_NVIM_MESSAGE WM_USER
 
 // WPARAM: none, LPARAM: none
-#define WM_RENDERER_FONT_UPDATE (WM_USER + 1)
\ No newline at end of file
+#define WM_RENDERER_FONT_UPDATE (WM_USER + 1)
+// WPARAM: none, LPARAM: none
+// Posted by the replay thread once the whole trace is queued
+#define WM_NVIM_REPLAY_DONE (WM_USER + 2)
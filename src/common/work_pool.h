@@ -0,0 +1,190 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+constexpr uint32_t WORK_POOL_MAX_WORKERS = 64;
+
+// Called once for every index of a batch. worker is 0 on the calling
+// thread and unique among the threads running the batch.
+using WorkPoolTask = void (*)(void *context, uint32_t index, uint32_t worker);
+
+// The indices a worker has yet to take, [begin, end) packed into one word
+// so the owner popping and a thief splitting it can't both get an index
+struct alignas(64) WorkPoolRange {
+	std::atomic<uint64_t> bounds;
+};
+
+struct WorkPoolStats {
+	uint64_t batches;
+	uint64_t items;
+	uint64_t steals;
+};
+
+// Runs batches of independent items on a fixed set of threads. Every
+// worker, the caller included, starts on an even slice of the indices and
+// works through it front to back. Once out of work it takes the back half
+// of whichever slice has the most left, so uneven items still spread out.
+struct WorkPool {
+	uint32_t worker_count; // Threads plus the caller
+	std::thread *threads;
+	WorkPoolRange ranges[WORK_POOL_MAX_WORKERS];
+
+	WorkPoolTask task;
+	void *context;
+	// Bumped for every batch and on shutdown, idle threads wait on it
+	alignas(64) std::atomic<uint32_t> batch_signal;
+	std::atomic<uint32_t> busy_threads; // Still working on the current batch
+	std::atomic<bool> closed;
+
+	std::atomic<uint64_t> batches;
+	std::atomic<uint64_t> items;
+	std::atomic<uint64_t> steals;
+};
+
+inline uint64_t WorkPoolPackRange(uint32_t begin, uint32_t end) {
+	return (static_cast<uint64_t>(end) << 32) | begin;
+}
+
+inline bool WorkPoolPop(WorkPoolRange *range, uint32_t *index) {
+	uint64_t bounds = range->bounds.load();
+	while (true) {
+		uint32_t begin = static_cast<uint32_t>(bounds);
+		uint32_t end = static_cast<uint32_t>(bounds >> 32);
+		if (begin >= end) {
+			return false;
+		}
+		if (range->bounds.compare_exchange_weak(bounds, WorkPoolPackRange(begin + 1, end))) {
+			*index = begin;
+			return true;
+		}
+	}
+}
+
+// Moves the back half of the fullest other slice into worker's own, which
+// is empty. False once every slice is.
+inline bool WorkPoolSteal(WorkPool *pool, uint32_t worker) {
+	while (true) {
+		uint32_t victim = worker;
+		uint64_t victim_bounds = 0;
+		uint32_t most_left = 0;
+		for (uint32_t i = 0; i < pool->worker_count; ++i) {
+			uint64_t bounds = pool->ranges[i].bounds.load();
+			uint32_t begin = static_cast<uint32_t>(bounds);
+			uint32_t end = static_cast<uint32_t>(bounds >> 32);
+			if (i != worker && begin < end && end - begin > most_left) {
+				victim = i;
+				victim_bounds = bounds;
+				most_left = end - begin;
+			}
+		}
+		if (most_left == 0) {
+			return false;
+		}
+
+		uint32_t begin = static_cast<uint32_t>(victim_bounds);
+		uint32_t end = static_cast<uint32_t>(victim_bounds >> 32);
+		uint32_t middle = end - (most_left + 1) / 2;
+		if (pool->ranges[victim].bounds.compare_exchange_strong(victim_bounds, WorkPoolPackRange(begin, middle))) {
+			pool->ranges[worker].bounds.store(WorkPoolPackRange(middle, end));
+			pool->steals.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+}
+
+inline void WorkPoolWork(WorkPool *pool, uint32_t worker) {
+	uint64_t item_count = 0;
+	uint32_t index;
+	while (true) {
+		if (!WorkPoolPop(&pool->ranges[worker], &index)) {
+			if (!WorkPoolSteal(pool, worker)) {
+				break;
+			}
+			continue;
+		}
+		pool->task(pool->context, index, worker);
+		item_count++;
+	}
+	pool->items.fetch_add(item_count, std::memory_order_relaxed);
+}
+
+inline void WorkPoolThread(WorkPool *pool, uint32_t worker) {
+	uint32_t seen_signal = 0;
+	while (true) {
+		pool->batch_signal.wait(seen_signal);
+		seen_signal = pool->batch_signal.load();
+		if (pool->closed.load()) {
+			return;
+		}
+
+		WorkPoolWork(pool, worker);
+		if (pool->busy_threads.fetch_sub(1) == 1) {
+			pool->busy_threads.notify_all();
+		}
+	}
+}
+
+// thread_count extra threads, 0 runs every batch on the caller
+inline void WorkPoolInitialize(WorkPool *pool, uint32_t thread_count) {
+	thread_count = thread_count < WORK_POOL_MAX_WORKERS - 1 ? thread_count : WORK_POOL_MAX_WORKERS - 1;
+	pool->worker_count = thread_count + 1;
+	pool->batch_signal.store(0);
+	pool->busy_threads.store(0);
+	pool->closed.store(false);
+	pool->threads = thread_count ? new std::thread[thread_count] : nullptr;
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		pool->threads[i] = std::thread(WorkPoolThread, pool, i + 1);
+	}
+}
+
+inline void WorkPoolShutdown(WorkPool *pool) {
+	pool->closed.store(true);
+	pool->batch_signal.fetch_add(1);
+	pool->batch_signal.notify_all();
+	for (uint32_t i = 0; i + 1 < pool->worker_count; ++i) {
+		pool->threads[i].join();
+	}
+	delete[] pool->threads;
+	pool->threads = nullptr;
+	pool->worker_count = 0;
+}
+
+// Calls task for every index in [0, count) and returns once all are done.
+// Only one thread may run batches.
+inline void WorkPoolRun(WorkPool *pool, uint32_t count, WorkPoolTask task, void *context) {
+	pool->batches.fetch_add(1, std::memory_order_relaxed);
+	if (pool->worker_count <= 1 || count < 2) {
+		for (uint32_t i = 0; i < count; ++i) {
+			task(context, i, 0);
+		}
+		pool->items.fetch_add(count, std::memory_order_relaxed);
+		return;
+	}
+
+	pool->task = task;
+	pool->context = context;
+	for (uint32_t i = 0; i < pool->worker_count; ++i) {
+		uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(count) * i / pool->worker_count);
+		uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(count) * (i + 1) / pool->worker_count);
+		pool->ranges[i].bounds.store(WorkPoolPackRange(begin, end));
+	}
+	pool->busy_threads.store(pool->worker_count - 1);
+	pool->batch_signal.fetch_add(1);
+	pool->batch_signal.notify_all();
+
+	WorkPoolWork(pool, 0);
+	uint32_t busy_threads;
+	while ((busy_threads = pool->busy_threads.load()) != 0) {
+		pool->busy_threads.wait(busy_threads);
+	}
+}
+
+// Approximate while a batch is running
+inline WorkPoolStats WorkPoolGetStats(WorkPool *pool) {
+	return WorkPoolStats {
+		.batches = pool->batches.load(std::memory_order_relaxed),
+		.items = pool->items.load(std::memory_order_relaxed),
+		.steals = pool->steals.load(std::memory_order_relaxed)
+	};
+}
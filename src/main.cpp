@@ -1,4 +1,5 @@
 #include "nvim/nvim.h"
+#include "nvim/nvim_call.h"
 #include "renderer/renderer.h"
 
 #include <string>
@@ -26,6 +27,8 @@ struct Context {
 	bool enable_cursor_timeout;
 	uint32_t cursor_timer_id;
 	uint32_t cursor_timeout_in_ms;
+	uint32_t request_timer_id;
+	uint32_t mouse_timer_id;
 	HKL hkl;
 };
 
@@ -51,55 +54,63 @@ void ToggleFullscreen(HWND hwnd, Context *context) {
 	}
 }
 
-void ProcessMPackMessage(Context *context, mpack_tree_t *tree) {
-	MPackMessageResult result = MPackExtractMessageResult(tree);
+// nvim has read the user init file, so guifont reflects the user's config
+NvimTask ApplyUserGuiFont(Context *context) {
+	NvimCallResult<std::string> guifont = co_await NvimCall<std::string>(context->nvim,
+		NVIM_REQUEST_NAMES[nvim_get_option_value], "guifont", NvimEmptyMap {});
+	if (guifont.status != NvimResponseStatus::Ok || guifont.value.empty()) {
+		co_return;
+	}
+
+	RendererUpdateGuiFont(context->renderer, guifont.value.data(), guifont.value.size());
+
+	if (context->start_rows != 0 && context->start_cols != 0) {
+		// after user config is read, process --geometry resize for the current font.
+		// if user config also sets lines or columns, --geometry takes precedence.
+		PixelSize start_size = RendererGridToPixelSize(context->renderer, context->start_rows, context->start_cols);
+		SetWindowPos(context->hwnd, HWND_TOP, 0, 0, 
+			start_size.width, start_size.height, SWP_NOMOVE | SWP_NOZORDER | SWP_FRAMECHANGED);
+	}
+}
+
+void ProcessMPackMessage(Context *context, mpack_reader_t *reader) {
+	MPackMessageResult result = MPackExtractMessageResult(reader);
 
 	switch (result.type) {
 	case MPackMessageType::Response: {
-		assert(result.response.msg_id <= context->nvim->next_msg_id);
-		switch (context->nvim->msg_id_to_method[result.response.msg_id]) {
-		case NvimRequest::nvim_get_option_value: {
-			Vec<char> guifont_buffer;
-			NvimParseOptionValueStr(context->nvim, result.params, &guifont_buffer);
-			if (!guifont_buffer.empty()) {
-				RendererUpdateGuiFont(context->renderer, guifont_buffer.data(), strlen(guifont_buffer.data()));
-
-				if (context->start_rows != 0 && context->start_cols != 0) {
-					// after user config is read, process --geometry resize for the current font.
-					// if user config also sets lines or columns, --geometry takes precedence.
-					PixelSize start_size = RendererGridToPixelSize(context->renderer, context->start_rows, context->start_cols);
-					SetWindowPos(context->hwnd, HWND_TOP, 0, 0, 
-						start_size.width, start_size.height, SWP_NOMOVE | SWP_NOZORDER | SWP_FRAMECHANGED);
-				}
-			}
-		} break;
-		case NvimRequest::vim_get_api_info:
-		case NvimRequest::nvim_input:
-		case NvimRequest::nvim_input_mouse:
-		case NvimRequest::nvim_command: {
-		} break;
-		}
+		NvimHandleResponse(context->nvim, &result.response, reader);
 	} break;
 	case MPackMessageType::Notification: {
-		if (MPackMatchString(result.notification.name, "redraw")) {
-			RendererRedraw(context->renderer, result.params, context->start_maximized);
+		switch (NvimLookupInboundMethod(result.notification.name)) {
+		case NvimInboundMethod::Redraw: {
+			RendererRedraw(context->renderer, reader, context->start_maximized);
+		} break;
+		default: {
+			context->nvim->unknown_method_count++;
+		} break;
 		}
 	} break;
 	case MPackMessageType::Request: {
-		if (MPackMatchString(result.request.method, "vimenter")) {
+		switch (NvimLookupInboundMethod(result.request.method)) {
+		case NvimInboundMethod::VimEnter: {
 			// nvim has read user init file, we can now request info if we want
 			// like additional startup settings or something else
 			NvimSendResponse(context->nvim, result.request.msg_id);
-			NvimGetOptionValue(context->nvim, "guifont");
+			ApplyUserGuiFont(context);
+		} break;
+		default: {
+			context->nvim->unknown_method_count++;
+		} break;
 		}
 	} break;
 	}
 }
 
 bool SendResizeIfNecessary(Context *context, int rows, int cols) {
-	if (!context->renderer->grid_initialized) return false;
+	GridModel *model = &context->renderer->model;
+	if (!model->grid_initialized) return false;
 
-	if (rows != context->renderer->grid_rows || cols != context->renderer->grid_cols) {
+	if (rows != model->grid_rows || cols != model->grid_cols) {
 		NvimSendResize(context->nvim, rows, cols);
 		return true;
 	}
@@ -146,8 +157,88 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam) {
 		PostQuitMessage(0);
 	} return 0;
 	case WM_NVIM_MESSAGE: {
-		mpack_tree_t *tree = reinterpret_cast<mpack_tree_t *>(wparam);
-		ProcessMPackMessage(context, tree);
+		// Only process what was queued at the time of the wake-up. If more
+		// arrives in the meantime another wake-up is posted, so input is
+		// never starved behind a flood of redraws.
+		context->nvim->message_wake_pending.store(false);
+		size_t pending_count = SpscQueueSize(&context->nvim->message_queue);
+
+		NvimMessage message;
+		for (size_t i = 0; i < pending_count && NvimPeekMessage(context->nvim, &message); ++i) {
+			mpack_reader_t reader;
+			mpack_reader_init_data(&reader, message.data, message.size);
+			ProcessMPackMessage(context, &reader);
+			mpack_reader_destroy(&reader);
+			NvimPopMessage(context->nvim);
+		}
+
+		if (!SpscQueueEmpty(&context->nvim->message_queue) &&
+			!context->nvim->message_wake_pending.exchange(true)) {
+			PostMessage(hwnd, WM_NVIM_MESSAGE, 0, 0);
+		}
+	} return 0;
+	case WM_NVIM_REPLAY_DONE: {
+		// Wait for the window to work through whatever is still queued
+		if (!SpscQueueEmpty(&context->nvim->message_queue)) {
+			PostMessage(hwnd, WM_NVIM_REPLAY_DONE, 0, 0);
+			return 0;
+		}
+
+		// The window stays open on the final screen, the numbers go to the debugger
+		Renderer *renderer = context->renderer;
+		GridModel *model = &renderer->model;
+		double elapsed_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - context->nvim->replay_start).count());
+		double elapsed_s = elapsed_ns / 1e9;
+		TripleBufferStats snapshot_stats = TripleBufferGetStats(&renderer->snapshots);
+		WorkPoolStats row_pool_stats = WorkPoolGetStats(&renderer->row_pool);
+		SpscQueueStats queue_stats = SpscQueueGetStats(&context->nvim->message_queue);
+		RpcWriterStats writer_stats = RpcWriterGetStats(&context->nvim->rpc_writer);
+		// The render thread's counters are only stable under its lock
+		std::unique_lock<std::mutex> render_lock(renderer->render_mutex);
+		char stats[2048];
+		snprintf(stats, sizeof(stats),
+			"Nvy: replay took %.2f ms, %.0f events/s, %.0f cells/s, %.0f ns per flush (%llu flushes), "
+			"%.1f redundant row draws avoided per flush, layout cache %llu hits %llu misses, "
+			"%.1f background rects per flush from %.1f highlight runs, %.0f pixels copied per flush, "
+			"%.1f rows snapshotted per flush, %llu of %llu snapshots dropped, "
+			"%llu rows prepared in batches on %u threads with %llu steals, "
+			"%llu unknown rpc methods, %llu unknown redraw events, "
+			"%llu messages queued at most %llu deep with %llu producer stalls, "
+			"%llu messages sent in %llu writes of %llu bytes, at most %llu per write, "
+			"%llu mouse events sent as %llu messages, %llu drags dropped, %llu wheel notches batched\n",
+			elapsed_ns / 1e6,
+			static_cast<double>(model->redraw_event_count) / elapsed_s,
+			static_cast<double>(model->grid_cell_count) / elapsed_s,
+			model->flush_count ? elapsed_ns / static_cast<double>(model->flush_count) : 0.0,
+			static_cast<unsigned long long>(model->flush_count),
+			model->flush_count ? static_cast<double>(model->redundant_draw_count) / model->flush_count : 0.0,
+			static_cast<unsigned long long>(renderer->layout_cache.hit_count),
+			static_cast<unsigned long long>(renderer->layout_cache.miss_count),
+			model->flush_count ? static_cast<double>(renderer->background_rect_count) / model->flush_count : 0.0,
+			model->flush_count ? static_cast<double>(renderer->background_run_count) / model->flush_count : 0.0,
+			model->flush_count ? static_cast<double>(renderer->damage_tracker.pixels_touched) / model->flush_count : 0.0,
+			model->flush_count ? static_cast<double>(renderer->snapshot_row_count) / model->flush_count : 0.0,
+			static_cast<unsigned long long>(snapshot_stats.dropped),
+			static_cast<unsigned long long>(snapshot_stats.published),
+			static_cast<unsigned long long>(row_pool_stats.items),
+			renderer->row_pool.worker_count,
+			static_cast<unsigned long long>(row_pool_stats.steals),
+			static_cast<unsigned long long>(context->nvim->unknown_method_count),
+			static_cast<unsigned long long>(model->unknown_redraw_event_count),
+			static_cast<unsigned long long>(queue_stats.pushed),
+			static_cast<unsigned long long>(queue_stats.max_depth),
+			static_cast<unsigned long long>(queue_stats.producer_stalls),
+			static_cast<unsigned long long>(writer_stats.messages),
+			static_cast<unsigned long long>(writer_stats.writes),
+			static_cast<unsigned long long>(writer_stats.bytes_written),
+			static_cast<unsigned long long>(writer_stats.largest_batch),
+			static_cast<unsigned long long>(context->nvim->mouse_event_count),
+			static_cast<unsigned long long>(context->nvim->mouse_message_count),
+			static_cast<unsigned long long>(context->nvim->mouse_drags_dropped),
+			static_cast<unsigned long long>(context->nvim->mouse_wheel_notches_batched));
+		render_lock.unlock();
+		OutputDebugStringA(stats);
 	} return 0;
 	case WM_RENDERER_FONT_UPDATE: {
 		auto [rows, cols] = RendererPixelsToGridSize(context->renderer,
@@ -239,24 +330,35 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam) {
 		POINTS cursor_pos = MAKEPOINTS(lparam);
 		GridPoint grid_pos = RendererCursorToGridPoint(context->renderer, cursor_pos.x, cursor_pos.y);
 		if (context->cached_cursor_grid_pos.col != grid_pos.col || context->cached_cursor_grid_pos.row != grid_pos.row) {
+			bool drag_held_back = false;
 			switch (wparam) {
 			case MK_LBUTTON: {
-				NvimSendMouseInput(context->nvim, MouseButton::Left, MouseAction::Drag, grid_pos.row, grid_pos.col);
+				drag_held_back = NvimSendMouseInput(context->nvim, MouseButton::Left, MouseAction::Drag, grid_pos.row, grid_pos.col);
 			} break;
 			case MK_MBUTTON: {
-				NvimSendMouseInput(context->nvim, MouseButton::Middle, MouseAction::Drag, grid_pos.row, grid_pos.col);
+				drag_held_back = NvimSendMouseInput(context->nvim, MouseButton::Middle, MouseAction::Drag, grid_pos.row, grid_pos.col);
 			} break;
 			case MK_RBUTTON: {
-				NvimSendMouseInput(context->nvim, MouseButton::Right, MouseAction::Drag, grid_pos.row, grid_pos.col);
+				drag_held_back = NvimSendMouseInput(context->nvim, MouseButton::Right, MouseAction::Drag, grid_pos.row, grid_pos.col);
 			} break;
 			}
+			if (drag_held_back) {
+				SetTimer(hwnd, context->mouse_timer_id, NVIM_MOUSE_DRAG_BUDGET_MS, NULL);
+			}
 			context->cached_cursor_grid_pos = grid_pos;
 		}
 	} return 0;
 	case WM_TIMER: {
-		if (context->enable_cursor_timeout && wparam == 1) {
+		if (context->enable_cursor_timeout && wparam == context->cursor_timer_id) {
 			SetCursor(NULL);
 		}
+		else if (wparam == context->request_timer_id) {
+			NvimExpireRequests(context->nvim);
+		}
+		else if (wparam == context->mouse_timer_id) {
+			KillTimer(hwnd, context->mouse_timer_id);
+			NvimFlushMouse(context->nvim);
+		}
 	} return 0;
 	case WM_LBUTTONDOWN:
 	case WM_RBUTTONDOWN:
@@ -439,6 +541,11 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE prev_instance, _
 
 	bool enable_cursor_timeout = false;
 	uint32_t cursor_timeout_in_ms = 0;
+	char server_address[MAX_PATH] {};
+	char record_trace_path[MAX_PATH] {};
+	char replay_trace_path[MAX_PATH] {};
+	bool replay_realtime = false;
+	char synthetic_workload[32] {};
 
 	static constexpr const wchar_t *NVIM_CMD = L"nvim --embed";
 	size_t nvim_cmd_len = wcslen(NVIM_CMD);
@@ -496,6 +603,25 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE prev_instance, _
 			wchar_t* end_ptr;
 			cursor_timeout_in_ms = wcstol(&cmd_line_args[i][17], &end_ptr, 10);
 		}
+		// Attach to a running `nvim --listen <address>` instead of spawning one
+		else if (!wcsncmp(cmd_line_args[i], L"--server=", wcslen(L"--server="))) {
+			WideCharToMultiByte(CP_UTF8, 0, &cmd_line_args[i][9], -1, server_address, MAX_PATH, nullptr, nullptr);
+		}
+		else if (!wcsncmp(cmd_line_args[i], L"--record-trace=", wcslen(L"--record-trace="))) {
+			WideCharToMultiByte(CP_UTF8, 0, &cmd_line_args[i][15], -1, record_trace_path, MAX_PATH, nullptr, nullptr);
+		}
+		// Replays a recorded trace instead of running nvim, at full speed unless --replay-realtime is given
+		else if (!wcsncmp(cmd_line_args[i], L"--replay-trace=", wcslen(L"--replay-trace="))) {
+			WideCharToMultiByte(CP_UTF8, 0, &cmd_line_args[i][15], -1, replay_trace_path, MAX_PATH, nullptr, nullptr);
+		}
+		else if (!wcscmp(cmd_line_args[i], L"--replay-realtime")) {
+			replay_realtime = true;
+		}
+		// Replays a generated workload: repaint, scroll, highlight or wide
+		else if (!wcsncmp(cmd_line_args[i], L"--synthetic-workload=", wcslen(L"--synthetic-workload="))) {
+			WideCharToMultiByte(CP_UTF8, 0, &cmd_line_args[i][21], -1, synthetic_workload,
+				sizeof(synthetic_workload), nullptr, nullptr);
+		}
 		// Already processed
 		else if (!wcsncmp(cmd_line_args[i], L"--neovim-bin=", wcslen(L"--neovim-bin="))) {}
 		// Otherwise assume the argument is a filename to open
@@ -540,6 +666,8 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE prev_instance, _
 	Nvim nvim {};
 	Renderer renderer {};
 	constexpr uint32_t cursor_timer_id = 1;
+	constexpr uint32_t request_timer_id = 2;
+	constexpr uint32_t mouse_timer_id = 3;
 	Context context {
 		.start_maximized = start_maximized,
 		.start_fullscreen = start_fullscreen,
@@ -551,7 +679,9 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE prev_instance, _
 		.saved_window_placement = WINDOWPLACEMENT { .length = sizeof(WINDOWPLACEMENT) },
 		.enable_cursor_timeout = enable_cursor_timeout,
 		.cursor_timer_id = cursor_timer_id,
-		.cursor_timeout_in_ms = cursor_timeout_in_ms
+		.cursor_timeout_in_ms = cursor_timeout_in_ms,
+		.request_timer_id = request_timer_id,
+		.mouse_timer_id = mouse_timer_id
 	};
 
 	HWND hwnd = CreateWindowEx(
@@ -580,8 +710,36 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE prev_instance, _
 	DwmSetWindowAttribute(hwnd, DWMWA_USE_IMMERSIVE_DARK_MODE, &should_use_dark_mode, sizeof(BOOL));
 	RendererInitialize(&renderer, hwnd, disable_ligatures, linespace_factor, context.saved_dpi_scaling);
 
-	NvimInitialize(&nvim, nvim_cmd, hwnd);
+	if (record_trace_path[0] && !NvimRecordTrace(&nvim, record_trace_path)) {
+		MessageBoxA(NULL, "ERROR: Could not create the trace file", "Nvy", MB_OK | MB_ICONERROR);
+		return 1;
+	}
+
+	if (synthetic_workload[0]) {
+		if (!NvimReplaySyntheticWorkload(&nvim, synthetic_workload, hwnd)) {
+			MessageBoxA(NULL, "ERROR: Unknown synthetic workload", "Nvy", MB_OK | MB_ICONERROR);
+			return 1;
+		}
+	}
+	else if (replay_trace_path[0]) {
+		if (!NvimReplayTrace(&nvim, replay_trace_path, replay_realtime, hwnd)) {
+			MessageBoxA(NULL, "ERROR: Could not open the trace file", "Nvy", MB_OK | MB_ICONERROR);
+			return 1;
+		}
+	}
+	else if (server_address[0]) {
+		if (!NvimAttach(&nvim, server_address, hwnd)) {
+			MessageBoxA(NULL, "ERROR: Could not connect to the nvim server", "Nvy", MB_OK | MB_ICONERROR);
+			return 1;
+		}
+		// No VimEnter request is coming, apply the font right away
+		ApplyUserGuiFont(&context);
+	}
+	else {
+		NvimInitialize(&nvim, nvim_cmd, hwnd);
+	}
 	free(nvim_cmd);
+	SetTimer(hwnd, request_timer_id, NVIM_REQUEST_TIMER_INTERVAL_MS, NULL);
 
 	// Forceably update the window to prevent any frames where the window is blank. Windows API docs
 	// specify that SetWindowPos should be called with these arguments after SetWindowLong is called.
@@ -607,7 +765,17 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE prev_instance, _
 		// TranslateMessage(&msg);
 		DispatchMessage(&msg);
 
-		if (renderer.draw_active) continue;
+		// Keys that piled up while we were busy go out as one nvim_input,
+		// the flush waits only for queued keyboard messages so redraws
+		// arriving in the meantime can't hold input back
+		MSG next_msg;
+		if (!PeekMessage(&next_msg, nullptr, WM_KEYFIRST, WM_KEYLAST, PM_NOREMOVE)) {
+			NvimFlushInput(&nvim);
+		}
+		// Same for wheel notches, held back to go out in a single write
+		if (!PeekMessage(&next_msg, nullptr, WM_MOUSEWHEEL, WM_MOUSEWHEEL, PM_NOREMOVE)) {
+			NvimFlushMouseWheel(&nvim);
+		}
 
 		if (previous_width != context.saved_window_width || previous_height != context.saved_window_height) {
 			previous_width = context.saved_window_width;
@@ -631,7 +799,7 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE prev_instance, _
 			// nvim outputs directly in double byte on error on windows
 			char buffer[1024 * 4];
 			DWORD read = 0;
-			if (!ReadFile(nvim.stderr_read, buffer, sizeof(buffer) - 1, &read, NULL)) {
+			if (!ReadFile(nvim.transport.stderr_read, buffer, sizeof(buffer) - 1, &read, NULL)) {
 				break;
 			}
 			if (!read) { continue; }
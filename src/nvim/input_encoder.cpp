@@ -0,0 +1,44 @@
+#include "input_encoder.h"
+
+char *InputEncoderReserve(InputEncoder *encoder, size_t length) {
+	size_t size = encoder->pending.size();
+	if (size == 0) {
+		encoder->pending.resize(INPUT_HEADER_SIZE);
+		memcpy(encoder->pending.data(), INPUT_NOTIFICATION_PREFIX.data, INPUT_NOTIFICATION_PREFIX.size);
+		size = INPUT_HEADER_SIZE;
+	}
+
+	encoder->pending.resize(size + length);
+	encoder->key_count++;
+	return encoder->pending.data() + size;
+}
+
+void InputEncoderAppend(InputEncoder *encoder, const char *input, size_t length) {
+	memcpy(InputEncoderReserve(encoder, length), input, length);
+}
+
+void InputEncoderAppendModified(InputEncoder *encoder, uint8_t modifiers, const char *key, size_t key_length) {
+	const ModifierPrefix &prefix = MODIFIER_PREFIXES[modifiers];
+
+	char *out = InputEncoderReserve(encoder, prefix.length + key_length + 2);
+	*out++ = '<';
+	memcpy(out, prefix.prefix, prefix.length);
+	out += prefix.length;
+	memcpy(out, key, key_length);
+	out += key_length;
+	*out = '>';
+}
+
+size_t InputEncoderFinish(InputEncoder *encoder, const char **data_out) {
+	size_t size = encoder->pending.size();
+	if (size == 0) {
+		return 0;
+	}
+
+	MPackEncodeStr32Header(encoder->pending.data() + INPUT_NOTIFICATION_PREFIX.size,
+		static_cast<uint32_t>(size - INPUT_HEADER_SIZE));
+	*data_out = encoder->pending.data();
+	encoder->pending.resize(0);
+	encoder->message_count++;
+	return size;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "common/mpack_helper.h"
+#include "common/vec.h"
+
+// The nvim_input notification is built in place, headed by the pre-encoded
+// [2, "nvim_input", [ prefix and a str32 header whose length is patched on finish
+constexpr MPackPrefix INPUT_NOTIFICATION_PREFIX = MPackEncodeNotificationPrefix("nvim_input", 1);
+static_assert(INPUT_NOTIFICATION_PREFIX.size != 0);
+constexpr size_t INPUT_HEADER_SIZE = INPUT_NOTIFICATION_PREFIX.size + MPACK_STR32_HEADER_SIZE;
+
+// Key notation names by key code, e.g. virtual key, built at compile time
+// from a list of the keys that have a name
+constexpr int KEY_NOTATION_KEY_COUNT = 256;
+constexpr size_t MAX_KEY_NAME_LENGTH = 15;
+struct KeyNotationName {
+	int key;
+	const char *name;
+};
+struct KeyName {
+	char name[MAX_KEY_NAME_LENGTH + 1];
+	uint8_t length;
+};
+struct KeyNotationTable {
+	KeyName keys[KEY_NOTATION_KEY_COUNT];
+};
+template<size_t N>
+constexpr KeyNotationTable BuildKeyNotationTable(const KeyNotationName (&names)[N]) {
+	KeyNotationTable table {};
+	for (const KeyNotationName &entry : names) {
+		KeyName &key = table.keys[entry.key];
+		key.length = static_cast<uint8_t>(ConstexprStrlen(entry.name));
+		for (size_t i = 0; i < key.length; ++i) {
+			key.name[i] = entry.name[i];
+		}
+	}
+	return table;
+}
+
+// Indexed by modifier mask, in the order nvim expects them in key notation
+enum KeyModifier : uint8_t {
+	KEY_MODIFIER_CTRL = 1 << 0,
+	KEY_MODIFIER_SHIFT = 1 << 1,
+	KEY_MODIFIER_ALT = 1 << 2
+};
+struct ModifierPrefix {
+	const char *prefix;
+	uint8_t length;
+};
+constexpr ModifierPrefix MODIFIER_PREFIXES[] {
+	{ "", 0 },
+	{ "C-", 2 },
+	{ "S-", 2 },
+	{ "C-S-", 4 },
+	{ "M-", 2 },
+	{ "C-M-", 4 },
+	{ "S-M-", 4 },
+	{ "C-S-M-", 6 }
+};
+
+// Collects keys in key notation into a single nvim_input notification
+struct InputEncoder {
+	Vec<char> pending;
+	uint64_t key_count;
+	uint64_t message_count;
+};
+
+inline bool InputEncoderEmpty(InputEncoder *encoder) {
+	return encoder->pending.empty();
+}
+
+// Room for one key of length bytes, a message is started if none is pending
+char *InputEncoderReserve(InputEncoder *encoder, size_t length);
+void InputEncoderAppend(InputEncoder *encoder, const char *input, size_t length);
+// Appends <modifiers-key>, modifiers being a KeyModifier mask
+void InputEncoderAppendModified(InputEncoder *encoder, uint8_t modifiers, const char *key, size_t key_length);
+// Completes the pending message and starts over. Returns its size, or 0 if
+// there was nothing to send, data_out stays valid until the next key.
+size_t InputEncoderFinish(InputEncoder *encoder, const char **data_out);
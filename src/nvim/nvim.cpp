@@ -1,253 +1,517 @@
 #include "nvim.h"
+#include "nvim/nvim_call.h"
 #include "common/mpack_helper.h"
 #include "third_party/mpack/mpack.h"
 
-constexpr int Megabytes(int n) {
-    return 1024 * 1024 * n;
+static void NvimCompleteRequest(Nvim *nvim, NvimPendingRequest *request, const NvimResponse *response) {
+	// Free the slot first, the handler may well issue the next request
+	NvimResponseHandler handler = request->handler;
+	void *user_data = request->user_data;
+	*request = NvimPendingRequest {};
+	nvim->pending_request_count--;
+
+	if (handler) {
+		handler(nvim, response, user_data);
+	}
 }
 
-int64_t RegisterRequest(Nvim *nvim, NvimRequest request) {
-	nvim->msg_id_to_method.push_back(request);
+int64_t NvimRegisterRequest(Nvim *nvim, NvimResponseHandler handler, void *user_data, uint32_t timeout_ms) {
+	if (nvim->pending_request_count == NVIM_MAX_PENDING_REQUESTS) {
+		nvim->dropped_request_count++;
+		if (handler) {
+			NvimResponse response {
+				.status = NvimResponseStatus::Dropped,
+				.error_message = MPackString { .data = "", .length = 0 }
+			};
+			handler(nvim, &response, user_data);
+		}
+		// Never matches a slot, so the response is discarded as stale
+		return nvim->next_msg_id++;
+	}
+
+	// Skip ids whose slot is still taken by a slow request
+	NvimPendingRequest *request;
+	while (true) {
+		request = &nvim->pending_requests[nvim->next_msg_id & (NVIM_MAX_PENDING_REQUESTS - 1)];
+		if (!request->in_use) break;
+		nvim->next_msg_id++;
+	}
+
+	*request = NvimPendingRequest {
+		.msg_id = nvim->next_msg_id,
+		.in_use = true,
+		.handler = handler,
+		.user_data = user_data,
+		.deadline = timeout_ms ? GetTickCount64() + timeout_ms : 0
+	};
+	nvim->pending_request_count++;
 	return nvim->next_msg_id++;
 }
 
-static size_t ReadFromNvim(mpack_tree_t *tree, char *buffer, size_t count) {
-	HANDLE nvim_stdout_read = mpack_tree_context(tree);
-	DWORD bytes_read;
-	BOOL success = ReadFile(nvim_stdout_read, buffer, static_cast<DWORD>(count), &bytes_read, nullptr);
-	if (!success) {
-		mpack_tree_flag_error(tree, mpack_error_io);
+void NvimCancelRequest(Nvim *nvim, int64_t msg_id) {
+	NvimPendingRequest *request = &nvim->pending_requests[msg_id & (NVIM_MAX_PENDING_REQUESTS - 1)];
+	if (request->in_use && request->msg_id == msg_id) {
+		request->handler = nullptr;
+		request->user_data = nullptr;
+	}
+}
+
+void NvimHandleResponse(Nvim *nvim, const MPackResponse *response, mpack_reader_t *reader) {
+	NvimPendingRequest *request = &nvim->pending_requests[response->msg_id & (NVIM_MAX_PENDING_REQUESTS - 1)];
+	if (!request->in_use || request->msg_id != response->msg_id) {
+		// Already timed out, or dropped when the table was full
+		nvim->stale_response_count++;
+		return;
+	}
+
+	if (response->has_error) {
+		nvim->failed_request_count++;
+	}
+
+	NvimResponse result {
+		.status = response->has_error ? NvimResponseStatus::Error : NvimResponseStatus::Ok,
+		.error_message = response->error_message,
+		.result = response->has_error ? nullptr : reader
+	};
+	NvimCompleteRequest(nvim, request, &result);
+}
+
+void NvimExpireRequests(Nvim *nvim) {
+	if (nvim->pending_request_count == 0) return;
+
+	uint64_t now = GetTickCount64();
+	NvimResponse response {
+		.status = NvimResponseStatus::Timeout,
+		.error_message = MPackString { .data = "", .length = 0 }
+	};
+	for (NvimPendingRequest &request : nvim->pending_requests) {
+		if (request.in_use && request.deadline != 0 && request.deadline <= now) {
+			nvim->timed_out_request_count++;
+			NvimCompleteRequest(nvim, &request, &response);
+		}
+	}
+}
+
+// Fails everything in flight so waiting coroutines get to finish
+static void NvimDropRequests(Nvim *nvim) {
+	NvimResponse response {
+		.status = NvimResponseStatus::Dropped,
+		.error_message = MPackString { .data = "", .length = 0 }
+	};
+	for (NvimPendingRequest &request : nvim->pending_requests) {
+		if (request.in_use) {
+			NvimCompleteRequest(nvim, &request, &response);
+		}
+	}
+}
+
+// Reads from nvim until a complete message is buffered. Messages are framed
+// without being decoded, the caller pulls the contents with an mpack_reader_t
+// directly from the buffer. The buffer grows as needed, so there is no size cap.
+bool NvimReadMessage(Nvim *nvim, NvimMessage *message_out) {
+	while (true) {
+		char *message_start = nvim->inbound_buffer.data() + nvim->inbound_message_start;
+		size_t available = nvim->inbound_buffer.size() - nvim->inbound_message_start;
+		size_t message_size = MPackFramerScan(&nvim->inbound_framer, message_start, available);
+		if (message_size == SIZE_MAX) {
+			return false;
+		}
+		if (message_size != 0) {
+			message_out->data = message_start;
+			message_out->size = message_size;
+			nvim->inbound_message_start += message_size;
+			MPackFramerReset(&nvim->inbound_framer);
+			return true;
+		}
+
+		// Move the partial message to the front of the buffer before reading more
+		if (nvim->inbound_message_start != 0) {
+			memmove(nvim->inbound_buffer.data(), message_start, available);
+			nvim->inbound_buffer.resize(available);
+			nvim->inbound_message_start = 0;
+		}
+
+		size_t size = nvim->inbound_buffer.size();
+		nvim->inbound_buffer.resize(size + NVIM_READ_CHUNK_SIZE);
+		size_t bytes_read = TransportRead(&nvim->transport, nvim->inbound_buffer.data() + size, NVIM_READ_CHUNK_SIZE);
+		if (bytes_read == 0) {
+			nvim->inbound_buffer.resize(size);
+			return false;
+		}
+		nvim->inbound_buffer.resize(size + bytes_read);
 	}
-	return bytes_read;
+}
+
+// Blocks only while the queue is full, returns false once it is closed
+static bool NvimQueueMessage(Nvim *nvim, const char *data, size_t size) {
+	if (!SpscQueuePush(&nvim->message_queue, data, size)) {
+		return false;
+	}
+
+	// Only wake up the window if it isn't already going to drain the queue
+	if (!nvim->message_wake_pending.exchange(true)) {
+		PostMessage(nvim->hwnd, WM_NVIM_MESSAGE, 0, 0);
+	}
+	return true;
 }
 
 DWORD WINAPI NvimMessageHandler(LPVOID param) {
 	Nvim *nvim = static_cast<Nvim *>(param);
-	mpack_tree_t *tree = static_cast<mpack_tree_t *>(malloc(sizeof(mpack_tree_t)));
-	mpack_tree_init_stream(tree, ReadFromNvim, nvim->stdout_read, Megabytes(20), 1'048'576);
 
-	while (true) {
-		mpack_tree_parse(tree);
-		if (mpack_tree_error(tree) != mpack_ok) {
+	NvimMessage message;
+	while (NvimReadMessage(nvim, &message)) {
+		if (nvim->recording_trace) {
+			TraceWriterAppend(&nvim->trace_writer, message.data, message.size);
+		}
+		if (!NvimQueueMessage(nvim, message.data, message.size)) {
 			break;
 		}
-
-		// Blocking, dubious thread safety. Seems to work though...
-		SendMessage(nvim->hwnd, WM_NVIM_MESSAGE, reinterpret_cast<WPARAM>(tree), 0);
 	}
 
-	mpack_tree_destroy(tree);
-	free(tree);
 	PostMessage(nvim->hwnd, WM_DESTROY, 0, 0);
 	return 0;
 }
 
-DWORD WINAPI NvimProcessMonitor(LPVOID param) {
+DWORD WINAPI NvimReplayHandler(LPVOID param) {
 	Nvim *nvim = static_cast<Nvim *>(param);
-	while (true) {
-		DWORD exit_code;
-		if (GetExitCodeProcess(nvim->process_info.hProcess, &exit_code) && exit_code == STILL_ACTIVE) {
-			Sleep(1);
+
+	TraceMessage message;
+	bool completed = true;
+	while (TraceReaderNext(&nvim->trace_reader, &message)) {
+		if (nvim->replay_realtime) {
+			std::this_thread::sleep_until(nvim->replay_start + std::chrono::nanoseconds(message.timestamp_ns));
 		}
-		else {
-			nvim->exit_code = exit_code;
+		if (!NvimQueueMessage(nvim, message.data, message.size)) {
+			completed = false;
 			break;
 		}
 	}
+	TraceReaderClose(&nvim->trace_reader);
+
+	// The window reports the numbers once it has caught up
+	if (completed) {
+		PostMessage(nvim->hwnd, WM_NVIM_REPLAY_DONE, 0, 0);
+	}
+	return 0;
+}
+
+bool NvimPeekMessage(Nvim *nvim, NvimMessage *message_out) {
+	SpscSlot *slot = SpscQueueFront(&nvim->message_queue);
+	if (!slot) {
+		return false;
+	}
+
+	message_out->data = slot->data;
+	message_out->size = slot->size;
+	return true;
+}
+
+void NvimPopMessage(Nvim *nvim) {
+	SpscQueuePop(&nvim->message_queue);
+}
+
+DWORD WINAPI NvimProcessMonitor(LPVOID param) {
+	Nvim *nvim = static_cast<Nvim *>(param);
+	int exit_code;
+	while (!TransportGetExitCode(&nvim->transport, &exit_code)) {
+		Sleep(1);
+	}
+	nvim->exit_code = exit_code;
 	PostMessage(nvim->hwnd, WM_DESTROY, 0, 0);
 	return 0;
 }
 
-void NvimInitialize(Nvim *nvim, wchar_t *command_line, HWND hwnd) {
-	nvim->hwnd = hwnd;
+struct NvimApiInfo {
+	int64_t api_level;
+};
+
+// [channel_id, api_metadata], we only look for version.api_level
+bool NvimDecodeResult(mpack_reader_t *reader, NvimApiInfo *api_info) {
+	api_info->api_level = 0;
+	uint32_t length = MPackReadArray(reader);
+	if (length != 2) {
+		MPackFinishArray(reader, length, 0);
+		return false;
+	}
+	MPackSkip(reader);
 
-	HANDLE job_object = CreateJobObjectW(nullptr, nullptr);
-	JOBOBJECT_EXTENDED_LIMIT_INFORMATION job_info {
-		.BasicLimitInformation = JOBOBJECT_BASIC_LIMIT_INFORMATION {
-			.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE
+	uint32_t top_level_map_length = MPackReadMap(reader);
+	for (uint32_t i = 0; i < top_level_map_length; ++i) {
+		if (!MPackMatchString(MPackReadString(reader), "version")) {
+			MPackSkip(reader);
+			continue;
 		}
-	};
-	SetInformationJobObject(job_object, JobObjectExtendedLimitInformation, &job_info, sizeof(job_info));
-	
-	SECURITY_ATTRIBUTES sec_attribs {
-		.nLength = sizeof(SECURITY_ATTRIBUTES),
-		.bInheritHandle = true
-	};
-	HANDLE stdin_read, stdout_write, stderr_write;
-	CreatePipe(&stdin_read, &nvim->stdin_write, &sec_attribs, 0);
-	CreatePipe(&nvim->stdout_read, &stdout_write, &sec_attribs, 0);
-	CreatePipe(&nvim->stderr_read, &stderr_write, &sec_attribs, 0);
-
-	STARTUPINFO startup_info {
-		.cb = sizeof(STARTUPINFO),
-		.dwFlags = STARTF_USESTDHANDLES,
-		.hStdInput = stdin_read,
-		.hStdOutput = stdout_write,
-		.hStdError = stderr_write
-	};
 
-	// wchar_t command_line[] = L"nvim --embed";
-	CreateProcessW(
-		nullptr,
-		command_line,
-		nullptr,
-		nullptr,
-		true,
-		CREATE_NO_WINDOW,
-		nullptr,
-		nullptr,
-		&startup_info,
-		&nvim->process_info
-	);
-	AssignProcessToJobObject(job_object, nvim->process_info.hProcess);
-
-	// Close unneeded handles
-	CloseHandle(stdin_read);
-	CloseHandle(stdout_write);
-	CloseHandle(stderr_write);
-	CloseHandle(nvim->process_info.hThread);
-
-	// Start process monitor thread
-	DWORD _;
-	CreateThread( nullptr, 0, NvimProcessMonitor, nvim, 0, &_);
-
-	// Do the initial messages with nvim in sync
-	mpack_tree_t *tree_reader = static_cast<mpack_tree_t *>(malloc(sizeof(mpack_tree_t)));
-	mpack_tree_init_stream(tree_reader, ReadFromNvim, nvim->stdout_read, Megabytes(20), 1'048'576);
-
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-
-	// Query api info
-	MPackStartRequest(RegisterRequest(nvim, vim_get_api_info), NVIM_REQUEST_NAMES[vim_get_api_info], &writer);
-	mpack_start_array(&writer, 0);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	if (!MPackSendData(nvim->stdin_write, data, size)) {
-		return;
+		uint32_t version_map_length = MPackReadMap(reader);
+		for (uint32_t j = 0; j < version_map_length; ++j) {
+			if (MPackMatchString(MPackReadString(reader), "api_level")) {
+				api_info->api_level = MPackReadInt(reader);
+			}
+			else {
+				MPackSkip(reader);
+			}
+		}
+		mpack_done_map(reader);
 	}
-	mpack_tree_parse(tree_reader);
-	if (mpack_tree_error(tree_reader)) {
-		return;
+	mpack_done_map(reader);
+	mpack_done_array(reader);
+	return mpack_reader_error(reader) == mpack_ok;
+}
+
+// Everything is sent up front in one batch, only the api level
+// check has to wait for nvim to answer
+NvimTask NvimStartup(Nvim *nvim, bool attached) {
+	NvimCall<NvimApiInfo> api_info(nvim, NVIM_REQUEST_NAMES[vim_get_api_info]);
+
+	// Set g:nvy global variable
+	mpack_writer_t *writer = NvimBeginMessage(nvim);
+	MPackStartNotification(NVIM_OUTBOUND_NOTIFICATION_NAMES[nvim_set_var], writer);
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "nvy");
+	mpack_write_int(writer, 1);
+	mpack_finish_array(writer);
+	RpcWriterCommit(&nvim->rpc_writer);
+
+	// Setup neovim to send a blocking request so we can finalize seting up before
+	// buffer. An attached server is long past VimEnter and we aren't channel 1.
+	if (!attached) {
+		NvimSendCommand(nvim, "autocmd VimEnter * call rpcrequest(1, 'vimenter')");
 	}
-	MPackMessageResult result = MPackExtractMessageResult(tree_reader);
-	if (result.type == MPackMessageType::Response){
-		mpack_node_t top_level_map = mpack_node_array_at(result.params, 1);
-		mpack_node_t version_map = mpack_node_map_value_at(top_level_map, 0);
-		int64_t api_level = mpack_node_map_cstr(version_map, "api_level").data->value.i;
-		assert(api_level > 6);
+
+	NvimCallResult<NvimApiInfo> result = co_await api_info;
+	if (result.status == NvimResponseStatus::Ok) {
+		assert(result.value.api_level > 6);
 	}
+}
 
-	// Set g:nvy global variable
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartNotification(NVIM_OUTBOUND_NOTIFICATION_NAMES[nvim_set_var], &writer);
-	mpack_start_array(&writer, 2);
-	mpack_write_cstr(&writer, "nvy");
-	mpack_write_int(&writer, 1);
-	mpack_finish_array(&writer);
-	size = MPackFinishMessage(&writer);
-	if (!MPackSendData(nvim->stdin_write, data, size)) {
-		return;
+static void NvimStart(Nvim *nvim, HWND hwnd, bool attached) {
+	nvim->hwnd = hwnd;
+
+	DWORD _;
+	if (!attached) {
+		// Start process monitor thread
+		CreateThread(nullptr, 0, NvimProcessMonitor, nvim, 0, &_);
 	}
 
-	// Setup neovim to send a blocking request so we can finalize seting up before
-	// buffer
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartRequest(RegisterRequest(nvim, nvim_command), NVIM_REQUEST_NAMES[nvim_command], &writer);
-	mpack_start_array(&writer, 1);
-	mpack_write_cstr(&writer, "autocmd VimEnter * call rpcrequest(1, 'vimenter')");
-	mpack_finish_array(&writer);
-	size = MPackFinishMessage(&writer);
-	if (!MPackSendData(nvim->stdin_write, data, size)) {
-		return;
+	RpcWriterInitialize(&nvim->rpc_writer, &nvim->transport);
+
+	MPackFramerReset(&nvim->inbound_framer);
+	nvim->reader_thread = CreateThread(nullptr, 0, NvimMessageHandler, nvim, 0, &_);
+
+	NvimStartup(nvim, attached);
+}
+
+void NvimInitialize(Nvim *nvim, wchar_t *command_line, HWND hwnd) {
+	// wchar_t command_line[] = L"nvim --embed";
+	TransportSpawn(&nvim->transport, command_line);
+	NvimStart(nvim, hwnd, false);
+}
+
+bool NvimAttach(Nvim *nvim, const char *address, HWND hwnd) {
+	if (!TransportConnect(&nvim->transport, address)) {
+		return false;
 	}
-	mpack_tree_parse(tree_reader);
-	if (mpack_tree_error(tree_reader)) {
-		return;
+	NvimStart(nvim, hwnd, true);
+	return true;
+}
+
+bool NvimRecordTrace(Nvim *nvim, const char *trace_path) {
+	nvim->recording_trace = TraceWriterOpen(&nvim->trace_writer, trace_path);
+	return nvim->recording_trace;
+}
+
+static void NvimStartReplay(Nvim *nvim, bool realtime, HWND hwnd) {
+	nvim->hwnd = hwnd;
+	nvim->replay_realtime = realtime;
+	nvim->replay_start = std::chrono::steady_clock::now();
+
+	// There is no nvim to answer, keep the writer closed so
+	// requests are dropped instead of waiting for their timeout
+	nvim->rpc_writer.closed = true;
+
+	DWORD _;
+	nvim->reader_thread = CreateThread(nullptr, 0, NvimReplayHandler, nvim, 0, &_);
+}
+
+bool NvimReplayTrace(Nvim *nvim, const char *trace_path, bool realtime, HWND hwnd) {
+	if (!TraceReaderOpen(&nvim->trace_reader, trace_path)) {
+		return false;
 	}
-	result = MPackExtractMessageResult(tree_reader); // get the result just in case...
+	NvimStartReplay(nvim, realtime, hwnd);
+	return true;
+}
 
-	mpack_tree_destroy(tree_reader);
-	free(tree_reader);
+bool NvimReplaySyntheticWorkload(Nvim *nvim, const char *workload_name, HWND hwnd) {
+	SyntheticWorkload workload = SyntheticWorkloadLookup(workload_name);
+	if (workload == SyntheticWorkload::Unknown) {
+		return false;
+	}
 
-	CreateThread(nullptr, 0, NvimMessageHandler, nvim, 0, &_);
+	SyntheticWorkloadGenerate(workload, &nvim->synthetic_trace);
+	if (!TraceReaderOpenMemory(&nvim->trace_reader, nvim->synthetic_trace.data(), nvim->synthetic_trace.size())) {
+		return false;
+	}
+	NvimStartReplay(nvim, false, hwnd);
+	return true;
 }
 
 void NvimShutdown(Nvim *nvim) {
-	DWORD exit_code;
-	GetExitCodeProcess(nvim->process_info.hProcess, &exit_code);
+	int exit_code;
+	bool exited = TransportGetExitCode(&nvim->transport, &exit_code);
+
+	// Unblock the reader thread in case it is waiting on a full queue
+	SpscQueueClose(&nvim->message_queue);
+	RpcWriterShutdown(&nvim->rpc_writer);
+	NvimDropRequests(nvim);
+	TraceWriterClose(&nvim->trace_writer);
+
+	// An exited nvim keeps its stderr open, main reads the error message from it
+	if (!exited || nvim->transport.kind == TransportKind::Socket) {
+		TransportClose(&nvim->transport);
+	}
 
-	if(exit_code == STILL_ACTIVE) {
-		CloseHandle(nvim->stdin_write);
-		CloseHandle(nvim->stdout_read);
-		CloseHandle(nvim->stderr_read);
-		TerminateProcess(nvim->process_info.hProcess, 0);
-		CloseHandle(nvim->process_info.hProcess);
-		CloseHandle(nvim->process_info.hThread);
+	// With the queue closed and the transport gone the reader thread is on its
+	// way out. A realtime replay may still be sleeping until its next message,
+	// in that case the slots are left to the process exit.
+	if (nvim->reader_thread) {
+		if (WaitForSingleObject(nvim->reader_thread, NVIM_READER_SHUTDOWN_TIMEOUT_MS) == WAIT_OBJECT_0) {
+			SpscQueueDestroy(&nvim->message_queue);
+		}
+		CloseHandle(nvim->reader_thread);
+		nvim->reader_thread = nullptr;
 	}
 }
 
 void NvimSendUIAttach(Nvim *nvim, int grid_rows, int grid_cols) {
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-
 	// Send UI attach notification
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartNotification(NVIM_OUTBOUND_NOTIFICATION_NAMES[nvim_ui_attach], &writer);
-	mpack_start_array(&writer, 3);
-	mpack_write_int(&writer, grid_cols);
-	mpack_write_int(&writer, grid_rows);
-	mpack_start_map(&writer, 1);
-	mpack_write_cstr(&writer, "ext_linegrid");
-	mpack_write_true(&writer);
-	mpack_finish_map(&writer);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+	mpack_writer_t *writer = NvimBeginMessage(nvim);
+	MPackStartNotification(NVIM_OUTBOUND_NOTIFICATION_NAMES[nvim_ui_attach], writer);
+	mpack_start_array(writer, 3);
+	mpack_write_int(writer, grid_cols);
+	mpack_write_int(writer, grid_rows);
+	mpack_start_map(writer, 1);
+	mpack_write_cstr(writer, "ext_linegrid");
+	mpack_write_true(writer);
+	mpack_finish_map(writer);
+	mpack_finish_array(writer);
+	RpcWriterCommit(&nvim->rpc_writer);
 }
 
 void NvimSendResize(Nvim *nvim, int grid_rows, int grid_cols) {
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
+	mpack_writer_t *writer = NvimBeginMessage(nvim);
+
+	MPackStartNotification(NVIM_OUTBOUND_NOTIFICATION_NAMES[nvim_ui_try_resize], writer);
+	mpack_start_array(writer, 2);
+	mpack_write_int(writer, grid_cols);
+	mpack_write_int(writer, grid_rows);
+	mpack_finish_array(writer);
+	RpcWriterCommit(&nvim->rpc_writer);
+}
 
-	MPackStartNotification(NVIM_OUTBOUND_NOTIFICATION_NAMES[nvim_ui_try_resize], &writer);
-	mpack_start_array(&writer, 2);
-	mpack_write_int(&writer, grid_cols);
-	mpack_write_int(&writer, grid_rows);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+// Key notation for the virtual keys that aren't handled through WM_CHAR
+constexpr KeyNotationName VIRTUAL_KEY_NAMES[] {
+	{ VK_BACK, "BS" },
+	{ VK_TAB, "Tab" },
+	{ VK_RETURN, "CR" },
+	{ VK_ESCAPE, "Esc" },
+	{ VK_PRIOR, "PageUp" },
+	{ VK_NEXT, "PageDown" },
+	{ VK_HOME, "Home" },
+	{ VK_END, "End" },
+	{ VK_LEFT, "Left" },
+	{ VK_UP, "Up" },
+	{ VK_RIGHT, "Right" },
+	{ VK_DOWN, "Down" },
+	{ VK_INSERT, "Insert" },
+	{ VK_DELETE, "Del" },
+	{ VK_NUMPAD0, "k0" },
+	{ VK_NUMPAD1, "k1" },
+	{ VK_NUMPAD2, "k2" },
+	{ VK_NUMPAD3, "k3" },
+	{ VK_NUMPAD4, "k4" },
+	{ VK_NUMPAD5, "k5" },
+	{ VK_NUMPAD6, "k6" },
+	{ VK_NUMPAD7, "k7" },
+	{ VK_NUMPAD8, "k8" },
+	{ VK_NUMPAD9, "k9" },
+	{ VK_MULTIPLY, "kMultiply" },
+	{ VK_ADD, "kPlus" },
+	{ VK_SEPARATOR, "kComma" },
+	{ VK_SUBTRACT, "kMinus" },
+	{ VK_DECIMAL, "kPoint" },
+	{ VK_DIVIDE, "kDivide" },
+	{ VK_F1, "F1" },
+	{ VK_F2, "F2" },
+	{ VK_F3, "F3" },
+	{ VK_F4, "F4" },
+	{ VK_F5, "F5" },
+	{ VK_F6, "F6" },
+	{ VK_F7, "F7" },
+	{ VK_F8, "F8" },
+	{ VK_F9, "F9" },
+	{ VK_F10, "F10" },
+	{ VK_F11, "F11" },
+	{ VK_F12, "F12" },
+	{ VK_F13, "F13" },
+	{ VK_F14, "F14" },
+	{ VK_F15, "F15" },
+	{ VK_F16, "F16" },
+	{ VK_F17, "F17" },
+	{ VK_F18, "F18" },
+	{ VK_F19, "F19" },
+	{ VK_F20, "F20" },
+	{ VK_F21, "F21" },
+	{ VK_F22, "F22" },
+	{ VK_F23, "F23" },
+	{ VK_F24, "F24" },
+};
+
+constexpr KeyNotationTable KEY_NOTATION_TABLE = BuildKeyNotationTable(VIRTUAL_KEY_NAMES);
+
+inline uint8_t GetKeyModifiers() {
+	return ((GetKeyState(VK_CONTROL) & 0x80) ? KEY_MODIFIER_CTRL : 0) |
+		((GetKeyState(VK_SHIFT) & 0x80) ? KEY_MODIFIER_SHIFT : 0) |
+		((GetKeyState(VK_MENU) & 0x80) ? KEY_MODIFIER_ALT : 0);
 }
 
-void NvimSendModifiedInput(Nvim *nvim, const char *input) {
-	bool shift_down = (GetKeyState(VK_SHIFT) & 0x80) != 0;
-	bool ctrl_down = (GetKeyState(VK_CONTROL) & 0x80) != 0;
-	bool alt_down = (GetKeyState(VK_MENU) & 0x80) != 0;
+// Keys and mouse events are never held back at the same time,
+// so both streams stay in order
+static void NvimPrepareInput(Nvim *nvim) {
+	if (InputEncoderEmpty(&nvim->input_encoder)) {
+		NvimFlushMouse(nvim);
+	}
+}
+
+static void NvimQueueInput(Nvim *nvim, const char *input, size_t length) {
+	NvimPrepareInput(nvim);
+	InputEncoderAppend(&nvim->input_encoder, input, length);
+}
 
-	constexpr int MAX_INPUT_STRING_SIZE = 64;
-	char input_string[MAX_INPUT_STRING_SIZE];
+mpack_writer_t *NvimBeginMessage(Nvim *nvim) {
+	NvimFlushInput(nvim);
+	NvimFlushMouse(nvim);
+	return RpcWriterBegin(&nvim->rpc_writer);
+}
 
-	snprintf(input_string, MAX_INPUT_STRING_SIZE, "<%s%s%s%s>", ctrl_down ? "C-" : "", 
-			shift_down ? "S-" : "", alt_down ? "M-" : "", input);
+void NvimFlushInput(Nvim *nvim) {
+	const char *data;
+	size_t size = InputEncoderFinish(&nvim->input_encoder, &data);
+	if (size == 0) return;
 
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartRequest(RegisterRequest(nvim, nvim_input), NVIM_REQUEST_NAMES[nvim_input], &writer);
-	mpack_start_array(&writer, 1);
-	mpack_write_cstr(&writer, input_string);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+	RpcWriterCommitBytes(&nvim->rpc_writer, data, size);
+}
+
+// Queues <modifiers-key>
+void NvimSendModifiedInput(Nvim *nvim, const char *key, size_t key_length) {
+	NvimPrepareInput(nvim);
+	InputEncoderAppendModified(&nvim->input_encoder, GetKeyModifiers(), key, key_length);
 }
 
 void NvimSendChar(Nvim *nvim, wchar_t input_char) {
 	// If the space is simply a regular space,
 	// simply send the modified input
 	if(input_char == VK_SPACE) {
-		NvimSendModifiedInput(nvim, "Space");
+		NvimSendModifiedInput(nvim, "Space", 5);
 		return;
 	}
 
@@ -257,15 +521,7 @@ void NvimSendChar(Nvim *nvim, wchar_t input_char) {
 	}
 	WideCharToMultiByte(CP_UTF8, 0, &input_char, 1, utf8_encoded, 64, NULL, NULL);
 
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartRequest(RegisterRequest(nvim, nvim_input), NVIM_REQUEST_NAMES[nvim_input], &writer);
-	mpack_start_array(&writer, 1);
-	mpack_write_cstr(&writer, utf8_encoded);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+	NvimQueueInput(nvim, utf8_encoded, strlen(utf8_encoded));
 }
 
 void NvimSendSysChar(Nvim *nvim, wchar_t input_char) {
@@ -275,370 +531,226 @@ void NvimSendSysChar(Nvim *nvim, wchar_t input_char) {
 	}
 	WideCharToMultiByte(CP_UTF8, 0, &input_char, 1, utf8_encoded, 64, NULL, NULL);
 
-	NvimSendModifiedInput(nvim, utf8_encoded);
+	NvimSendModifiedInput(nvim, utf8_encoded, strlen(utf8_encoded));
 }
 
 void NvimSendInput(Nvim *nvim, const char *input_chars) {
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-
-	MPackStartRequest(RegisterRequest(nvim, nvim_input), NVIM_REQUEST_NAMES[nvim_input], &writer);
-	mpack_start_array(&writer, 1);
-	mpack_write_cstr(&writer, input_chars);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
-}
-
-void NvimSendMouseInput(Nvim *nvim, MouseButton button, MouseAction action, int mouse_row, int mouse_col) {
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartRequest(RegisterRequest(nvim, nvim_input_mouse), NVIM_REQUEST_NAMES[nvim_input_mouse], &writer);
-	mpack_start_array(&writer, 6);
-
-	switch (button) {
+	NvimQueueInput(nvim, input_chars, strlen(input_chars));
+}
+
+// Sent count times in a single write, input is always flushed by now
+static void NvimWriteMouseEvent(Nvim *nvim, const NvimMouseEvent *event) {
+	mpack_writer_t *writer = RpcWriterBegin(&nvim->rpc_writer);
+	MPackStartNotification(NVIM_OUTBOUND_NOTIFICATION_NAMES[nvim_input_mouse], writer);
+	mpack_start_array(writer, 6);
+
+	switch (event->button) {
 	case MouseButton::Left: {
-		mpack_write_cstr(&writer, "left");
+		mpack_write_cstr(writer, "left");
 	} break;
 	case MouseButton::Right: {
-		mpack_write_cstr(&writer, "right");
+		mpack_write_cstr(writer, "right");
 	} break;
 	case MouseButton::Middle: {
-		mpack_write_cstr(&writer, "middle");
+		mpack_write_cstr(writer, "middle");
 	} break;
 	case MouseButton::Wheel: {
-		mpack_write_cstr(&writer, "wheel");
+		mpack_write_cstr(writer, "wheel");
 	} break;
 	}
-	switch (action) {
+	switch (event->action) {
 	case MouseAction::Press: {
-		mpack_write_cstr(&writer, "press");
+		mpack_write_cstr(writer, "press");
 	} break;
 	case MouseAction::Drag: {
-		mpack_write_cstr(&writer, "drag");
+		mpack_write_cstr(writer, "drag");
 	} break;
 	case MouseAction::Release: {
-		mpack_write_cstr(&writer, "release");
+		mpack_write_cstr(writer, "release");
 	} break;
 	case MouseAction::MouseWheelUp: {
-		mpack_write_cstr(&writer, "up");
+		mpack_write_cstr(writer, "up");
 	} break;
 	case MouseAction::MouseWheelDown: {
-		mpack_write_cstr(&writer, "down");
+		mpack_write_cstr(writer, "down");
 	} break;
 	case MouseAction::MouseWheelLeft: {
-		mpack_write_cstr(&writer, "left");
+		mpack_write_cstr(writer, "left");
 	} break;
 	case MouseAction::MouseWheelRight: {
-		mpack_write_cstr(&writer, "right");
+		mpack_write_cstr(writer, "right");
 	} break;
 	}
 
-	bool ctrl_down = (GetKeyState(VK_CONTROL) & 0x80) != 0;
-	bool shift_down = (GetKeyState(VK_SHIFT) & 0x80) != 0;
-	bool alt_down = (GetKeyState(VK_MENU) & 0x80) != 0;
-	constexpr int MAX_INPUT_STRING_SIZE = 64;
-	char input_string[MAX_INPUT_STRING_SIZE];
-	snprintf(input_string, MAX_INPUT_STRING_SIZE, "%s%s%s", ctrl_down ? "C-" : "", shift_down ? "S-" : "", alt_down ? "M-" : "");
-	mpack_write_cstr(&writer, input_string);
-
-	mpack_write_i64(&writer, 0);
-	mpack_write_i64(&writer, mouse_row);
-	mpack_write_i64(&writer, mouse_col);
-	mpack_finish_array(&writer);
+	const ModifierPrefix &modifiers = MODIFIER_PREFIXES[event->modifiers];
+	mpack_write_str(writer, modifiers.prefix, modifiers.length);
 
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+	mpack_write_i64(writer, 0);
+	mpack_write_i64(writer, event->row);
+	mpack_write_i64(writer, event->col);
+	mpack_finish_array(writer);
+	RpcWriterCommit(&nvim->rpc_writer, event->count);
+	nvim->mouse_message_count += event->count;
 }
 
-bool NvimProcessKeyDown(Nvim *nvim, int virtual_key) {
-	const char *key;
-	switch (virtual_key) {
-	case VK_BACK: {
-		key = "BS";
-	} break;
-	case VK_TAB: {
-		key = "Tab";
-	} break;
-	case VK_RETURN: {
-		key = "CR";
-	} break;
-	case VK_ESCAPE: {
-		key = "Esc";
-	} break;
-	case VK_PRIOR: {
-		key = "PageUp";
-	} break;
-	case VK_NEXT: {
-		key = "PageDown";
-	} break;
-	case VK_HOME: {
-		key = "Home";
-	} break;
-	case VK_END: {
-		key = "End";
-	} break;
-	case VK_LEFT: {
-		key = "Left";
-	} break;
-	case VK_UP: {
-		key = "Up";
-	} break;
-	case VK_RIGHT: {
-		key = "Right";
-	} break;
-	case VK_DOWN: {
-		key = "Down";
-	} break;
-	case VK_INSERT: {
-		key = "Insert";
-	} break;
-	case VK_DELETE: {
-		key = "Del";
-	} break;
-	case VK_NUMPAD0: {
-		key = "k0";
-	} break;
-	case VK_NUMPAD1: {
-		key = "k1";
-	} break;
-	case VK_NUMPAD2: {
-		key = "k2";
-	} break;
-	case VK_NUMPAD3: {
-		key = "k3";
-	} break;
-	case VK_NUMPAD4: {
-		key = "k4";
-	} break;
-	case VK_NUMPAD5: {
-		key = "k5";
-	} break;
-	case VK_NUMPAD6: {
-		key = "k6";
-	} break;
-	case VK_NUMPAD7: {
-		key = "k7";
-	} break;
-	case VK_NUMPAD8: {
-		key = "k8";
-	} break;
-	case VK_NUMPAD9: {
-		key = "k9";
-	} break;
-	case VK_MULTIPLY: {
-		key = "kMultiply";
-	} break;
-	case VK_ADD: {
-		key = "kPlus";
-	} break;
-	case VK_SEPARATOR: {
-		key = "kComma";
-	} break;
-	case VK_SUBTRACT: {
-		key = "kMinus";
-	} break;
-	case VK_DECIMAL: {
-		key = "kPoint";
-	} break;
-	case VK_DIVIDE: {
-		key = "kDivide";
-	} break;
-	case VK_F1: {
-		key = "F1";
-	} break;
-	case VK_F2: {
-		key = "F2";
-	} break;
-	case VK_F3: {
-		key = "F3";
-	} break;
-	case VK_F4: {
-		key = "F4";
-	} break;
-	case VK_F5: {
-		key = "F5";
-	} break;
-	case VK_F6: {
-		key = "F6";
-	} break;
-	case VK_F7: {
-		key = "F7";
-	} break;
-	case VK_F8: {
-		key = "F8";
-	} break;
-	case VK_F9: {
-		key = "F9";
-	} break;
-	case VK_F10: {
-		key = "F10";
-	} break;
-	case VK_F11: {
-		key = "F11";
-	} break;
-	case VK_F12: {
-		key = "F12";
-	} break;
-	case VK_F13: {
-		key = "F13";
-	} break;
-	case VK_F14: {
-		key = "F14";
-	} break;
-	case VK_F15: {
-		key = "F15";
-	} break;
-	case VK_F16: {
-		key = "F16";
-	} break;
-	case VK_F17: {
-		key = "F17";
-	} break;
-	case VK_F18: {
-		key = "F18";
-	} break;
-	case VK_F19: {
-		key = "F19";
-	} break;
-	case VK_F20: {
-		key = "F20";
-	} break;
-	case VK_F21: {
-		key = "F21";
-	} break;
-	case VK_F22: {
-		key = "F22";
-	} break;
-	case VK_F23: {
-		key = "F23";
-	} break;
-	case VK_F24: {
-		key = "F24";
-	} break;
-	default: {
-	} return false;
-	}
+void NvimFlushMouse(Nvim *nvim) {
+	if (!nvim->mouse_event_pending) return;
 
-	NvimSendModifiedInput(nvim, key);
-	return true;
+	NvimWriteMouseEvent(nvim, &nvim->pending_mouse_event);
+	if (nvim->pending_mouse_event.action == MouseAction::Drag) {
+		nvim->last_drag_time = GetTickCount64();
+	}
+	nvim->mouse_event_pending = false;
 }
 
-void NvimGetOptionValue(Nvim *nvim, const char *option) {
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartRequest(RegisterRequest(nvim, nvim_get_option_value), NVIM_REQUEST_NAMES[nvim_get_option_value], &writer);
-	mpack_start_array(&writer, 2);
-	mpack_write_cstr(&writer, option);
-	mpack_start_map(&writer, 0);
-	mpack_finish_map(&writer);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+void NvimFlushMouseWheel(Nvim *nvim) {
+	if (nvim->mouse_event_pending && nvim->pending_mouse_event.button == MouseButton::Wheel) {
+		NvimFlushMouse(nvim);
+	}
 }
 
-void NvimParseOptionValueStr(Nvim *nvim, mpack_node_t value_node, Vec<char> *value_out) {
-	char path[MAX_PATH];
-	const char *value_path = mpack_node_str(value_node);
-	size_t value_path_strlen = mpack_node_strlen(value_node);
-	if (value_path && value_path_strlen)
-	{
-		value_out->resize(value_path_strlen);
-		memcpy(value_out->data(), value_path, value_path_strlen);
+// Wheel notches on the same cell are counted and written together, still an
+// nvim_input_mouse each, drags only keep the latest position until the frame
+// budget has passed.
+// Presses and releases go out right away, after anything still held back.
+bool NvimSendMouseInput(Nvim *nvim, MouseButton button, MouseAction action, int mouse_row, int mouse_col) {
+	NvimFlushInput(nvim);
+	nvim->mouse_event_count++;
+
+	NvimMouseEvent event {
+		.button = button,
+		.action = action,
+		.modifiers = GetKeyModifiers(),
+		.row = mouse_row,
+		.col = mouse_col,
+		.count = 1
+	};
+
+	NvimMouseEvent *pending = &nvim->pending_mouse_event;
+	if (nvim->mouse_event_pending && pending->button == button &&
+		pending->action == action && pending->modifiers == event.modifiers) {
+		if (button == MouseButton::Wheel && pending->row == mouse_row && pending->col == mouse_col) {
+			pending->count++;
+			nvim->mouse_wheel_notches_batched++;
+			return false;
+		}
+		if (action == MouseAction::Drag) {
+			pending->row = mouse_row;
+			pending->col = mouse_col;
+			nvim->mouse_drags_dropped++;
+			return true;
+		}
 	}
+
+	NvimFlushMouse(nvim);
+	if (button == MouseButton::Wheel) {
+		*pending = event;
+		nvim->mouse_event_pending = true;
+		return false;
+	}
+	if (action == MouseAction::Drag) {
+		uint64_t now = GetTickCount64();
+		if (now - nvim->last_drag_time < NVIM_MOUSE_DRAG_BUDGET_MS) {
+			*pending = event;
+			nvim->mouse_event_pending = true;
+			return true;
+		}
+		nvim->last_drag_time = now;
+	}
+
+	NvimWriteMouseEvent(nvim, &event);
+	return false;
+}
+
+bool NvimProcessKeyDown(Nvim *nvim, int virtual_key) {
+	if (virtual_key < 0 || virtual_key >= KEY_NOTATION_KEY_COUNT) return false;
+
+	const KeyName &key = KEY_NOTATION_TABLE.keys[virtual_key];
+	if (key.length == 0) return false;
+
+	NvimSendModifiedInput(nvim, key.name, key.length);
+	return true;
 }
 
 void NvimSendCommand(Nvim *nvim, const char *command) {
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartRequest(RegisterRequest(nvim, nvim_command), NVIM_REQUEST_NAMES[nvim_command], &writer);
-	mpack_start_array(&writer, 1);
-	mpack_write_cstr(&writer, command);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+	mpack_writer_t *writer = NvimBeginMessage(nvim);
+	MPackStartRequest(NvimRegisterRequest(nvim), NVIM_REQUEST_NAMES[nvim_command], writer);
+	mpack_start_array(writer, 1);
+	mpack_write_cstr(writer, command);
+	mpack_finish_array(writer);
+	RpcWriterCommit(&nvim->rpc_writer);
 }
 
 void NvimSendResponse(Nvim *nvim, int64_t req_id) {
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-
-	mpack_start_array(&writer, 4);
-	mpack_write_i64(&writer, 1);
-	mpack_write_i64(&writer, req_id);
-	mpack_write_nil(&writer);
-	mpack_write_int(&writer, 0);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+	mpack_writer_t *writer = NvimBeginMessage(nvim);
+
+	mpack_start_array(writer, 4);
+	mpack_write_i64(writer, 1);
+	mpack_write_i64(writer, req_id);
+	mpack_write_nil(writer);
+	mpack_write_int(writer, 0);
+	RpcWriterCommit(&nvim->rpc_writer);
 }
 
 void NvimOpenFile(Nvim *nvim, const wchar_t *file_name, bool open_new_buffer) {
-	char utf8_encoded[MAX_PATH]{};
-	WideCharToMultiByte(CP_UTF8, 0, file_name, -1, utf8_encoded, MAX_PATH, NULL, NULL);
-
-	char file_command[MAX_PATH + 8] = {};
-	if (open_new_buffer) {
-		strcpy_s(file_command, MAX_PATH, "new ");
-	}
-	else {
-		strcpy_s(file_command, MAX_PATH, "e ");
+	// Paths can exceed MAX_PATH with the \\?\ prefix, size the command to fit
+	const char *command_prefix = open_new_buffer ? "new " : "e ";
+	size_t prefix_length = strlen(command_prefix);
+	int utf8_length = WideCharToMultiByte(CP_UTF8, 0, file_name, -1, nullptr, 0, nullptr, nullptr);
+	if (utf8_length <= 0) {
+		return;
 	}
-	strcat_s(file_command, MAX_PATH, utf8_encoded);
 
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartRequest(RegisterRequest(nvim, nvim_command), NVIM_REQUEST_NAMES[nvim_command], &writer);
-	mpack_start_array(&writer, 1);
-	mpack_write_cstr(&writer, file_command);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+	char *file_command = static_cast<char *>(malloc(prefix_length + utf8_length));
+	memcpy(file_command, command_prefix, prefix_length);
+	WideCharToMultiByte(CP_UTF8, 0, file_name, -1, file_command + prefix_length, utf8_length, nullptr, nullptr);
+
+	mpack_writer_t *writer = NvimBeginMessage(nvim);
+	MPackStartRequest(NvimRegisterRequest(nvim), NVIM_REQUEST_NAMES[nvim_command], writer);
+	mpack_start_array(writer, 1);
+	mpack_write_cstr(writer, file_command);
+	mpack_finish_array(writer);
+	RpcWriterCommit(&nvim->rpc_writer);
+
+	free(file_command);
 }
 
 void NvimSetFocus(Nvim *nvim) {
 	const char *set_focus_command = "doautocmd <nomodeline> FocusGained";
 
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartRequest(RegisterRequest(nvim, nvim_command), NVIM_REQUEST_NAMES[nvim_command], &writer);
-	mpack_start_array(&writer, 1);
-	mpack_write_cstr(&writer, set_focus_command);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+	mpack_writer_t *writer = NvimBeginMessage(nvim);
+	MPackStartRequest(NvimRegisterRequest(nvim), NVIM_REQUEST_NAMES[nvim_command], writer);
+	mpack_start_array(writer, 1);
+	mpack_write_cstr(writer, set_focus_command);
+	mpack_finish_array(writer);
+	RpcWriterCommit(&nvim->rpc_writer);
 }
 
 void NvimKillFocus(Nvim *nvim) {
 	const char *set_focus_command = "doautocmd <nomodeline> FocusLost";
 
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartRequest(RegisterRequest(nvim, nvim_command), NVIM_REQUEST_NAMES[nvim_command], &writer);
-	mpack_start_array(&writer, 1);
-	mpack_write_cstr(&writer, set_focus_command);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+	mpack_writer_t *writer = NvimBeginMessage(nvim);
+	MPackStartRequest(NvimRegisterRequest(nvim), NVIM_REQUEST_NAMES[nvim_command], writer);
+	mpack_start_array(writer, 1);
+	mpack_write_cstr(writer, set_focus_command);
+	mpack_finish_array(writer);
+	RpcWriterCommit(&nvim->rpc_writer);
 }
 void NvimQuit(Nvim *nvim)
 {
+	// An attached server keeps running for its other clients, only detach
+	// from it. A replay has no nvim to quit at all.
+	if (nvim->transport.kind != TransportKind::Pipes) {
+		PostMessage(nvim->hwnd, WM_DESTROY, 0, 0);
+		return;
+	}
+
 	const char *quit_command = "qa";
 
-	char data[MAX_MPACK_OUTBOUND_MESSAGE_SIZE];
-	mpack_writer_t writer;
-	mpack_writer_init(&writer, data, MAX_MPACK_OUTBOUND_MESSAGE_SIZE);
-	MPackStartRequest(RegisterRequest(nvim, nvim_command), NVIM_REQUEST_NAMES[nvim_command], &writer);
-	mpack_start_array(&writer, 1);
-	mpack_write_cstr(&writer, quit_command);
-	mpack_finish_array(&writer);
-	size_t size = MPackFinishMessage(&writer);
-	MPackSendData(nvim->stdin_write, data, size);
+	mpack_writer_t *writer = NvimBeginMessage(nvim);
+	MPackStartRequest(NvimRegisterRequest(nvim), NVIM_REQUEST_NAMES[nvim_command], writer);
+	mpack_start_array(writer, 1);
+	mpack_write_cstr(writer, quit_command);
+	mpack_finish_array(writer);
+	RpcWriterCommit(&nvim->rpc_writer);
 }
@@ -1,29 +1,51 @@
 #pragma once
+#include "nvim/input_encoder.h"
+#include "nvim/transport.h"
+#include "nvim/rpc_writer.h"
+#include "nvim/trace.h"
+#include "nvim/synthetic_workload.h"
 
 enum NvimRequest : uint8_t {
 	vim_get_api_info = 0,
-	nvim_input = 1,
-	nvim_input_mouse = 2,
-	nvim_command = 3,
-	nvim_get_option_value = 4
+	nvim_command = 1,
+	nvim_get_option_value = 2
 };
 constexpr const char *NVIM_REQUEST_NAMES[] {
 	"nvim_get_api_info",
-	"nvim_input",
-	"nvim_input_mouse",
 	"nvim_command",
 	"nvim_get_option_value"
 };
+// Input is sent as notifications, nvim doesn't have to answer every keystroke
 enum NvimOutboundNotification : uint8_t {
 	nvim_ui_attach = 0,
 	nvim_ui_try_resize = 1,
-	nvim_set_var = 2
+	nvim_set_var = 2,
+	nvim_input = 3,
+	nvim_input_mouse = 4
 };
 constexpr const char *NVIM_OUTBOUND_NOTIFICATION_NAMES[] {
 	"nvim_ui_attach",
 	"nvim_ui_try_resize",
-	"nvim_set_var"
+	"nvim_set_var",
+	"nvim_input",
+	"nvim_input_mouse"
+};
+enum class NvimInboundMethod : uint8_t {
+	Redraw,
+	VimEnter,
+	Unknown
 };
+constexpr StringDispatchEntry<NvimInboundMethod> NVIM_INBOUND_METHODS[] {
+	{ "redraw", NvimInboundMethod::Redraw },
+	{ "vimenter", NvimInboundMethod::VimEnter }
+};
+constexpr StringDispatchTable NVIM_INBOUND_METHOD_TABLE(NVIM_INBOUND_METHODS, NvimInboundMethod::Unknown);
+static_assert(NVIM_INBOUND_METHOD_TABLE.valid, "No perfect hash found for the inbound methods");
+
+inline NvimInboundMethod NvimLookupInboundMethod(MPackString method) {
+	return NVIM_INBOUND_METHOD_TABLE.Lookup(method.data, method.length);
+}
+
 enum class MouseButton {
 	Left,
 	Right,
@@ -39,25 +61,139 @@ enum class MouseAction {
 	MouseWheelLeft,
 	MouseWheelRight
 };
-constexpr int MAX_MPACK_OUTBOUND_MESSAGE_SIZE = 4096;
+// Read ahead in large chunks, a full redraw arrives in few reads
+constexpr size_t NVIM_READ_CHUNK_SIZE = 256 * 1024;
+constexpr size_t NVIM_MESSAGE_QUEUE_CAPACITY = 64;
+// How long shutdown waits for the reader thread before leaving the queue be
+constexpr uint32_t NVIM_READER_SHUTDOWN_TIMEOUT_MS = 1000;
+constexpr size_t NVIM_MAX_PENDING_REQUESTS = 256;
+static_assert((NVIM_MAX_PENDING_REQUESTS & (NVIM_MAX_PENDING_REQUESTS - 1)) == 0);
+// How often the window checks for timed out requests
+constexpr uint32_t NVIM_REQUEST_TIMER_INTERVAL_MS = 250;
+// Drags within this window of the last one sent are held back, only the latest is sent
+constexpr uint32_t NVIM_MOUSE_DRAG_BUDGET_MS = 16;
+
+// A complete inbound message, pointing into the inbound buffer.
+// Only valid until the next call to NvimReadMessage.
+struct NvimMessage {
+	const char *data;
+	size_t size;
+};
+
+struct NvimMouseEvent {
+	MouseButton button;
+	MouseAction action;
+	uint8_t modifiers;
+	int row;
+	int col;
+	uint32_t count;
+};
+
+struct Nvim;
+enum class NvimResponseStatus : uint8_t {
+	Ok,
+	Error,
+	Timeout,
+	// The request table was full, or the channel shut down before a response came in
+	Dropped
+};
+struct NvimResponse {
+	NvimResponseStatus status;
+	// Both point into the inbound message and are only valid inside the handler
+	MPackString error_message;
+	mpack_reader_t *result; // Positioned at the result if status is Ok, otherwise nullptr
+};
+typedef void (*NvimResponseHandler)(Nvim *nvim, const NvimResponse *response, void *user_data);
+
+// In-flight requests live in a fixed table indexed by msg_id. Ids are picked
+// so that they land on a free slot, a response is then matched with a single
+// lookup and stale responses are rejected by comparing the stored id.
+struct NvimPendingRequest {
+	int64_t msg_id;
+	bool in_use;
+	NvimResponseHandler handler;
+	void *user_data;
+	uint64_t deadline; // GetTickCount64 based, 0 if the request never times out
+};
 
 struct Nvim {
 	int64_t next_msg_id;
-	Vec<NvimRequest> msg_id_to_method;
+	uint64_t unknown_method_count;
+
+	NvimPendingRequest pending_requests[NVIM_MAX_PENDING_REQUESTS];
+	size_t pending_request_count;
+	uint64_t dropped_request_count;
+	uint64_t timed_out_request_count;
+	uint64_t failed_request_count;
+	uint64_t stale_response_count;
+
+	Vec<char> inbound_buffer;
+	size_t inbound_message_start;
+	MPackFramer inbound_framer;
+
+	// Filled by the reader thread so it can parse ahead while the window
+	// applies and renders, drained by the window on WM_NVIM_MESSAGE
+	SpscQueue<NVIM_MESSAGE_QUEUE_CAPACITY> message_queue;
+	std::atomic<bool> message_wake_pending;
+	HANDLE reader_thread; // Reads from nvim or replays a trace into message_queue
+
+	RpcWriter rpc_writer;
+
+	// Keys typed during the current message loop iteration, sent
+	// as a single nvim_input once the message queue is drained
+	InputEncoder input_encoder;
+
+	// A wheel or drag event that is held back to see what follows it
+	bool mouse_event_pending;
+	NvimMouseEvent pending_mouse_event;
+	uint64_t last_drag_time;
+	uint64_t mouse_event_count;
+	uint64_t mouse_message_count;
+	uint64_t mouse_drags_dropped; // Drag positions replaced before they were sent
+	uint64_t mouse_wheel_notches_batched; // Notches held back to go out in a single write
+
+	// --record-trace tees every inbound message into trace_writer,
+	// --replay-trace feeds the messages of trace_reader to the window instead of nvim
+	bool recording_trace;
+	TraceWriter trace_writer;
+	TraceReader trace_reader;
+	bool replay_realtime; // Keep the recorded pacing instead of replaying at full speed
+	std::chrono::steady_clock::time_point replay_start;
+	Vec<char> synthetic_trace; // Backs trace_reader for --synthetic-workload
 
 	HWND hwnd;
-	HANDLE stdin_write;
-	HANDLE stdout_read;
-	HANDLE stderr_read;
-	PROCESS_INFORMATION process_info;
-	DWORD exit_code;
+	// Written to by rpc_writer, read from by the message handler thread
+	Transport transport;
+	int exit_code;
 };
 
 void NvimInitialize(Nvim *nvim, wchar_t *command_line, HWND hwnd);
+// Attaches to a server started with `nvim --listen`, returns false if it can't be reached
+bool NvimAttach(Nvim *nvim, const char *address, HWND hwnd);
+// Call before NvimInitialize or NvimAttach
+bool NvimRecordTrace(Nvim *nvim, const char *trace_path);
+// Plays back a recorded trace in place of a running nvim, anything sent is dropped
+bool NvimReplayTrace(Nvim *nvim, const char *trace_path, bool realtime, HWND hwnd);
+// Same for a generated workload, always at full speed
+bool NvimReplaySyntheticWorkload(Nvim *nvim, const char *workload_name, HWND hwnd);
 void NvimShutdown(Nvim *nvim);
 
-void NvimGetOptionValue(Nvim *nvim, const char *option);
-void NvimParseOptionValueStr(Nvim *nvim, mpack_node_t value_node, Vec<char> *value_out);
+bool NvimReadMessage(Nvim *nvim, NvimMessage *message_out);
+bool NvimPeekMessage(Nvim *nvim, NvimMessage *message_out);
+void NvimPopMessage(Nvim *nvim);
+
+// Returns the msg_id to send the request with. Without a handler the response is
+// only used to free the slot. If the table is full the handler is called right
+// away with NvimResponseStatus::Dropped and the response will be ignored.
+int64_t NvimRegisterRequest(Nvim *nvim, NvimResponseHandler handler = nullptr,
+	void *user_data = nullptr, uint32_t timeout_ms = 0);
+// Detaches the handler, the slot is freed once the response arrives
+void NvimCancelRequest(Nvim *nvim, int64_t msg_id);
+// Use instead of RpcWriterBegin, sends any pending input first to keep the message order
+mpack_writer_t *NvimBeginMessage(Nvim *nvim);
+void NvimFlushInput(Nvim *nvim);
+void NvimHandleResponse(Nvim *nvim, const MPackResponse *response, mpack_reader_t *reader);
+void NvimExpireRequests(Nvim *nvim);
 
 void NvimSendCommand(Nvim *nvim, const char *command);
 void NvimSendUIAttach(Nvim *nvim, int grid_rows, int grid_cols);
@@ -65,7 +201,10 @@ void NvimSendResize(Nvim *nvim, int grid_rows, int grid_cols);
 void NvimSendChar(Nvim *nvim, wchar_t input_char);
 void NvimSendSysChar(Nvim *nvim, wchar_t sys_char);
 void NvimSendInput(Nvim *nvim, const char* input_chars);
-void NvimSendMouseInput(Nvim *nvim, MouseButton button, MouseAction action, int mouse_row, int mouse_col);
+// Returns true if a drag was held back, NvimFlushMouse sends it once the frame budget has passed
+bool NvimSendMouseInput(Nvim *nvim, MouseButton button, MouseAction action, int mouse_row, int mouse_col);
+void NvimFlushMouse(Nvim *nvim);
+void NvimFlushMouseWheel(Nvim *nvim);
 void NvimSendResponse(Nvim *nvim, int64_t req_id);
 bool NvimProcessKeyDown(Nvim *nvim, int virtual_key);
 void NvimOpenFile(Nvim *nvim, const wchar_t *file_name, bool open_new_buffer = false);
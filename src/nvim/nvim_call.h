@@ -0,0 +1,143 @@
+#pragma once
+#include <coroutine>
+#include <cstdlib>
+#include <string>
+#include <utility>
+
+constexpr uint32_t NVIM_CALL_DEFAULT_TIMEOUT_MS = 5000;
+constexpr size_t NVIM_CALL_MAX_ERROR_MESSAGE_SIZE = 256;
+
+// Fire and forget coroutine, runs eagerly until its first co_await and
+// frees itself when done. Every NvimCall times out or is dropped on
+// shutdown, so a task waiting on one is always resumed eventually.
+struct NvimTask {
+	struct promise_type {
+		NvimTask get_return_object() noexcept { return NvimTask {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { abort(); }
+	};
+};
+
+// Argument and result types for NvimCall
+struct NvimEmptyMap {};
+struct NvimNoResult {};
+
+inline void NvimEncodeArg(mpack_writer_t *writer, const char *arg) {
+	mpack_write_cstr(writer, arg);
+}
+inline void NvimEncodeArg(mpack_writer_t *writer, int64_t arg) {
+	mpack_write_i64(writer, arg);
+}
+inline void NvimEncodeArg(mpack_writer_t *writer, int arg) {
+	mpack_write_int(writer, arg);
+}
+inline void NvimEncodeArg(mpack_writer_t *writer, bool arg) {
+	mpack_write_bool(writer, arg);
+}
+inline void NvimEncodeArg(mpack_writer_t *writer, NvimEmptyMap) {
+	mpack_start_map(writer, 0);
+	mpack_finish_map(writer);
+}
+
+// Each returns false if the result is not of the expected type
+inline bool NvimDecodeResult(mpack_reader_t *reader, NvimNoResult *) {
+	MPackSkip(reader);
+	return true;
+}
+inline bool NvimDecodeResult(mpack_reader_t *reader, int64_t *result) {
+	*result = MPackReadInt(reader);
+	return mpack_reader_error(reader) == mpack_ok;
+}
+inline bool NvimDecodeResult(mpack_reader_t *reader, bool *result) {
+	*result = MPackReadBool(reader);
+	return mpack_reader_error(reader) == mpack_ok;
+}
+// Copied, the inbound message is gone by the time the caller resumes
+inline bool NvimDecodeResult(mpack_reader_t *reader, std::string *result) {
+	if (mpack_peek_tag(reader).type != mpack_type_str) {
+		MPackSkip(reader);
+		return false;
+	}
+	MPackString str = MPackReadString(reader);
+	result->assign(str.data, str.length);
+	return true;
+}
+
+template<typename T>
+struct NvimCallResult {
+	NvimResponseStatus status;
+	T value;
+	char error_message[NVIM_CALL_MAX_ERROR_MESSAGE_SIZE];
+};
+
+// Awaitable rpc request, e.g.
+//     NvimCallResult<std::string> guifont = co_await NvimCall<std::string>(
+//         nvim, "nvim_get_option_value", "guifont", NvimEmptyMap {});
+// The request goes out on construction, so several calls can be in flight
+// before the first one is awaited. Must stay in place until it completes,
+// which the coroutine frame takes care of.
+template<typename T>
+struct NvimCall {
+	Nvim *nvim;
+	int64_t msg_id;
+	bool completed;
+	std::coroutine_handle<> continuation;
+	NvimCallResult<T> result;
+
+	template<typename ...Args>
+	NvimCall(Nvim *nvim_in, const char *method, Args ...args) :
+		nvim(nvim_in), completed(false), result {} {
+		mpack_writer_t *writer = NvimBeginMessage(nvim);
+		msg_id = NvimRegisterRequest(nvim, OnResponse, this, NVIM_CALL_DEFAULT_TIMEOUT_MS);
+		MPackStartRequest(msg_id, method, writer);
+		mpack_start_array(writer, sizeof...(Args));
+		(NvimEncodeArg(writer, args), ...);
+		mpack_finish_array(writer);
+		if (!RpcWriterCommit(&nvim->rpc_writer) && !completed) {
+			NvimCancelRequest(nvim, msg_id);
+			Complete(NvimResponseStatus::Dropped);
+		}
+	}
+	~NvimCall() {
+		if (!completed) {
+			NvimCancelRequest(nvim, msg_id);
+		}
+	}
+	NvimCall(const NvimCall &) = delete;
+	NvimCall &operator=(const NvimCall &) = delete;
+
+	bool await_ready() const noexcept {
+		return completed;
+	}
+	void await_suspend(std::coroutine_handle<> handle) noexcept {
+		continuation = handle;
+	}
+	NvimCallResult<T> await_resume() noexcept {
+		return std::move(result);
+	}
+
+	void Complete(NvimResponseStatus status) {
+		result.status = status;
+		completed = true;
+		if (continuation) {
+			std::exchange(continuation, nullptr).resume();
+		}
+	}
+
+	static void OnResponse(Nvim *nvim, const NvimResponse *response, void *user_data) {
+		NvimCall *call = static_cast<NvimCall *>(user_data);
+		NvimResponseStatus status = response->status;
+		if (status == NvimResponseStatus::Ok && !NvimDecodeResult(response->result, &call->result.value)) {
+			status = NvimResponseStatus::Error;
+		}
+
+		size_t error_length = response->error_message.length < NVIM_CALL_MAX_ERROR_MESSAGE_SIZE ?
+			response->error_message.length : NVIM_CALL_MAX_ERROR_MESSAGE_SIZE - 1;
+		memcpy(call->result.error_message, response->error_message.data, error_length);
+		call->result.error_message[error_length] = '\0';
+
+		call->Complete(status);
+	}
+};
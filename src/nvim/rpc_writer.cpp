@@ -0,0 +1,129 @@
+#include "rpc_writer.h"
+
+static void RpcWriterFlushChunk(mpack_writer_t *writer, const char *buffer, size_t count) {
+	RpcWriter *rpc_writer = static_cast<RpcWriter *>(mpack_writer_context(writer));
+	size_t size = rpc_writer->staging.size();
+	rpc_writer->staging.resize(size + count);
+	memcpy(rpc_writer->staging.data() + size, buffer, count);
+}
+
+static void RpcWriterThread(RpcWriter *rpc_writer) {
+	while (true) {
+		uint64_t batch_messages;
+		{
+			std::unique_lock<std::mutex> lock(rpc_writer->mutex);
+			rpc_writer->wake.wait(lock, [rpc_writer] {
+				return rpc_writer->closed || !rpc_writer->pending.empty();
+			});
+			// Only exit once everything queued before closing made it out
+			if (rpc_writer->pending.empty()) {
+				break;
+			}
+
+			rpc_writer->pending.swap(rpc_writer->writing);
+			batch_messages = rpc_writer->pending_messages;
+			rpc_writer->pending_messages = 0;
+		}
+
+		size_t size = rpc_writer->writing.size();
+		bool success = TransportWrite(rpc_writer->transport, rpc_writer->writing.data(), size);
+		rpc_writer->writing.resize(0);
+
+		rpc_writer->writes.fetch_add(1, std::memory_order_relaxed);
+		rpc_writer->bytes_written.fetch_add(size, std::memory_order_relaxed);
+		if (batch_messages > rpc_writer->largest_batch.load(std::memory_order_relaxed)) {
+			rpc_writer->largest_batch.store(batch_messages, std::memory_order_relaxed);
+		}
+
+		if (!success) {
+			// The transport is gone, drop anything queued from now on
+			std::lock_guard<std::mutex> lock(rpc_writer->mutex);
+			rpc_writer->closed = true;
+			rpc_writer->pending.resize(0);
+			break;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(rpc_writer->mutex);
+		rpc_writer->done = true;
+	}
+	rpc_writer->done_signal.notify_one();
+}
+
+void RpcWriterInitialize(RpcWriter *rpc_writer, Transport *transport) {
+	rpc_writer->transport = transport;
+	rpc_writer->closed = false;
+	rpc_writer->done = false;
+	rpc_writer->thread = std::thread(RpcWriterThread, rpc_writer);
+}
+
+void RpcWriterShutdown(RpcWriter *rpc_writer) {
+	if (!rpc_writer->thread.joinable()) {
+		return;
+	}
+
+	// Give already queued messages a chance to go out. If nvim stopped
+	// reading the thread is stuck in a write, cancel it rather than leave
+	// the thread running on an RpcWriter that is about to go away.
+	constexpr auto SHUTDOWN_TIMEOUT = std::chrono::milliseconds(100);
+	{
+		std::unique_lock<std::mutex> lock(rpc_writer->mutex);
+		rpc_writer->closed = true;
+		rpc_writer->wake.notify_one();
+		while (!rpc_writer->done_signal.wait_for(lock, SHUTDOWN_TIMEOUT, [rpc_writer] {
+			return rpc_writer->done;
+		})) {
+			TransportCancelWrite(rpc_writer->transport, &rpc_writer->thread);
+		}
+	}
+	rpc_writer->thread.join();
+}
+
+mpack_writer_t *RpcWriterBegin(RpcWriter *rpc_writer) {
+	rpc_writer->staging.resize(0);
+	mpack_writer_init(&rpc_writer->writer, rpc_writer->chunk, RPC_WRITER_CHUNK_SIZE);
+	mpack_writer_set_context(&rpc_writer->writer, rpc_writer);
+	mpack_writer_set_flush(&rpc_writer->writer, RpcWriterFlushChunk);
+	return &rpc_writer->writer;
+}
+
+bool RpcWriterCommit(RpcWriter *rpc_writer, uint32_t repeat) {
+	if (MPackFinishMessage(&rpc_writer->writer) != mpack_ok) {
+		return false;
+	}
+
+	size_t size = rpc_writer->staging.size();
+	rpc_writer->staging.resize(size * repeat);
+	for (uint32_t i = 1; i < repeat; ++i) {
+		memcpy(rpc_writer->staging.data() + size * i, rpc_writer->staging.data(), size);
+	}
+	return RpcWriterCommitBytes(rpc_writer, rpc_writer->staging.data(), rpc_writer->staging.size(), repeat);
+}
+
+bool RpcWriterCommitBytes(RpcWriter *rpc_writer, const char *data, size_t size, uint32_t message_count) {
+	{
+		std::lock_guard<std::mutex> lock(rpc_writer->mutex);
+		if (rpc_writer->closed) {
+			return false;
+		}
+
+		size_t pending_size = rpc_writer->pending.size();
+		rpc_writer->pending.resize(pending_size + size);
+		memcpy(rpc_writer->pending.data() + pending_size, data, size);
+		rpc_writer->pending_messages += message_count;
+	}
+	rpc_writer->wake.notify_one();
+
+	rpc_writer->messages.fetch_add(message_count, std::memory_order_relaxed);
+	return true;
+}
+
+RpcWriterStats RpcWriterGetStats(RpcWriter *rpc_writer) {
+	return RpcWriterStats {
+		.messages = rpc_writer->messages.load(std::memory_order_relaxed),
+		.writes = rpc_writer->writes.load(std::memory_order_relaxed),
+		.bytes_written = rpc_writer->bytes_written.load(std::memory_order_relaxed),
+		.largest_batch = rpc_writer->largest_batch.load(std::memory_order_relaxed)
+	};
+}
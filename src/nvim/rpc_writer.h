@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "common/mpack_helper.h"
+#include "common/vec.h"
+#include "nvim/transport.h"
+
+constexpr size_t RPC_WRITER_CHUNK_SIZE = 4096;
+
+struct RpcWriterStats {
+	uint64_t messages;
+	// Number of transport writes, every call carries all messages queued since the last
+	uint64_t writes;
+	uint64_t bytes_written;
+	uint64_t largest_batch;
+};
+
+// Outbound side of the rpc channel. Messages are encoded on the calling
+// thread and appended to a pending buffer, a dedicated thread hands
+// everything that accumulated to the transport in a single write. The caller
+// never blocks on a full pipe, and messages have no size limit.
+struct RpcWriter {
+	Transport *transport;
+	std::thread thread;
+
+	// Encoding state, only touched by the thread sending messages.
+	// mpack flushes the chunk into staging whenever it fills up.
+	mpack_writer_t writer;
+	char chunk[RPC_WRITER_CHUNK_SIZE];
+	Vec<char> staging;
+
+	// Guarded by mutex
+	std::mutex mutex;
+	std::condition_variable wake;
+	Vec<char> pending;
+	uint64_t pending_messages;
+	bool closed;
+	// Set by the writer thread right before it returns
+	bool done;
+	std::condition_variable done_signal;
+
+	// Owned by the writer thread, swapped with pending on every wakeup
+	Vec<char> writing;
+
+	std::atomic<uint64_t> messages;
+	std::atomic<uint64_t> writes;
+	std::atomic<uint64_t> bytes_written;
+	std::atomic<uint64_t> largest_batch;
+};
+
+void RpcWriterInitialize(RpcWriter *rpc_writer, Transport *transport);
+void RpcWriterShutdown(RpcWriter *rpc_writer);
+
+// Starts a new message, encode it with the returned writer and
+// hand it off with RpcWriterCommit
+mpack_writer_t *RpcWriterBegin(RpcWriter *rpc_writer);
+// Closes the message's top level array and queues it for writing, repeat times
+// over in one go. Returns false if the message could not be encoded and was dropped.
+bool RpcWriterCommit(RpcWriter *rpc_writer, uint32_t repeat = 1);
+// Queues complete, already encoded messages
+bool RpcWriterCommitBytes(RpcWriter *rpc_writer, const char *data, size_t size, uint32_t message_count = 1);
+
+RpcWriterStats RpcWriterGetStats(RpcWriter *rpc_writer);
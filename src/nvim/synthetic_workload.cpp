@@ -0,0 +1,327 @@
+#include "synthetic_workload.h"
+#include "common/mpack_helper.h"
+#include "common/string_dispatch.h"
+#include "nvim/trace.h"
+
+constexpr StringDispatchEntry<SyntheticWorkload> SYNTHETIC_WORKLOADS[] {
+	{ "repaint", SyntheticWorkload::Repaint },
+	{ "scroll", SyntheticWorkload::Scroll },
+	{ "highlight", SyntheticWorkload::Highlight },
+	{ "wide", SyntheticWorkload::Wide }
+};
+constexpr StringDispatchTable SYNTHETIC_WORKLOAD_TABLE(SYNTHETIC_WORKLOADS, SyntheticWorkload::Unknown);
+static_assert(SYNTHETIC_WORKLOAD_TABLE.valid, "No perfect hash found for the synthetic workloads");
+
+SyntheticWorkload SyntheticWorkloadLookup(const char *name) {
+	return SYNTHETIC_WORKLOAD_TABLE.Lookup(name, strlen(name));
+}
+
+// A grid_line cell, text is empty for the right half of a double width char
+struct SyntheticCell {
+	const char *text;
+	int hl_id; // -1 to keep the previous cell's
+	int repeat;
+};
+
+struct SyntheticLine {
+	SyntheticCell cells[SYNTHETIC_GRID_COLS];
+	int cell_count;
+	int width;
+};
+
+struct SyntheticFrame {
+	mpack_writer_t writer;
+	char *data;
+	size_t size;
+};
+
+// Cheap deterministic noise, workloads come out identical on every run
+static uint32_t SyntheticHash(uint32_t a, uint32_t b, uint32_t c) {
+	uint32_t hash = a * 0x9E3779B1u ^ b * 0x85EBCA77u ^ c * 0xC2B2AE3Du;
+	hash ^= hash >> 15;
+	hash *= 0x2C1B3C6Du;
+	hash ^= hash >> 12;
+	return hash;
+}
+
+static void SyntheticPushCell(SyntheticLine *line, const char *text, int hl_id, int repeat = 1) {
+	line->cells[line->cell_count++] = SyntheticCell { .text = text, .hl_id = hl_id, .repeat = repeat };
+	line->width += repeat;
+}
+
+static void SyntheticPadLine(SyntheticLine *line) {
+	if (line->width < SYNTHETIC_GRID_COLS) {
+		SyntheticPushCell(line, " ", 0, SYNTHETIC_GRID_COLS - line->width);
+	}
+}
+
+static constexpr const char *SYNTHETIC_LETTERS[] {
+	"a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m",
+	"n", "o", "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z",
+	"_", "(", ")", "{", "}", ";", "=", "*", "&", "0", "1", "2", "3"
+};
+static constexpr uint32_t SYNTHETIC_LETTER_COUNT = sizeof(SYNTHETIC_LETTERS) / sizeof(SYNTHETIC_LETTERS[0]);
+
+// Indented source code, words of min_word to min_word + 7 chars,
+// each word highlighted with one of hl_count ids starting at 1
+static void SyntheticCodeLine(SyntheticLine *line, uint32_t seed, uint32_t row,
+	int hl_count, int min_word) {
+	line->cell_count = 0;
+	line->width = 0;
+
+	int indent = static_cast<int>(SyntheticHash(seed, row, 0) % 8) * 4;
+	if (indent > 0) {
+		SyntheticPushCell(line, " ", 0, indent);
+	}
+
+	for (uint32_t word = 1; line->width < SYNTHETIC_GRID_COLS - 16; ++word) {
+		uint32_t hash = SyntheticHash(seed, row, word);
+		int word_length = min_word + static_cast<int>(hash % 8);
+		int hl_id = 1 + static_cast<int>((hash >> 8) % static_cast<uint32_t>(hl_count));
+		for (int i = 0; i < word_length; ++i) {
+			const char *letter = SYNTHETIC_LETTERS[(hash >> (i % 16)) % SYNTHETIC_LETTER_COUNT];
+			SyntheticPushCell(line, letter, i == 0 ? hl_id : -1);
+		}
+		SyntheticPushCell(line, " ", 0);
+	}
+	SyntheticPadLine(line);
+}
+
+static constexpr const char *SYNTHETIC_WIDE_CHARS[] {
+	"\xE6\xBC\xA2", // 漢
+	"\xE5\xAD\x97", // 字
+	"\xE8\xAA\x9E", // 語
+	"\xF0\x9F\x98\x80", // 😀
+	"\xF0\x9F\x9A\x80", // 🚀
+	"\xF0\x9F\x8C\x8D"  // 🌍
+};
+
+static void SyntheticWideLine(SyntheticLine *line, uint32_t seed, uint32_t row) {
+	line->cell_count = 0;
+	line->width = 0;
+
+	for (uint32_t run = 1; line->width < SYNTHETIC_GRID_COLS - 16; ++run) {
+		uint32_t hash = SyntheticHash(seed, row, run);
+		int hl_id = 1 + static_cast<int>(hash % 32);
+		if (hash & 0x100) {
+			// A few double width chars, each followed by its empty right half
+			int char_count = 1 + static_cast<int>((hash >> 9) % 6);
+			for (int i = 0; i < char_count; ++i) {
+				SyntheticPushCell(line, SYNTHETIC_WIDE_CHARS[(hash >> (i * 3)) % 6], i == 0 ? hl_id : -1);
+				SyntheticPushCell(line, "", -1);
+			}
+		}
+		else {
+			int word_length = 2 + static_cast<int>((hash >> 9) % 6);
+			for (int i = 0; i < word_length; ++i) {
+				SyntheticPushCell(line, SYNTHETIC_LETTERS[(hash >> i) % 26], i == 0 ? hl_id : -1);
+			}
+		}
+		SyntheticPushCell(line, " ", 0);
+	}
+	SyntheticPadLine(line);
+}
+
+static mpack_writer_t *SyntheticBeginFrame(SyntheticFrame *frame, uint32_t event_count) {
+	mpack_writer_init_growable(&frame->writer, &frame->data, &frame->size);
+	MPackStartNotification("redraw", &frame->writer);
+	mpack_start_array(&frame->writer, event_count);
+	return &frame->writer;
+}
+
+static void SyntheticFinishFrame(SyntheticFrame *frame, uint64_t timestamp_ns, Vec<char> *trace_out) {
+	mpack_finish_array(&frame->writer);
+	if (MPackFinishMessage(&frame->writer) != mpack_ok) {
+		return;
+	}
+
+	TraceRecord record {
+		.timestamp_ns = timestamp_ns,
+		.size = static_cast<uint32_t>(frame->size),
+		.reserved = 0
+	};
+	size_t padded_size = (frame->size + TRACE_ALIGNMENT - 1) & ~(TRACE_ALIGNMENT - 1);
+	size_t offset = trace_out->size();
+	trace_out->resize(offset + sizeof(record) + padded_size);
+	memcpy(trace_out->data() + offset, &record, sizeof(record));
+	memcpy(trace_out->data() + offset + sizeof(record), frame->data, frame->size);
+	memset(trace_out->data() + offset + sizeof(record) + frame->size, 0, padded_size - frame->size);
+	MPACK_FREE(frame->data);
+}
+
+static void SyntheticStartEvent(mpack_writer_t *writer, const char *name, uint32_t arg_count) {
+	mpack_start_array(writer, arg_count + 1);
+	mpack_write_cstr(writer, name);
+}
+
+static void SyntheticWriteGridLine(mpack_writer_t *writer, int row, const SyntheticLine *line) {
+	mpack_start_array(writer, 4);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, row);
+	mpack_write_int(writer, 0);
+	mpack_start_array(writer, static_cast<uint32_t>(line->cell_count));
+	for (int i = 0; i < line->cell_count; ++i) {
+		const SyntheticCell *cell = &line->cells[i];
+		uint32_t cell_length = cell->repeat > 1 ? 3 : (cell->hl_id >= 0 ? 2 : 1);
+		mpack_start_array(writer, cell_length);
+		mpack_write_cstr(writer, cell->text);
+		if (cell_length > 1) {
+			mpack_write_int(writer, cell->hl_id >= 0 ? cell->hl_id : 0);
+		}
+		if (cell_length > 2) {
+			mpack_write_int(writer, cell->repeat);
+		}
+		mpack_finish_array(writer);
+	}
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+}
+
+static void SyntheticWriteHighlights(mpack_writer_t *writer, int first_id, int count, uint32_t seed) {
+	SyntheticStartEvent(writer, "hl_attr_define", static_cast<uint32_t>(count));
+	for (int id = first_id; id < first_id + count; ++id) {
+		uint32_t hash = SyntheticHash(seed, static_cast<uint32_t>(id), 0);
+		bool has_background = (hash & 0x7) == 0;
+		mpack_start_array(writer, 4);
+		mpack_write_int(writer, id);
+		mpack_start_map(writer, 2 + has_background);
+		mpack_write_cstr(writer, "foreground");
+		mpack_write_u32(writer, hash & 0xFFFFFF);
+		mpack_write_cstr(writer, (hash & 0x1000000) ? "bold" : "italic");
+		mpack_write_bool(writer, (hash & 0x2000000) != 0);
+		if (has_background) {
+			mpack_write_cstr(writer, "background");
+			mpack_write_u32(writer, (hash >> 8) & 0x3F3F3F);
+		}
+		mpack_finish_map(writer);
+		mpack_start_map(writer, 0);
+		mpack_finish_map(writer);
+		mpack_start_array(writer, 0);
+		mpack_finish_array(writer);
+		mpack_finish_array(writer);
+	}
+	mpack_finish_array(writer);
+}
+
+static void SyntheticWriteCursorGoto(mpack_writer_t *writer, int row, int col) {
+	SyntheticStartEvent(writer, "grid_cursor_goto", 1);
+	mpack_start_array(writer, 3);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, row);
+	mpack_write_int(writer, col);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+}
+
+static void SyntheticWriteFlush(mpack_writer_t *writer) {
+	SyntheticStartEvent(writer, "flush", 1);
+	mpack_start_array(writer, 0);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+}
+
+// Grid, colors and highlights, then an empty screen
+static void SyntheticWriteSetup(SyntheticWorkload workload, Vec<char> *trace_out) {
+	SyntheticFrame frame;
+	mpack_writer_t *writer = SyntheticBeginFrame(&frame, 5);
+
+	SyntheticStartEvent(writer, "grid_resize", 1);
+	mpack_start_array(writer, 3);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, SYNTHETIC_GRID_COLS);
+	mpack_write_int(writer, SYNTHETIC_GRID_ROWS);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+
+	SyntheticStartEvent(writer, "default_colors_set", 1);
+	mpack_start_array(writer, 5);
+	mpack_write_u32(writer, 0xD4D4D4);
+	mpack_write_u32(writer, 0x1E1E1E);
+	mpack_write_u32(writer, 0xFF0000);
+	mpack_write_int(writer, 0);
+	mpack_write_int(writer, 0);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+
+	int highlight_count = workload == SyntheticWorkload::Highlight ? SYNTHETIC_HIGHLIGHT_COUNT : 32;
+	SyntheticWriteHighlights(writer, 1, highlight_count, 0);
+
+	SyntheticStartEvent(writer, "grid_clear", 1);
+	mpack_start_array(writer, 1);
+	mpack_write_int(writer, 1);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+
+	SyntheticWriteFlush(writer);
+	SyntheticFinishFrame(&frame, 0, trace_out);
+}
+
+void SyntheticWorkloadGenerate(SyntheticWorkload workload, Vec<char> *trace_out) {
+	trace_out->resize(sizeof(TraceHeader));
+	TraceHeader header { .magic = {}, .version = TRACE_VERSION, .reserved = 0 };
+	memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	memcpy(trace_out->data(), &header, sizeof(header));
+
+	SyntheticWriteSetup(workload, trace_out);
+
+	// Text area above a status line, scrolling moves half of it per frame
+	constexpr int TEXT_ROWS = SYNTHETIC_GRID_ROWS - 1;
+	constexpr int SCROLL_ROWS = TEXT_ROWS / 2;
+
+	SyntheticLine line;
+	for (uint32_t i = 1; i <= SYNTHETIC_FRAME_COUNT; ++i) {
+		SyntheticFrame frame;
+		int first_row = 0;
+		uint32_t event_count = 3;
+		if (workload == SyntheticWorkload::Scroll) {
+			first_row = TEXT_ROWS - SCROLL_ROWS;
+			event_count++;
+		}
+		if (workload == SyntheticWorkload::Highlight) {
+			event_count++;
+		}
+		mpack_writer_t *writer = SyntheticBeginFrame(&frame, event_count);
+
+		if (workload == SyntheticWorkload::Scroll) {
+			SyntheticStartEvent(writer, "grid_scroll", 1);
+			mpack_start_array(writer, 7);
+			mpack_write_int(writer, 1);
+			mpack_write_int(writer, 0);
+			mpack_write_int(writer, TEXT_ROWS);
+			mpack_write_int(writer, 0);
+			mpack_write_int(writer, SYNTHETIC_GRID_COLS);
+			mpack_write_int(writer, SCROLL_ROWS);
+			mpack_write_int(writer, 0);
+			mpack_finish_array(writer);
+			mpack_finish_array(writer);
+		}
+		if (workload == SyntheticWorkload::Highlight) {
+			// Treesitter keeps defining new ids as highlights combine
+			SyntheticWriteHighlights(writer, 1 + static_cast<int>(i * 64) % (SYNTHETIC_HIGHLIGHT_COUNT - 64), 64, i);
+		}
+
+		SyntheticStartEvent(writer, "grid_line", static_cast<uint32_t>(SYNTHETIC_GRID_ROWS - first_row));
+		for (int row = first_row; row < SYNTHETIC_GRID_ROWS; ++row) {
+			// The scrolled in rows continue the buffer, everything else changes every frame
+			uint32_t line_seed = workload == SyntheticWorkload::Scroll ?
+				static_cast<uint32_t>(i * SCROLL_ROWS + row) : i * SYNTHETIC_GRID_ROWS + row;
+			switch (workload) {
+			case SyntheticWorkload::Highlight: {
+				SyntheticCodeLine(&line, line_seed, 0, SYNTHETIC_HIGHLIGHT_COUNT, 1);
+			} break;
+			case SyntheticWorkload::Wide: {
+				SyntheticWideLine(&line, line_seed, 0);
+			} break;
+			default: {
+				SyntheticCodeLine(&line, line_seed, 0, 32, 2);
+			} break;
+			}
+			SyntheticWriteGridLine(writer, row, &line);
+		}
+		mpack_finish_array(writer);
+
+		SyntheticWriteCursorGoto(writer, static_cast<int>(i % TEXT_ROWS), 0);
+		SyntheticWriteFlush(writer);
+		SyntheticFinishFrame(&frame, i * SYNTHETIC_FRAME_INTERVAL_NS, trace_out);
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include "common/vec.h"
+
+constexpr int SYNTHETIC_GRID_ROWS = 120;
+constexpr int SYNTHETIC_GRID_COLS = 400;
+constexpr int SYNTHETIC_FRAME_COUNT = 240;
+constexpr uint64_t SYNTHETIC_FRAME_INTERVAL_NS = 16'666'667;
+// Highlight ids defined up front by the highlight workload
+constexpr int SYNTHETIC_HIGHLIGHT_COUNT = 4096;
+
+enum class SyntheticWorkload : uint8_t {
+	// Every row redrawn every frame
+	Repaint,
+	// Half page grid_scroll per frame, like holding <C-d>
+	Scroll,
+	// Treesitter style screens, short runs across thousands of hl ids
+	Highlight,
+	// Double width CJK and emoji on every row
+	Wide,
+	Unknown
+};
+
+SyntheticWorkload SyntheticWorkloadLookup(const char *name);
+// Fills trace_out with a trace of redraw notifications for the given workload,
+// ready to be replayed like a recorded one. Frames are spaced 60 per second.
+void SyntheticWorkloadGenerate(SyntheticWorkload workload, Vec<char> *trace_out);
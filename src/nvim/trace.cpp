@@ -0,0 +1,174 @@
+#include "trace.h"
+
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr size_t TraceAlign(size_t size) {
+	return (size + TRACE_ALIGNMENT - 1) & ~(TRACE_ALIGNMENT - 1);
+}
+
+static FILE *TraceOpenFile(const char *path) {
+#ifdef _WIN32
+	wchar_t wide_path[MAX_PATH];
+	if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, wide_path, MAX_PATH)) {
+		return nullptr;
+	}
+	FILE *file = nullptr;
+	_wfopen_s(&file, wide_path, L"wb");
+	return file;
+#else
+	return fopen(path, "wb");
+#endif
+}
+
+bool TraceWriterOpen(TraceWriter *writer, const char *path) {
+	writer->file = TraceOpenFile(path);
+	if (!writer->file) {
+		return false;
+	}
+
+	TraceHeader header { .magic = {}, .version = TRACE_VERSION, .reserved = 0 };
+	memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	fwrite(&header, sizeof(header), 1, writer->file);
+	writer->start = std::chrono::steady_clock::now();
+	writer->record_count = 0;
+	return true;
+}
+
+void TraceWriterAppend(TraceWriter *writer, const char *data, size_t size) {
+	constexpr char PADDING[TRACE_ALIGNMENT] {};
+	auto now = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(writer->mutex);
+	if (!writer->file) {
+		return;
+	}
+
+	TraceRecord record {
+		.timestamp_ns = static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(now - writer->start).count()),
+		.size = static_cast<uint32_t>(size),
+		.reserved = 0
+	};
+	fwrite(&record, sizeof(record), 1, writer->file);
+	fwrite(data, 1, size, writer->file);
+	fwrite(PADDING, 1, TraceAlign(size) - size, writer->file);
+	writer->record_count++;
+}
+
+void TraceWriterClose(TraceWriter *writer) {
+	std::lock_guard<std::mutex> lock(writer->mutex);
+	if (writer->file) {
+		fclose(writer->file);
+		writer->file = nullptr;
+	}
+}
+
+static bool TraceReaderValidate(TraceReader *reader) {
+	reader->offset = sizeof(TraceHeader);
+	const TraceHeader *header = reinterpret_cast<const TraceHeader *>(reader->data);
+	return reader->data && reader->size >= sizeof(TraceHeader) &&
+		memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0 && header->version == TRACE_VERSION;
+}
+
+bool TraceReaderOpen(TraceReader *reader, const char *path) {
+#ifdef _WIN32
+	wchar_t wide_path[MAX_PATH];
+	if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, wide_path, MAX_PATH)) {
+		return false;
+	}
+	reader->file = CreateFileW(wide_path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (reader->file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(reader->file, &file_size);
+	reader->size = static_cast<size_t>(file_size.QuadPart);
+	reader->mapping = CreateFileMappingW(reader->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	reader->data = reader->mapping ?
+		static_cast<const char *>(MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat file_stat;
+	fstat(fd, &file_stat);
+	reader->size = static_cast<size_t>(file_stat.st_size);
+	void *mapping = reader->size ? mmap(nullptr, reader->size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	reader->data = mapping != MAP_FAILED ? static_cast<const char *>(mapping) : nullptr;
+	close(fd);
+#endif
+
+	reader->mapped = true;
+	if (!TraceReaderValidate(reader)) {
+		TraceReaderClose(reader);
+		return false;
+	}
+	return true;
+}
+
+bool TraceReaderOpenMemory(TraceReader *reader, const char *data, size_t size) {
+	reader->data = data;
+	reader->size = size;
+	reader->mapped = false;
+	return TraceReaderValidate(reader);
+}
+
+bool TraceReaderNext(TraceReader *reader, TraceMessage *message_out) {
+	if (reader->size - reader->offset < sizeof(TraceRecord)) {
+		return false;
+	}
+
+	const TraceRecord *record = reinterpret_cast<const TraceRecord *>(reader->data + reader->offset);
+	size_t data_offset = reader->offset + sizeof(TraceRecord);
+	if (reader->size - data_offset < record->size) {
+		return false;
+	}
+
+	message_out->timestamp_ns = record->timestamp_ns;
+	message_out->data = reader->data + data_offset;
+	message_out->size = record->size;
+	reader->offset = data_offset + TraceAlign(record->size);
+	if (reader->offset > reader->size) {
+		// Padding of the last record is missing, nothing follows it anyway
+		reader->offset = reader->size;
+	}
+	return true;
+}
+
+void TraceReaderClose(TraceReader *reader) {
+	if (!reader->mapped) {
+		reader->data = nullptr;
+		reader->size = 0;
+		reader->offset = 0;
+		return;
+	}
+
+#ifdef _WIN32
+	if (reader->data) {
+		UnmapViewOfFile(reader->data);
+	}
+	if (reader->mapping) {
+		CloseHandle(reader->mapping);
+	}
+	CloseHandle(reader->file);
+	reader->mapping = nullptr;
+	reader->file = nullptr;
+#else
+	if (reader->data) {
+		munmap(const_cast<char *>(reader->data), reader->size);
+	}
+#endif
+	reader->data = nullptr;
+	reader->size = 0;
+	reader->offset = 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+
+// A trace is the inbound rpc stream as nvim sent it, one record per message.
+// Records are 8 byte aligned so a mapped trace can be read in place:
+//     TraceHeader, then per message TraceRecord followed by size bytes of
+//     data and padding up to the next multiple of 8
+constexpr char TRACE_MAGIC[8] { 'N', 'V', 'Y', 'T', 'R', 'A', 'C', 'E' };
+constexpr uint32_t TRACE_VERSION = 1;
+constexpr size_t TRACE_ALIGNMENT = 8;
+
+struct TraceHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+struct TraceRecord {
+	uint64_t timestamp_ns; // Since the recording started
+	uint32_t size;
+	uint32_t reserved;
+};
+static_assert(sizeof(TraceHeader) % TRACE_ALIGNMENT == 0);
+static_assert(sizeof(TraceRecord) % TRACE_ALIGNMENT == 0);
+
+// Appended to by the reader thread, closed by the window on shutdown
+struct TraceWriter {
+	std::mutex mutex;
+	FILE *file;
+	std::chrono::steady_clock::time_point start;
+	uint64_t record_count;
+};
+
+// Paths are UTF-8
+bool TraceWriterOpen(TraceWriter *writer, const char *path);
+void TraceWriterAppend(TraceWriter *writer, const char *data, size_t size);
+void TraceWriterClose(TraceWriter *writer);
+
+struct TraceMessage {
+	uint64_t timestamp_ns;
+	const char *data; // Points into the mapping
+	size_t size;
+};
+
+struct TraceReader {
+	const char *data;
+	size_t size;
+	size_t offset;
+	bool mapped; // Otherwise data is owned by the caller
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+bool TraceReaderOpen(TraceReader *reader, const char *path);
+// Reads a trace that is already in memory, e.g. a generated one
+bool TraceReaderOpenMemory(TraceReader *reader, const char *data, size_t size);
+// Returns false at the end of the trace. A truncated last record, e.g.
+// from a recording that did not shut down cleanly, ends the trace early.
+bool TraceReaderNext(TraceReader *reader, TraceMessage *message_out);
+void TraceReaderClose(TraceReader *reader);
@@ -0,0 +1,382 @@
+#include "transport.h"
+
+#ifdef _WIN32
+
+bool TransportSpawn(Transport *transport, wchar_t *command_line) {
+	transport->job_object = CreateJobObjectW(nullptr, nullptr);
+	JOBOBJECT_EXTENDED_LIMIT_INFORMATION job_info {
+		.BasicLimitInformation = JOBOBJECT_BASIC_LIMIT_INFORMATION {
+			.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE
+		}
+	};
+	SetInformationJobObject(transport->job_object, JobObjectExtendedLimitInformation, &job_info, sizeof(job_info));
+
+	SECURITY_ATTRIBUTES sec_attribs {
+		.nLength = sizeof(SECURITY_ATTRIBUTES),
+		.bInheritHandle = true
+	};
+	HANDLE stdin_read, stdout_write, stderr_write;
+	CreatePipe(&stdin_read, &transport->write_handle, &sec_attribs, 0);
+	CreatePipe(&transport->read_handle, &stdout_write, &sec_attribs, 0);
+	CreatePipe(&transport->stderr_read, &stderr_write, &sec_attribs, 0);
+
+	STARTUPINFO startup_info {
+		.cb = sizeof(STARTUPINFO),
+		.dwFlags = STARTF_USESTDHANDLES,
+		.hStdInput = stdin_read,
+		.hStdOutput = stdout_write,
+		.hStdError = stderr_write
+	};
+
+	PROCESS_INFORMATION process_info {};
+	BOOL success = CreateProcessW(
+		nullptr,
+		command_line,
+		nullptr,
+		nullptr,
+		true,
+		CREATE_NO_WINDOW,
+		nullptr,
+		nullptr,
+		&startup_info,
+		&process_info
+	);
+	AssignProcessToJobObject(transport->job_object, process_info.hProcess);
+
+	// Close unneeded handles
+	CloseHandle(stdin_read);
+	CloseHandle(stdout_write);
+	CloseHandle(stderr_write);
+	CloseHandle(process_info.hThread);
+
+	transport->process = process_info.hProcess;
+	transport->kind = TransportKind::Pipes;
+	return success != 0;
+}
+
+bool TransportConnect(Transport *transport, const char *address) {
+	wchar_t pipe_name[MAX_PATH];
+	if (!MultiByteToWideChar(CP_UTF8, 0, address, -1, pipe_name, MAX_PATH)) {
+		return false;
+	}
+
+	HANDLE pipe = CreateFileW(pipe_name, GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+		OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+	if (pipe == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	transport->read_handle = pipe;
+	transport->write_handle = pipe;
+	transport->overlapped = true;
+	transport->read_event = CreateEventW(nullptr, true, false, nullptr);
+	transport->write_event = CreateEventW(nullptr, true, false, nullptr);
+	transport->kind = TransportKind::Socket;
+	return true;
+}
+
+void TransportClose(Transport *transport) {
+	if (transport->kind == TransportKind::Pipes) {
+		CloseHandle(transport->write_handle);
+		CloseHandle(transport->read_handle);
+		CloseHandle(transport->stderr_read);
+		TerminateProcess(transport->process, 0);
+		CloseHandle(transport->process);
+	}
+	else if (transport->kind == TransportKind::Socket) {
+		CloseHandle(transport->read_handle);
+		CloseHandle(transport->read_event);
+		CloseHandle(transport->write_event);
+	}
+	transport->kind = TransportKind::None;
+}
+
+static bool TransportFinishIo(HANDLE handle, OVERLAPPED *overlapped, BOOL started, DWORD *bytes) {
+	if (!started && GetLastError() != ERROR_IO_PENDING) {
+		return false;
+	}
+	return GetOverlappedResult(handle, overlapped, bytes, true) != 0;
+}
+
+size_t TransportRead(Transport *transport, char *buffer, size_t size) {
+	DWORD chunk_size = static_cast<DWORD>(size < MAXDWORD ? size : MAXDWORD);
+	DWORD bytes_read = 0;
+	if (transport->overlapped) {
+		OVERLAPPED overlapped { .hEvent = transport->read_event };
+		BOOL started = ReadFile(transport->read_handle, buffer, chunk_size, nullptr, &overlapped);
+		if (!TransportFinishIo(transport->read_handle, &overlapped, started, &bytes_read)) {
+			return 0;
+		}
+	}
+	else if (!ReadFile(transport->read_handle, buffer, chunk_size, &bytes_read, nullptr)) {
+		return 0;
+	}
+	return bytes_read;
+}
+
+bool TransportWrite(Transport *transport, const char *data, size_t size) {
+	// Pipes may accept partial writes, loop until everything is out
+	while (size > 0) {
+		DWORD chunk_size = static_cast<DWORD>(size < MAXDWORD ? size : MAXDWORD);
+		DWORD bytes_written = 0;
+		if (transport->overlapped) {
+			OVERLAPPED *overlapped = &transport->write_overlapped;
+			*overlapped = OVERLAPPED { .hEvent = transport->write_event };
+			BOOL started = WriteFile(transport->write_handle, data, chunk_size, nullptr, overlapped);
+			if (!TransportFinishIo(transport->write_handle, overlapped, started, &bytes_written)) {
+				return false;
+			}
+		}
+		else if (!WriteFile(transport->write_handle, data, chunk_size, &bytes_written, nullptr)) {
+			return false;
+		}
+		data += bytes_written;
+		size -= bytes_written;
+	}
+	return true;
+}
+
+void TransportCancelWrite(Transport *transport, std::thread *writer_thread) {
+	// Only the write, the reader thread shares the handle of a named pipe
+	if (transport->overlapped) {
+		CancelIoEx(transport->write_handle, &transport->write_overlapped);
+	}
+	else {
+		CancelSynchronousIo(writer_thread->native_handle());
+	}
+}
+
+bool TransportGetExitCode(Transport *transport, int *exit_code) {
+	*exit_code = 0;
+	if (transport->kind != TransportKind::Pipes) {
+		return true;
+	}
+
+	DWORD process_exit_code = 0;
+	if (GetExitCodeProcess(transport->process, &process_exit_code) && process_exit_code == STILL_ACTIVE) {
+		return false;
+	}
+	*exit_code = static_cast<int>(process_exit_code);
+	return true;
+}
+
+#else
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static void TransportClosePipe(int fds[2]) {
+	for (int i = 0; i < 2; ++i) {
+		if (fds[i] >= 0) {
+			close(fds[i]);
+			fds[i] = -1;
+		}
+	}
+}
+
+// Neither end is inherited by nvim
+static bool TransportOpenCancelPipe(Transport *transport) {
+	if (pipe(transport->cancel_fds) != 0) {
+		transport->cancel_fds[0] = transport->cancel_fds[1] = -1;
+		return false;
+	}
+	fcntl(transport->cancel_fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(transport->cancel_fds[1], F_SETFD, FD_CLOEXEC);
+	return true;
+}
+
+// A write to nvim after it exited would otherwise kill us with SIGPIPE
+// instead of failing with EPIPE
+static void TransportIgnoreSigpipe() {
+	signal(SIGPIPE, SIG_IGN);
+}
+
+bool TransportSpawn(Transport *transport, char *const argv[]) {
+	int stdin_pipe[2] { -1, -1 }, stdout_pipe[2] { -1, -1 }, stderr_pipe[2] { -1, -1 };
+	if (pipe(stdin_pipe) != 0 || pipe(stdout_pipe) != 0 || pipe(stderr_pipe) != 0 ||
+		!TransportOpenCancelPipe(transport)) {
+		TransportClosePipe(stdin_pipe);
+		TransportClosePipe(stdout_pipe);
+		TransportClosePipe(stderr_pipe);
+		return false;
+	}
+	TransportIgnoreSigpipe();
+
+	posix_spawn_file_actions_t file_actions;
+	posix_spawn_file_actions_init(&file_actions);
+	posix_spawn_file_actions_adddup2(&file_actions, stdin_pipe[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&file_actions, stdout_pipe[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&file_actions, stderr_pipe[1], STDERR_FILENO);
+	posix_spawn_file_actions_addclose(&file_actions, stdin_pipe[1]);
+	posix_spawn_file_actions_addclose(&file_actions, stdout_pipe[0]);
+	posix_spawn_file_actions_addclose(&file_actions, stderr_pipe[0]);
+
+	// Ignored signals stay ignored across exec, nvim should get the default SIGPIPE
+	posix_spawnattr_t spawn_attributes;
+	posix_spawnattr_init(&spawn_attributes);
+	sigset_t default_signals;
+	sigemptyset(&default_signals);
+	sigaddset(&default_signals, SIGPIPE);
+	posix_spawnattr_setsigdefault(&spawn_attributes, &default_signals);
+	posix_spawnattr_setflags(&spawn_attributes, POSIX_SPAWN_SETSIGDEF);
+
+	pid_t pid = 0;
+	int result = posix_spawnp(&pid, argv[0], &file_actions, &spawn_attributes, argv, environ);
+	posix_spawnattr_destroy(&spawn_attributes);
+	posix_spawn_file_actions_destroy(&file_actions);
+
+	// Close unneeded fds
+	close(stdin_pipe[0]);
+	close(stdout_pipe[1]);
+	close(stderr_pipe[1]);
+	if (result != 0) {
+		close(stdin_pipe[1]);
+		close(stdout_pipe[0]);
+		close(stderr_pipe[0]);
+		TransportClosePipe(transport->cancel_fds);
+		transport->kind = TransportKind::None;
+		return false;
+	}
+
+	// Only our end, nvim's stdin stays blocking
+	fcntl(stdin_pipe[1], F_SETFL, fcntl(stdin_pipe[1], F_GETFL) | O_NONBLOCK);
+	transport->write_fd = stdin_pipe[1];
+	transport->read_fd = stdout_pipe[0];
+	transport->stderr_fd = stderr_pipe[0];
+	transport->pid = pid;
+	transport->exit_code = 0;
+	transport->kind = TransportKind::Pipes;
+	return true;
+}
+
+bool TransportConnect(Transport *transport, const char *address) {
+	sockaddr_un socket_address {};
+	socket_address.sun_family = AF_UNIX;
+	size_t address_length = strlen(address);
+	if (address_length >= sizeof(socket_address.sun_path)) {
+		return false;
+	}
+	memcpy(socket_address.sun_path, address, address_length + 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return false;
+	}
+	TransportIgnoreSigpipe();
+	if (connect(fd, reinterpret_cast<sockaddr *>(&socket_address), sizeof(socket_address)) != 0 ||
+		!TransportOpenCancelPipe(transport)) {
+		close(fd);
+		return false;
+	}
+
+	transport->read_fd = fd;
+	transport->write_fd = fd;
+	transport->stderr_fd = -1;
+	transport->pid = 0;
+	transport->exit_code = 0;
+	transport->kind = TransportKind::Socket;
+	return true;
+}
+
+void TransportClose(Transport *transport) {
+	if (transport->kind == TransportKind::Pipes) {
+		close(transport->write_fd);
+		close(transport->read_fd);
+		close(transport->stderr_fd);
+		if (transport->pid > 0) {
+			kill(transport->pid, SIGTERM);
+			waitpid(transport->pid, nullptr, 0);
+			transport->pid = 0;
+		}
+	}
+	else if (transport->kind == TransportKind::Socket) {
+		close(transport->read_fd);
+	}
+	if (transport->kind != TransportKind::None) {
+		TransportClosePipe(transport->cancel_fds);
+	}
+	transport->kind = TransportKind::None;
+}
+
+size_t TransportRead(Transport *transport, char *buffer, size_t size) {
+	while (true) {
+		ssize_t bytes_read = read(transport->read_fd, buffer, size);
+		if (bytes_read >= 0) {
+			return static_cast<size_t>(bytes_read);
+		}
+		if (errno != EINTR) {
+			return 0;
+		}
+	}
+}
+
+bool TransportWrite(Transport *transport, const char *data, size_t size) {
+	while (size > 0) {
+		// Never blocks, a full pipe or socket is waited on below with the cancel pipe
+		ssize_t bytes_written = transport->kind == TransportKind::Socket ?
+			send(transport->write_fd, data, size, MSG_DONTWAIT) :
+			write(transport->write_fd, data, size);
+		if (bytes_written >= 0) {
+			data += bytes_written;
+			size -= static_cast<size_t>(bytes_written);
+			continue;
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			return false;
+		}
+
+		pollfd poll_fds[2] {
+			{ .fd = transport->write_fd, .events = POLLOUT, .revents = 0 },
+			{ .fd = transport->cancel_fds[0], .events = POLLIN, .revents = 0 }
+		};
+		if (poll(poll_fds, 2, -1) < 0 && errno != EINTR) {
+			return false;
+		}
+		if (poll_fds[1].revents) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The byte is never read, so every later write that would block fails as well
+void TransportCancelWrite(Transport *transport, std::thread *) {
+	char cancel = 0;
+	while (write(transport->cancel_fds[1], &cancel, 1) < 0 && errno == EINTR) {}
+}
+
+bool TransportGetExitCode(Transport *transport, int *exit_code) {
+	*exit_code = 0;
+	if (transport->kind != TransportKind::Pipes) {
+		return true;
+	}
+
+	// The status can only be collected once, keep it for later callers
+	if (transport->pid > 0) {
+		int status = 0;
+		pid_t result = waitpid(transport->pid, &status, WNOHANG);
+		if (result == 0) {
+			return false;
+		}
+		// -1 means the process is gone but its status is lost
+		transport->exit_code = result == transport->pid && WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+		transport->pid = 0;
+	}
+	*exit_code = transport->exit_code;
+	return true;
+}
+
+#endif
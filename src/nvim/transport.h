@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+enum class TransportKind : uint8_t {
+	None,
+	// stdio pipes of a spawned `nvim --embed`
+	Pipes,
+	// Attached to a running `nvim --listen`
+	Socket
+};
+
+// The byte stream the rpc channel runs over. Reading happens on the reader
+// thread and writing on the writer thread, both block until done.
+struct Transport {
+	TransportKind kind;
+#ifdef _WIN32
+	HANDLE read_handle;
+	HANDLE write_handle; // Same as read_handle for a named pipe
+	HANDLE stderr_read;
+	HANDLE process;
+	HANDLE job_object;
+	// Named pipes are opened for overlapped io, synchronous io on a single
+	// handle would serialize the reader and the writer thread
+	bool overlapped;
+	HANDLE read_event;
+	HANDLE write_event;
+	OVERLAPPED write_overlapped; // Of the write in progress, so it alone can be cancelled
+#else
+	int read_fd;
+	int write_fd; // Same as read_fd for a socket
+	int stderr_fd;
+	int cancel_fds[2]; // Readable once writes are cancelled, write_fd never blocks
+	pid_t pid; // 0 once the process has been reaped
+	int exit_code;
+#endif
+};
+
+#ifdef _WIN32
+bool TransportSpawn(Transport *transport, wchar_t *command_line);
+#else
+bool TransportSpawn(Transport *transport, char *const argv[]);
+#endif
+// A named pipe path (\\.\pipe\...) on Windows, a unix socket path elsewhere
+bool TransportConnect(Transport *transport, const char *address);
+void TransportClose(Transport *transport);
+
+// Returns the number of bytes read, 0 once the stream is closed or broken
+size_t TransportRead(Transport *transport, char *buffer, size_t size);
+bool TransportWrite(Transport *transport, const char *data, size_t size);
+// Fails the write writer_thread is blocked in, e.g. on a pipe nvim stopped
+// reading from. On Windows a cancel that lands before the write started has
+// no effect, call it until the writer has given up.
+void TransportCancelWrite(Transport *transport, std::thread *writer_thread);
+
+// Returns false while the spawned process is still running. Attached
+// servers have no process of ours, they count as exited successfully.
+bool TransportGetExitCode(Transport *transport, int *exit_code);
@@ -0,0 +1,116 @@
+#include "background_planner.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+static void *BackgroundPlannerReserve(void *array, uint32_t *capacity, uint32_t needed, size_t element_size) {
+	if (needed <= *capacity) {
+		return array;
+	}
+	uint32_t new_capacity = *capacity ? *capacity : 64;
+	while (new_capacity < needed) {
+		new_capacity *= 2;
+	}
+	*capacity = new_capacity;
+	return realloc(array, new_capacity * element_size);
+}
+
+void BackgroundPlannerShutdown(BackgroundPlanner *planner) {
+	free(planner->rects);
+	free(planner->row_runs);
+	free(planner->open);
+	free(planner->next_open);
+	*planner = BackgroundPlanner {};
+}
+
+void BackgroundPlannerBegin(BackgroundPlanner *planner) {
+	planner->rect_count = 0;
+	planner->row_run_count = 0;
+	planner->row = -1;
+	planner->open_count = 0;
+	planner->open_row = -1;
+}
+
+// Both lists are in column order, so one pass pairs every run with the
+// open rect it can extend, if any
+static void BackgroundPlannerStackRow(BackgroundPlanner *planner) {
+	if (planner->row_run_count == 0) {
+		return;
+	}
+
+	if (planner->row != planner->open_row + 1) {
+		planner->open_count = 0;
+	}
+
+	// The two open lists swap every row, so they share one capacity
+	uint32_t open_capacity = planner->open_capacity;
+	planner->open = static_cast<uint32_t *>(BackgroundPlannerReserve(planner->open,
+		&open_capacity, planner->row_run_count, sizeof(uint32_t)));
+	planner->next_open = static_cast<uint32_t *>(BackgroundPlannerReserve(planner->next_open,
+		&planner->open_capacity, planner->row_run_count, sizeof(uint32_t)));
+	planner->rects = static_cast<BackgroundRect *>(BackgroundPlannerReserve(planner->rects,
+		&planner->rect_capacity, planner->rect_count + planner->row_run_count, sizeof(BackgroundRect)));
+
+	uint32_t next_open_count = 0;
+	uint32_t j = 0;
+	for (uint32_t i = 0; i < planner->row_run_count; ++i) {
+		BackgroundRect *run = &planner->row_runs[i];
+		while (j < planner->open_count && planner->rects[planner->open[j]].col_begin < run->col_begin) {
+			j++;
+		}
+
+		if (j < planner->open_count) {
+			BackgroundRect *rect = &planner->rects[planner->open[j]];
+			if (rect->col_begin == run->col_begin && rect->col_end == run->col_end && rect->color == run->color) {
+				rect->row_end = planner->row + 1;
+				planner->next_open[next_open_count++] = planner->open[j++];
+				continue;
+			}
+		}
+
+		planner->rects[planner->rect_count] = *run;
+		planner->next_open[next_open_count++] = planner->rect_count++;
+	}
+
+	std::swap(planner->open, planner->next_open);
+	planner->open_count = next_open_count;
+	planner->open_row = planner->row;
+	planner->row_run_count = 0;
+}
+
+void BackgroundPlannerAddRun(BackgroundPlanner *planner, int row, int col_begin, int col_end, uint32_t color) {
+	assert(row >= planner->row && col_begin < col_end);
+	if (row != planner->row) {
+		BackgroundPlannerStackRow(planner);
+		planner->row = row;
+	}
+
+	if (planner->row_run_count > 0) {
+		BackgroundRect *last = &planner->row_runs[planner->row_run_count - 1];
+		if (last->col_end == col_begin && last->color == color) {
+			last->col_end = col_end;
+			return;
+		}
+	}
+
+	planner->row_runs = static_cast<BackgroundRect *>(BackgroundPlannerReserve(planner->row_runs,
+		&planner->row_run_capacity, planner->row_run_count + 1, sizeof(BackgroundRect)));
+	planner->row_runs[planner->row_run_count++] = BackgroundRect {
+		.color = color,
+		.row_begin = row,
+		.row_end = row + 1,
+		.col_begin = col_begin,
+		.col_end = col_end
+	};
+}
+
+void BackgroundPlannerFinish(BackgroundPlanner *planner) {
+	BackgroundPlannerStackRow(planner);
+
+	// Rects never overlap, so any order paints the same picture
+	std::sort(planner->rects, planner->rects + planner->rect_count, [](const BackgroundRect &a, const BackgroundRect &b) {
+		if (a.color != b.color) return a.color < b.color;
+		if (a.row_begin != b.row_begin) return a.row_begin < b.row_begin;
+		return a.col_begin < b.col_begin;
+	});
+}
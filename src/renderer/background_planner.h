@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+
+// Turns the highlight runs of a batch of rows into few background fills.
+// Touching runs of one color within a row are joined, identical runs on
+// consecutive rows are stacked into one rect, and the result is sorted
+// by color so every color needs a single brush change. Coordinates are
+// in cells, colors are opaque.
+struct BackgroundRect {
+	uint32_t color;
+	int row_begin;
+	int row_end;
+	int col_begin;
+	int col_end;
+};
+
+struct BackgroundPlanner {
+	BackgroundRect *rects;
+	uint32_t rect_count;
+	uint32_t rect_capacity;
+
+	// The row being added, joined horizontally as runs come in
+	BackgroundRect *row_runs;
+	uint32_t row_run_count;
+	uint32_t row_run_capacity;
+	int row;
+
+	// Rects reaching down to the last finished row, in column order.
+	// Only these can be stacked onto by the next row.
+	uint32_t *open;
+	uint32_t *next_open;
+	uint32_t open_count;
+	uint32_t open_capacity;
+	int open_row;
+};
+
+void BackgroundPlannerShutdown(BackgroundPlanner *planner);
+// Starts a new batch, the rects of the last one are dropped
+void BackgroundPlannerBegin(BackgroundPlanner *planner);
+// Columns [col_begin, col_end) of row are filled with color. Rows go in
+// ascending order, gaps allowed, and runs within a row left to right.
+void BackgroundPlannerAddRun(BackgroundPlanner *planner, int row, int col_begin, int col_end, uint32_t color);
+// Stacks the last row and sorts the rects by color, ready to fill
+void BackgroundPlannerFinish(BackgroundPlanner *planner);
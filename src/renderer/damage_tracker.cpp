@@ -0,0 +1,114 @@
+#include "damage_tracker.h"
+#include <algorithm>
+#include <cstring>
+
+static bool DamageRectContains(const DamageRect *outer, const DamageRect *inner) {
+	return outer->left <= inner->left && outer->top <= inner->top &&
+		outer->right >= inner->right && outer->bottom >= inner->bottom;
+}
+
+// Joins two rects if their union is a rect itself, i.e. they share a side
+// and touch or overlap along it, or one holds the other
+static bool DamageRectTryJoin(DamageRect *into, const DamageRect *rect) {
+	if (DamageRectContains(into, rect)) {
+		return true;
+	}
+	if (DamageRectContains(rect, into)) {
+		*into = *rect;
+		return true;
+	}
+	if (into->left == rect->left && into->right == rect->right &&
+		into->top <= rect->bottom && rect->top <= into->bottom) {
+		into->top = std::min(into->top, rect->top);
+		into->bottom = std::max(into->bottom, rect->bottom);
+		return true;
+	}
+	if (into->top == rect->top && into->bottom == rect->bottom &&
+		into->left <= rect->right && rect->left <= into->right) {
+		into->left = std::min(into->left, rect->left);
+		into->right = std::max(into->right, rect->right);
+		return true;
+	}
+	return false;
+}
+
+// Joins rects until no pair can be joined, returns the new count
+static uint32_t DamageRectsJoin(DamageRect *rects, uint32_t count) {
+	bool joined = true;
+	while (joined) {
+		joined = false;
+		for (uint32_t i = 0; i < count; ++i) {
+			for (uint32_t j = i + 1; j < count;) {
+				if (DamageRectTryJoin(&rects[i], &rects[j])) {
+					rects[j] = rects[--count];
+					joined = true;
+				}
+				else {
+					++j;
+				}
+			}
+		}
+	}
+	return count;
+}
+
+void DamageTrackerBeginFrame(DamageTracker *tracker, int width, int height) {
+	memcpy(tracker->previous_rects, tracker->rects, tracker->rect_count * sizeof(DamageRect));
+	tracker->previous_rect_count = tracker->rect_count;
+	tracker->previous_full = tracker->full;
+
+	tracker->rect_count = 0;
+	tracker->full = false;
+	if (tracker->width != width || tracker->height != height) {
+		tracker->width = width;
+		tracker->height = height;
+		DamageTrackerAddFull(tracker);
+	}
+}
+
+void DamageTrackerAdd(DamageTracker *tracker, DamageRect rect) {
+	rect.left = std::max(rect.left, 0);
+	rect.top = std::max(rect.top, 0);
+	rect.right = std::min(rect.right, tracker->width);
+	rect.bottom = std::min(rect.bottom, tracker->height);
+	if (tracker->full || rect.left >= rect.right || rect.top >= rect.bottom) {
+		return;
+	}
+
+	// Rows come in order, so most rects extend the one before
+	if (tracker->rect_count > 0 && DamageRectTryJoin(&tracker->rects[tracker->rect_count - 1], &rect)) {
+		return;
+	}
+	if (tracker->rect_count == DAMAGE_TRACKER_MAX_RECTS) {
+		DamageTrackerAddFull(tracker);
+		return;
+	}
+	tracker->rects[tracker->rect_count++] = rect;
+}
+
+void DamageTrackerAddFull(DamageTracker *tracker) {
+	tracker->full = true;
+	tracker->rects[0] = DamageRect { .left = 0, .top = 0, .right = tracker->width, .bottom = tracker->height };
+	tracker->rect_count = 1;
+}
+
+void DamageTrackerFinishFrame(DamageTracker *tracker) {
+	tracker->rect_count = DamageRectsJoin(tracker->rects, tracker->rect_count);
+
+	if (tracker->full || tracker->previous_full) {
+		tracker->copy_rects[0] = DamageRect { .left = 0, .top = 0, .right = tracker->width, .bottom = tracker->height };
+		tracker->copy_rect_count = 1;
+	}
+	else {
+		memcpy(tracker->copy_rects, tracker->rects, tracker->rect_count * sizeof(DamageRect));
+		memcpy(tracker->copy_rects + tracker->rect_count, tracker->previous_rects, tracker->previous_rect_count * sizeof(DamageRect));
+		tracker->copy_rect_count = DamageRectsJoin(tracker->copy_rects, tracker->rect_count + tracker->previous_rect_count);
+	}
+
+	tracker->frame_pixels = 0;
+	for (uint32_t i = 0; i < tracker->copy_rect_count; ++i) {
+		DamageRect *rect = &tracker->copy_rects[i];
+		tracker->frame_pixels += static_cast<uint64_t>(rect->right - rect->left) * (rect->bottom - rect->top);
+	}
+	tracker->pixels_touched += tracker->frame_pixels;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Which parts of the window changed from one frame to the next, in pixels.
+// With two buffers in the flip chain, the back buffer being drawn into last
+// held the frame before the previous one, so it is brought up to date by
+// copying both this frame's damage and the last frame's.
+constexpr uint32_t DAMAGE_TRACKER_MAX_RECTS = 32; // Any more and the frame counts as full
+
+struct DamageRect {
+	int left;
+	int top;
+	int right;
+	int bottom;
+};
+
+struct DamageTracker {
+	int width;
+	int height;
+
+	// This frame's damage, what the present is told about
+	DamageRect rects[DAMAGE_TRACKER_MAX_RECTS];
+	uint32_t rect_count;
+	bool full;
+
+	DamageRect previous_rects[DAMAGE_TRACKER_MAX_RECTS];
+	uint32_t previous_rect_count;
+	bool previous_full;
+
+	// This frame's damage and the last, what the back buffer needs copied
+	DamageRect copy_rects[DAMAGE_TRACKER_MAX_RECTS * 2];
+	uint32_t copy_rect_count;
+
+	uint64_t frame_pixels; // Pixels in copy_rects
+	uint64_t pixels_touched; // frame_pixels summed over every frame
+};
+
+// Starts a frame of the given size. A size change damages the whole frame.
+void DamageTrackerBeginFrame(DamageTracker *tracker, int width, int height);
+void DamageTrackerAdd(DamageTracker *tracker, DamageRect rect);
+void DamageTrackerAddFull(DamageTracker *tracker);
+// Tidies up the damage and works out copy_rects
+void DamageTrackerFinishFrame(DamageTracker *tracker);
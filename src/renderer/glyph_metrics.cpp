@@ -0,0 +1,90 @@
+#include "glyph_metrics.h"
+#include <cstdlib>
+#include <cstring>
+
+void GlyphMetricsCacheShutdown(GlyphMetricsCache *cache) {
+	for (uint32_t i = 0; i < GLYPH_METRICS_PAGE_COUNT; ++i) {
+		free(cache->pages[i]);
+		cache->pages[i] = nullptr;
+	}
+	free(cache->map);
+	cache->map = nullptr;
+	cache->map_capacity = 0;
+	cache->map_count = 0;
+}
+
+void GlyphMetricsCacheClear(GlyphMetricsCache *cache) {
+	// Keep the memory, the new font is likely to need the same pages
+	for (uint32_t i = 0; i < GLYPH_METRICS_PAGE_COUNT; ++i) {
+		if (cache->pages[i]) {
+			memset(cache->pages[i], 0, GLYPH_METRICS_PAGE_SIZE * sizeof(GlyphMetrics));
+		}
+	}
+	if (cache->map) {
+		memset(cache->map, 0, cache->map_capacity * sizeof(GlyphMetricsMapEntry));
+	}
+	cache->map_count = 0;
+}
+
+static GlyphMetricsMapEntry *GlyphMetricsMapSlot(GlyphMetricsMapEntry *map, uint32_t capacity, uint32_t codepoint) {
+	uint32_t mask = capacity - 1;
+	uint32_t index = (codepoint * 0x9E3779B1u) >> 8;
+	while (true) {
+		GlyphMetricsMapEntry *entry = &map[index & mask];
+		if (entry->codepoint == codepoint || entry->codepoint == 0) {
+			return entry;
+		}
+		index++;
+	}
+}
+
+static void GlyphMetricsMapGrow(GlyphMetricsCache *cache) {
+	uint32_t capacity = cache->map_capacity ? cache->map_capacity * 2 : GLYPH_METRICS_MAP_INITIAL_CAPACITY;
+	auto map = static_cast<GlyphMetricsMapEntry *>(calloc(capacity, sizeof(GlyphMetricsMapEntry)));
+	for (uint32_t i = 0; i < cache->map_capacity; ++i) {
+		if (cache->map[i].codepoint) {
+			*GlyphMetricsMapSlot(map, capacity, cache->map[i].codepoint) = cache->map[i];
+		}
+	}
+	free(cache->map);
+	cache->map = map;
+	cache->map_capacity = capacity;
+}
+
+GlyphMetrics *GlyphMetricsFind(GlyphMetricsCache *cache, uint32_t codepoint) {
+	if (codepoint < 0x10000) {
+		GlyphMetrics **page = &cache->pages[codepoint / GLYPH_METRICS_PAGE_SIZE];
+		if (!*page) {
+			*page = static_cast<GlyphMetrics *>(calloc(GLYPH_METRICS_PAGE_SIZE, sizeof(GlyphMetrics)));
+		}
+		return &(*page)[codepoint % GLYPH_METRICS_PAGE_SIZE];
+	}
+
+	// Stay at most half full so probes stay short
+	if ((cache->map_count + 1) * 2 > cache->map_capacity) {
+		GlyphMetricsMapGrow(cache);
+	}
+	GlyphMetricsMapEntry *entry = GlyphMetricsMapSlot(cache->map, cache->map_capacity, codepoint);
+	if (entry->codepoint == 0) {
+		entry->codepoint = codepoint;
+		cache->map_count++;
+	}
+	return &entry->metrics;
+}
+
+const GlyphMetrics *GlyphMetricsPeek(const GlyphMetricsCache *cache, uint32_t codepoint) {
+	const GlyphMetrics *metrics = nullptr;
+	if (codepoint < 0x10000) {
+		const GlyphMetrics *page = cache->pages[codepoint / GLYPH_METRICS_PAGE_SIZE];
+		if (page) {
+			metrics = &page[codepoint % GLYPH_METRICS_PAGE_SIZE];
+		}
+	}
+	else if (cache->map) {
+		GlyphMetricsMapEntry *entry = GlyphMetricsMapSlot(cache->map, cache->map_capacity, codepoint);
+		if (entry->codepoint == codepoint) {
+			metrics = &entry->metrics;
+		}
+	}
+	return metrics && (metrics->flags & GLYPH_METRICS_MEASURED) ? metrics : nullptr;
+}
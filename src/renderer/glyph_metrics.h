@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+
+// What shaping needs to know about a codepoint in the current font,
+// measured once and kept until the font changes
+enum GlyphMetricsFlags : uint32_t {
+	GLYPH_METRICS_MEASURED = 1 << 0,
+	GLYPH_METRICS_COVERED = 1 << 1 // The primary font has a glyph, no fallback needed
+};
+struct GlyphMetrics {
+	float advance;
+	uint32_t flags;
+};
+
+// The BMP is a flat table split into pages that are allocated on first use,
+// anything beyond it goes into a small open addressed map
+constexpr uint32_t GLYPH_METRICS_PAGE_SIZE = 256;
+constexpr uint32_t GLYPH_METRICS_PAGE_COUNT = 0x10000 / GLYPH_METRICS_PAGE_SIZE;
+constexpr uint32_t GLYPH_METRICS_MAP_INITIAL_CAPACITY = 64;
+
+struct GlyphMetricsMapEntry {
+	uint32_t codepoint; // 0 marks an empty slot, U+0000 lives in the BMP pages
+	GlyphMetrics metrics;
+};
+
+struct GlyphMetricsCache {
+	GlyphMetrics *pages[GLYPH_METRICS_PAGE_COUNT];
+	GlyphMetricsMapEntry *map;
+	uint32_t map_capacity;
+	uint32_t map_count;
+};
+
+void GlyphMetricsCacheShutdown(GlyphMetricsCache *cache);
+// Forgets every measurement, for when the font, its size or the DPI change
+void GlyphMetricsCacheClear(GlyphMetricsCache *cache);
+// The slot for codepoint, zeroed if it has not been measured yet
+GlyphMetrics *GlyphMetricsFind(GlyphMetricsCache *cache, uint32_t codepoint);
+// nullptr if codepoint has not been measured yet. Never allocates, so any
+// number of threads can peek as long as nothing is measured meanwhile.
+const GlyphMetrics *GlyphMetricsPeek(const GlyphMetricsCache *cache, uint32_t codepoint);
@@ -1,5 +1,6 @@
 #include "glyph_renderer.h"
 #include "renderer/renderer.h"
+#include <algorithm>
 
 HRESULT GlyphDrawingEffect::QueryInterface(REFIID riid, void **ppv_object) noexcept {
 	if (__uuidof(GlyphDrawingEffect) == riid) {
@@ -38,11 +39,11 @@ HRESULT GlyphRenderer::DrawGlyphRun(void *client_drawing_context, float baseline
 	{
 		GlyphDrawingEffect *drawing_effect;
 		client_drawing_effect->QueryInterface(__uuidof(GlyphDrawingEffect), reinterpret_cast<void **>(&drawing_effect));
-		drawing_effect_brush->SetColor(D2D1::ColorF(drawing_effect->text_color));
+		drawing_effect_brush->SetColor(drawing_effect->text_color);
 		SafeRelease(&drawing_effect);
 	}
 	else {
-		drawing_effect_brush->SetColor(D2D1::ColorF(renderer->hl_attribs[0].foreground));
+		drawing_effect_brush->SetColor(D2D1::ColorF(renderer->frame->hl_attribs[0].foreground));
 	}
 
 	DWRITE_GLYPH_IMAGE_FORMATS supported_formats =
@@ -165,12 +166,11 @@ HRESULT GlyphRenderer::DrawLine(void *client_drawing_context, float baseline_ori
 	{
 		GlyphDrawingEffect *drawing_effect;
 		client_drawing_effect->QueryInterface(__uuidof(GlyphDrawingEffect), reinterpret_cast<void **>(&drawing_effect));
-		uint32_t line_color = use_special_color ? drawing_effect->special_color : drawing_effect->text_color;
-		temp_brush->SetColor(D2D1::ColorF(line_color));
+		temp_brush->SetColor(use_special_color ? drawing_effect->special_color : drawing_effect->text_color);
 		SafeRelease(&drawing_effect);
 	}
 	else {
-		uint32_t line_color = use_special_color ? renderer->hl_attribs[0].special : renderer->hl_attribs[0].foreground;
+		uint32_t line_color = use_special_color ? renderer->frame->hl_attribs[0].special : renderer->frame->hl_attribs[0].foreground;
 		temp_brush->SetColor(D2D1::ColorF(line_color));
 	} 
 
@@ -178,7 +178,7 @@ HRESULT GlyphRenderer::DrawLine(void *client_drawing_context, float baseline_ori
 		.left = baseline_origin_x,
 		.top = baseline_origin_y + offset,
 		.right = baseline_origin_x + width,
-		.bottom = baseline_origin_y + offset + max(thickness, 1.0f)
+		.bottom = baseline_origin_y + offset + std::max(thickness, 1.0f)
 	};
 
     renderer->d2d_context->FillRectangle(rect, temp_brush);
@@ -0,0 +1,117 @@
+#include "grapheme_table.h"
+#include "common/string_dispatch.h"
+#include "common/utf8.h"
+#include <cstdlib>
+#include <cstring>
+
+void GraphemeTableInitialize(GraphemeTable *table) {
+	table->entries = static_cast<GraphemeEntry *>(calloc(GRAPHEME_TABLE_CAPACITY, sizeof(GraphemeEntry)));
+	table->used_count = 0;
+	table->removed_count = 0;
+	table->generation = 0;
+	table->version = 0;
+	table->reuse_version = 0;
+}
+
+void GraphemeTableShutdown(GraphemeTable *table) {
+	free(table->entries);
+	table->entries = nullptr;
+}
+
+void GraphemeTableClear(GraphemeTable *table) {
+	if (table->used_count == 0 && table->removed_count == 0) {
+		return;
+	}
+	for (uint32_t i = 0; i < GRAPHEME_TABLE_CAPACITY; ++i) {
+		table->entries[i].slot = GraphemeSlot::Empty;
+	}
+	table->used_count = 0;
+	table->removed_count = 0;
+	table->version++;
+	table->reuse_version++;
+}
+
+uint32_t GraphemeIntern(GraphemeTable *table, const char *text, size_t length) {
+	if (length > GRAPHEME_MAX_LENGTH) {
+		return UTF8_UNSUPPORTED_CELL;
+	}
+
+	uint32_t hash = HashString(text, length, 0);
+	uint32_t mask = GRAPHEME_TABLE_CAPACITY - 1;
+	GraphemeEntry *free_entry = nullptr;
+	for (uint32_t probe = 0; probe < GRAPHEME_TABLE_CAPACITY; ++probe) {
+		uint32_t index = (hash + probe) & mask;
+		GraphemeEntry *entry = &table->entries[index];
+		if (entry->slot == GraphemeSlot::Used) {
+			if (entry->hash == hash && entry->length == length && memcmp(entry->text, text, length) == 0) {
+				return GRAPHEME_ID_FLAG | index;
+			}
+			continue;
+		}
+
+		if (!free_entry) {
+			free_entry = entry;
+		}
+		if (entry->slot == GraphemeSlot::Empty) {
+			break;
+		}
+	}
+
+	if (!free_entry) {
+		return UTF8_UNSUPPORTED_CELL;
+	}
+
+	// Convert once here so drawing can copy the UTF-16 straight out
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(text);
+	uint32_t utf16_length = 0;
+	for (size_t i = 0; i < length;) {
+		uint32_t codepoint;
+		i += Utf8DecodeCodepoint(bytes + i, length - i, &codepoint);
+		utf16_length += Utf16Encode(codepoint, &free_entry->utf16[utf16_length]);
+		if (utf16_length + 2 > GRAPHEME_MAX_LENGTH) {
+			break;
+		}
+	}
+
+	if (free_entry->slot == GraphemeSlot::Removed) {
+		table->removed_count--;
+	}
+	table->used_count++;
+	free_entry->slot = GraphemeSlot::Used;
+	free_entry->length = static_cast<uint8_t>(length);
+	free_entry->utf16_length = static_cast<uint8_t>(utf16_length);
+	free_entry->hash = hash;
+	free_entry->generation = table->generation;
+	memcpy(free_entry->text, text, length);
+	table->version++;
+	return GRAPHEME_ID_FLAG | static_cast<uint32_t>(free_entry - table->entries);
+}
+
+void GraphemeSweep(GraphemeTable *table) {
+	// Anything not marked since the last sweep is gone from the grid
+	table->generation++;
+	for (uint32_t i = 0; i < GRAPHEME_TABLE_CAPACITY; ++i) {
+		GraphemeEntry *entry = &table->entries[i];
+		if (entry->slot == GraphemeSlot::Used && entry->generation != table->generation) {
+			entry->slot = GraphemeSlot::Removed;
+			table->used_count--;
+			table->removed_count++;
+		}
+	}
+
+	// A tombstone followed by an empty slot ends no probe chain and can be
+	// emptied as well. Walking backwards, twice around for the wrap, clears
+	// whole runs of them in one pass.
+	uint32_t mask = GRAPHEME_TABLE_CAPACITY - 1;
+	for (uint32_t n = 0; n < GRAPHEME_TABLE_CAPACITY * 2; ++n) {
+		uint32_t i = (GRAPHEME_TABLE_CAPACITY * 2 - 1 - n) & mask;
+		if (table->entries[i].slot == GraphemeSlot::Removed &&
+			table->entries[(i + 1) & mask].slot == GraphemeSlot::Empty) {
+			table->entries[i].slot = GraphemeSlot::Empty;
+			table->removed_count--;
+		}
+	}
+	table->sweep_count++;
+	table->version++;
+	table->reuse_version++;
+}
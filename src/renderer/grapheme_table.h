@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Cells usually hold a single codepoint. Text made of several codepoints,
+// e.g. a letter followed by combining marks, is interned instead and the
+// cell holds its id, which keeps grid cells fixed size.
+constexpr uint32_t GRAPHEME_ID_FLAG = 0x80000000;
+// nvim caps cell text at 32 bytes
+constexpr size_t GRAPHEME_MAX_LENGTH = 32;
+constexpr uint32_t GRAPHEME_TABLE_CAPACITY = 4096;
+static_assert((GRAPHEME_TABLE_CAPACITY & (GRAPHEME_TABLE_CAPACITY - 1)) == 0);
+// Once this many slots are taken, unused graphemes are swept out
+constexpr uint32_t GRAPHEME_SWEEP_THRESHOLD = GRAPHEME_TABLE_CAPACITY / 4 * 3;
+
+enum class GraphemeSlot : uint8_t {
+	Empty,
+	Used,
+	Removed // Keeps probe chains intact, reused by the next insert
+};
+
+struct GraphemeEntry {
+	GraphemeSlot slot;
+	uint8_t length;
+	uint8_t utf16_length;
+	uint32_t hash;
+	uint32_t generation; // Last sweep that found the entry on the grid
+	char text[GRAPHEME_MAX_LENGTH];
+	wchar_t utf16[GRAPHEME_MAX_LENGTH];
+};
+
+// Open addressed, an id is the slot index so entries never move
+struct GraphemeTable {
+	GraphemeEntry *entries;
+	uint32_t used_count;
+	uint32_t removed_count;
+	uint32_t generation;
+	uint64_t sweep_count;
+	uint64_t version; // Bumped by every change to the entries
+	uint64_t reuse_version; // Bumped when an id may come to stand for other text
+};
+
+inline bool IsGraphemeId(uint32_t cell) {
+	return (cell & GRAPHEME_ID_FLAG) != 0;
+}
+
+void GraphemeTableInitialize(GraphemeTable *table);
+void GraphemeTableShutdown(GraphemeTable *table);
+// Drops every entry, for when no cell refers to any of them anymore
+void GraphemeTableClear(GraphemeTable *table);
+
+// Returns the id for text, or U+25A1 if it is too long or the table is full
+uint32_t GraphemeIntern(GraphemeTable *table, const char *text, size_t length);
+inline const GraphemeEntry *GraphemeLookup(GraphemeTable *table, uint32_t id) {
+	return &table->entries[id & ~GRAPHEME_ID_FLAG];
+}
+
+// Once the table is filling up, every id still on the grid is marked live
+// and GraphemeSweep frees the rest
+inline bool GraphemeNeedsSweep(GraphemeTable *table) {
+	return table->used_count + table->removed_count >= GRAPHEME_SWEEP_THRESHOLD;
+}
+inline void GraphemeMarkLive(GraphemeTable *table, uint32_t id) {
+	table->entries[id & ~GRAPHEME_ID_FLAG].generation = table->generation + 1;
+}
+void GraphemeSweep(GraphemeTable *table);
@@ -0,0 +1,594 @@
+#include "grid_model.h"
+#include "common/string_dispatch.h"
+#include "common/utf8.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GRID_MODEL_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define GRID_MODEL_NEON
+#endif
+
+void GridModelInitialize(GridModel *model, const GridModelHooks *hooks) {
+	model->hooks = *hooks;
+	HighlightRemapInitialize(&model->hl_remap, MAX_HIGHLIGHT_ATTRIBS);
+	model->hl_attribs.push_back(HighlightAttributes {});
+	model->hl_attrib_defined.push_back(true);
+	GraphemeTableInitialize(&model->grapheme_table);
+}
+
+void GridModelShutdown(GridModel *model) {
+	free(model->grid_cells);
+	free(model->grid_row_cells);
+	free(model->grid_row_versions);
+	GraphemeTableShutdown(&model->grapheme_table);
+	HighlightRemapShutdown(&model->hl_remap);
+}
+
+void FillGridCells(GridCell *cells, GridCell value, size_t count) {
+	size_t i = 0;
+	uint64_t packed;
+	memcpy(&packed, &value, sizeof(packed));
+#if defined(GRID_MODEL_SSE2)
+	__m128i values = _mm_set1_epi64x(static_cast<int64_t>(packed));
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(cells + i), values);
+	}
+#elif defined(GRID_MODEL_NEON)
+	uint64x2_t values = vdupq_n_u64(packed);
+	for (; i + 2 <= count; i += 2) {
+		vst1q_u64(reinterpret_cast<uint64_t *>(cells + i), values);
+	}
+#endif
+	for (; i < count; ++i) {
+		cells[i] = value;
+	}
+}
+
+// Rows are only ever drawn at flush, marking one that already changed
+// since the last flush saves the draw that used to happen right away.
+// The render thread redraws whichever rows' versions moved past the ones
+// it drew, however many snapshots it skipped.
+static void GridModelMarkRowDirty(GridModel *model, int row) {
+	if (model->grid_row_versions[row] > model->published_grid_version) {
+		model->redundant_draw_count++;
+	}
+	model->grid_row_versions[row] = ++model->grid_version;
+}
+
+static void GridModelMarkGridDirty(GridModel *model) {
+	for (int i = 0; i < model->grid_rows; ++i) {
+		GridModelMarkRowDirty(model, i);
+	}
+}
+
+static void GridModelUpdateDefaultColors(GridModel *model, mpack_reader_t *reader, uint32_t default_colors_count) {
+	for (uint32_t i = 0; i < default_colors_count; ++i) {
+		uint32_t color_arr_length = MPackReadArray(reader);
+
+		// Default colors occupy the first index of the highlight attribs array
+		model->hl_attribs[0].foreground = MPackReadColor(reader);
+		model->hl_attribs[0].background = MPackReadColor(reader);
+		model->hl_attribs[0].special = MPackReadColor(reader);
+		model->hl_attribs[0].flags = 0;
+		MPackFinishArray(reader, color_arr_length, 3);
+	}
+
+	// Every default colored run has its color baked into cached layouts
+	model->hl_version++;
+	model->hl_style_version++;
+	model->grid_invalidate_version++;
+}
+
+// New ids look like the defaults until hl_attr_define describes them
+static uint16_t GridModelGetHighlightAttribId(GridModel *model, int64_t nvim_hl_id) {
+	uint16_t hl_attrib_id = HighlightRemapGet(&model->hl_remap, nvim_hl_id);
+	while (model->hl_attribs.size() <= hl_attrib_id) {
+		model->hl_attribs.push_back(HighlightAttributes {
+			.foreground = DEFAULT_COLOR,
+			.background = DEFAULT_COLOR,
+			.special = DEFAULT_COLOR,
+			.flags = 0
+		});
+		model->hl_attrib_defined.push_back(false);
+		model->hl_version++;
+	}
+	return hl_attrib_id;
+}
+
+enum class HighlightAttributeKey : uint8_t {
+	Foreground,
+	Background,
+	Special,
+	Reverse,
+	Italic,
+	Bold,
+	Strikethrough,
+	Underline,
+	Undercurl,
+	Unknown
+};
+constexpr StringDispatchEntry<HighlightAttributeKey> HIGHLIGHT_ATTRIBUTE_KEYS[] {
+	{ "foreground", HighlightAttributeKey::Foreground },
+	{ "background", HighlightAttributeKey::Background },
+	{ "special", HighlightAttributeKey::Special },
+	{ "reverse", HighlightAttributeKey::Reverse },
+	{ "italic", HighlightAttributeKey::Italic },
+	{ "bold", HighlightAttributeKey::Bold },
+	{ "strikethrough", HighlightAttributeKey::Strikethrough },
+	{ "underline", HighlightAttributeKey::Underline },
+	{ "undercurl", HighlightAttributeKey::Undercurl }
+};
+constexpr StringDispatchTable HIGHLIGHT_ATTRIBUTE_KEY_TABLE(HIGHLIGHT_ATTRIBUTE_KEYS, HighlightAttributeKey::Unknown);
+static_assert(HIGHLIGHT_ATTRIBUTE_KEY_TABLE.valid, "No perfect hash found for the highlight attribute keys");
+
+static void GridModelUpdateHighlightAttributes(GridModel *model, mpack_reader_t *reader, uint32_t attrib_count) {
+	for (uint32_t i = 0; i < attrib_count; ++i) {
+		uint32_t attrib_arr_length = MPackReadArray(reader);
+		int64_t nvim_hl_id = MPackReadInt(reader);
+		uint16_t hl_attrib_id = GridModelGetHighlightAttribId(model, nvim_hl_id);
+
+		// Once the dense ids run out, new ids are parsed into a scratch
+		// entry so that the defaults in slot 0 stay intact
+		bool overflowed = hl_attrib_id == 0 && nvim_hl_id != 0;
+		HighlightAttributes overflow_hl_attribs;
+		HighlightAttributes *hl_attribs = overflowed ? &overflow_hl_attribs : &model->hl_attribs[hl_attrib_id];
+		HighlightAttributes previous_hl_attribs = *hl_attribs;
+		hl_attribs->foreground = DEFAULT_COLOR;
+		hl_attribs->background = DEFAULT_COLOR;
+		hl_attribs->special = DEFAULT_COLOR;
+		hl_attribs->flags = 0;
+
+		const auto SetFlag = [&](HighlightAttributeFlags flag) {
+			if (MPackReadBool(reader)) {
+				hl_attribs->flags |= flag;
+			}
+			else {
+				hl_attribs->flags &= ~flag;
+			}
+		};
+
+		// Walk the attribute map once, dispatching on each key
+		uint32_t attrib_map_length = MPackReadMap(reader);
+		for (uint32_t j = 0; j < attrib_map_length; ++j) {
+			MPackString key = MPackReadString(reader);
+			switch (HIGHLIGHT_ATTRIBUTE_KEY_TABLE.Lookup(key.data, key.length)) {
+			case HighlightAttributeKey::Foreground: {
+				hl_attribs->foreground = MPackReadColor(reader);
+			} break;
+			case HighlightAttributeKey::Background: {
+				hl_attribs->background = MPackReadColor(reader);
+			} break;
+			case HighlightAttributeKey::Special: {
+				hl_attribs->special = MPackReadColor(reader);
+			} break;
+			case HighlightAttributeKey::Reverse: {
+				SetFlag(HL_ATTRIB_REVERSE);
+			} break;
+			case HighlightAttributeKey::Italic: {
+				SetFlag(HL_ATTRIB_ITALIC);
+			} break;
+			case HighlightAttributeKey::Bold: {
+				SetFlag(HL_ATTRIB_BOLD);
+			} break;
+			case HighlightAttributeKey::Strikethrough: {
+				SetFlag(HL_ATTRIB_STRIKETHROUGH);
+			} break;
+			case HighlightAttributeKey::Underline: {
+				SetFlag(HL_ATTRIB_UNDERLINE);
+			} break;
+			case HighlightAttributeKey::Undercurl: {
+				SetFlag(HL_ATTRIB_UNDERCURL);
+			} break;
+			case HighlightAttributeKey::Unknown: {
+				MPackSkip(reader);
+			} break;
+			}
+		}
+		mpack_done_map(reader);
+
+		// Cached layouts carry the colors and styles of the ids they use,
+		// the render thread drops them once it sees the style version move.
+		// An id's first definition only replaces the placeholder defaults,
+		// which nothing has been drawn with yet.
+		if (!overflowed &&
+			(previous_hl_attribs.foreground != hl_attribs->foreground ||
+			previous_hl_attribs.background != hl_attribs->background ||
+			previous_hl_attribs.special != hl_attribs->special ||
+			previous_hl_attribs.flags != hl_attribs->flags)) {
+			model->hl_version++;
+			if (model->hl_attrib_defined[hl_attrib_id]) {
+				model->hl_style_version++;
+			}
+		}
+		if (!overflowed) {
+			model->hl_attrib_defined[hl_attrib_id] = true;
+		}
+
+		MPackFinishArray(reader, attrib_arr_length, 2);
+	}
+}
+
+static void GridModelUpdateGridLines(GridModel *model, mpack_reader_t *reader, uint32_t line_count) {
+	assert(model->grid_cells != nullptr);
+
+	if (GraphemeNeedsSweep(&model->grapheme_table)) {
+		for (int i = 0; i < model->grid_rows * model->grid_cols; ++i) {
+			if (IsGraphemeId(model->grid_cells[i].text)) {
+				GraphemeMarkLive(&model->grapheme_table, model->grid_cells[i].text);
+			}
+		}
+		GraphemeSweep(&model->grapheme_table);
+	}
+
+	for (uint32_t i = 0; i < line_count; ++i) {
+		uint32_t grid_line_length = MPackReadArray(reader);
+		MPackSkip(reader); // grid id
+
+		int row = static_cast<int>(MPackReadInt(reader));
+		int col_start = static_cast<int>(MPackReadInt(reader));
+
+		uint32_t cell_array_length = MPackReadArray(reader);
+
+		uint16_t hl_attrib_id = 0;
+		int offset = col_start;
+		GridCell *cells = model->grid_row_cells[row];
+		for (uint32_t j = 0; j < cell_array_length; ++j) {
+			uint32_t cell_length = MPackReadArray(reader);
+
+			MPackString text = MPackReadString(reader);
+
+			if (cell_length > 1) {
+				hl_attrib_id = GridModelGetHighlightAttribId(model, MPackReadInt(reader));
+			}
+
+			int repeat = 1;
+			if (cell_length > 2) {
+				repeat = static_cast<int>(MPackReadInt(reader));
+			}
+			MPackFinishArray(reader, cell_length, std::min(cell_length, 3u));
+
+			if (text.length == 0) {
+				// This is the right part of the wide char. Sadly grid_line
+				// event can be splitted at the middle of wide character.
+				cells[offset].text = 0;
+
+				// This cell itself is not a wide character.
+				cells[offset].flags &= ~CELL_WIDE_CHAR;
+
+				// Adjust properties. It never happens that offset == 0,
+				// since it is the right half of wide char, but adding check
+				// for safety.
+				if (offset > 0) {
+					// Set is_wide_char flag for the left cell to true.
+					cells[offset - 1].flags |= CELL_WIDE_CHAR;
+
+					// Inherit hl_attrib_id from left half.
+					cells[offset].hl_attrib_id = cells[offset - 1].hl_attrib_id;
+				}
+
+				++offset;
+			} else {
+				// This is single width character or left half cell of wide
+				// character.
+
+				// Left cell should not be a wide character, so reset the
+				// flag. This time checking offset > 0 is mandatory.
+				if (offset > 0) {
+					cells[offset - 1].flags &= ~CELL_WIDE_CHAR;
+				}
+
+				// Decoded once per cell, repeats are a plain fill. Wide
+				// characters are never repeated, and their is_wide_char flag
+				// is set once the empty right half shows up (first branch).
+				uint32_t cell = Utf8DecodeCell(text.data, text.length);
+				if (cell == UTF8_MULTIPLE_CODEPOINTS) {
+					cell = GraphemeIntern(&model->grapheme_table, text.data, text.length);
+				}
+				GridCell grid_cell { .text = cell, .hl_attrib_id = hl_attrib_id, .flags = 0 };
+				FillGridCells(&cells[offset], grid_cell, repeat);
+				offset += repeat;
+			}
+		}
+		mpack_done_array(reader);
+		MPackFinishArray(reader, grid_line_length, 4);
+		model->grid_cell_count += offset - col_start;
+
+		GridModelMarkRowDirty(model, row);
+	}
+}
+
+static bool GridModelUpdateGridSize(GridModel *model, mpack_reader_t *reader, uint32_t grid_resize_count) {
+	int grid_cols = model->grid_cols;
+	int grid_rows = model->grid_rows;
+	for (uint32_t i = 0; i < grid_resize_count; ++i) {
+		uint32_t grid_resize_length = MPackReadArray(reader);
+		MPackSkip(reader); // grid id
+		grid_cols = static_cast<int>(MPackReadInt(reader));
+		grid_rows = static_cast<int>(MPackReadInt(reader));
+		MPackFinishArray(reader, grid_resize_length, 3);
+	}
+
+	if (model->grid_cells == nullptr ||
+		model->grid_cols != grid_cols ||
+		model->grid_rows != grid_rows) {
+
+		model->grid_cols = grid_cols;
+		model->grid_rows = grid_rows;
+
+		free(model->grid_cells);
+		model->grid_cells = static_cast<GridCell *>(malloc(static_cast<size_t>(grid_cols) * grid_rows * sizeof(GridCell)));
+		// Initialize all grid character to a space. An empty
+		// grid cell is equivalent to a space in a text layout
+		FillGridCells(model->grid_cells, GridCell { .text = ' ', .hl_attrib_id = 0, .flags = 0 },
+			static_cast<size_t>(grid_cols) * grid_rows);
+		free(model->grid_row_cells);
+		model->grid_row_cells = static_cast<GridCell **>(malloc(grid_rows * sizeof(GridCell *)));
+		for (int i = 0; i < grid_rows; ++i) {
+			model->grid_row_cells[i] = &model->grid_cells[static_cast<size_t>(i) * grid_cols];
+		}
+		free(model->grid_row_versions);
+		model->grid_row_versions = static_cast<uint64_t *>(calloc(grid_rows, sizeof(uint64_t)));
+		GridModelMarkGridDirty(model);
+		GraphemeTableClear(&model->grapheme_table);
+
+		model->grid_initialized = true;
+		return true;
+	}
+
+	return false;
+}
+
+static void GridModelUpdateCursorPos(GridModel *model, mpack_reader_t *reader, uint32_t cursor_goto_count) {
+	for (uint32_t i = 0; i < cursor_goto_count; ++i) {
+		uint32_t cursor_goto_length = MPackReadArray(reader);
+		MPackSkip(reader); // grid id
+		model->cursor.row = static_cast<int>(MPackReadInt(reader));
+		model->cursor.col = static_cast<int>(MPackReadInt(reader));
+		MPackFinishArray(reader, cursor_goto_length, 3);
+	}
+}
+
+static void GridModelUpdateCursorMode(GridModel *model, mpack_reader_t *reader, uint32_t mode_change_count) {
+	for (uint32_t i = 0; i < mode_change_count; ++i) {
+		uint32_t mode_change_length = MPackReadArray(reader);
+		MPackSkip(reader); // mode name
+		int64_t mode_index = MPackReadInt(reader);
+		assert(mode_index >= 0 && mode_index < MAX_CURSOR_MODE_INFOS);
+		model->cursor.mode_info = &model->cursor_mode_infos[mode_index];
+		MPackFinishArray(reader, mode_change_length, 2);
+	}
+}
+
+static void GridModelUpdateCursorModeInfos(GridModel *model, mpack_reader_t *reader, uint32_t mode_info_set_count) {
+	for (uint32_t i = 0; i < mode_info_set_count; ++i) {
+		uint32_t mode_info_set_length = MPackReadArray(reader);
+		MPackSkip(reader); // cursor_style_enabled
+
+		uint32_t mode_infos_length = MPackReadArray(reader);
+		assert(mode_infos_length <= MAX_CURSOR_MODE_INFOS);
+
+		for (uint32_t j = 0; j < mode_infos_length; ++j) {
+			CursorModeInfo *mode_info = &model->cursor_mode_infos[j];
+			mode_info->shape = CursorShape::None;
+			mode_info->hl_attrib_id = 0;
+
+			uint32_t mode_info_map_length = MPackReadMap(reader);
+			for (uint32_t k = 0; k < mode_info_map_length; ++k) {
+				MPackString key = MPackReadString(reader);
+				if (MPackMatchString(key, "cursor_shape")) {
+					MPackString cursor_shape = MPackReadString(reader);
+					if (MPackMatchString(cursor_shape, "block")) {
+						mode_info->shape = CursorShape::Block;
+					}
+					else if (MPackMatchString(cursor_shape, "vertical")) {
+						mode_info->shape = CursorShape::Vertical;
+					}
+					else if (MPackMatchString(cursor_shape, "horizontal")) {
+						mode_info->shape = CursorShape::Horizontal;
+					}
+				}
+				else if (MPackMatchString(key, "attr_id")) {
+					mode_info->hl_attrib_id = GridModelGetHighlightAttribId(model, MPackReadInt(reader));
+				}
+				else {
+					MPackSkip(reader);
+				}
+			}
+			mpack_done_map(reader);
+		}
+		mpack_done_array(reader);
+
+		MPackFinishArray(reader, mode_info_set_length, 2);
+	}
+}
+
+static void GridModelScrollRegion(GridModel *model, mpack_reader_t *reader, uint32_t scroll_count) {
+	for (uint32_t i = 0; i < scroll_count; ++i) {
+		uint32_t scroll_region_length = MPackReadArray(reader);
+		MPackSkip(reader); // grid id
+
+		int64_t top = MPackReadInt(reader);
+		int64_t bottom = MPackReadInt(reader);
+		int64_t left = MPackReadInt(reader);
+		int64_t right = MPackReadInt(reader);
+		int64_t rows = MPackReadInt(reader);
+		[[maybe_unused]] int64_t cols = MPackReadInt(reader);
+		MPackFinishArray(reader, scroll_region_length, 7);
+
+		// Currently nvim does not support horizontal scrolling,
+		// the parameter is reserved for later use
+		assert(cols == 0);
+
+		// Sadly I have given up on making use of IDXGISwapChain1::Present1
+		// scroll_rects or bitmap copies. The former seems insufficient for
+		// nvim since it can require multiple scrolls per frame, the latter
+		// I can't seem to make work with the FLIP_SEQUENTIAL swapchain model.
+		// Thus we fall back to redrawing the scrolled grid lines at flush
+		if (left == 0 && right == model->grid_cols) {
+			// Full width regions just reorder their rows. The rows scrolled
+			// out come back in as the vacated ones, whose contents nvim
+			// leaves undefined, so the whole region needs a redraw.
+			int64_t region_rows = bottom - top;
+			if (rows < region_rows && -rows < region_rows) {
+				GridCell **region = &model->grid_row_cells[top];
+				int64_t middle = rows > 0 ? rows : region_rows + rows;
+				std::rotate(region, region + middle, region + region_rows);
+			}
+			for (int64_t j = top; j < bottom; ++j) {
+				GridModelMarkRowDirty(model, static_cast<int>(j));
+			}
+		}
+		else {
+			// This part is slightly cryptic, basically we're just
+			// iterating from top to bottom or vice versa depending on scroll direction.
+			bool scrolling_down = rows > 0;
+			int64_t start_row = scrolling_down ? top : bottom - 1;
+			int64_t end_row = scrolling_down ? bottom - 1 : top;
+			int64_t increment = scrolling_down ? 1 : -1;
+
+			for (int64_t j = start_row; scrolling_down ? j <= end_row : j >= end_row; j += increment) {
+				// Clip anything outside the scroll region
+				int64_t target_row = j - rows;
+				if (target_row < top || target_row >= bottom) {
+					continue;
+				}
+
+				memcpy(
+					&model->grid_row_cells[target_row][left],
+					&model->grid_row_cells[j][left],
+					(right - left) * sizeof(GridCell)
+				);
+				GridModelMarkRowDirty(model, static_cast<int>(target_row));
+			}
+		}
+	}
+}
+
+static void GridModelClearGrid(GridModel *model) {
+	// Initialize all grid character to a space.
+	FillGridCells(model->grid_cells, GridCell { .text = ' ', .hl_attrib_id = 0, .flags = 0 },
+		static_cast<size_t>(model->grid_cols) * model->grid_rows);
+	GraphemeTableClear(&model->grapheme_table);
+	GridModelMarkGridDirty(model);
+}
+
+constexpr StringDispatchTable REDRAW_EVENT_TABLE(REDRAW_EVENTS, RedrawEvent::Unknown);
+static_assert(REDRAW_EVENT_TABLE.valid, "No perfect hash found for the redraw events");
+
+static void GridModelWindowEvent(GridModel *model, RedrawEvent event, mpack_reader_t *reader, uint32_t arg_count) {
+	if (model->hooks.window_event) {
+		model->hooks.window_event(model->hooks.context, event, reader, arg_count);
+	}
+	else {
+		MPackSkip(reader, arg_count);
+	}
+}
+
+void GridModelRedraw(GridModel *model, mpack_reader_t *reader) {
+	const GridModelHooks *hooks = &model->hooks;
+	uint32_t redraw_commands_length = MPackReadArray(reader);
+	for (uint32_t i = 0; i < redraw_commands_length; ++i) {
+		uint32_t redraw_command_length = MPackReadArray(reader);
+		MPackString redraw_command_name = MPackReadString(reader);
+		if (mpack_reader_error(reader) != mpack_ok || redraw_command_length == 0) {
+			break;
+		}
+
+		// Each event is followed by one or more argument tuples,
+		// every handler consumes exactly this many
+		uint32_t arg_count = redraw_command_length - 1;
+		model->redraw_event_count += arg_count;
+		RedrawEvent event = REDRAW_EVENT_TABLE.Lookup(redraw_command_name.data, redraw_command_name.length);
+		switch (event) {
+		case RedrawEvent::OptionSet:
+		case RedrawEvent::SetTitle: {
+			GridModelWindowEvent(model, event, reader, arg_count);
+		} break;
+		case RedrawEvent::GridResize: {
+			if (GridModelUpdateGridSize(model, reader, arg_count) && hooks->grid_resized) {
+				hooks->grid_resized(hooks->context);
+			}
+		} break;
+		case RedrawEvent::GridClear: {
+			MPackSkip(reader, arg_count);
+			GridModelClearGrid(model);
+		} break;
+		case RedrawEvent::DefaultColorsSet: {
+			GridModelUpdateDefaultColors(model, reader, arg_count);
+		} break;
+		case RedrawEvent::HlAttrDefine: {
+			GridModelUpdateHighlightAttributes(model, reader, arg_count);
+		} break;
+		case RedrawEvent::GridLine: {
+			GridModelUpdateGridLines(model, reader, arg_count);
+		} break;
+		case RedrawEvent::GridCursorGoto: {
+			// The cursor is an overlay, the grid below it needs no redraw
+			GridModelUpdateCursorPos(model, reader, arg_count);
+			if (hooks->cursor_moved) {
+				hooks->cursor_moved(hooks->context);
+			}
+		} break;
+		case RedrawEvent::ModeInfoSet: {
+			GridModelUpdateCursorModeInfos(model, reader, arg_count);
+		} break;
+		case RedrawEvent::ModeChange: {
+			GridModelUpdateCursorMode(model, reader, arg_count);
+		} break;
+		case RedrawEvent::BusyStart: {
+			MPackSkip(reader, arg_count);
+			model->ui_busy = true;
+		} break;
+		case RedrawEvent::BusyStop: {
+			MPackSkip(reader, arg_count);
+			model->ui_busy = false;
+		} break;
+		case RedrawEvent::GridScroll: {
+			GridModelScrollRegion(model, reader, arg_count);
+		} break;
+		case RedrawEvent::Flush: {
+			MPackSkip(reader, arg_count);
+			if (hooks->flush) {
+				hooks->flush(hooks->context);
+			}
+			model->published_grid_version = model->grid_version;
+			model->flush_count++;
+		} break;
+		case RedrawEvent::Unknown: {
+			MPackSkip(reader, arg_count);
+			model->unknown_redraw_event_count++;
+		} break;
+		}
+		mpack_done_array(reader);
+	}
+	mpack_done_array(reader);
+}
+
+GridSnapshotSource GridModelSnapshotSource(GridModel *model) {
+	CursorModeInfo *mode_info = model->cursor.mode_info;
+	return GridSnapshotSource {
+		.rows = model->grid_rows,
+		.cols = model->grid_cols,
+		.row_cells = model->grid_row_cells,
+		.row_versions = model->grid_row_versions,
+		.hl_attribs = model->hl_attribs.data(),
+		.hl_count = static_cast<uint32_t>(model->hl_attribs.size()),
+		.hl_version = model->hl_version,
+		.hl_style_version = model->hl_style_version,
+		.grapheme_table = &model->grapheme_table,
+		.cursor = SnapshotCursor {
+			.row = model->cursor.row,
+			.col = model->cursor.col,
+			.shape = mode_info ? mode_info->shape : CursorShape::None,
+			.hl_attrib_id = static_cast<uint16_t>(mode_info ? mode_info->hl_attrib_id : 0),
+			.visible = mode_info && !model->ui_busy
+		},
+		.invalidate_version = model->grid_invalidate_version,
+		.flush_count = model->flush_count
+	};
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "common/mpack_helper.h"
+#include "common/string_dispatch.h"
+#include "common/vec.h"
+#include "renderer/grapheme_table.h"
+#include "renderer/grid_snapshot.h"
+#include "renderer/highlight_remap.h"
+
+constexpr int MAX_HIGHLIGHT_ATTRIBS = 0xFFFF;
+constexpr int MAX_CURSOR_MODE_INFOS = 64;
+
+struct CursorModeInfo {
+	CursorShape shape;
+	uint16_t hl_attrib_id;
+};
+struct Cursor {
+	CursorModeInfo *mode_info;
+	int row;
+	int col;
+};
+
+enum class RedrawEvent : uint8_t {
+	OptionSet,
+	GridResize,
+	GridClear,
+	DefaultColorsSet,
+	HlAttrDefine,
+	GridLine,
+	GridCursorGoto,
+	ModeInfoSet,
+	ModeChange,
+	SetTitle,
+	BusyStart,
+	BusyStop,
+	GridScroll,
+	Flush,
+	Unknown
+};
+constexpr StringDispatchEntry<RedrawEvent> REDRAW_EVENTS[] {
+	{ "option_set", RedrawEvent::OptionSet },
+	{ "grid_resize", RedrawEvent::GridResize },
+	{ "grid_clear", RedrawEvent::GridClear },
+	{ "default_colors_set", RedrawEvent::DefaultColorsSet },
+	{ "hl_attr_define", RedrawEvent::HlAttrDefine },
+	{ "grid_line", RedrawEvent::GridLine },
+	{ "grid_cursor_goto", RedrawEvent::GridCursorGoto },
+	{ "mode_info_set", RedrawEvent::ModeInfoSet },
+	{ "mode_change", RedrawEvent::ModeChange },
+	{ "set_title", RedrawEvent::SetTitle },
+	{ "busy_start", RedrawEvent::BusyStart },
+	{ "busy_stop", RedrawEvent::BusyStop },
+	{ "grid_scroll", RedrawEvent::GridScroll },
+	{ "flush", RedrawEvent::Flush }
+};
+
+// What the window does with the redraw events on top of the model, all
+// of them optional. The model has no use for option_set and set_title,
+// window_event gets those and has to consume all arg_count argument
+// tuples; they are skipped if it isn't set.
+struct GridModelHooks {
+	void *context;
+	void (*window_event)(void *context, RedrawEvent event, mpack_reader_t *reader, uint32_t arg_count);
+	void (*grid_resized)(void *context); // The size actually changed
+	void (*cursor_moved)(void *context);
+	void (*flush)(void *context); // Before the flush is counted
+};
+
+// The grid as nvim's redraw events describe it, without anything to draw
+// it with. Lives on the thread that reads the redraw events.
+struct GridModel {
+	GridModelHooks hooks;
+
+	CursorModeInfo cursor_mode_infos[MAX_CURSOR_MODE_INFOS];
+	HighlightRemap hl_remap; // nvim hl ids to the dense ids indexing hl_attribs
+	Vec<HighlightAttributes> hl_attribs;
+	Vec<bool> hl_attrib_defined; // Set once hl_attr_define described the id
+	uint64_t hl_version; // Bumped by any change to hl_attribs
+	uint64_t hl_style_version; // Bumped when an id already handed out changed
+	Cursor cursor;
+	bool ui_busy;
+
+	bool grid_initialized;
+	int grid_rows;
+	int grid_cols;
+	GridCell *grid_cells;
+	GridCell **grid_row_cells; // Rows in screen order, scrolling reorders them
+	GraphemeTable grapheme_table;
+	uint64_t *grid_row_versions; // grid_version as of each row's last change
+	uint64_t grid_version;
+	uint64_t published_grid_version; // grid_version at the last flush
+	uint64_t grid_invalidate_version; // Bumped when every row needs a redraw
+
+	uint64_t unknown_redraw_event_count;
+	uint64_t redraw_event_count; // Argument tuples, i.e. one per grid_line line
+	uint64_t grid_cell_count; // Cells written by grid_line, repeats included
+	uint64_t flush_count;
+	uint64_t redundant_draw_count; // Row draws saved by deferring them to flush
+};
+
+void GridModelInitialize(GridModel *model, const GridModelHooks *hooks);
+void GridModelShutdown(GridModel *model);
+
+// Applies the events of one redraw notification, reader positioned at its params
+void GridModelRedraw(GridModel *model, mpack_reader_t *reader);
+// The model as it is now, to take a snapshot of
+GridSnapshotSource GridModelSnapshotSource(GridModel *model);
+
+// grid_line repeats come in long runs, mostly of spaces
+void FillGridCells(GridCell *cells, GridCell value, size_t count);
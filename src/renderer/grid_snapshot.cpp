@@ -0,0 +1,73 @@
+#include "grid_snapshot.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Marks a row copy that no grid version can match
+constexpr uint64_t GRID_SNAPSHOT_NO_VERSION = ~0ull;
+
+void GridSnapshotShutdown(GridSnapshot *snapshot) {
+	free(snapshot->cells);
+	free(snapshot->row_versions);
+	free(snapshot->hl_attribs);
+	free(snapshot->graphemes);
+	*snapshot = GridSnapshot {};
+}
+
+int GridSnapshotUpdate(GridSnapshot *snapshot, const GridSnapshotSource *source) {
+	size_t cell_count = static_cast<size_t>(source->rows) * source->cols;
+	if (snapshot->rows != source->rows || snapshot->cols != source->cols) {
+		if (snapshot->cell_capacity < cell_count) {
+			free(snapshot->cells);
+			snapshot->cells = static_cast<GridCell *>(malloc(cell_count * sizeof(GridCell)));
+			snapshot->cell_capacity = cell_count;
+		}
+		if (snapshot->row_capacity < source->rows) {
+			free(snapshot->row_versions);
+			snapshot->row_versions = static_cast<uint64_t *>(malloc(source->rows * sizeof(uint64_t)));
+			snapshot->row_capacity = source->rows;
+		}
+		for (int i = 0; i < source->rows; ++i) {
+			snapshot->row_versions[i] = GRID_SNAPSHOT_NO_VERSION;
+		}
+		snapshot->rows = source->rows;
+		snapshot->cols = source->cols;
+	}
+
+	// Slots are three flushes apart at most, usually only a few rows moved on
+	int copied_rows = 0;
+	for (int i = 0; i < source->rows; ++i) {
+		if (snapshot->row_versions[i] != source->row_versions[i]) {
+			memcpy(GridSnapshotRow(snapshot, i), source->row_cells[i], source->cols * sizeof(GridCell));
+			snapshot->row_versions[i] = source->row_versions[i];
+			copied_rows++;
+		}
+	}
+
+	if (!snapshot->hl_attribs || snapshot->hl_version != source->hl_version) {
+		if (snapshot->hl_capacity < source->hl_count) {
+			free(snapshot->hl_attribs);
+			snapshot->hl_capacity = std::max(source->hl_count, snapshot->hl_capacity * 2);
+			snapshot->hl_attribs = static_cast<HighlightAttributes *>(malloc(snapshot->hl_capacity * sizeof(HighlightAttributes)));
+		}
+		memcpy(snapshot->hl_attribs, source->hl_attribs, source->hl_count * sizeof(HighlightAttributes));
+		snapshot->hl_count = source->hl_count;
+		snapshot->hl_version = source->hl_version;
+	}
+	snapshot->hl_style_version = source->hl_style_version;
+
+	const GraphemeTable *grapheme_table = source->grapheme_table;
+	if (!snapshot->graphemes || snapshot->grapheme_version != grapheme_table->version) {
+		if (!snapshot->graphemes) {
+			snapshot->graphemes = static_cast<GraphemeEntry *>(malloc(GRAPHEME_TABLE_CAPACITY * sizeof(GraphemeEntry)));
+		}
+		memcpy(snapshot->graphemes, grapheme_table->entries, GRAPHEME_TABLE_CAPACITY * sizeof(GraphemeEntry));
+		snapshot->grapheme_version = grapheme_table->version;
+	}
+	snapshot->grapheme_reuse_version = grapheme_table->reuse_version;
+
+	snapshot->cursor = source->cursor;
+	snapshot->invalidate_version = source->invalidate_version;
+	snapshot->flush_count = source->flush_count;
+	return copied_rows;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "renderer/grapheme_table.h"
+
+constexpr uint32_t DEFAULT_COLOR = 0x46464646;
+enum HighlightAttributeFlags : uint16_t {
+	HL_ATTRIB_REVERSE			= 1 << 0,
+	HL_ATTRIB_ITALIC			= 1 << 1,
+	HL_ATTRIB_BOLD				= 1 << 2,
+	HL_ATTRIB_STRIKETHROUGH		= 1 << 3,
+	HL_ATTRIB_UNDERLINE			= 1 << 4,
+	HL_ATTRIB_UNDERCURL			= 1 << 5
+};
+struct HighlightAttributes {
+	uint32_t foreground;
+	uint32_t background;
+	uint32_t special;
+	uint16_t flags;
+};
+
+enum class CursorShape {
+	None,
+	Block,
+	Vertical,
+	Horizontal
+};
+
+enum GridCellFlags : uint16_t {
+	CELL_WIDE_CHAR = 1 << 0 // Left half of a double width char
+};
+// Text and attributes side by side, so a row is one contiguous run
+struct GridCell {
+	uint32_t text; // Codepoint or grapheme id, 0 for the right half of a wide char
+	uint16_t hl_attrib_id;
+	uint16_t flags;
+};
+static_assert(sizeof(GridCell) == 8);
+
+// The cursor as the current mode draws it
+struct SnapshotCursor {
+	int row;
+	int col;
+	CursorShape shape;
+	uint16_t hl_attrib_id;
+	bool visible; // There is a mode and the UI isn't busy
+};
+
+// Everything a frame is drawn from, copied out of the grid at flush so the
+// render thread never reads what the redraw handlers are changing. Slots
+// are reused across flushes, each part remembers the version it holds and
+// is only copied again once the grid's has moved on.
+struct GridSnapshot {
+	int rows;
+	int cols;
+	GridCell *cells; // Rows in screen order
+	uint64_t *row_versions; // Bumped by every change to a row
+	size_t cell_capacity;
+	int row_capacity;
+
+	HighlightAttributes *hl_attribs;
+	uint32_t hl_count;
+	uint32_t hl_capacity;
+	uint64_t hl_version;
+	uint64_t hl_style_version; // Bumped when ids in use changed how they look
+
+	GraphemeEntry *graphemes; // Indexed like the grapheme table
+	uint64_t grapheme_version;
+	uint64_t grapheme_reuse_version; // Bumped when ids may stand for different text
+
+	SnapshotCursor cursor;
+	uint64_t invalidate_version; // Bumped when every row needs a redraw
+	uint64_t flush_count;
+};
+
+// What a snapshot is taken from, pointing into the grid
+struct GridSnapshotSource {
+	int rows;
+	int cols;
+	GridCell *const *row_cells;
+	const uint64_t *row_versions;
+	const HighlightAttributes *hl_attribs;
+	uint32_t hl_count;
+	uint64_t hl_version;
+	uint64_t hl_style_version;
+	const GraphemeTable *grapheme_table;
+	SnapshotCursor cursor;
+	uint64_t invalidate_version;
+	uint64_t flush_count;
+};
+
+void GridSnapshotShutdown(GridSnapshot *snapshot);
+// Brings snapshot up to date with source, copying only the parts that
+// changed since the snapshot was last updated. Returns the rows copied.
+int GridSnapshotUpdate(GridSnapshot *snapshot, const GridSnapshotSource *source);
+
+inline GridCell *GridSnapshotRow(GridSnapshot *snapshot, int row) {
+	return &snapshot->cells[static_cast<size_t>(row) * snapshot->cols];
+}
+inline const GraphemeEntry *GridSnapshotGrapheme(GridSnapshot *snapshot, uint32_t id) {
+	return &snapshot->graphemes[id & ~GRAPHEME_ID_FLAG];
+}
@@ -0,0 +1,79 @@
+#include "highlight_remap.h"
+#include <cstdlib>
+
+static HighlightRemapEntry *HighlightRemapSlot(HighlightRemapEntry *entries, uint32_t capacity, int64_t nvim_hl_id) {
+	uint32_t mask = capacity - 1;
+	uint32_t index = static_cast<uint32_t>((static_cast<uint64_t>(nvim_hl_id) * 0x9E3779B97F4A7C15ull) >> 40);
+	while (true) {
+		HighlightRemapEntry *entry = &entries[index & mask];
+		if (entry->nvim_hl_id == nvim_hl_id || entry->nvim_hl_id == -1) {
+			return entry;
+		}
+		index++;
+	}
+}
+
+static void HighlightRemapAllocate(HighlightRemap *remap, uint32_t capacity) {
+	auto entries = static_cast<HighlightRemapEntry *>(malloc(capacity * sizeof(HighlightRemapEntry)));
+	for (uint32_t i = 0; i < capacity; ++i) {
+		entries[i].nvim_hl_id = -1;
+	}
+	for (uint32_t i = 0; i < remap->capacity; ++i) {
+		if (remap->entries[i].nvim_hl_id != -1) {
+			*HighlightRemapSlot(entries, capacity, remap->entries[i].nvim_hl_id) = remap->entries[i];
+		}
+	}
+
+	free(remap->entries);
+	remap->entries = entries;
+	remap->capacity = capacity;
+}
+
+void HighlightRemapInitialize(HighlightRemap *remap, uint32_t max_ids) {
+	remap->entries = nullptr;
+	remap->capacity = 0;
+	remap->count = 0;
+	remap->max_ids = max_ids;
+	remap->overflow_count = 0;
+	HighlightRemapAllocate(remap, HIGHLIGHT_REMAP_INITIAL_CAPACITY);
+
+	*HighlightRemapSlot(remap->entries, remap->capacity, 0) = HighlightRemapEntry { .nvim_hl_id = 0, .hl_attrib_id = 0 };
+	remap->count = 1;
+	remap->last_nvim_hl_id = 0;
+	remap->last_hl_attrib_id = 0;
+}
+
+void HighlightRemapShutdown(HighlightRemap *remap) {
+	free(remap->entries);
+	remap->entries = nullptr;
+	remap->capacity = 0;
+}
+
+uint16_t HighlightRemapGet(HighlightRemap *remap, int64_t nvim_hl_id) {
+	if (nvim_hl_id == remap->last_nvim_hl_id) {
+		return remap->last_hl_attrib_id;
+	}
+	if (nvim_hl_id < 0) {
+		return 0;
+	}
+
+	HighlightRemapEntry *entry = HighlightRemapSlot(remap->entries, remap->capacity, nvim_hl_id);
+	if (entry->nvim_hl_id == -1) {
+		if (remap->count >= remap->max_ids) {
+			remap->overflow_count++;
+			return 0;
+		}
+
+		// Stay at most half full so probes stay short
+		if ((remap->count + 1) * 2 > remap->capacity) {
+			HighlightRemapAllocate(remap, remap->capacity * 2);
+			entry = HighlightRemapSlot(remap->entries, remap->capacity, nvim_hl_id);
+		}
+		entry->nvim_hl_id = nvim_hl_id;
+		entry->hl_attrib_id = static_cast<uint16_t>(remap->count++);
+	}
+
+	remap->last_nvim_hl_id = nvim_hl_id;
+	remap->last_hl_attrib_id = entry->hl_attrib_id;
+	return entry->hl_attrib_id;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+
+// nvim's hl ids are sparse and keep growing across colorscheme reloads.
+// Cells store a dense 16 bit id instead, handed out in order of first
+// appearance, so the highlight tables only grow with the ids in use.
+constexpr uint32_t HIGHLIGHT_REMAP_INITIAL_CAPACITY = 1024;
+
+struct HighlightRemapEntry {
+	int64_t nvim_hl_id; // -1 marks an empty slot
+	uint16_t hl_attrib_id;
+};
+
+struct HighlightRemap {
+	HighlightRemapEntry *entries;
+	uint32_t capacity;
+	uint32_t count;
+	uint32_t max_ids; // Dense ids are 0 .. max_ids - 1
+	uint64_t overflow_count; // Ids past max_ids, drawn with the defaults
+
+	// grid_line mostly repeats the id it looked up last
+	int64_t last_nvim_hl_id;
+	uint16_t last_hl_attrib_id;
+};
+
+// nvim's id 0, the default colors, always maps to 0
+void HighlightRemapInitialize(HighlightRemap *remap, uint32_t max_ids);
+void HighlightRemapShutdown(HighlightRemap *remap);
+// The dense id for nvim_hl_id, assigning the next free one if it is new.
+// Once every dense id is taken, new ids map to 0.
+uint16_t HighlightRemapGet(HighlightRemap *remap, int64_t nvim_hl_id);
@@ -0,0 +1,202 @@
+#include "layout_cache.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+static void LayoutCacheReset(LayoutCache *cache) {
+	for (uint32_t i = 0; i < cache->capacity; ++i) {
+		cache->entries[i].next = i + 1 < cache->capacity ? i + 1 : LAYOUT_CACHE_NONE;
+	}
+	memset(cache->slots, 0xFF, (static_cast<size_t>(cache->slot_mask) + 1) * sizeof(uint32_t));
+
+	cache->count = 0;
+	cache->free_head = 0;
+	cache->lru_head = LAYOUT_CACHE_NONE;
+	cache->lru_tail = LAYOUT_CACHE_NONE;
+	cache->memory_used = 0;
+}
+
+void LayoutCacheInitialize(LayoutCache *cache, uint32_t capacity, size_t memory_budget, LayoutCacheRelease release) {
+	assert(capacity > 0);
+	cache->entries = static_cast<LayoutCacheEntry *>(calloc(capacity, sizeof(LayoutCacheEntry)));
+	cache->capacity = capacity;
+
+	uint32_t slot_count = 1;
+	while (slot_count < capacity * 2) {
+		slot_count <<= 1;
+	}
+	cache->slots = static_cast<uint32_t *>(malloc(slot_count * sizeof(uint32_t)));
+	cache->slot_mask = slot_count - 1;
+
+	cache->memory_budget = memory_budget;
+	cache->release = release;
+	cache->hit_count = 0;
+	cache->miss_count = 0;
+	cache->eviction_count = 0;
+	LayoutCacheReset(cache);
+}
+
+void LayoutCacheShutdown(LayoutCache *cache) {
+	LayoutCacheClear(cache);
+	free(cache->entries);
+	free(cache->slots);
+	cache->entries = nullptr;
+	cache->slots = nullptr;
+}
+
+void LayoutCacheClear(LayoutCache *cache) {
+	if (cache->count == 0) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < cache->capacity; ++i) {
+		LayoutCacheEntry *entry = &cache->entries[i];
+		if (entry->value) {
+			cache->release(entry->value);
+			entry->value = nullptr;
+		}
+		free(entry->key);
+		entry->key = nullptr;
+	}
+	LayoutCacheReset(cache);
+}
+
+static inline uint64_t LayoutCacheRotate(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t LayoutCacheMix(uint64_t hash, uint64_t word) {
+	constexpr uint64_t PRIME_1 = 0x9E3779B97F4A7C15ull;
+	constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+	return LayoutCacheRotate(hash ^ (word * PRIME_2), 31) * PRIME_1;
+}
+
+// Rows are a few thousand bytes. Four independent lanes of 8 bytes keep
+// the multiplies from waiting on each other.
+uint64_t LayoutCacheHash(const void *key, size_t key_size) {
+	const uint8_t *bytes = static_cast<const uint8_t *>(key);
+	uint64_t lanes[4] { key_size, 0x6A09E667F3BCC908ull, 0xBB67AE8584CAA73Bull, 0x3C6EF372FE94F82Bull };
+
+	size_t i = 0;
+	for (; i + 32 <= key_size; i += 32) {
+		uint64_t words[4];
+		memcpy(words, bytes + i, sizeof(words));
+		for (int lane = 0; lane < 4; ++lane) {
+			lanes[lane] = LayoutCacheMix(lanes[lane], words[lane]);
+		}
+	}
+
+	uint64_t hash = LayoutCacheRotate(lanes[0], 1) + LayoutCacheRotate(lanes[1], 7) +
+		LayoutCacheRotate(lanes[2], 12) + LayoutCacheRotate(lanes[3], 18);
+	for (; i < key_size; i += 8) {
+		uint64_t word = 0;
+		memcpy(&word, bytes + i, std::min(key_size - i, sizeof(word)));
+		hash = LayoutCacheMix(hash, word);
+	}
+
+	hash ^= hash >> 33;
+	hash *= 0xC2B2AE3D27D4EB4Full;
+	hash ^= hash >> 29;
+	return hash;
+}
+
+static void LayoutCacheUnlink(LayoutCache *cache, uint32_t id) {
+	LayoutCacheEntry *entry = &cache->entries[id];
+	if (entry->prev != LAYOUT_CACHE_NONE) cache->entries[entry->prev].next = entry->next;
+	else cache->lru_head = entry->next;
+	if (entry->next != LAYOUT_CACHE_NONE) cache->entries[entry->next].prev = entry->prev;
+	else cache->lru_tail = entry->prev;
+}
+
+static void LayoutCachePushFront(LayoutCache *cache, uint32_t id) {
+	LayoutCacheEntry *entry = &cache->entries[id];
+	entry->prev = LAYOUT_CACHE_NONE;
+	entry->next = cache->lru_head;
+	if (cache->lru_head != LAYOUT_CACHE_NONE) cache->entries[cache->lru_head].prev = id;
+	else cache->lru_tail = id;
+	cache->lru_head = id;
+}
+
+// Returns the slot holding the key, or the empty slot that ends its probe
+static uint32_t LayoutCacheFindSlot(LayoutCache *cache, uint64_t hash, const void *key, size_t key_size) {
+	uint32_t slot = static_cast<uint32_t>(hash) & cache->slot_mask;
+	while (cache->slots[slot] != LAYOUT_CACHE_NONE) {
+		LayoutCacheEntry *entry = &cache->entries[cache->slots[slot]];
+		if (entry->hash == hash && entry->key_size == key_size && memcmp(entry->key, key, key_size) == 0) {
+			return slot;
+		}
+		slot = (slot + 1) & cache->slot_mask;
+	}
+	return slot;
+}
+
+static void LayoutCacheEvict(LayoutCache *cache, uint32_t id) {
+	LayoutCacheEntry *entry = &cache->entries[id];
+
+	// Backward shift deletion keeps probe chains intact without tombstones
+	uint32_t slot = LayoutCacheFindSlot(cache, entry->hash, entry->key, entry->key_size);
+	uint32_t next = (slot + 1) & cache->slot_mask;
+	while (cache->slots[next] != LAYOUT_CACHE_NONE) {
+		uint32_t home = static_cast<uint32_t>(cache->entries[cache->slots[next]].hash) & cache->slot_mask;
+		// Move the entry back unless its home lies in (slot, next]
+		if (((next - home) & cache->slot_mask) >= ((next - slot) & cache->slot_mask)) {
+			cache->slots[slot] = cache->slots[next];
+			slot = next;
+		}
+		next = (next + 1) & cache->slot_mask;
+	}
+	cache->slots[slot] = LAYOUT_CACHE_NONE;
+
+	LayoutCacheUnlink(cache, id);
+	cache->release(entry->value);
+	free(entry->key);
+	entry->value = nullptr;
+	entry->key = nullptr;
+	cache->memory_used -= entry->cost;
+	entry->next = cache->free_head;
+	cache->free_head = id;
+	cache->count--;
+	cache->eviction_count++;
+}
+
+void *LayoutCacheLookup(LayoutCache *cache, uint64_t hash, const void *key, size_t key_size) {
+	uint32_t slot = LayoutCacheFindSlot(cache, hash, key, key_size);
+	uint32_t id = cache->slots[slot];
+	if (id == LAYOUT_CACHE_NONE) {
+		cache->miss_count++;
+		return nullptr;
+	}
+
+	cache->hit_count++;
+	if (cache->lru_head != id) {
+		LayoutCacheUnlink(cache, id);
+		LayoutCachePushFront(cache, id);
+	}
+	return cache->entries[id].value;
+}
+
+void LayoutCacheInsert(LayoutCache *cache, uint64_t hash, const void *key, size_t key_size, void *value, size_t value_cost) {
+	size_t cost = key_size + value_cost;
+	while (cache->count > 0 && (cache->count == cache->capacity || cache->memory_used + cost > cache->memory_budget)) {
+		LayoutCacheEvict(cache, cache->lru_tail);
+	}
+
+	uint32_t id = cache->free_head;
+	LayoutCacheEntry *entry = &cache->entries[id];
+	cache->free_head = entry->next;
+
+	entry->hash = hash;
+	entry->key = malloc(key_size);
+	memcpy(entry->key, key, key_size);
+	entry->key_size = key_size;
+	entry->value = value;
+	entry->cost = cost;
+	cache->memory_used += cost;
+	cache->count++;
+
+	uint32_t slot = LayoutCacheFindSlot(cache, hash, key, key_size);
+	assert(cache->slots[slot] == LAYOUT_CACHE_NONE);
+	cache->slots[slot] = id;
+	LayoutCachePushFront(cache, id);
+}
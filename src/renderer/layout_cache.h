@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// LRU cache from a row's contents to its shaped layout. Keys are arbitrary
+// bytes that are copied and compared in full, so a hash collision can't
+// hand back the wrong layout. Values are opaque, the release callback
+// frees them on eviction.
+constexpr uint32_t LAYOUT_CACHE_NONE = 0xFFFFFFFF;
+
+typedef void (*LayoutCacheRelease)(void *value);
+
+struct LayoutCacheEntry {
+	uint64_t hash;
+	void *key;
+	size_t key_size;
+	void *value;
+	size_t cost; // Key plus the caller's estimate for the value, in bytes
+	uint32_t prev; // Towards the most recently used entry
+	uint32_t next;
+};
+
+struct LayoutCache {
+	LayoutCacheEntry *entries;
+	uint32_t capacity;
+	uint32_t count;
+	uint32_t free_head; // Unused entries, chained through next
+
+	// Open addressed index of entry ids, twice the capacity
+	uint32_t *slots;
+	uint32_t slot_mask;
+
+	uint32_t lru_head;
+	uint32_t lru_tail;
+
+	size_t memory_budget;
+	size_t memory_used;
+	LayoutCacheRelease release;
+
+	uint64_t hit_count;
+	uint64_t miss_count;
+	uint64_t eviction_count;
+};
+
+void LayoutCacheInitialize(LayoutCache *cache, uint32_t capacity, size_t memory_budget, LayoutCacheRelease release);
+void LayoutCacheShutdown(LayoutCache *cache);
+// Releases every value, e.g. when the font or highlights change
+void LayoutCacheClear(LayoutCache *cache);
+
+uint64_t LayoutCacheHash(const void *key, size_t key_size);
+// Returns nullptr on a miss, a hit becomes the most recently used entry
+void *LayoutCacheLookup(LayoutCache *cache, uint64_t hash, const void *key, size_t key_size);
+// The key must not be in the cache yet. Least recently used entries are
+// evicted until the new one fits the budget.
+void LayoutCacheInsert(LayoutCache *cache, uint64_t hash, const void *key, size_t key_size, void *value, size_t value_cost);
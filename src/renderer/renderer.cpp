@@ -1,5 +1,9 @@
 #include "renderer.h"
 #include "renderer/glyph_renderer.h"
+#include "common/string_dispatch.h"
+#include "common/utf8.h"
+#include <algorithm>
+#include <bit>
 
 void InitializeD2D(Renderer *renderer) {
 	D2D1_FACTORY_OPTIONS options {};
@@ -7,7 +11,7 @@ void InitializeD2D(Renderer *renderer) {
 	options.debugLevel = D2D1_DEBUG_LEVEL_INFORMATION;
 #endif
 
-	WIN_CHECK(D2D1CreateFactory(D2D1_FACTORY_TYPE_SINGLE_THREADED, options, &renderer->d2d_factory));
+	WIN_CHECK(D2D1CreateFactory(D2D1_FACTORY_TYPE_MULTI_THREADED, options, &renderer->d2d_factory));
 }
 
 void InitializeD3D(Renderer *renderer) {
@@ -58,7 +62,7 @@ void InitializeWindowDependentResources(Renderer *renderer, uint32_t width, uint
 	// Initializing window resources invalidates previous draws to the window,
 	// so all lines need to be redrawn to make sure they are preserved.
 	// Otherwise lines will appear entirely black until updated.
-	renderer->draws_invalidated = true;
+	renderer->render_invalidated = true;
 
 	renderer->pixel_size.width = width;
 	renderer->pixel_size.height = height;
@@ -70,6 +74,7 @@ void InitializeWindowDependentResources(Renderer *renderer, uint32_t width, uint
 
 	if (renderer->dxgi_swapchain) {
 		renderer->d2d_target_bitmap->Release();
+		SafeRelease(&renderer->d2d_grid_bitmap);
 
 		HRESULT hr = renderer->dxgi_swapchain->ResizeBuffers(
 			2,
@@ -116,6 +121,7 @@ void InitializeWindowDependentResources(Renderer *renderer, uint32_t width, uint
 
 		WIN_CHECK(renderer->dxgi_swapchain->SetMaximumFrameLatency(1));
 		renderer->swapchain_wait_handle = renderer->dxgi_swapchain->GetFrameLatencyWaitableObject();
+		renderer->swapchain_generation++;
 
 		SafeRelease(&dxgi_swapchain_temp);
 		SafeRelease(&dxgi_device);
@@ -141,10 +147,33 @@ void InitializeWindowDependentResources(Renderer *renderer, uint32_t width, uint
 	));
 	renderer->d2d_context->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
 
+	// The grid is kept here across frames, the back buffer only ever
+	// gets a copy of it with the cursor on top
+	constexpr D2D1_BITMAP_PROPERTIES1 grid_bitmap_properties {
+		.pixelFormat = D2D1_PIXEL_FORMAT {
+			.format = DXGI_FORMAT_B8G8R8A8_UNORM,
+			.alphaMode = D2D1_ALPHA_MODE_IGNORE
+		},
+		.dpiX = DEFAULT_DPI,
+		.dpiY = DEFAULT_DPI,
+		.bitmapOptions = D2D1_BITMAP_OPTIONS_TARGET
+	};
+	WIN_CHECK(renderer->d2d_context->CreateBitmap(
+		D2D1::SizeU(width, height),
+		nullptr,
+		0,
+		&grid_bitmap_properties,
+		&renderer->d2d_grid_bitmap
+	));
+
 	SafeRelease(&dxgi_backbuffer);
 }
 
 void HandleDeviceLost(Renderer *renderer) {
+	if (renderer->swapchain_wait_handle) {
+		CloseHandle(renderer->swapchain_wait_handle);
+		renderer->swapchain_wait_handle = nullptr;
+	}
 	SafeRelease(&renderer->d3d_device);
 	SafeRelease(&renderer->d3d_context);
 	SafeRelease(&renderer->dxgi_swapchain);
@@ -152,6 +181,7 @@ void HandleDeviceLost(Renderer *renderer) {
 	SafeRelease(&renderer->d2d_device);
 	SafeRelease(&renderer->d2d_context);
 	SafeRelease(&renderer->d2d_target_bitmap);
+	SafeRelease(&renderer->d2d_grid_bitmap);
 	SafeRelease(&renderer->d2d_background_rect_brush);
 	SafeRelease(&renderer->dwrite_factory);
 	SafeRelease(&renderer->dwrite_text_format);
@@ -169,13 +199,33 @@ void HandleDeviceLost(Renderer *renderer) {
 	);
 }
 
+void ReleaseTextLayout(void *text_layout);
+void RendererWindowEvent(void *context, RedrawEvent event, mpack_reader_t *reader, uint32_t arg_count);
+void RendererGridResized(void *context);
+void RendererCursorMoved(void *context);
+void RendererModelFlushed(void *context);
 void RendererInitialize(Renderer *renderer, HWND hwnd, bool disable_ligatures, float linespace_factor, float monitor_dpi) {
 	renderer->hwnd = hwnd;
 	renderer->disable_ligatures = disable_ligatures;
 	renderer->linespace_factor = linespace_factor;
 
 	renderer->dpi_scale = monitor_dpi / 96.0f;
-	renderer->hl_attribs.resize(MAX_HIGHLIGHT_ATTRIBS);
+	GridModelHooks model_hooks {
+		.context = renderer,
+		.window_event = RendererWindowEvent,
+		.grid_resized = RendererGridResized,
+		.cursor_moved = RendererCursorMoved,
+		.flush = RendererModelFlushed
+	};
+	GridModelInitialize(&renderer->model, &model_hooks);
+	renderer->hl_resolved.push_back(ResolvedHighlight {});
+	renderer->hl_generation = 1;
+	TripleBufferInitialize(&renderer->snapshots);
+	// The render thread works through batches too, so one core less
+	uint32_t core_count = std::thread::hardware_concurrency();
+	WorkPoolInitialize(&renderer->row_pool, std::min(core_count > 1 ? core_count - 1 : 0, ROW_POOL_MAX_THREADS));
+	LayoutCacheInitialize(&renderer->layout_cache, LAYOUT_CACHE_CAPACITY, LAYOUT_CACHE_BUDGET, ReleaseTextLayout);
+	LayoutCacheInitialize(&renderer->cursor_layout_cache, CURSOR_LAYOUT_CACHE_CAPACITY, CURSOR_LAYOUT_CACHE_BUDGET, ReleaseTextLayout);
 
 	wcscpy_s(renderer->fallback_font, MAX_FONT_LENGTH, L"Consolas");
 
@@ -183,9 +233,12 @@ void RendererInitialize(Renderer *renderer, HWND hwnd, bool disable_ligatures, f
 	InitializeD3D(renderer);
 	InitializeDWrite(renderer);
 	renderer->glyph_renderer = new GlyphRenderer(renderer);
+	renderer->cursor_drawing_effect = new GlyphDrawingEffect(D2D1::ColorF(0), D2D1::ColorF(0));
+	renderer->cursor_drawing_effect->AddRef();
 	RendererUpdateFont(renderer, DEFAULT_FONT_SIZE, DEFAULT_FONT, static_cast<int>(strlen(DEFAULT_FONT)));
 }
 
+void RenderThread(Renderer *renderer);
 void RendererAttach(Renderer *renderer) {
 	RECT client_rect;
 	GetClientRect(renderer->hwnd, &client_rect);
@@ -194,9 +247,19 @@ void RendererAttach(Renderer *renderer) {
 		static_cast<uint32_t>(client_rect.right - client_rect.left),
 		static_cast<uint32_t>(client_rect.bottom - client_rect.top)
 	);
+	renderer->render_thread = std::thread(RenderThread, renderer);
 }
 
 void RendererShutdown(Renderer *renderer) {
+	TripleBufferClose(&renderer->snapshots);
+	if (renderer->render_thread.joinable()) {
+		renderer->render_thread.join();
+	}
+	WorkPoolShutdown(&renderer->row_pool);
+
+	if (renderer->swapchain_wait_handle) {
+		CloseHandle(renderer->swapchain_wait_handle);
+	}
 	SafeRelease(&renderer->d3d_device);
 	SafeRelease(&renderer->d3d_context);
 	SafeRelease(&renderer->dxgi_swapchain);
@@ -204,44 +267,44 @@ void RendererShutdown(Renderer *renderer) {
 	SafeRelease(&renderer->d2d_device);
 	SafeRelease(&renderer->d2d_context);
 	SafeRelease(&renderer->d2d_target_bitmap);
+	SafeRelease(&renderer->d2d_grid_bitmap);
 	SafeRelease(&renderer->d2d_background_rect_brush);
 	SafeRelease(&renderer->dwrite_factory);
 	SafeRelease(&renderer->dwrite_text_format);
 	delete renderer->glyph_renderer;
 
-	free(renderer->grid_chars);
+	GridModelShutdown(&renderer->model);
+	free(renderer->drawn_row_versions);
+	free(renderer->frame_dirty_rows);
+	for (int i = 0; i < renderer->frame_rows; ++i) {
+		RowDrawDescFree(&renderer->row_descs[i]);
+	}
+	free(renderer->row_descs);
 	free(renderer->wchar_buffer);
-	free(renderer->grid_cell_properties);
+	for (GridSnapshot &snapshot : renderer->snapshots.slots) {
+		GridSnapshotShutdown(&snapshot);
+	}
+	LayoutCacheShutdown(&renderer->layout_cache);
+	LayoutCacheShutdown(&renderer->cursor_layout_cache);
+	for (size_t i = 0; i < renderer->hl_resolved.size(); ++i) {
+		SafeRelease(&renderer->hl_resolved[i].drawing_effect);
+	}
+	SafeRelease(&renderer->cursor_drawing_effect);
+	BackgroundPlannerShutdown(&renderer->background_planner);
+	GlyphMetricsCacheShutdown(&renderer->glyph_metrics);
 }
 
 void RendererResize(Renderer *renderer, uint32_t width, uint32_t height) {
+	std::lock_guard<std::mutex> lock(renderer->render_mutex);
 	InitializeWindowDependentResources(renderer, width, height);
 }
 
-bool ContainsSurrogatePair(uint32_t cell) {
-	return cell > 0xFFFF;
+void ConvertToWide(Renderer *renderer, GridCell *cells, uint32_t length) {
+	renderer->wchar_buffer_length = CellsToUtf16(renderer->frame, cells, length, renderer->wchar_buffer);
 }
 
-void ConvertToWide(Renderer *renderer, uint32_t *text, uint32_t length) {
-	size_t wchar_i = 0;
-	for (size_t i = 0; i < length; i++) {
-		// Unpack surrogate pairs into two sequential wchars.
-		if (ContainsSurrogatePair(text[i])) {
-			renderer->wchar_buffer[wchar_i] = static_cast<wchar_t>(text[i] >> 16);
-			renderer->wchar_buffer[wchar_i + 1] = static_cast<wchar_t>(text[i] & 0xFFFF);
-			wchar_i += 2;
-			continue;
-		}
-
-		renderer->wchar_buffer[wchar_i] = static_cast<wchar_t>(text[i]);
-		wchar_i += 1;
-	}
-
-	renderer->wchar_buffer_length = wchar_i;
-}
-
-float GetTextWidth(Renderer *renderer, uint32_t *text, uint32_t length) {
-	ConvertToWide(renderer, text, length);
+float GetTextWidth(Renderer *renderer, GridCell *cells, uint32_t length) {
+	ConvertToWide(renderer, cells, length);
 
 	// Create dummy text format to hit test the width of the font
 	IDWriteTextLayout *test_text_layout = nullptr;
@@ -263,7 +326,7 @@ float GetTextWidth(Renderer *renderer, uint32_t *text, uint32_t length) {
 }
 
 bool UpdateFontMetrics(Renderer *renderer, float font_size, const char* font_string, int strlen) {
-	font_size = max(5.0f, min(font_size, 150.0f));
+	font_size = std::clamp(font_size, 5.0f, 150.0f);
 	renderer->last_requested_font_size = font_size;
 
 	IDWriteFontCollection *font_collection;
@@ -374,97 +437,65 @@ bool UpdateFontMetrics(Renderer *renderer, float font_size, const char* font_str
 }
 
 bool RendererUpdateFont(Renderer *renderer, float font_size, const char *font_string, int strlen) {
+	std::lock_guard<std::mutex> lock(renderer->render_mutex);
 	if (renderer->dwrite_text_format) {
 		renderer->dwrite_text_format->Release();
 	}
 
-	renderer->draws_invalidated = true;
+	renderer->render_invalidated = true;
+	LayoutCacheClear(&renderer->layout_cache);
+	LayoutCacheClear(&renderer->cursor_layout_cache);
+	GlyphMetricsCacheClear(&renderer->glyph_metrics);
 	return UpdateFontMetrics(renderer, font_size, font_string, strlen);
 }
 
-void UpdateDefaultColors(Renderer *renderer, mpack_node_t default_colors) {
-	size_t default_colors_arr_length = mpack_node_array_length(default_colors);
-
-	for (size_t i = 1; i < default_colors_arr_length; ++i) {
-		mpack_node_t color_arr = mpack_node_array_at(default_colors, i);
-
-		// Default colors occupy the first index of the highlight attribs array
-		renderer->hl_attribs[0].foreground = static_cast<uint32_t>(mpack_node_array_at(color_arr, 0).data->value.u);
-		renderer->hl_attribs[0].background = static_cast<uint32_t>(mpack_node_array_at(color_arr, 1).data->value.u);
-		renderer->hl_attribs[0].special = static_cast<uint32_t>(mpack_node_array_at(color_arr, 2).data->value.u);
-		renderer->hl_attribs[0].flags = 0;
-	}
-}
-
-void UpdateHighlightAttributes(Renderer *renderer, mpack_node_t highlight_attribs) {
-	uint64_t attrib_count = mpack_node_array_length(highlight_attribs);
-	for (uint64_t i = 1; i < attrib_count; ++i) {
-		int64_t attrib_index = mpack_node_array_at(mpack_node_array_at(highlight_attribs, i), 0).data->value.i;
-		assert(attrib_index <= MAX_HIGHLIGHT_ATTRIBS);
-
-		mpack_node_t attrib_map = mpack_node_array_at(mpack_node_array_at(highlight_attribs, i), 1);
-
-		const auto SetColor = [&](const char *name, uint32_t *color) {
-			mpack_node_t color_node = mpack_node_map_cstr_optional(attrib_map, name);
-			if (!mpack_node_is_missing(color_node)) {
-				*color = static_cast<uint32_t>(color_node.data->value.u);
-			}
-			else {
-				*color = DEFAULT_COLOR;
-			}
-		};
-		SetColor("foreground", &renderer->hl_attribs[attrib_index].foreground);
-		SetColor("background", &renderer->hl_attribs[attrib_index].background);
-		SetColor("special", &renderer->hl_attribs[attrib_index].special);
-
-		const auto SetFlag = [&](const char *flag_name, HighlightAttributeFlags flag) {
-			mpack_node_t flag_node = mpack_node_map_cstr_optional(attrib_map, flag_name);
-			if (!mpack_node_is_missing(flag_node)) {
-				if (flag_node.data->value.b) {
-					renderer->hl_attribs[attrib_index].flags |= flag;
-				}
-				else {
-					renderer->hl_attribs[attrib_index].flags &= ~flag;
-				}
-			}
-		};
-		SetFlag("reverse", HL_ATTRIB_REVERSE);
-		SetFlag("italic", HL_ATTRIB_ITALIC);
-		SetFlag("bold", HL_ATTRIB_BOLD);
-		SetFlag("strikethrough", HL_ATTRIB_STRIKETHROUGH);
-		SetFlag("underline", HL_ATTRIB_UNDERLINE);
-		SetFlag("undercurl", HL_ATTRIB_UNDERCURL);
-	}
-}
-
 uint32_t CreateForegroundColor(Renderer *renderer, HighlightAttributes *hl_attribs) {
 	if (hl_attribs->flags & HL_ATTRIB_REVERSE) {
-		return hl_attribs->background == DEFAULT_COLOR ? renderer->hl_attribs[0].background : hl_attribs->background;
+		return hl_attribs->background == DEFAULT_COLOR ? renderer->frame->hl_attribs[0].background : hl_attribs->background;
 	}
 	else {
-		return hl_attribs->foreground == DEFAULT_COLOR ? renderer->hl_attribs[0].foreground : hl_attribs->foreground;
+		return hl_attribs->foreground == DEFAULT_COLOR ? renderer->frame->hl_attribs[0].foreground : hl_attribs->foreground;
 	}
 }
 
 uint32_t CreateBackgroundColor(Renderer *renderer, HighlightAttributes *hl_attribs) {
 	if (hl_attribs->flags & HL_ATTRIB_REVERSE) {
-		return hl_attribs->foreground == DEFAULT_COLOR ? renderer->hl_attribs[0].foreground : hl_attribs->foreground;
+		return hl_attribs->foreground == DEFAULT_COLOR ? renderer->frame->hl_attribs[0].foreground : hl_attribs->foreground;
 	}
 	else {
-		return hl_attribs->background == DEFAULT_COLOR ? renderer->hl_attribs[0].background : hl_attribs->background;
+		return hl_attribs->background == DEFAULT_COLOR ? renderer->frame->hl_attribs[0].background : hl_attribs->background;
 	}
 }
 
 uint32_t CreateSpecialColor(Renderer *renderer, HighlightAttributes *hl_attribs) {
-	return hl_attribs->special == DEFAULT_COLOR ? renderer->hl_attribs[0].special : hl_attribs->special;
+	return hl_attribs->special == DEFAULT_COLOR ? renderer->frame->hl_attribs[0].special : hl_attribs->special;
+}
+
+ResolvedHighlight *GetResolvedHighlight(Renderer *renderer, uint16_t hl_attrib_id) {
+	ResolvedHighlight *resolved = &renderer->hl_resolved[hl_attrib_id];
+	if (resolved->generation != renderer->hl_generation) {
+		HighlightAttributes *hl_attribs = &renderer->frame->hl_attribs[hl_attrib_id];
+		resolved->background = CreateBackgroundColor(renderer, hl_attribs);
+
+		// Layouts holding the old colors have been dropped from the cache
+		// by now, so the effect is updated in place
+		D2D1_COLOR_F text_color = D2D1::ColorF(CreateForegroundColor(renderer, hl_attribs));
+		D2D1_COLOR_F special_color = D2D1::ColorF(CreateSpecialColor(renderer, hl_attribs));
+		if (resolved->drawing_effect) {
+			resolved->drawing_effect->text_color = text_color;
+			resolved->drawing_effect->special_color = special_color;
+		}
+		else {
+			resolved->drawing_effect = new GlyphDrawingEffect(text_color, special_color);
+			resolved->drawing_effect->AddRef();
+		}
+		resolved->generation = renderer->hl_generation;
+	}
+	return resolved;
 }
 
 void ApplyHighlightAttributes(Renderer *renderer, HighlightAttributes *hl_attribs,
-	IDWriteTextLayout *text_layout, int start, int end) {
-	GlyphDrawingEffect *drawing_effect = new GlyphDrawingEffect(
-			CreateForegroundColor(renderer, hl_attribs),
-			CreateSpecialColor(renderer, hl_attribs)
-	);
+	GlyphDrawingEffect *drawing_effect, IDWriteTextLayout *text_layout, int start, int end) {
 	DWRITE_TEXT_RANGE range {
 		.startPosition = static_cast<uint32_t>(start),
 		.length = static_cast<uint32_t>(end - start)
@@ -489,342 +520,315 @@ void ApplyHighlightAttributes(Renderer *renderer, HighlightAttributes *hl_attrib
 	text_layout->SetDrawingEffect(drawing_effect, range);
 }
 
-void DrawBackgroundRect(Renderer *renderer, D2D1_RECT_F rect, HighlightAttributes *hl_attribs) {
-	uint32_t color = CreateBackgroundColor(renderer, hl_attribs);
-	renderer->d2d_background_rect_brush->SetColor(D2D1::ColorF(color));
+void DrawBackgroundRect(Renderer *renderer, D2D1_RECT_F rect, D2D1_COLOR_F color) {
+	renderer->d2d_background_rect_brush->SetColor(color);
 
 	renderer->d2d_context->FillRectangle(rect, renderer->d2d_background_rect_brush);
 }
 
 D2D1_RECT_F GetCursorForegroundRect(Renderer *renderer, D2D1_RECT_F cursor_bg_rect) {
-	if (renderer->cursor.mode_info) {
-		switch (renderer->cursor.mode_info->shape) {
-		case CursorShape::None: {
-		} return cursor_bg_rect;
-		case CursorShape::Block: {
-		} return cursor_bg_rect;
-		case CursorShape::Vertical: {
-			cursor_bg_rect.right = cursor_bg_rect.left + 2;
-		} return cursor_bg_rect;
-		case CursorShape::Horizontal: {
-			cursor_bg_rect.top = cursor_bg_rect.bottom - 2;
-		} return cursor_bg_rect;
-		}
+	switch (renderer->frame->cursor.shape) {
+	case CursorShape::None: {
+	} return cursor_bg_rect;
+	case CursorShape::Block: {
+	} return cursor_bg_rect;
+	case CursorShape::Vertical: {
+		cursor_bg_rect.right = cursor_bg_rect.left + 2;
+	} return cursor_bg_rect;
+	case CursorShape::Horizontal: {
+		cursor_bg_rect.top = cursor_bg_rect.bottom - 2;
+	} return cursor_bg_rect;
 	}
 	return cursor_bg_rect;
 }
 
-void DrawHighlightedText(Renderer *renderer, D2D1_RECT_F rect, uint32_t *text, uint32_t length, HighlightAttributes *hl_attribs) {
-	ConvertToWide(renderer, text, length);
+// The layout only depends on the cells and their styles, the cursor's
+// colors are read from cursor_drawing_effect when it is drawn
+IDWriteTextLayout *CreateCursorLayout(Renderer *renderer, GridCell *cells, uint32_t length, HighlightAttributes *hl_attribs) {
+	ConvertToWide(renderer, cells, length);
 
 	IDWriteTextLayout *text_layout = nullptr;
 	WIN_CHECK(renderer->dwrite_factory->CreateTextLayout(
 		renderer->wchar_buffer,
 		renderer->wchar_buffer_length,
 		renderer->dwrite_text_format,
-		rect.right - rect.left,
-		rect.bottom - rect.top,
+		renderer->font_width * length,
+		renderer->font_height,
 		&text_layout
 	));
-	ApplyHighlightAttributes(renderer, hl_attribs, text_layout, 0, 1);
+	ApplyHighlightAttributes(renderer, hl_attribs, renderer->cursor_drawing_effect, text_layout,
+		0, static_cast<int>(renderer->wchar_buffer_length));
+	return text_layout;
+}
 
-	renderer->d2d_context->PushAxisAlignedClip(rect, D2D1_ANTIALIAS_MODE_ALIASED);
-	text_layout->Draw(renderer, renderer->glyph_renderer, rect.left, rect.top);
-	text_layout->Release();
-	renderer->d2d_context->PopAxisAlignedClip();
+// Measured the first time a codepoint shows up in the current font, which
+// saves a throwaway text layout per cell on every draw
+const GlyphMetrics *GetGlyphMetrics(Renderer *renderer, uint32_t codepoint) {
+	GlyphMetrics *metrics = GlyphMetricsFind(&renderer->glyph_metrics, codepoint);
+	if (!(metrics->flags & GLYPH_METRICS_MEASURED)) {
+		GridCell cell { .text = codepoint };
+		metrics->advance = GetTextWidth(renderer, &cell, 1);
+
+		uint16_t glyph_index;
+		WIN_CHECK(renderer->font_face->GetGlyphIndicesW(&codepoint, 1, &glyph_index));
+		metrics->flags = GLYPH_METRICS_MEASURED | (glyph_index ? GLYPH_METRICS_COVERED : 0);
+	}
+	return metrics;
 }
 
-void DrawGridLine(Renderer *renderer, int row) {
-	int base = row * renderer->grid_cols;
+// Graphemes are rare enough to measure every time
+float MeasureGrapheme(void *context, const GridCell *cell) {
+	GridCell grapheme_cell = *cell;
+	return GetTextWidth(static_cast<Renderer *>(context), &grapheme_cell, 1);
+}
 
-	D2D1_RECT_F rect {
-		.left = 0.0f,
-		.top = row * renderer->font_height,
-		.right = renderer->grid_cols * renderer->font_width,
-		.bottom = (row * renderer->font_height) + renderer->font_height
-	};
+// For rows that need glyphs measured first, which only the render thread
+// can do, or graphemes measured at all
+void PrepareRowSerially(Renderer *renderer, RowDrawDesc *desc) {
+	GridCell *cells = GridSnapshotRow(renderer->frame, desc->row);
+	for (int i = 0; i < renderer->frame->cols; ++i) {
+		if (!IsGraphemeId(cells[i].text)) {
+			GetGlyphMetrics(renderer, cells[i].text);
+		}
+	}
+	[[maybe_unused]] bool prepared = RowPrepare(desc, renderer->frame, &renderer->glyph_metrics, renderer->font_width, MeasureGrapheme, renderer);
+	assert(prepared);
+}
+
+// Shapes a prepared row with all the spacing and highlights applied, ready to draw
+IDWriteTextLayout1 *CreateGridLineLayout(Renderer *renderer, RowDrawDesc *desc) {
+	GridSnapshot *frame = renderer->frame;
+	float width = frame->cols * renderer->font_width;
 
 	IDWriteTextLayout *temp_text_layout = nullptr;
-	ConvertToWide(renderer, &renderer->grid_chars[base], renderer->grid_cols);
 	WIN_CHECK(renderer->dwrite_factory->CreateTextLayout(
-		renderer->wchar_buffer,
-		renderer->wchar_buffer_length,
+		desc->text,
+		desc->text_length,
 		renderer->dwrite_text_format,
-		rect.right - rect.left,
-		rect.bottom - rect.top,
+		width,
+		renderer->font_height,
 		&temp_text_layout
 	));
-    size_t grid_chars_length = renderer->wchar_buffer_length;
 	IDWriteTextLayout1 *text_layout;
 	temp_text_layout->QueryInterface<IDWriteTextLayout1>(&text_layout);
 	temp_text_layout->Release();
 
-	uint16_t hl_attrib_id = renderer->grid_cell_properties[base].hl_attrib_id;
-	int col_offset = 0;
-	int col_offset_wchars = 0;
-	for (int i = 0, i_wchars = 0; i < renderer->grid_cols;
-		i_wchars += ContainsSurrogatePair(renderer->grid_chars[base + i]) ? 2 : 1, ++i) {
-
-		// Add spacing for wide chars
-		if (renderer->grid_cell_properties[base + i].is_wide_char) {
-			float char_width = GetTextWidth(renderer, &renderer->grid_chars[base + i], 2);
-			DWRITE_TEXT_RANGE range { .startPosition = static_cast<uint32_t>(i_wchars), .length = 1 };
-			text_layout->SetCharacterSpacing(0, (renderer->font_width * 2) - char_width, 0, range);
-		}
-
-		// Add spacing for unicode chars. These characters are still single char width, 
-		// but some of them by default will take up a bit more or less, leading to issues. 
-		// So we realign them here.	
-		else if(renderer->grid_chars[base + i] > 0xFF) {
-			float char_width = GetTextWidth(renderer, &renderer->grid_chars[base + i], 1);
-			if(abs(char_width - renderer->font_width) > 0.01f) {
-				DWRITE_TEXT_RANGE range { .startPosition = static_cast<uint32_t>(i_wchars), .length = 1 };
-				text_layout->SetCharacterSpacing(0, renderer->font_width - char_width, 0, range);
-			}
-		}
-		else {
-			// Add spacing for character not existing in this font
-			uint16_t glyph_index;
-			uint32_t code = static_cast<uint32_t>(renderer->grid_chars[base + i]);
-			WIN_CHECK(renderer->font_face->GetGlyphIndicesW(&code, 1, &glyph_index));
-			if (glyph_index == 0)
-			{
-				float char_width = GetTextWidth(renderer, &renderer->grid_chars[base + i], 1);
-				float d_width = renderer->font_width - char_width;
-				if (d_width > 0)
-				{
-					DWRITE_TEXT_RANGE range{ .startPosition = static_cast<uint32_t>(i_wchars), .length = 1 };
-					text_layout->SetCharacterSpacing(d_width / 2, d_width / 2, 0, range);
-				}
-			}
-		}
-
-		// Check if the attributes change, 
-		// if so draw until this point and continue with the new attributes
-		if (renderer->grid_cell_properties[base + i].hl_attrib_id != hl_attrib_id) {
-			D2D1_RECT_F bg_rect {
-				.left = col_offset * renderer->font_width,
-				.top = row * renderer->font_height,
-				.right = col_offset * renderer->font_width + renderer->font_width * (i - col_offset),
-				.bottom = (row * renderer->font_height) + renderer->font_height
-			};
-			DrawBackgroundRect(renderer, bg_rect, &renderer->hl_attribs[hl_attrib_id]);
-			ApplyHighlightAttributes(renderer, &renderer->hl_attribs[hl_attrib_id], text_layout, col_offset_wchars, i_wchars);
-
-			hl_attrib_id = renderer->grid_cell_properties[base + i].hl_attrib_id;
-			col_offset = i;
-			col_offset_wchars = i_wchars;
-		}
+	for (uint32_t i = 0; i < desc->spacing_count; ++i) {
+		RowSpacing *spacing = &desc->spacings[i];
+		DWRITE_TEXT_RANGE range { .startPosition = spacing->start, .length = spacing->length };
+		text_layout->SetCharacterSpacing(spacing->leading, spacing->trailing, 0, range);
+	}
+	for (uint32_t i = 0; i < desc->run_count; ++i) {
+		RowHighlightRun *run = &desc->runs[i];
+		ApplyHighlightAttributes(renderer, &frame->hl_attribs[run->hl_attrib_id],
+			GetResolvedHighlight(renderer, run->hl_attrib_id)->drawing_effect, text_layout, run->start, run->end);
 	}
-	
-	// Draw the remaining columns, there is always atleast the last column to draw,
-	// but potentially more in case the last X columns share the same hl_attrib
-	D2D1_RECT_F last_rect = rect;
-	last_rect.left = col_offset * renderer->font_width;
-	DrawBackgroundRect(renderer, last_rect, &renderer->hl_attribs[hl_attrib_id]);
-	ApplyHighlightAttributes(renderer, &renderer->hl_attribs[hl_attrib_id], text_layout, col_offset_wchars, grid_chars_length);
 
-	renderer->d2d_context->PushAxisAlignedClip(rect, D2D1_ANTIALIAS_MODE_ALIASED);
 	if(renderer->disable_ligatures) {
 		text_layout->SetTypography(renderer->dwrite_typography, DWRITE_TEXT_RANGE { 
 			.startPosition = 0, 
-			.length = static_cast<uint32_t>(grid_chars_length)
+			.length = desc->text_length
 		});
 	}
-	text_layout->Draw(renderer, renderer->glyph_renderer, 0.0f, rect.top);
-	renderer->d2d_context->PopAxisAlignedClip();
-	text_layout->Release();
+	return text_layout;
 }
 
-void DrawAllGridLines(Renderer *renderer) {
-	for (size_t i = 0; i < renderer->grid_rows; ++i) {
-		DrawGridLine(renderer, i);
-	}
+void ReleaseTextLayout(void *text_layout) {
+	static_cast<IDWriteTextLayout *>(text_layout)->Release();
 }
 
-bool IsSurrogatePair(wchar_t left, wchar_t right) {
-	return (0xD800 <= left && left <= 0xDBFF) && (0xDC00 <= right && right <= 0xDFFF);
+// Hands one background run per highlight run to the planner, which
+// joins runs of the same color however many ids they came from
+void PlanGridLineBackground(Renderer *renderer, int row) {
+	GridSnapshot *frame = renderer->frame;
+	GridCell *cells = GridSnapshotRow(frame, row);
+	uint16_t hl_attrib_id = cells[0].hl_attrib_id;
+	int col_offset = 0;
+	for (int i = 1; i <= frame->cols; ++i) {
+		if (i == frame->cols || cells[i].hl_attrib_id != hl_attrib_id) {
+			BackgroundPlannerAddRun(&renderer->background_planner, row, col_offset, i,
+				GetResolvedHighlight(renderer, hl_attrib_id)->background);
+			renderer->background_run_count++;
+			if (i < frame->cols) {
+				hl_attrib_id = cells[i].hl_attrib_id;
+				col_offset = i;
+			}
+		}
+	}
 }
 
-void DrawGridLines(Renderer *renderer, mpack_node_t grid_lines) {
-	assert(renderer->grid_chars != nullptr);
-	assert(renderer->grid_cell_properties != nullptr);
-	
-	int grid_size = renderer->grid_cols * renderer->grid_rows;
-	size_t line_count = mpack_node_array_length(grid_lines);
-	for (size_t i = 1; i < line_count; ++i) {
-		mpack_node_t grid_line = mpack_node_array_at(grid_lines, i);
-
-		int row = MPackIntFromArray(grid_line, 1);
-		int col_start = MPackIntFromArray(grid_line, 2);
-
-		mpack_node_t cell_array = mpack_node_array_at(grid_line, 3);
-		size_t cell_array_length = mpack_node_array_length(cell_array);
+void DrawPlannedBackgrounds(Renderer *renderer) {
+	BackgroundPlanner *planner = &renderer->background_planner;
+	for (uint32_t i = 0; i < planner->rect_count; ++i) {
+		BackgroundRect *planned = &planner->rects[i];
+		if (i == 0 || planned->color != planner->rects[i - 1].color) {
+			renderer->d2d_background_rect_brush->SetColor(D2D1::ColorF(planned->color));
+		}
+		D2D1_RECT_F rect {
+			.left = planned->col_begin * renderer->font_width,
+			.top = planned->row_begin * renderer->font_height,
+			.right = planned->col_end * renderer->font_width,
+			.bottom = planned->row_end * renderer->font_height
+		};
+		renderer->d2d_context->FillRectangle(rect, renderer->d2d_background_rect_brush);
+	}
+	renderer->background_rect_count += planner->rect_count;
+}
 
-		int hl_attrib_id = 0;
-		int offset = row * renderer->grid_cols + col_start;
-		for (size_t j = 0; j < cell_array_length; ++j) {
-			mpack_node_t cell = mpack_node_array_at(cell_array, j);
-			size_t cell_length = mpack_node_array_length(cell);
+// Only the text, the background has been filled by the planner
+void DrawGridLine(Renderer *renderer, int row, IDWriteTextLayout1 *text_layout) {
+	D2D1_RECT_F rect {
+		.left = 0.0f,
+		.top = row * renderer->font_height,
+		.right = renderer->frame->cols * renderer->font_width,
+		.bottom = (row * renderer->font_height) + renderer->font_height
+	};
 
-			mpack_node_t text = mpack_node_array_at(cell, 0);
-			const char *str = mpack_node_str(text);
+	renderer->d2d_context->PushAxisAlignedClip(rect, D2D1_ANTIALIAS_MODE_ALIASED);
+	text_layout->Draw(renderer, renderer->glyph_renderer, 0.0f, rect.top);
+	renderer->d2d_context->PopAxisAlignedClip();
+}
 
-			if (cell_length > 1) {
-				hl_attrib_id = MPackIntFromArray(cell, 1);
-			}
+// Worker side of the row pool. Reads the snapshot and the measured glyphs
+// only, the render thread waits for the batch before touching either.
+void PrepareRowTask(void *context, uint32_t index, uint32_t) {
+	Renderer *renderer = static_cast<Renderer *>(context);
+	RowDrawDesc *desc = &renderer->row_descs[index];
+	desc->prepared = RowPrepare(desc, renderer->frame, &renderer->glyph_metrics, renderer->font_width, nullptr, nullptr);
+}
 
-			int repeat = 1;
-			if (cell_length > 2) {
-				repeat = MPackIntFromArray(cell, 2);
+void DrawDirtyGridLines(Renderer *renderer) {
+	GridSnapshot *frame = renderer->frame;
+
+	// Text is clipped to its row, so every background can go first,
+	// batched across rows into as few fills as possible
+	BackgroundPlannerBegin(&renderer->background_planner);
+	for (int i = 0; i < (frame->rows + 63) / 64; ++i) {
+		uint64_t row_bits = renderer->frame_dirty_rows[i];
+		while (row_bits) {
+			PlanGridLineBackground(renderer, i * 64 + std::countr_zero(row_bits));
+			row_bits &= row_bits - 1;
+		}
+	}
+	BackgroundPlannerFinish(&renderer->background_planner);
+	DrawPlannedBackgrounds(renderer);
+
+	// Rows with the same cells reuse their shaped layout, the rest are
+	// prepared on the row pool and only shaped and drawn here
+	size_t key_size = frame->cols * sizeof(GridCell);
+	uint32_t prepare_count = 0;
+	for (int i = 0; i < (frame->rows + 63) / 64; ++i) {
+		uint64_t row_bits = renderer->frame_dirty_rows[i];
+		while (row_bits) {
+			int row = i * 64 + std::countr_zero(row_bits);
+			row_bits &= row_bits - 1;
+
+			GridCell *cells = GridSnapshotRow(frame, row);
+			uint64_t hash = LayoutCacheHash(cells, key_size);
+			auto text_layout = static_cast<IDWriteTextLayout1 *>(LayoutCacheLookup(&renderer->layout_cache, hash, cells, key_size));
+			if (text_layout) {
+				DrawGridLine(renderer, row, text_layout);
+				continue;
 			}
+			RowDrawDesc *desc = &renderer->row_descs[prepare_count++];
+			desc->row = row;
+			desc->hash = hash;
+		}
+	}
+	if (prepare_count >= ROW_POOL_MIN_BATCH) {
+		WorkPoolRun(&renderer->row_pool, prepare_count, PrepareRowTask, renderer);
+	}
+	else {
+		for (uint32_t i = 0; i < prepare_count; ++i) {
+			PrepareRowTask(renderer, i, 0);
+		}
+	}
 
-			int strlen = static_cast<int>(mpack_node_strlen(text));
-			if (strlen == 0) {
-				// This is the right part of the wide char. Sadly grid_line
-				// event can be splitted at the middle of wide character.
-
-				// Be careful not to overwrite right half of surrogate pair.
-				// It never happens that offset == 0, since it is the right
-				// half of wide char, but add check for safety.
-				if (offset == 0 || !IsSurrogatePair(renderer->grid_chars[offset - 1], renderer->grid_chars[offset])) {
-					renderer->grid_chars[offset] = L'\0';
-				}
-
-				// This cell itself is not a wide character.
-				renderer->grid_cell_properties[offset].is_wide_char = false;
-
-				// Adjust properties. Again it never happens that offset == 0,
-				// since it is the right half of wide char, but adding check
-				// for safety.
-				if (offset > 0) {
-					// Set is_wide_char flag for the left cell to true.
-					renderer->grid_cell_properties[offset - 1].is_wide_char = true;
-
-					// Inherit hl_attrib_id from left half.
-					renderer->grid_cell_properties[offset].hl_attrib_id = renderer->grid_cell_properties[offset - 1].hl_attrib_id;
-				}
-
-				++offset;
-			} else {
-				// This is single width character or left half cell of wide
-				// character.
-
-				// Left cell should not be a wide character, so reset the
-				// flag. This time checking offset > 0 is mandatory.
-				if (offset > 0) {
-					renderer->grid_cell_properties[offset - 1].is_wide_char = false;
-				}
+	for (uint32_t i = 0; i < prepare_count; ++i) {
+		RowDrawDesc *desc = &renderer->row_descs[i];
+		GridCell *cells = GridSnapshotRow(frame, desc->row);
 
-				// Wide character will never be repeated, so we don't have to
-				// handle wide character specially.
-				for (int k = 0; k < repeat; ++k) {
-					wchar_t buffer[2];
-					int wstrlen = MultiByteToWideChar(CP_UTF8, 0, str, strlen, buffer, 2);
-					if (wstrlen == 2) {
-						// If the str takes two wchars, it must be a surrogate pair.
-						bool is_surrogate_pair = IsSurrogatePair(buffer[0], buffer[1]);
-						if (is_surrogate_pair) {
-							// Pack the surrogate pair into a single grid cell.
-							renderer->grid_chars[offset] = (buffer[0] << 16) | buffer[1];
-						} else {
-							// This is an unsupported character (ie: a diacritic), draw a box here instead.
-							renderer->grid_chars[offset] = 0x25a1;
-						}
-					} else {
-						renderer->grid_chars[offset] = buffer[0];
-					}
-
-					renderer->grid_cell_properties[offset].hl_attrib_id = hl_attrib_id;
-
-					// Here we set is_wide_char to be always false. This is
-					// because if it is actually a wide character, then the
-					// right half of the char, empty string, should be appear
-					// soon, and the flag will be set there (first branch of
-					// this `if`).
-					renderer->grid_cell_properties[offset].is_wide_char = false;
-
-					++offset;
-				}
+		// Identical rows missed together, the first one shaped fills the cache
+		auto text_layout = static_cast<IDWriteTextLayout1 *>(LayoutCacheLookup(&renderer->layout_cache, desc->hash, cells, key_size));
+		if (!text_layout) {
+			if (!desc->prepared) {
+				PrepareRowSerially(renderer, desc);
 			}
+			text_layout = CreateGridLineLayout(renderer, desc);
+			LayoutCacheInsert(&renderer->layout_cache, desc->hash, cells, key_size, text_layout,
+				desc->text_length * LAYOUT_CACHE_COST_PER_CHAR);
 		}
+		DrawGridLine(renderer, desc->row, text_layout);
+	}
+}
+
+// The cell or two the cursor covers, false if it isn't on the grid
+bool GetCursorRect(Renderer *renderer, D2D1_RECT_F *cursor_rect) {
+	GridSnapshot *frame = renderer->frame;
+	if (!frame->cursor.visible) return false;
+	if (frame->cursor.row >= frame->rows || frame->cursor.col >= frame->cols) return false;
+	GridCell *cursor_cell = &GridSnapshotRow(frame, frame->cursor.row)[frame->cursor.col];
 
-		DrawGridLine(renderer, row);
+	int double_width_char_factor = 1;
+	if (cursor_cell->flags & CELL_WIDE_CHAR) {
+		double_width_char_factor += 1;
 	}
+
+	*cursor_rect = D2D1_RECT_F {
+		.left = frame->cursor.col * renderer->font_width,
+		.top = frame->cursor.row * renderer->font_height,
+		.right = frame->cursor.col * renderer->font_width + renderer->font_width * double_width_char_factor,
+		.bottom = (frame->cursor.row * renderer->font_height) + renderer->font_height
+	};
+	return true;
 }
 
 void DrawCursor(Renderer *renderer) {
-	if (!renderer->cursor.mode_info) return;
-	int cursor_grid_offset = renderer->cursor.row * renderer->grid_cols + renderer->cursor.col;
+	D2D1_RECT_F cursor_rect;
+	if (!GetCursorRect(renderer, &cursor_rect)) return;
+	GridSnapshot *frame = renderer->frame;
+	GridCell *cursor_cell = &GridSnapshotRow(frame, frame->cursor.row)[frame->cursor.col];
 
 	int double_width_char_factor = 1;
-	if (cursor_grid_offset < (renderer->grid_rows * renderer->grid_cols) &&
-		renderer->grid_cell_properties[cursor_grid_offset].is_wide_char) {
+	if (cursor_cell->flags & CELL_WIDE_CHAR) {
 		double_width_char_factor += 1;
 	}
 
-	HighlightAttributes cursor_hl_attribs = renderer->hl_attribs[renderer->cursor.mode_info->hl_attrib_id];
+	HighlightAttributes cursor_hl_attribs = frame->hl_attribs[frame->cursor.hl_attrib_id];
 
 	// Inherit GUI options for char under cursor (like italic)
-	int hl_attrib_id_under_cursor = renderer->grid_cell_properties[cursor_grid_offset].hl_attrib_id;
-	HighlightAttributes under_cursor_hl_attribs = renderer->hl_attribs[hl_attrib_id_under_cursor];
+	int hl_attrib_id_under_cursor = cursor_cell->hl_attrib_id;
+	HighlightAttributes under_cursor_hl_attribs = frame->hl_attribs[hl_attrib_id_under_cursor];
 	cursor_hl_attribs.flags = under_cursor_hl_attribs.flags;
 
-	if (renderer->cursor.mode_info->hl_attrib_id == 0) {
+	if (frame->cursor.hl_attrib_id == 0) {
 		cursor_hl_attribs.flags |= HL_ATTRIB_REVERSE;
 	}
 
-	D2D1_RECT_F cursor_rect {
-		.left = renderer->cursor.col * renderer->font_width,
-		.top = renderer->cursor.row * renderer->font_height,
-		.right = renderer->cursor.col * renderer->font_width + renderer->font_width * double_width_char_factor,
-		.bottom = (renderer->cursor.row * renderer->font_height) + renderer->font_height
-	};
 	D2D1_RECT_F cursor_fg_rect = GetCursorForegroundRect(renderer, cursor_rect);
-	DrawBackgroundRect(renderer, cursor_fg_rect, &cursor_hl_attribs);
-
-	if (renderer->cursor.mode_info->shape == CursorShape::Block) {
-		DrawHighlightedText(renderer, cursor_fg_rect, &renderer->grid_chars[cursor_grid_offset],
-			double_width_char_factor, &cursor_hl_attribs);
-	}
-}
-
-bool UpdateGridSize(Renderer *renderer, mpack_node_t grid_resize) {
-	mpack_node_t grid_resize_params = mpack_node_array_at(grid_resize, 1);
-	int grid_cols = MPackIntFromArray(grid_resize_params, 1);
-	int grid_rows = MPackIntFromArray(grid_resize_params, 2);
-
-	if (renderer->grid_chars == nullptr ||
-		renderer->wchar_buffer == nullptr ||
-		renderer->grid_cell_properties == nullptr ||
-		renderer->grid_cols != grid_cols ||
-		renderer->grid_rows != grid_rows) {
-		
-		renderer->grid_cols = grid_cols;
-		renderer->grid_rows = grid_rows;
-
-		free(renderer->grid_chars);
-		renderer->grid_chars = static_cast<uint32_t *>(malloc(static_cast<size_t>(grid_cols) * grid_rows * sizeof(uint32_t)));
-		// Initialize all grid character to a space. An empty
-		// grid cell is equivalent to a space in a text layout
-		for (int i = 0; i < grid_cols * grid_rows; ++i) {
-			renderer->grid_chars[i] = L' ';
+	DrawBackgroundRect(renderer, cursor_fg_rect, D2D1::ColorF(CreateBackgroundColor(renderer, &cursor_hl_attribs)));
+
+	if (frame->cursor.shape == CursorShape::Block) {
+		// The cursor has made up attributes, so it gets an effect of its own
+		renderer->cursor_drawing_effect->text_color = D2D1::ColorF(CreateForegroundColor(renderer, &cursor_hl_attribs));
+		renderer->cursor_drawing_effect->special_color = D2D1::ColorF(CreateSpecialColor(renderer, &cursor_hl_attribs));
+
+		CursorLayoutKey key {};
+		memcpy(key.cells, cursor_cell, double_width_char_factor * sizeof(GridCell));
+		key.hl_flags = cursor_hl_attribs.flags;
+		key.length = static_cast<uint16_t>(double_width_char_factor);
+		uint64_t hash = LayoutCacheHash(&key, sizeof(key));
+		auto text_layout = static_cast<IDWriteTextLayout *>(LayoutCacheLookup(&renderer->cursor_layout_cache, hash, &key, sizeof(key)));
+		if (!text_layout) {
+			text_layout = CreateCursorLayout(renderer, cursor_cell, double_width_char_factor, &cursor_hl_attribs);
+			LayoutCacheInsert(&renderer->cursor_layout_cache, hash, &key, sizeof(key), text_layout,
+				renderer->wchar_buffer_length * LAYOUT_CACHE_COST_PER_CHAR);
 		}
-		renderer->grid_cell_properties = static_cast<CellProperty *>(calloc(static_cast<size_t>(grid_cols) * grid_rows, sizeof(CellProperty)));
-		free(renderer->wchar_buffer);
-		renderer->wchar_buffer = static_cast<wchar_t *>(malloc(static_cast<size_t>(grid_cols * 2) * sizeof(wchar_t)));
 
-		renderer->grid_initialized = true;
-		return true;
+		renderer->d2d_context->PushAxisAlignedClip(cursor_fg_rect, D2D1_ANTIALIAS_MODE_ALIASED);
+		text_layout->Draw(renderer, renderer->glyph_renderer, cursor_fg_rect.left, cursor_fg_rect.top);
+		renderer->d2d_context->PopAxisAlignedClip();
 	}
-
-	return false;
-}
-
-void UpdateCursorPos(Renderer *renderer, mpack_node_t cursor_goto) {
-	mpack_node_t cursor_goto_params = mpack_node_array_at(cursor_goto, 1);
-	renderer->cursor.row = MPackIntFromArray(cursor_goto_params, 1);
-	renderer->cursor.col = MPackIntFromArray(cursor_goto_params, 2);
 }
 
 void UpdateImePos(Renderer* renderer) {
@@ -832,8 +836,8 @@ void UpdateImePos(Renderer* renderer) {
 	COMPOSITIONFORM composition_form {
 		.dwStyle = CFS_POINT,
 		.ptCurrentPos = {
-			.x = static_cast<LONG>(renderer->cursor.col * renderer->font_width),
-			.y = static_cast<LONG>(renderer->cursor.row * renderer->font_height)
+			.x = static_cast<LONG>(renderer->model.cursor.col * renderer->font_width),
+			.y = static_cast<LONG>(renderer->model.cursor.row * renderer->font_height)
 		}
 	};
 
@@ -848,12 +852,16 @@ void UpdateImePos(Renderer* renderer) {
 	ImmReleaseContext(renderer->hwnd, input_context);
 }
 
-void UpdateWindowTitle(Renderer *renderer, mpack_node_t set_title) {
-	// Get new title
-	mpack_node_t params = mpack_node_array_at(set_title, 1);
-	mpack_node_t value = mpack_node_array_at(params, 0);
-	const char *new_title = mpack_node_str(value);
-	int len = mpack_node_strlen(value);
+void UpdateWindowTitle(Renderer *renderer, mpack_reader_t *reader, uint32_t set_title_count) {
+	// Get new title, only the last one in the batch matters
+	MPackString value { .data = "", .length = 0 };
+	for (uint32_t i = 0; i < set_title_count; ++i) {
+		uint32_t set_title_length = MPackReadArray(reader);
+		value = MPackReadString(reader);
+		MPackFinishArray(reader, set_title_length, 1);
+	}
+	const char *new_title = value.data;
+	int len = static_cast<int>(value.length);
 
 	// Append " - Nvy" to the title. If title is empty, do not add " - ".
 	const char *append = len == 0 ? "Nvy" : " - Nvy";
@@ -876,107 +884,9 @@ void UpdateWindowTitle(Renderer *renderer, mpack_node_t set_title) {
 	free(wbuf);
 }
 
-void UpdateCursorMode(Renderer *renderer, mpack_node_t mode_change) {
-	mpack_node_t mode_change_params = mpack_node_array_at(mode_change, 1);
-	renderer->cursor.mode_info = &renderer->cursor_mode_infos[mpack_node_array_at(mode_change_params, 1).data->value.u];
-}
-
-void UpdateCursorModeInfos(Renderer *renderer, mpack_node_t mode_info_set_params) {
-	mpack_node_t mode_info_params = mpack_node_array_at(mode_info_set_params, 1);
-	mpack_node_t mode_infos = mpack_node_array_at(mode_info_params, 1);
-	size_t mode_infos_length = mpack_node_array_length(mode_infos);
-	assert(mode_infos_length <= MAX_CURSOR_MODE_INFOS);
-
-	for (size_t i = 0; i < mode_infos_length; ++i) {
-		mpack_node_t mode_info_map = mpack_node_array_at(mode_infos, i);
-
-		renderer->cursor_mode_infos[i].shape = CursorShape::None;
-		mpack_node_t cursor_shape = mpack_node_map_cstr_optional(mode_info_map, "cursor_shape");
-		if (!mpack_node_is_missing(cursor_shape)) {
-			const char *cursor_shape_str = mpack_node_str(cursor_shape);
-			size_t strlen = mpack_node_strlen(cursor_shape);
-			if (!strncmp(cursor_shape_str, "block", strlen)) {
-				renderer->cursor_mode_infos[i].shape = CursorShape::Block;
-			}
-			else if (!strncmp(cursor_shape_str, "vertical", strlen)) {
-				renderer->cursor_mode_infos[i].shape = CursorShape::Vertical;
-			}
-			else if (!strncmp(cursor_shape_str, "horizontal", strlen)) {
-				renderer->cursor_mode_infos[i].shape = CursorShape::Horizontal;
-			}
-		}
-
-		renderer->cursor_mode_infos[i].hl_attrib_id = 0;
-		mpack_node_t hl_attrib_index = mpack_node_map_cstr_optional(mode_info_map, "attr_id");
-		if (!mpack_node_is_missing(hl_attrib_index)) {
-			renderer->cursor_mode_infos[i].hl_attrib_id = static_cast<int>(hl_attrib_index.data->value.i);
-		}
-	}
-}
-
-void ScrollRegion(Renderer *renderer, mpack_node_t scroll_region) {
-	size_t scroll_count = mpack_node_array_length(scroll_region);
-
-	for (size_t i = 1; i < scroll_count; ++i) {
-		mpack_node_t scroll_region_params = mpack_node_array_at(scroll_region, i);
-
-		int64_t top = mpack_node_array_at(scroll_region_params, 1).data->value.i;
-		int64_t bottom = mpack_node_array_at(scroll_region_params, 2).data->value.i;
-		int64_t left = mpack_node_array_at(scroll_region_params, 3).data->value.i;
-		int64_t right = mpack_node_array_at(scroll_region_params, 4).data->value.i;
-		int64_t rows = mpack_node_array_at(scroll_region_params, 5).data->value.i;
-		int64_t cols = mpack_node_array_at(scroll_region_params, 6).data->value.i;
-
-		// Currently nvim does not support horizontal scrolling, 
-		// the parameter is reserved for later use
-		assert(cols == 0);
-
-		// This part is slightly cryptic, basically we're just
-		// iterating from top to bottom or vice versa depending on scroll direction.
-		bool scrolling_down = rows > 0;
-		int64_t start_row = scrolling_down ? top : bottom - 1;
-		int64_t end_row = scrolling_down ? bottom - 1 : top;
-		int64_t increment = scrolling_down ? 1 : -1;
-
-		for (int64_t j = start_row; scrolling_down ? j <= end_row : j >= end_row; j += increment) {
-			// Clip anything outside the scroll region
-			int64_t target_row = j - rows;
-			if (target_row < top || target_row >= bottom) {
-				continue;
-			}
-
-			memcpy(
-				&renderer->grid_chars[target_row * renderer->grid_cols + left],
-				&renderer->grid_chars[j * renderer->grid_cols + left],
-				(right - left) * sizeof(uint32_t)
-			);
-
-			memcpy(
-				&renderer->grid_cell_properties[target_row * renderer->grid_cols + left],
-				&renderer->grid_cell_properties[j * renderer->grid_cols + left],
-				(right - left) * sizeof(CellProperty)
-			);
-
-			// Sadly I have given up on making use of IDXGISwapChain1::Present1
-			// scroll_rects or bitmap copies. The former seems insufficient for
-			// nvim since it can require multiple scrolls per frame, the latter
-			// I can't seem to make work with the FLIP_SEQUENTIAL swapchain model.
-			// Thus we fall back to drawing the appropriate scrolled grid lines
-			DrawGridLine(renderer, target_row);
-		}
-
-		// Redraw the line which the cursor has moved to, as it is no
-		// longer guaranteed that the cursor is still there
-		int cursor_row = renderer->cursor.row - rows;
-		if(cursor_row >= 0 && cursor_row < renderer->grid_rows) {
-			DrawGridLine(renderer, cursor_row);
-		}
-	}
-}
-
 void DrawBorderRectangles(Renderer *renderer) {
-	float left_border = renderer->font_width * renderer->grid_cols;
-	float top_border = renderer->font_height * renderer->grid_rows;
+	float left_border = renderer->font_width * renderer->frame->cols;
+	float top_border = renderer->font_height * renderer->frame->rows;
 
 	if(left_border != static_cast<float>(renderer->pixel_size.width)) {
 		D2D1_RECT_F vertical_rect {
@@ -985,7 +895,7 @@ void DrawBorderRectangles(Renderer *renderer) {
 			.right = static_cast<float>(renderer->pixel_size.width),
 			.bottom = static_cast<float>(renderer->pixel_size.height)
 		};
-		DrawBackgroundRect(renderer, vertical_rect, &renderer->hl_attribs[0]);
+		DrawBackgroundRect(renderer, vertical_rect, D2D1::ColorF(GetResolvedHighlight(renderer, 0)->background));
 	}
 
 	if(top_border != static_cast<float>(renderer->pixel_size.height)) {
@@ -995,7 +905,7 @@ void DrawBorderRectangles(Renderer *renderer) {
 			.right = static_cast<float>(renderer->pixel_size.width),
 			.bottom = static_cast<float>(renderer->pixel_size.height)
 		};
-		DrawBackgroundRect(renderer, horizontal_rect, &renderer->hl_attribs[0]);
+		DrawBackgroundRect(renderer, horizontal_rect, D2D1::ColorF(GetResolvedHighlight(renderer, 0)->background));
 	}
 }
 
@@ -1004,7 +914,16 @@ bool RendererUpdateGuiFont(Renderer *renderer, const char *guifont, size_t strle
 		return false;
 	}
 
-	const char *size_str = strstr(guifont, ":h");
+	// The guifont string comes straight from the message buffer and is
+	// not null-terminated, so all searches are bounded by strlen
+	const char *guifont_end = guifont + strlen;
+	const char *size_str = nullptr;
+	for (const char *c = guifont; c + 1 < guifont_end; ++c) {
+		if (c[0] == ':' && c[1] == 'h') {
+			size_str = c;
+			break;
+		}
+	}
 	if (!size_str) {
 		return false;
 	}
@@ -1013,7 +932,7 @@ bool RendererUpdateGuiFont(Renderer *renderer, const char *guifont, size_t strle
 	size_t size_str_len = strlen - (font_str_len + 2);
 	size_str += 2;
 
-	const char *fallback_font_str = strstr(size_str, ":");
+	const char *fallback_font_str = static_cast<const char *>(memchr(size_str, ':', size_str_len));
 	if(fallback_font_str) {
 		fallback_font_str += 1;
 		size_t fallback_font_str_len = strlen - (fallback_font_str - guifont);
@@ -1039,165 +958,265 @@ bool RendererUpdateGuiFont(Renderer *renderer, const char *guifont, size_t strle
 	return RendererUpdateFont(renderer, font_size, guifont, static_cast<int>(font_str_len));
 }
 
-void SetGuiOptions(Renderer *renderer, mpack_node_t option_set) {
-	uint64_t option_set_length = mpack_node_array_length(option_set);
-
-	for (uint64_t i = 1; i < option_set_length; ++i) {
-		mpack_node_t name = mpack_node_array_at(mpack_node_array_at(option_set, i), 0);
-		mpack_node_t value = mpack_node_array_at(mpack_node_array_at(option_set, i), 1);
-		if (MPackMatchString(name, "guifont")) {
-			const char *font_str = mpack_node_str(value);
-			size_t strlen = mpack_node_strlen(value);
-			RendererUpdateGuiFont(renderer, font_str, strlen);
+void SetGuiOptions(Renderer *renderer, mpack_reader_t *reader, uint32_t option_set_count) {
+	for (uint32_t i = 0; i < option_set_count; ++i) {
+		uint32_t option_length = MPackReadArray(reader);
+		MPackString name = MPackReadString(reader);
+		if (MPackMatchString(name, "guifont") && mpack_peek_tag(reader).type == mpack_type_str) {
+			MPackString value = MPackReadString(reader);
+			RendererUpdateGuiFont(renderer, value.data, value.length);
 
 			// Send message to window in order to update nvim row/col count
 			PostMessage(renderer->hwnd, WM_RENDERER_FONT_UPDATE, 0, 0);
+			MPackFinishArray(reader, option_length, 2);
+		}
+		else {
+			MPackFinishArray(reader, option_length, 1);
 		}
 	}
 }
 
-void ClearGrid(Renderer *renderer) {
-	// Initialize all grid character to a space.
-	for (int i = 0; i < renderer->grid_cols * renderer->grid_rows; ++i) {
-		renderer->grid_chars[i] = L' ';
-	}
-	memset(renderer->grid_cell_properties, 0, renderer->grid_cols * renderer->grid_rows * sizeof(CellProperty));
-	D2D1_RECT_F rect {
-		.left = 0.0f,
-		.top = 0.0f,
-		.right = renderer->grid_cols * renderer->font_width,
-		.bottom = renderer->grid_rows * renderer->font_height
+void StartDraw(Renderer *renderer) {
+	renderer->d2d_context->SetTarget(renderer->d2d_grid_bitmap);
+	renderer->d2d_context->BeginDraw();
+	renderer->d2d_context->SetTransform(D2D1::IdentityMatrix());
+}
+
+DamageRect ToDamageRect(D2D1_RECT_F rect) {
+	return DamageRect {
+		.left = static_cast<int>(floorf(rect.left)),
+		.top = static_cast<int>(floorf(rect.top)),
+		.right = static_cast<int>(ceilf(rect.right)),
+		.bottom = static_cast<int>(ceilf(rect.bottom))
 	};
-	DrawBackgroundRect(renderer, rect, &renderer->hl_attribs[0]);
 }
 
-void StartDraw(Renderer *renderer) {
-	if (!renderer->draw_active) {
-		WaitForSingleObjectEx(
-			renderer->swapchain_wait_handle,
-			1000,
-			true
-		);
+// Dirty rows count in full, reshaping a row can change glyphs next to the
+// cells that changed. The cursor damages where it was and where it is now.
+void TrackDamage(Renderer *renderer, bool grid_invalidated) {
+	DamageTracker *tracker = &renderer->damage_tracker;
+	DamageTrackerBeginFrame(tracker, renderer->pixel_size.width, renderer->pixel_size.height);
+	if (grid_invalidated) {
+		DamageTrackerAddFull(tracker);
+	}
+
+	for (int i = 0; i < (renderer->frame->rows + 63) / 64; ++i) {
+		uint64_t row_bits = renderer->frame_dirty_rows[i];
+		while (row_bits) {
+			int row = i * 64 + std::countr_zero(row_bits);
+			DamageTrackerAdd(tracker, ToDamageRect(D2D1_RECT_F {
+				.left = 0.0f,
+				.top = row * renderer->font_height,
+				.right = renderer->frame->cols * renderer->font_width,
+				.bottom = (row * renderer->font_height) + renderer->font_height
+			}));
+			row_bits &= row_bits - 1;
+		}
+	}
 
-		renderer->d2d_context->SetTarget(renderer->d2d_target_bitmap);
-		renderer->d2d_context->BeginDraw();
-		renderer->d2d_context->SetTransform(D2D1::IdentityMatrix());
-		renderer->draw_active = true;
+	DamageTrackerAdd(tracker, renderer->cursor_damage);
+	D2D1_RECT_F cursor_rect;
+	if (GetCursorRect(renderer, &cursor_rect)) {
+		renderer->cursor_damage = ToDamageRect(cursor_rect);
+		DamageTrackerAdd(tracker, renderer->cursor_damage);
+	}
+	else {
+		renderer->cursor_damage = DamageRect {};
 	}
+	DamageTrackerFinishFrame(tracker);
 }
 
-void CopyFrontToBack(Renderer *renderer) {
-	ID3D11Resource *front;
-	ID3D11Resource *back;
-	WIN_CHECK(renderer->dxgi_swapchain->GetBuffer(0, IID_PPV_ARGS(&back)));
-	WIN_CHECK(renderer->dxgi_swapchain->GetBuffer(1, IID_PPV_ARGS(&front)));
-	renderer->d3d_context->CopyResource(back, front);
+// The back buffer is brought up to date from the retained grid, which
+// leaves the cursor free to move without touching the grid
+void CompositeFrame(Renderer *renderer) {
+	renderer->d2d_context->SetTarget(renderer->d2d_target_bitmap);
+	DamageTracker *tracker = &renderer->damage_tracker;
+	for (uint32_t i = 0; i < tracker->copy_rect_count; ++i) {
+		DamageRect *damage = &tracker->copy_rects[i];
+		D2D1_POINT_2F target_offset { .x = static_cast<float>(damage->left), .y = static_cast<float>(damage->top) };
+		D2D1_RECT_F source_rect {
+			.left = static_cast<float>(damage->left),
+			.top = static_cast<float>(damage->top),
+			.right = static_cast<float>(damage->right),
+			.bottom = static_cast<float>(damage->bottom)
+		};
+		renderer->d2d_context->DrawImage(renderer->d2d_grid_bitmap, &target_offset, &source_rect,
+			D2D1_INTERPOLATION_MODE_NEAREST_NEIGHBOR, D2D1_COMPOSITE_MODE_SOURCE_COPY);
+	}
 
-	SafeRelease(&front);
-	SafeRelease(&back);
+	DrawCursor(renderer);
+	renderer->d2d_context->SetTarget(renderer->d2d_grid_bitmap);
 }
 
 void FinishDraw(Renderer *renderer) {
 	renderer->d2d_context->EndDraw();
 
-	HRESULT hr = renderer->dxgi_swapchain->Present(0, DXGI_PRESENT_ALLOW_TEARING);
-	renderer->draw_active = false;
-
-	CopyFrontToBack(renderer);
+	// The whole back buffer is up to date, the dirty rects only let the
+	// compositor skip the rest. No rects at all presents everything.
+	DamageTracker *tracker = &renderer->damage_tracker;
+	RECT dirty_rects[DAMAGE_TRACKER_MAX_RECTS];
+	for (uint32_t i = 0; i < tracker->rect_count; ++i) {
+		dirty_rects[i] = RECT {
+			.left = tracker->rects[i].left,
+			.top = tracker->rects[i].top,
+			.right = tracker->rects[i].right,
+			.bottom = tracker->rects[i].bottom
+		};
+	}
+	DXGI_PRESENT_PARAMETERS present_parameters {
+		.DirtyRectsCount = tracker->full ? 0 : tracker->rect_count,
+		.pDirtyRects = tracker->full ? nullptr : dirty_rects,
+		.pScrollRect = nullptr,
+		.pScrollOffset = nullptr
+	};
+	HRESULT hr = renderer->dxgi_swapchain->Present1(0, DXGI_PRESENT_ALLOW_TEARING, &present_parameters);
 
 	if (hr == DXGI_ERROR_DEVICE_REMOVED) {
 		HandleDeviceLost(renderer);
 	}
 }
 
-void RendererFlush(Renderer* renderer) {
-	StartDraw(renderer);
-	if (renderer->draws_invalidated) {
-		renderer->draws_invalidated = false;
-		DrawAllGridLines(renderer);
+// Render thread, with render_mutex held
+void RenderSnapshot(Renderer *renderer, GridSnapshot *frame) {
+	renderer->frame = frame;
+	bool grid_invalidated = renderer->render_invalidated ||
+		frame->invalidate_version != renderer->drawn_invalidate_version;
+	if (!renderer->wchar_buffer || frame->rows != renderer->frame_rows || frame->cols != renderer->frame_cols) {
+		for (int i = 0; i < renderer->frame_rows; ++i) {
+			RowDrawDescFree(&renderer->row_descs[i]);
+		}
+		free(renderer->row_descs);
+		renderer->row_descs = static_cast<RowDrawDesc *>(calloc(frame->rows, sizeof(RowDrawDesc)));
+		for (int i = 0; i < frame->rows; ++i) {
+			RowDrawDescReserve(&renderer->row_descs[i], frame->cols);
+		}
+		renderer->frame_rows = frame->rows;
+		renderer->frame_cols = frame->cols;
+		free(renderer->drawn_row_versions);
+		renderer->drawn_row_versions = static_cast<uint64_t *>(calloc(frame->rows, sizeof(uint64_t)));
+		free(renderer->frame_dirty_rows);
+		renderer->frame_dirty_rows = static_cast<uint64_t *>(calloc((frame->rows + 63) / 64, sizeof(uint64_t)));
+		free(renderer->wchar_buffer);
+		// Enough for every cell to be a grapheme of the maximum length
+		renderer->wchar_buffer = static_cast<wchar_t *>(malloc(static_cast<size_t>(frame->cols) * GRAPHEME_MAX_LENGTH * sizeof(wchar_t)));
+		grid_invalidated = true;
+	}
+	renderer->render_invalidated = false;
+	renderer->drawn_invalidate_version = frame->invalidate_version;
+
+	// Cached layouts carry the colors and styles of the ids they use
+	if (frame->hl_style_version != renderer->drawn_hl_style_version) {
+		LayoutCacheClear(&renderer->layout_cache);
+		renderer->hl_generation++;
+		renderer->drawn_hl_style_version = frame->hl_style_version;
+	}
+	// Freed grapheme ids get handed out again, possibly for different text
+	if (frame->grapheme_reuse_version != renderer->drawn_grapheme_reuse_version) {
+		LayoutCacheClear(&renderer->layout_cache);
+		LayoutCacheClear(&renderer->cursor_layout_cache);
+		renderer->drawn_grapheme_reuse_version = frame->grapheme_reuse_version;
+	}
+	while (renderer->hl_resolved.size() < frame->hl_count) {
+		renderer->hl_resolved.push_back(ResolvedHighlight {});
 	}
 
-	if (!renderer->ui_busy) {
-		DrawCursor(renderer);
+	// Snapshots skipped since the last frame only show up as rows whose
+	// version moved further
+	memset(renderer->frame_dirty_rows, 0, (frame->rows + 63) / 64 * sizeof(uint64_t));
+	for (int i = 0; i < frame->rows; ++i) {
+		if (grid_invalidated || frame->row_versions[i] != renderer->drawn_row_versions[i]) {
+			renderer->frame_dirty_rows[i / 64] |= 1ull << (i % 64);
+			renderer->drawn_row_versions[i] = frame->row_versions[i];
+		}
 	}
-	DrawBorderRectangles(renderer);
-	FinishDraw(renderer);
-}
 
-void RendererRedraw(Renderer *renderer, mpack_node_t params, bool start_maximized) {
 	StartDraw(renderer);
+	DrawDirtyGridLines(renderer);
+	DrawBorderRectangles(renderer);
 
-	uint64_t redraw_commands_length = mpack_node_array_length(params);
-	for (uint64_t i = 0; i < redraw_commands_length; ++i) {
-		mpack_node_t redraw_command_arr = mpack_node_array_at(params, i);
-		mpack_node_t redraw_command_name = mpack_node_array_at(redraw_command_arr, 0);
+	TrackDamage(renderer, grid_invalidated);
+	CompositeFrame(renderer);
+	FinishDraw(renderer);
+}
 
-		if (MPackMatchString(redraw_command_name, "option_set")) {
-			SetGuiOptions(renderer, redraw_command_arr);
-		}
-		if (MPackMatchString(redraw_command_name, "grid_resize")) {
-			if (UpdateGridSize(renderer, redraw_command_arr))
-			{
-				PixelSize size = RendererGridToPixelSize(renderer, renderer->grid_rows, renderer->grid_cols);
-				SetWindowPos(renderer->hwnd, HWND_TOP, 0, 0, size.width, size.height, SWP_NOMOVE | SWP_NOZORDER | SWP_FRAMECHANGED);
-			}
-		}
-		if (MPackMatchString(redraw_command_name, "grid_clear")) {
-			ClearGrid(renderer);
-		}
-		else if (MPackMatchString(redraw_command_name, "default_colors_set")) {
-			UpdateDefaultColors(renderer, redraw_command_arr);
-			renderer->draws_invalidated = true;
-		}
-		else if (MPackMatchString(redraw_command_name, "hl_attr_define")) {
-			UpdateHighlightAttributes(renderer, redraw_command_arr);
-		}
-		else if (MPackMatchString(redraw_command_name, "grid_line")) {
-			DrawGridLines(renderer, redraw_command_arr);
-		}
-		else if (MPackMatchString(redraw_command_name, "grid_cursor_goto")) {
-			// If the old cursor position is still within the row bounds,
-			// redraw the line to get rid of the cursor
-			if(renderer->cursor.row < renderer->grid_rows) {
-				DrawGridLine(renderer, renderer->cursor.row);
-			}
-			UpdateCursorPos(renderer, redraw_command_arr);
-			UpdateImePos(renderer);
-		}
-		else if (MPackMatchString(redraw_command_name, "mode_info_set")) {
-			UpdateCursorModeInfos(renderer, redraw_command_arr);
-		}
-		else if (MPackMatchString(redraw_command_name, "mode_change")) {
-			// Redraw cursor if its inside the bounds
-			if(renderer->cursor.row < renderer->grid_rows) {
-				DrawGridLine(renderer, renderer->cursor.row);
-			}
-			UpdateCursorMode(renderer, redraw_command_arr);
-		}
-		else if (MPackMatchString(redraw_command_name, "set_title")) {
-			UpdateWindowTitle(renderer, redraw_command_arr);
-		}
-		else if (MPackMatchString(redraw_command_name, "busy_start")) {
-			renderer->ui_busy = true;
-			// Hide cursor while UI is busy
-			if(renderer->cursor.row < renderer->grid_rows) {
-				DrawGridLine(renderer, renderer->cursor.row);
+void RenderThread(Renderer *renderer) {
+	// A resize or a lost device on the window thread can replace the
+	// swapchain and close its handle, so the wait is on a duplicate that
+	// stays valid until this thread closes it
+	HANDLE wait_handle = nullptr;
+	uint32_t wait_generation = 0;
+	while (TripleBufferWait(&renderer->snapshots)) {
+		{
+			std::lock_guard<std::mutex> lock(renderer->render_mutex);
+			if (wait_generation != renderer->swapchain_generation) {
+				if (wait_handle) {
+					CloseHandle(wait_handle);
+					wait_handle = nullptr;
+				}
+				DuplicateHandle(GetCurrentProcess(), renderer->swapchain_wait_handle,
+					GetCurrentProcess(), &wait_handle, 0, FALSE, DUPLICATE_SAME_ACCESS);
+				wait_generation = renderer->swapchain_generation;
 			}
 		}
-		else if (MPackMatchString(redraw_command_name, "busy_stop")) {
-			renderer->ui_busy = false;
-		}
-		else if (MPackMatchString(redraw_command_name, "grid_scroll")) {
-			ScrollRegion(renderer, redraw_command_arr);
+
+		// Outside the lock, so resizes and font changes on the window
+		// thread never queue up behind a vsync
+		if (wait_handle) {
+			WaitForSingleObjectEx(wait_handle, 1000, true);
 		}
-		else if (MPackMatchString(redraw_command_name, "flush")) {
-			if (!renderer->has_drawn) {
-				renderer->has_drawn = true;
-				ShowWindow(renderer->hwnd, start_maximized ? SW_MAXIMIZE : SW_SHOWDEFAULT);			}
 
-			RendererFlush(renderer);
+		std::lock_guard<std::mutex> lock(renderer->render_mutex);
+		GridSnapshot *snapshot = TripleBufferAcquire(&renderer->snapshots);
+		if (snapshot) {
+			RenderSnapshot(renderer, snapshot);
 		}
 	}
+	if (wait_handle) {
+		CloseHandle(wait_handle);
+	}
+}
+
+// Publishes the grid as it is now, the render thread takes it from there
+void RendererFlush(Renderer* renderer) {
+	GridSnapshotSource source = GridModelSnapshotSource(&renderer->model);
+	renderer->snapshot_row_count += GridSnapshotUpdate(TripleBufferWriteSlot(&renderer->snapshots), &source);
+	TripleBufferPublish(&renderer->snapshots);
+	renderer->model.published_grid_version = renderer->model.grid_version;
+}
+
+// The window's side of the redraw events, the grid model handles the rest
+void RendererWindowEvent(void *context, RedrawEvent event, mpack_reader_t *reader, uint32_t arg_count) {
+	Renderer *renderer = static_cast<Renderer *>(context);
+	if (event == RedrawEvent::OptionSet) {
+		SetGuiOptions(renderer, reader, arg_count);
+	}
+	else {
+		UpdateWindowTitle(renderer, reader, arg_count);
+	}
+}
+
+void RendererGridResized(void *context) {
+	Renderer *renderer = static_cast<Renderer *>(context);
+	PixelSize size = RendererGridToPixelSize(renderer, renderer->model.grid_rows, renderer->model.grid_cols);
+	SetWindowPos(renderer->hwnd, HWND_TOP, 0, 0, size.width, size.height, SWP_NOMOVE | SWP_NOZORDER | SWP_FRAMECHANGED);
+}
+
+void RendererCursorMoved(void *context) {
+	UpdateImePos(static_cast<Renderer *>(context));
+}
+
+void RendererModelFlushed(void *context) {
+	Renderer *renderer = static_cast<Renderer *>(context);
+	if (!renderer->has_drawn) {
+		renderer->has_drawn = true;
+		ShowWindow(renderer->hwnd, renderer->start_maximized ? SW_MAXIMIZE : SW_SHOWDEFAULT);
+	}
+	RendererFlush(renderer);
+}
+
+void RendererRedraw(Renderer *renderer, mpack_reader_t *reader, bool start_maximized) {
+	renderer->start_maximized = start_maximized;
+	GridModelRedraw(&renderer->model, reader);
 }
 
 PixelSize RendererGridToPixelSize(Renderer *renderer, int rows, int cols) {
@@ -1,31 +1,19 @@
 #pragma once
+#include <mutex>
+#include <thread>
+#include "renderer/glyph_metrics.h"
+#include "renderer/background_planner.h"
+#include "renderer/damage_tracker.h"
+#include "renderer/grapheme_table.h"
+#include "renderer/grid_model.h"
+#include "renderer/grid_snapshot.h"
+#include "renderer/highlight_remap.h"
+#include "renderer/layout_cache.h"
+#include "renderer/row_prep.h"
 
 constexpr const char *DEFAULT_FONT = "Consolas";
 constexpr float DEFAULT_FONT_SIZE = 14.0f;
 
-constexpr uint32_t DEFAULT_COLOR = 0x46464646;
-enum HighlightAttributeFlags : uint16_t {
-	HL_ATTRIB_REVERSE			= 1 << 0,
-	HL_ATTRIB_ITALIC			= 1 << 1,
-	HL_ATTRIB_BOLD				= 1 << 2,
-	HL_ATTRIB_STRIKETHROUGH		= 1 << 3,
-	HL_ATTRIB_UNDERLINE			= 1 << 4,
-	HL_ATTRIB_UNDERCURL			= 1 << 5
-};
-struct HighlightAttributes {
-	uint32_t foreground;
-	uint32_t background;
-	uint32_t special;
-	uint16_t flags;
-};
-
-enum class CursorShape {
-	None,
-	Block,
-	Vertical,
-	Horizontal
-};
-
 struct GridPoint {
 	int row;
 	int col;
@@ -39,32 +27,51 @@ struct PixelSize {
 	int height;
 };
 
-struct CursorModeInfo {
-	CursorShape shape;
-	uint16_t hl_attrib_id;
-};
-struct Cursor {
-	CursorModeInfo *mode_info;
-	int row;
-	int col;
+// hl_attribs with reverse and default colors worked out, rebuilt on first
+// use after hl_attr_define or default_colors_set changed them
+struct GlyphDrawingEffect;
+struct ResolvedHighlight {
+	uint32_t generation;
+	uint32_t background; // 0xRRGGBB, what the background planner merges on
+	GlyphDrawingEffect *drawing_effect; // Text and special colors, shared by every run using the id
 };
 
-struct CellProperty {
-	uint16_t hl_attrib_id;
-	bool is_wide_char;
+// Everything that shapes the glyph under a block cursor
+struct CursorLayoutKey {
+	GridCell cells[2]; // The second one only for wide chars
+	uint16_t hl_flags;
+	uint16_t length;
 };
+static_assert(sizeof(CursorLayoutKey) == 20);
 
-constexpr int MAX_HIGHLIGHT_ATTRIBS = 0xFFFF;
-constexpr int MAX_CURSOR_MODE_INFOS = 64;
 constexpr int MAX_FONT_LENGTH = 128;
 constexpr float DEFAULT_DPI = 96.0f;
 constexpr float POINTS_PER_INCH = 72.0f;
-struct GlyphDrawingEffect;
+constexpr uint32_t LAYOUT_CACHE_CAPACITY = 1024;
+constexpr size_t LAYOUT_CACHE_BUDGET = 32 * 1024 * 1024;
+// Rough size of a shaped layout per UTF-16 unit, DirectWrite doesn't say
+constexpr size_t LAYOUT_CACHE_COST_PER_CHAR = 96;
+constexpr uint32_t CURSOR_LAYOUT_CACHE_CAPACITY = 64;
+constexpr size_t CURSOR_LAYOUT_CACHE_BUDGET = 256 * 1024;
+// Past a few threads shaping and drawing the rows dominates anyway
+constexpr uint32_t ROW_POOL_MAX_THREADS = 7;
+// Fewer rows than this aren't worth waking the pool for
+constexpr uint32_t ROW_POOL_MIN_BATCH = 8;
 struct GlyphRenderer;
+// The grid model lives on the window thread, which takes a snapshot of it
+// at every flush. The render thread draws the latest snapshot and skips
+// any it didn't get to in time. Resources both threads touch, the device,
+// the font and the render caches, are only used under render_mutex.
 struct Renderer {
-	CursorModeInfo cursor_mode_infos[MAX_CURSOR_MODE_INFOS];
-	Vec<HighlightAttributes> hl_attribs;
-	Cursor cursor;
+	GridModel model;
+	Vec<ResolvedHighlight> hl_resolved; // Render thread, indexed like model.hl_attribs
+	uint32_t hl_generation; // Bumped whenever an id may have changed colors
+	GlyphDrawingEffect *cursor_drawing_effect;
+
+	std::thread render_thread;
+	std::mutex render_mutex;
+	TripleBuffer<GridSnapshot> snapshots;
+	GridSnapshot *frame; // The snapshot being drawn, render thread only
 
 	GlyphRenderer *glyph_renderer;
 
@@ -72,11 +79,15 @@ struct Renderer {
 	ID3D11Device2 *d3d_device;
 	ID3D11DeviceContext2 *d3d_context;
 	IDXGISwapChain2 *dxgi_swapchain;
+	// Replaced along with the swapchain, under render_mutex. The render
+	// thread waits on its own duplicate, see RenderThread.
 	HANDLE swapchain_wait_handle;
+	uint32_t swapchain_generation; // Bumped whenever the handle is replaced
 	ID2D1Factory5 *d2d_factory;
 	ID2D1Device4 *d2d_device;
 	ID2D1DeviceContext4 *d2d_context;
 	ID2D1Bitmap1 *d2d_target_bitmap;
+	ID2D1Bitmap1 *d2d_grid_bitmap; // Retained grid without the cursor
 	ID2D1SolidColorBrush *d2d_background_rect_brush;
 
     IDWriteFontFace1 *font_face;
@@ -100,21 +111,36 @@ struct Renderer {
 	float font_width;
 	float font_ascent;
     float font_descent;
+	GlyphMetricsCache glyph_metrics;
 
 	D2D1_SIZE_U pixel_size;
-	bool grid_initialized;
-	int grid_rows;
-	int grid_cols;
-	uint32_t *grid_chars;
+
+	// Render thread
+	LayoutCache layout_cache;
+	LayoutCache cursor_layout_cache; // Glyphs under the block cursor, by CursorLayoutKey
+	int frame_rows;
+	int frame_cols;
+	uint64_t *drawn_row_versions; // Row versions in the retained grid bitmap
+	uint64_t *frame_dirty_rows; // One bit per row the frame redraws
+	WorkPool row_pool;
+	RowDrawDesc *row_descs; // One per frame row, the rows whose layouts missed the cache
+	uint64_t drawn_invalidate_version;
+	uint64_t drawn_hl_style_version;
+	uint64_t drawn_grapheme_reuse_version;
+	bool render_invalidated; // The grid bitmap was lost, set under render_mutex
+	BackgroundPlanner background_planner;
+	DamageTracker damage_tracker;
+	DamageRect cursor_damage; // Where the cursor was drawn last frame
 	wchar_t *wchar_buffer;
 	size_t wchar_buffer_length;
-	CellProperty *grid_cell_properties;
 
 	HWND hwnd;
-	bool draw_active;
-	bool ui_busy;
+	bool start_maximized;
 	bool has_drawn;
-	bool draws_invalidated;
+
+	uint64_t snapshot_row_count; // Rows copied into snapshots
+	uint64_t background_run_count; // Highlight runs handed to the background planner
+	uint64_t background_rect_count; // Rects it filled for them
 };
 
 void RendererInitialize(Renderer *renderer, HWND hwnd, bool disable_ligatures, float linespace_factor, float monitor_dpi);
@@ -124,7 +150,7 @@ void RendererShutdown(Renderer *renderer);
 void RendererResize(Renderer *renderer, uint32_t width, uint32_t height);
 bool RendererUpdateGuiFont(Renderer *renderer, const char *guifont, size_t strlen);
 bool RendererUpdateFont(Renderer *renderer, float font_size, const char *font_string = "", int strlen = 0);
-void RendererRedraw(Renderer *renderer, mpack_node_t params, bool start_maximized);
+void RendererRedraw(Renderer *renderer, mpack_reader_t *reader, bool start_maximized);
 void RendererFlush(Renderer* renderer);
 
 PixelSize RendererGridToPixelSize(Renderer *renderer, int rows, int cols);
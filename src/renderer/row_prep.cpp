@@ -0,0 +1,112 @@
+#include "row_prep.h"
+#include "common/utf8.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+void RowDrawDescReserve(RowDrawDesc *desc, int cols) {
+	RowDrawDescFree(desc);
+	// Enough for every cell to be a grapheme of the maximum length
+	desc->text = static_cast<wchar_t *>(malloc(static_cast<size_t>(cols) * GRAPHEME_MAX_LENGTH * sizeof(wchar_t)));
+	desc->spacings = static_cast<RowSpacing *>(malloc(cols * sizeof(RowSpacing)));
+	desc->runs = static_cast<RowHighlightRun *>(malloc(cols * sizeof(RowHighlightRun)));
+	desc->cols = cols;
+}
+
+void RowDrawDescFree(RowDrawDesc *desc) {
+	free(desc->text);
+	free(desc->spacings);
+	free(desc->runs);
+	*desc = RowDrawDesc {};
+}
+
+uint32_t CellsToUtf16(GridSnapshot *frame, const GridCell *cells, uint32_t length, wchar_t *out) {
+	uint32_t out_length = 0;
+	for (uint32_t i = 0; i < length; ++i) {
+		uint32_t text = cells[i].text;
+		if (IsGraphemeId(text)) {
+			const GraphemeEntry *grapheme = GridSnapshotGrapheme(frame, text);
+			memcpy(&out[out_length], grapheme->utf16, grapheme->utf16_length * sizeof(wchar_t));
+			out_length += grapheme->utf16_length;
+			continue;
+		}
+
+		// Codepoints outside the BMP become surrogate pairs
+		out_length += Utf16Encode(text, &out[out_length]);
+	}
+	return out_length;
+}
+
+uint32_t CellUtf16Length(GridSnapshot *frame, uint32_t cell) {
+	if (IsGraphemeId(cell)) {
+		return GridSnapshotGrapheme(frame, cell)->utf16_length;
+	}
+	return Utf16Length(cell);
+}
+
+static void RowAddSpacing(RowDrawDesc *desc, uint32_t start, uint32_t length, float leading, float trailing) {
+	desc->spacings[desc->spacing_count++] = RowSpacing {
+		.start = start,
+		.length = length,
+		.leading = leading,
+		.trailing = trailing
+	};
+}
+
+bool RowPrepare(RowDrawDesc *desc, GridSnapshot *frame, const GlyphMetricsCache *glyph_metrics,
+	float font_width, RowMeasureGrapheme measure_grapheme, void *measure_context) {
+	GridCell *cells = GridSnapshotRow(frame, desc->row);
+	desc->text_length = CellsToUtf16(frame, cells, frame->cols, desc->text);
+	desc->spacing_count = 0;
+	desc->run_count = 0;
+
+	uint16_t hl_attrib_id = cells[0].hl_attrib_id;
+	uint32_t run_start = 0;
+	uint32_t i_wchars = 0;
+	for (int i = 0; i < frame->cols; ++i) {
+		uint32_t cell_wchars = CellUtf16Length(frame, cells[i].text);
+
+		// Wide chars and anything past Latin-1 are stretched or squeezed
+		// to their cells, some glyphs by default take up a bit more or
+		// less. The rest only get centered if the font lacks them.
+		bool wide_char = cells[i].flags & CELL_WIDE_CHAR;
+		if (wide_char || cells[i].text > 0xFF) {
+			float char_width;
+			if (IsGraphemeId(cells[i].text)) {
+				if (!measure_grapheme) return false;
+				char_width = measure_grapheme(measure_context, &cells[i]);
+			}
+			else {
+				const GlyphMetrics *metrics = GlyphMetricsPeek(glyph_metrics, cells[i].text);
+				if (!metrics) return false;
+				char_width = metrics->advance;
+			}
+
+			if (wide_char) {
+				RowAddSpacing(desc, i_wchars, cell_wchars, 0, (font_width * 2) - char_width);
+			}
+			else if (fabsf(char_width - font_width) > 0.01f) {
+				RowAddSpacing(desc, i_wchars, cell_wchars, 0, font_width - char_width);
+			}
+		}
+		else {
+			const GlyphMetrics *metrics = GlyphMetricsPeek(glyph_metrics, cells[i].text);
+			if (!metrics) return false;
+			if (!(metrics->flags & GLYPH_METRICS_COVERED)) {
+				float d_width = font_width - metrics->advance;
+				if (d_width > 0) {
+					RowAddSpacing(desc, i_wchars, 1, d_width / 2, d_width / 2);
+				}
+			}
+		}
+
+		if (cells[i].hl_attrib_id != hl_attrib_id) {
+			desc->runs[desc->run_count++] = RowHighlightRun { .start = run_start, .end = i_wchars, .hl_attrib_id = hl_attrib_id };
+			hl_attrib_id = cells[i].hl_attrib_id;
+			run_start = i_wchars;
+		}
+		i_wchars += cell_wchars;
+	}
+	desc->runs[desc->run_count++] = RowHighlightRun { .start = run_start, .end = desc->text_length, .hl_attrib_id = hl_attrib_id };
+	return true;
+}
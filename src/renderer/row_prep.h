@@ -0,0 +1,51 @@
+#pragma once
+#include "renderer/glyph_metrics.h"
+#include "renderer/grid_snapshot.h"
+
+// Extra space around a glyph that realigns it to the cell grid, the
+// arguments of IDWriteTextLayout1::SetCharacterSpacing. Positions are in
+// UTF-16 units.
+struct RowSpacing {
+	uint32_t start;
+	uint32_t length;
+	float leading;
+	float trailing;
+};
+// Text [start, end) drawn with one highlight id
+struct RowHighlightRun {
+	uint32_t start;
+	uint32_t end;
+	uint16_t hl_attrib_id;
+};
+
+// Everything a row's text layout is built from. Worked out from the
+// snapshot and the measured glyphs alone, so rows can be prepared on
+// any thread and only creating and drawing the layout stays serial.
+struct RowDrawDesc {
+	int row;
+	uint64_t hash; // Of the row's cells, its layout cache key
+	wchar_t *text;
+	uint32_t text_length;
+	RowSpacing *spacings;
+	uint32_t spacing_count;
+	RowHighlightRun *runs;
+	uint32_t run_count;
+	int cols; // What the buffers are sized for
+	bool prepared; // False if RowPrepare gave up on the row
+};
+
+// Measures a grapheme cluster, graphemes are rare enough not to be cached
+using RowMeasureGrapheme = float (*)(void *context, const GridCell *cell);
+
+void RowDrawDescReserve(RowDrawDesc *desc, int cols);
+void RowDrawDescFree(RowDrawDesc *desc);
+
+// Returns the UTF-16 length of cells written to out
+uint32_t CellsToUtf16(GridSnapshot *frame, const GridCell *cells, uint32_t length, wchar_t *out);
+uint32_t CellUtf16Length(GridSnapshot *frame, uint32_t cell);
+
+// Fills in desc for desc->row of frame. Returns false if the row needs a
+// glyph that has not been measured yet, or a grapheme without
+// measure_grapheme, leaving desc incomplete.
+bool RowPrepare(RowDrawDesc *desc, GridSnapshot *frame, const GlyphMetricsCache *glyph_metrics,
+	float font_width, RowMeasureGrapheme measure_grapheme, void *measure_context);
@@ -0,0 +1,127 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "renderer/background_planner.h"
+#include "test.h"
+
+static bool RectEquals(const BackgroundRect &rect, uint32_t color, int row_begin, int row_end, int col_begin, int col_end) {
+	return rect.color == color && rect.row_begin == row_begin && rect.row_end == row_end &&
+		rect.col_begin == col_begin && rect.col_end == col_end;
+}
+
+static void BackgroundPlannerJoinTest() {
+	BackgroundPlanner planner {};
+	BackgroundPlannerBegin(&planner);
+	// Two ids of one color side by side, then another color
+	BackgroundPlannerAddRun(&planner, 0, 0, 4, 7);
+	BackgroundPlannerAddRun(&planner, 0, 4, 10, 7);
+	BackgroundPlannerAddRun(&planner, 0, 10, 12, 3);
+	// The same row below stacks, a wider run does not
+	BackgroundPlannerAddRun(&planner, 1, 0, 10, 7);
+	BackgroundPlannerAddRun(&planner, 1, 10, 12, 3);
+	BackgroundPlannerAddRun(&planner, 2, 0, 12, 7);
+	// Row 3 is not part of the batch, row 4 starts over
+	BackgroundPlannerAddRun(&planner, 4, 0, 12, 7);
+	BackgroundPlannerFinish(&planner);
+
+	CHECK(planner.rect_count == 4);
+	if (planner.rect_count == 4) {
+		CHECK(RectEquals(planner.rects[0], 3, 0, 2, 10, 12));
+		CHECK(RectEquals(planner.rects[1], 7, 0, 2, 0, 10));
+		CHECK(RectEquals(planner.rects[2], 7, 2, 3, 0, 12));
+		CHECK(RectEquals(planner.rects[3], 7, 4, 5, 0, 12));
+	}
+
+	// A new batch forgets the last one
+	BackgroundPlannerBegin(&planner);
+	BackgroundPlannerAddRun(&planner, 5, 0, 12, 7);
+	BackgroundPlannerFinish(&planner);
+	CHECK(planner.rect_count == 1 && RectEquals(planner.rects[0], 7, 5, 6, 0, 12));
+	BackgroundPlannerShutdown(&planner);
+}
+
+constexpr int PLANNER_TEST_ROWS = 40;
+constexpr int PLANNER_TEST_COLS = 60;
+constexpr int PLANNER_TEST_GRIDS = 2000;
+
+static uint32_t PlannerTestRandom(uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+// Random grids of few colors, with rows repeating the one above now and
+// then, planned for a random subset of rows. Painting the rects has to
+// reproduce exactly those rows, each cell covered once.
+static void BackgroundPlannerCoverageTest() {
+	static uint32_t grid[PLANNER_TEST_ROWS][PLANNER_TEST_COLS];
+	static int painted[PLANNER_TEST_ROWS][PLANNER_TEST_COLS];
+	static uint32_t painted_color[PLANNER_TEST_ROWS][PLANNER_TEST_COLS];
+	bool planned[PLANNER_TEST_ROWS];
+
+	BackgroundPlanner planner {};
+	uint32_t state = 12345;
+	uint32_t bad_cells = 0;
+	uint32_t unsorted = 0;
+	uint32_t too_many = 0;
+	for (int g = 0; g < PLANNER_TEST_GRIDS; ++g) {
+		uint32_t color_count = 1 + PlannerTestRandom(&state) % 4;
+		for (int row = 0; row < PLANNER_TEST_ROWS; ++row) {
+			if (row > 0 && PlannerTestRandom(&state) % 3 == 0) {
+				memcpy(grid[row], grid[row - 1], sizeof(grid[row]));
+			}
+			else {
+				uint32_t color = PlannerTestRandom(&state) % color_count;
+				for (int col = 0; col < PLANNER_TEST_COLS; ++col) {
+					if (PlannerTestRandom(&state) % 8 == 0) {
+						color = PlannerTestRandom(&state) % color_count;
+					}
+					grid[row][col] = color;
+				}
+			}
+			planned[row] = PlannerTestRandom(&state) % 4 != 0;
+		}
+
+		// One run per cell, the worst case for joining
+		uint32_t run_count = 0;
+		BackgroundPlannerBegin(&planner);
+		for (int row = 0; row < PLANNER_TEST_ROWS; ++row) {
+			if (!planned[row]) continue;
+			for (int col = 0; col < PLANNER_TEST_COLS; ++col) {
+				BackgroundPlannerAddRun(&planner, row, col, col + 1, grid[row][col]);
+				run_count++;
+			}
+		}
+		BackgroundPlannerFinish(&planner);
+
+		memset(painted, 0, sizeof(painted));
+		for (uint32_t i = 0; i < planner.rect_count; ++i) {
+			const BackgroundRect &rect = planner.rects[i];
+			if (i > 0 && rect.color < planner.rects[i - 1].color) {
+				unsorted++;
+			}
+			for (int row = rect.row_begin; row < rect.row_end; ++row) {
+				for (int col = rect.col_begin; col < rect.col_end; ++col) {
+					painted[row][col]++;
+					painted_color[row][col] = rect.color;
+				}
+			}
+		}
+		for (int row = 0; row < PLANNER_TEST_ROWS; ++row) {
+			for (int col = 0; col < PLANNER_TEST_COLS; ++col) {
+				bool expected = planned[row] ? painted[row][col] == 1 && painted_color[row][col] == grid[row][col] :
+					painted[row][col] == 0;
+				bad_cells += !expected;
+			}
+		}
+		too_many += planner.rect_count > run_count;
+	}
+	CHECK(bad_cells == 0);
+	CHECK(unsorted == 0);
+	CHECK(too_many == 0);
+	BackgroundPlannerShutdown(&planner);
+}
+
+void BackgroundPlannerTests() {
+	BackgroundPlannerJoinTest();
+	BackgroundPlannerCoverageTest();
+}
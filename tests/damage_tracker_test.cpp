@@ -0,0 +1,159 @@
+#include <cstring>
+
+#include "renderer/damage_tracker.h"
+#include "test.h"
+
+static bool DamageRectEquals(DamageRect rect, int left, int top, int right, int bottom) {
+	return rect.left == left && rect.top == top && rect.right == right && rect.bottom == bottom;
+}
+
+static void DamageTrackerJoinTest() {
+	DamageTracker tracker {};
+	DamageTrackerBeginFrame(&tracker, 100, 80);
+	CHECK(tracker.full);
+	DamageTrackerFinishFrame(&tracker);
+	CHECK(tracker.copy_rect_count == 1 && tracker.frame_pixels == 100 * 80);
+
+	// The size is the same, only the last frame's full damage is copied
+	DamageTrackerBeginFrame(&tracker, 100, 80);
+	CHECK(!tracker.full && tracker.rect_count == 0);
+	DamageTrackerAdd(&tracker, DamageRect { .left = 0, .top = 10, .right = 100, .bottom = 20 });
+	DamageTrackerAdd(&tracker, DamageRect { .left = 0, .top = 20, .right = 100, .bottom = 30 });
+	// Clipped to the window, and nothing left of it once clipped
+	DamageTrackerAdd(&tracker, DamageRect { .left = -5, .top = 70, .right = 10, .bottom = 95 });
+	DamageTrackerAdd(&tracker, DamageRect { .left = 100, .top = 0, .right = 120, .bottom = 10 });
+	DamageTrackerAdd(&tracker, DamageRect { .left = 50, .top = 40, .right = 50, .bottom = 60 });
+	DamageTrackerFinishFrame(&tracker);
+	CHECK(tracker.rect_count == 2);
+	CHECK(DamageRectEquals(tracker.rects[0], 0, 10, 100, 30));
+	CHECK(DamageRectEquals(tracker.rects[1], 0, 70, 10, 80));
+	CHECK(tracker.copy_rect_count == 1 && tracker.frame_pixels == 100 * 80);
+
+	// Now the copy is this frame's damage and the last one's
+	DamageTrackerBeginFrame(&tracker, 100, 80);
+	DamageTrackerAdd(&tracker, DamageRect { .left = 0, .top = 30, .right = 100, .bottom = 40 });
+	DamageTrackerFinishFrame(&tracker);
+	CHECK(tracker.rect_count == 1);
+	CHECK(tracker.copy_rect_count == 2);
+	CHECK(tracker.frame_pixels == 100 * 30 + 10 * 10);
+
+	// A resize damages everything
+	DamageTrackerBeginFrame(&tracker, 120, 80);
+	CHECK(tracker.full);
+	DamageTrackerAdd(&tracker, DamageRect { .left = 0, .top = 0, .right = 10, .bottom = 10 });
+	DamageTrackerFinishFrame(&tracker);
+	CHECK(tracker.rect_count == 1 && DamageRectEquals(tracker.rects[0], 0, 0, 120, 80));
+}
+
+static void DamageTrackerOverflowTest() {
+	DamageTracker tracker {};
+	DamageTrackerBeginFrame(&tracker, 1000, 1000);
+	DamageTrackerFinishFrame(&tracker);
+
+	DamageTrackerBeginFrame(&tracker, 1000, 1000);
+	// Scattered cells that can't be joined
+	for (uint32_t i = 0; i <= DAMAGE_TRACKER_MAX_RECTS; ++i) {
+		int offset = static_cast<int>(i) * 20;
+		DamageTrackerAdd(&tracker, DamageRect { .left = offset, .top = offset, .right = offset + 10, .bottom = offset + 10 });
+	}
+	CHECK(tracker.full && tracker.rect_count == 1);
+	DamageTrackerFinishFrame(&tracker);
+	CHECK(tracker.frame_pixels == 1000 * 1000);
+}
+
+constexpr int DAMAGE_TEST_WIDTH = 64;
+constexpr int DAMAGE_TEST_HEIGHT = 48;
+constexpr int DAMAGE_TEST_FRAMES = 20'000;
+
+static uint32_t DamageTestRandom(uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+static void DamageTestPaint(bool (*pixels)[DAMAGE_TEST_WIDTH], DamageRect rect) {
+	for (int y = rect.top; y < rect.bottom; ++y) {
+		for (int x = rect.left; x < rect.right; ++x) {
+			pixels[y][x] = true;
+		}
+	}
+}
+
+// Random damage, mostly row strips like drawn grid lines with a few
+// scattered cells, for many frames. Whatever joining does, the rects have
+// to cover every damaged pixel and stay inside the window, and the copy
+// has to cover this frame's damage and the last one's.
+static void DamageTrackerCoverageTest() {
+	static bool damaged[2][DAMAGE_TEST_HEIGHT][DAMAGE_TEST_WIDTH];
+	static bool covered[DAMAGE_TEST_HEIGHT][DAMAGE_TEST_WIDTH];
+	static bool copied[DAMAGE_TEST_HEIGHT][DAMAGE_TEST_WIDTH];
+
+	DamageTracker tracker {};
+	uint32_t state = 777;
+	uint32_t missed = 0;
+	uint32_t out_of_bounds = 0;
+	uint32_t copies_missed = 0;
+	uint32_t full_frames = 0;
+	for (int frame = 0; frame < DAMAGE_TEST_FRAMES; ++frame) {
+		bool (*current)[DAMAGE_TEST_WIDTH] = damaged[frame & 1];
+		bool (*previous)[DAMAGE_TEST_WIDTH] = damaged[(frame & 1) ^ 1];
+		memset(current, 0, sizeof(damaged[0]));
+
+		DamageTrackerBeginFrame(&tracker, DAMAGE_TEST_WIDTH, DAMAGE_TEST_HEIGHT);
+		if (frame == 0) {
+			DamageTestPaint(current, DamageRect { .left = 0, .top = 0, .right = DAMAGE_TEST_WIDTH, .bottom = DAMAGE_TEST_HEIGHT });
+		}
+		uint32_t rect_count = DamageTestRandom(&state) % 40;
+		int row = 0;
+		for (uint32_t i = 0; i < rect_count; ++i) {
+			DamageRect rect;
+			if (DamageTestRandom(&state) % 4) {
+				row += static_cast<int>(DamageTestRandom(&state) % 3) * 4;
+				int col = static_cast<int>(DamageTestRandom(&state) % 4) * 8;
+				rect = DamageRect { .left = col, .top = row, .right = col + 40, .bottom = row + 4 };
+			}
+			else {
+				int x = static_cast<int>(DamageTestRandom(&state) % (DAMAGE_TEST_WIDTH + 8)) - 4;
+				int y = static_cast<int>(DamageTestRandom(&state) % (DAMAGE_TEST_HEIGHT + 8)) - 4;
+				rect = DamageRect { .left = x, .top = y, .right = x + 6, .bottom = y + 8 };
+			}
+			DamageTrackerAdd(&tracker, rect);
+			DamageRect clipped {
+				.left = rect.left < 0 ? 0 : rect.left,
+				.top = rect.top < 0 ? 0 : rect.top,
+				.right = rect.right > DAMAGE_TEST_WIDTH ? DAMAGE_TEST_WIDTH : rect.right,
+				.bottom = rect.bottom > DAMAGE_TEST_HEIGHT ? DAMAGE_TEST_HEIGHT : rect.bottom
+			};
+			DamageTestPaint(current, clipped);
+		}
+		DamageTrackerFinishFrame(&tracker);
+		full_frames += tracker.full;
+
+		memset(covered, 0, sizeof(covered));
+		memset(copied, 0, sizeof(copied));
+		for (uint32_t i = 0; i < tracker.rect_count; ++i) {
+			const DamageRect &rect = tracker.rects[i];
+			out_of_bounds += rect.left < 0 || rect.top < 0 || rect.right > DAMAGE_TEST_WIDTH || rect.bottom > DAMAGE_TEST_HEIGHT;
+			DamageTestPaint(covered, rect);
+		}
+		for (uint32_t i = 0; i < tracker.copy_rect_count; ++i) {
+			DamageTestPaint(copied, tracker.copy_rects[i]);
+		}
+		for (int y = 0; y < DAMAGE_TEST_HEIGHT; ++y) {
+			for (int x = 0; x < DAMAGE_TEST_WIDTH; ++x) {
+				missed += current[y][x] && !covered[y][x];
+				copies_missed += (current[y][x] || (frame > 0 && previous[y][x])) && !copied[y][x];
+			}
+		}
+	}
+	CHECK(missed == 0);
+	CHECK(out_of_bounds == 0);
+	CHECK(copies_missed == 0);
+	// Most frames have to stay partial for the test to say anything
+	CHECK(full_frames < DAMAGE_TEST_FRAMES / 2);
+}
+
+void DamageTrackerTests() {
+	DamageTrackerJoinTest();
+	DamageTrackerOverflowTest();
+	DamageTrackerCoverageTest();
+}
@@ -0,0 +1,128 @@
+#include <thread>
+
+#include "renderer/glyph_metrics.h"
+#include "test.h"
+
+// A made up advance per codepoint, so every slot can be told apart
+static float GlyphTestAdvance(uint32_t codepoint) {
+	return 1.0f + static_cast<float>(codepoint % 1009) / 8.0f;
+}
+
+static void GlyphTestMeasure(GlyphMetricsCache *cache, uint32_t codepoint) {
+	GlyphMetrics *metrics = GlyphMetricsFind(cache, codepoint);
+	metrics->advance = GlyphTestAdvance(codepoint);
+	metrics->flags = GLYPH_METRICS_MEASURED | (codepoint % 3 ? GLYPH_METRICS_COVERED : 0u);
+}
+
+static bool GlyphTestMatches(const GlyphMetricsCache *cache, uint32_t codepoint) {
+	const GlyphMetrics *metrics = GlyphMetricsPeek(cache, codepoint);
+	return metrics && metrics->advance == GlyphTestAdvance(codepoint) &&
+		((metrics->flags & GLYPH_METRICS_COVERED) != 0) == (codepoint % 3 != 0);
+}
+
+// Codepoints in the BMP pages and in the map past it, a few thousand
+// of the latter so the map grows several times
+constexpr uint32_t GLYPH_TEST_BMP_STRIDE = 37;
+constexpr uint32_t GLYPH_TEST_BMP_COUNT = (0x10000 + GLYPH_TEST_BMP_STRIDE - 1) / GLYPH_TEST_BMP_STRIDE;
+constexpr uint32_t GLYPH_TEST_SUPPLEMENTARY_FIRST = 0x1F000;
+constexpr uint32_t GLYPH_TEST_SUPPLEMENTARY_COUNT = 3000;
+
+static void GlyphTestMeasureAll(GlyphMetricsCache *cache) {
+	for (uint32_t codepoint = 0; codepoint < 0x10000; codepoint += GLYPH_TEST_BMP_STRIDE) {
+		GlyphTestMeasure(cache, codepoint);
+	}
+	for (uint32_t i = 0; i < GLYPH_TEST_SUPPLEMENTARY_COUNT; ++i) {
+		GlyphTestMeasure(cache, GLYPH_TEST_SUPPLEMENTARY_FIRST + i * 7);
+	}
+}
+
+static uint32_t GlyphTestCountMismatches(const GlyphMetricsCache *cache) {
+	uint32_t mismatches = 0;
+	for (uint32_t codepoint = 0; codepoint < 0x10000; codepoint += GLYPH_TEST_BMP_STRIDE) {
+		mismatches += !GlyphTestMatches(cache, codepoint);
+	}
+	for (uint32_t i = 0; i < GLYPH_TEST_SUPPLEMENTARY_COUNT; ++i) {
+		mismatches += !GlyphTestMatches(cache, GLYPH_TEST_SUPPLEMENTARY_FIRST + i * 7);
+	}
+	return mismatches;
+}
+
+static void GlyphMetricsLookupTest() {
+	GlyphMetricsCache cache {};
+	// Nothing is allocated by peeking
+	CHECK(GlyphMetricsPeek(&cache, 'a') == nullptr);
+	CHECK(GlyphMetricsPeek(&cache, 0x1F600) == nullptr);
+	CHECK(cache.pages['a' / GLYPH_METRICS_PAGE_SIZE] == nullptr && cache.map == nullptr);
+
+	// A found slot stays unmeasured until it is filled in
+	GlyphMetrics *metrics = GlyphMetricsFind(&cache, 'a');
+	CHECK(metrics->flags == 0 && metrics->advance == 0.0f);
+	CHECK(GlyphMetricsPeek(&cache, 'a') == nullptr);
+	CHECK(GlyphMetricsPeek(&cache, 'b') == nullptr);
+	CHECK(GlyphMetricsFind(&cache, 'a') == metrics);
+
+	GlyphTestMeasureAll(&cache);
+	CHECK(GlyphTestCountMismatches(&cache) == 0);
+	CHECK(cache.map_count == GLYPH_TEST_SUPPLEMENTARY_COUNT);
+	CHECK(cache.map_count * 2 <= cache.map_capacity);
+	// Neighbours of measured codepoints were never measured
+	CHECK(GlyphMetricsPeek(&cache, 1) == nullptr);
+	CHECK(GlyphMetricsPeek(&cache, GLYPH_TEST_SUPPLEMENTARY_FIRST + 1) == nullptr);
+	CHECK(GlyphMetricsPeek(&cache, 0x10FFFF) == nullptr);
+
+	// Finding a measured codepoint again keeps its metrics
+	GlyphMetricsFind(&cache, GLYPH_TEST_SUPPLEMENTARY_FIRST + 7);
+	CHECK(cache.map_count == GLYPH_TEST_SUPPLEMENTARY_COUNT);
+	CHECK(GlyphTestMatches(&cache, GLYPH_TEST_SUPPLEMENTARY_FIRST + 7));
+
+	GlyphMetricsCacheShutdown(&cache);
+	CHECK(cache.map == nullptr && cache.map_count == 0);
+}
+
+// A font change forgets every measurement but keeps the memory
+static void GlyphMetricsClearTest() {
+	GlyphMetricsCache cache {};
+	GlyphTestMeasureAll(&cache);
+	GlyphMetrics *page = cache.pages[0];
+	uint32_t map_capacity = cache.map_capacity;
+
+	GlyphMetricsCacheClear(&cache);
+	CHECK(GlyphTestCountMismatches(&cache) == GLYPH_TEST_BMP_COUNT + GLYPH_TEST_SUPPLEMENTARY_COUNT);
+	CHECK(cache.pages[0] == page && cache.map_capacity == map_capacity && cache.map_count == 0);
+
+	GlyphTestMeasureAll(&cache);
+	CHECK(GlyphTestCountMismatches(&cache) == 0);
+	CHECK(cache.map_capacity == map_capacity);
+	GlyphMetricsCacheShutdown(&cache);
+}
+
+// Rows are prepared on several threads peeking at once, with nothing
+// measured meanwhile
+static void GlyphMetricsConcurrentPeekTest() {
+	GlyphMetricsCache cache {};
+	GlyphTestMeasureAll(&cache);
+
+	constexpr int THREAD_COUNT = 4;
+	uint32_t mismatches[THREAD_COUNT] {};
+	std::thread threads[THREAD_COUNT];
+	for (int i = 0; i < THREAD_COUNT; ++i) {
+		threads[i] = std::thread([&cache, &mismatches, i]() {
+			for (int pass = 0; pass < 20; ++pass) {
+				mismatches[i] += GlyphTestCountMismatches(&cache);
+			}
+		});
+	}
+	uint32_t total = 0;
+	for (int i = 0; i < THREAD_COUNT; ++i) {
+		threads[i].join();
+		total += mismatches[i];
+	}
+	CHECK(total == 0);
+	GlyphMetricsCacheShutdown(&cache);
+}
+
+void GlyphMetricsTests() {
+	GlyphMetricsLookupTest();
+	GlyphMetricsClearTest();
+	GlyphMetricsConcurrentPeekTest();
+}
@@ -0,0 +1,190 @@
+#include <cstdio>
+#include <cstring>
+
+#include "common/string_dispatch.h"
+#include "common/utf8.h"
+#include "renderer/grapheme_table.h"
+#include "test.h"
+
+constexpr uint32_t GRAPHEME_TEST_MASK = GRAPHEME_TABLE_CAPACITY - 1;
+
+static uint32_t GraphemeTestIntern(GraphemeTable *table, const char *text) {
+	return GraphemeIntern(table, text, strlen(text));
+}
+
+static uint32_t GraphemeTestSlot(uint32_t id) {
+	return id & ~GRAPHEME_ID_FLAG;
+}
+
+// Made up text whose hash lands on bucket, skipping the first skip
+// matches, so tests can place entries where they need them
+static void GraphemeTestTextFor(uint32_t bucket, uint32_t skip, char *text_out) {
+	for (uint32_t i = 0; ; ++i) {
+		int length = snprintf(text_out, GRAPHEME_MAX_LENGTH, "g%u", i);
+		if ((HashString(text_out, length, 0) & GRAPHEME_TEST_MASK) == bucket && skip-- == 0) {
+			return;
+		}
+	}
+}
+
+static void GraphemeInternTest() {
+	GraphemeTable table;
+	GraphemeTableInitialize(&table);
+
+	// e + combining acute, two UTF-16 units
+	uint32_t acute = GraphemeTestIntern(&table, "e\xCC\x81");
+	CHECK(IsGraphemeId(acute));
+	const GraphemeEntry *entry = GraphemeLookup(&table, acute);
+	CHECK(entry->slot == GraphemeSlot::Used && entry->length == 3 && memcmp(entry->text, "e\xCC\x81", 3) == 0);
+	CHECK(entry->utf16_length == 2 && entry->utf16[0] == L'e' && entry->utf16[1] == 0x301);
+	CHECK(table.version == 1 && table.reuse_version == 0);
+
+	// Thumbs up with a skin tone, two surrogate pairs
+	uint32_t thumbs = GraphemeTestIntern(&table, "\xF0\x9F\x91\x8D\xF0\x9F\x8F\xBD");
+	entry = GraphemeLookup(&table, thumbs);
+	CHECK(thumbs != acute && entry->utf16_length == 4);
+	CHECK(entry->utf16[0] == 0xD83D && entry->utf16[1] == 0xDC4D);
+
+	// The same text again is the same id and changes nothing
+	CHECK(GraphemeTestIntern(&table, "e\xCC\x81") == acute);
+	CHECK(table.used_count == 2 && table.version == 2);
+
+	// nvim caps cell text at 32 bytes, longer text is shown as a box
+	char text[GRAPHEME_MAX_LENGTH + 1];
+	memset(text, 'a', sizeof(text));
+	CHECK(GraphemeIntern(&table, text, GRAPHEME_MAX_LENGTH + 1) == UTF8_UNSUPPORTED_CELL);
+	uint32_t longest = GraphemeIntern(&table, text, GRAPHEME_MAX_LENGTH);
+	CHECK(IsGraphemeId(longest) && GraphemeLookup(&table, longest)->length == GRAPHEME_MAX_LENGTH);
+	CHECK(table.used_count == 3);
+
+	// Clearing drops every id, and clearing an empty table does nothing
+	GraphemeTableClear(&table);
+	CHECK(table.used_count == 0 && table.version == 4 && table.reuse_version == 1);
+	CHECK(GraphemeLookup(&table, acute)->slot == GraphemeSlot::Empty);
+	GraphemeTableClear(&table);
+	CHECK(table.version == 4 && table.reuse_version == 1);
+	GraphemeTableShutdown(&table);
+}
+
+// Only ids marked since the last sweep survive it
+static void GraphemeSweepTest() {
+	GraphemeTable table;
+	GraphemeTableInitialize(&table);
+	uint32_t kept = GraphemeTestIntern(&table, "a\xCC\x88");
+	uint32_t dropped = GraphemeTestIntern(&table, "o\xCC\x88");
+	uint32_t also_kept = GraphemeTestIntern(&table, "u\xCC\x88");
+	uint64_t version = table.version;
+
+	GraphemeMarkLive(&table, kept);
+	GraphemeMarkLive(&table, also_kept);
+	GraphemeSweep(&table);
+	CHECK(table.used_count == 2 && table.sweep_count == 1);
+	CHECK(table.version == version + 1 && table.reuse_version == 1);
+	CHECK(GraphemeLookup(&table, dropped)->slot != GraphemeSlot::Used);
+	CHECK(GraphemeTestIntern(&table, "a\xCC\x88") == kept);
+	CHECK(GraphemeTestIntern(&table, "u\xCC\x88") == also_kept);
+
+	// Being kept once doesn't keep an id for good
+	GraphemeMarkLive(&table, kept);
+	GraphemeSweep(&table);
+	CHECK(table.used_count == 1);
+	CHECK(GraphemeLookup(&table, kept)->slot == GraphemeSlot::Used);
+	CHECK(GraphemeLookup(&table, also_kept)->slot != GraphemeSlot::Used);
+	GraphemeTableShutdown(&table);
+}
+
+// A dropped entry in the middle of a probe chain stays a tombstone, so
+// the entries past it are still found, and the next insert reuses it
+static void GraphemeTombstoneTest() {
+	GraphemeTable table;
+	GraphemeTableInitialize(&table);
+	constexpr uint32_t BUCKET = 100;
+	char first[GRAPHEME_MAX_LENGTH], middle[GRAPHEME_MAX_LENGTH], last[GRAPHEME_MAX_LENGTH], later[GRAPHEME_MAX_LENGTH];
+	GraphemeTestTextFor(BUCKET, 0, first);
+	GraphemeTestTextFor(BUCKET, 1, middle);
+	GraphemeTestTextFor(BUCKET, 2, last);
+	GraphemeTestTextFor(BUCKET, 3, later);
+
+	uint32_t first_id = GraphemeTestIntern(&table, first);
+	uint32_t middle_id = GraphemeTestIntern(&table, middle);
+	uint32_t last_id = GraphemeTestIntern(&table, last);
+	CHECK(GraphemeTestSlot(first_id) == BUCKET && GraphemeTestSlot(middle_id) == BUCKET + 1 &&
+		GraphemeTestSlot(last_id) == BUCKET + 2);
+
+	GraphemeMarkLive(&table, first_id);
+	GraphemeMarkLive(&table, last_id);
+	GraphemeSweep(&table);
+	CHECK(GraphemeLookup(&table, middle_id)->slot == GraphemeSlot::Removed);
+	CHECK(table.used_count == 2 && table.removed_count == 1);
+	CHECK(GraphemeTestIntern(&table, last) == last_id);
+
+	uint32_t later_id = GraphemeTestIntern(&table, later);
+	CHECK(later_id == middle_id);
+	CHECK(table.used_count == 3 && table.removed_count == 0);
+	GraphemeTableShutdown(&table);
+}
+
+// Tombstones ending a chain are emptied again, including a chain that
+// wraps from the last slot around to the first ones
+static void GraphemeTombstoneWrapTest() {
+	GraphemeTable table;
+	GraphemeTableInitialize(&table);
+	char texts[3][GRAPHEME_MAX_LENGTH];
+	uint32_t ids[3];
+	for (uint32_t i = 0; i < 3; ++i) {
+		GraphemeTestTextFor(GRAPHEME_TEST_MASK, i, texts[i]);
+		ids[i] = GraphemeTestIntern(&table, texts[i]);
+	}
+	CHECK(GraphemeTestSlot(ids[0]) == GRAPHEME_TEST_MASK && GraphemeTestSlot(ids[1]) == 0 &&
+		GraphemeTestSlot(ids[2]) == 1);
+
+	// The end of the chain is still in use, the tombstones have to stay
+	GraphemeMarkLive(&table, ids[2]);
+	GraphemeSweep(&table);
+	CHECK(table.removed_count == 2);
+	CHECK(GraphemeLookup(&table, ids[0])->slot == GraphemeSlot::Removed);
+	CHECK(GraphemeLookup(&table, ids[1])->slot == GraphemeSlot::Removed);
+	CHECK(GraphemeTestIntern(&table, texts[2]) == ids[2]);
+
+	// Now nothing is, and the whole chain goes back to empty
+	GraphemeSweep(&table);
+	CHECK(table.used_count == 0 && table.removed_count == 0);
+	for (uint32_t id : ids) {
+		CHECK(GraphemeLookup(&table, id)->slot == GraphemeSlot::Empty);
+	}
+	GraphemeTableShutdown(&table);
+}
+
+// Every slot taken, new text gets the box and known text still its id
+static void GraphemeFullTableTest() {
+	GraphemeTable table;
+	GraphemeTableInitialize(&table);
+	char text[GRAPHEME_MAX_LENGTH];
+	uint32_t distinct = 0;
+	for (uint32_t i = 0; i < GRAPHEME_TABLE_CAPACITY; ++i) {
+		snprintf(text, sizeof(text), "full%u", i);
+		uint32_t id = GraphemeTestIntern(&table, text);
+		distinct += IsGraphemeId(id) && GraphemeTestSlot(id) < GRAPHEME_TABLE_CAPACITY;
+	}
+	CHECK(distinct == GRAPHEME_TABLE_CAPACITY && table.used_count == GRAPHEME_TABLE_CAPACITY);
+	CHECK(GraphemeNeedsSweep(&table));
+
+	uint64_t version = table.version;
+	CHECK(GraphemeTestIntern(&table, "one too many") == UTF8_UNSUPPORTED_CELL);
+	CHECK(table.version == version);
+	uint32_t known = GraphemeTestIntern(&table, "full1234");
+	CHECK(IsGraphemeId(known) && memcmp(GraphemeLookup(&table, known)->text, "full1234", 8) == 0);
+
+	GraphemeTableClear(&table);
+	CHECK(!GraphemeNeedsSweep(&table));
+	CHECK(IsGraphemeId(GraphemeTestIntern(&table, "one too many")));
+	GraphemeTableShutdown(&table);
+}
+
+void GraphemeTableTests() {
+	GraphemeInternTest();
+	GraphemeSweepTest();
+	GraphemeTombstoneTest();
+	GraphemeTombstoneWrapTest();
+	GraphemeFullTableTest();
+}
@@ -0,0 +1,394 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "renderer/grid_model.h"
+#include "test.h"
+
+// Builds one redraw notification, events are added as [name, args...]
+struct RedrawMessage {
+	char *data;
+	size_t size;
+	mpack_writer_t writer;
+};
+
+static void RedrawBegin(RedrawMessage *message, uint32_t event_count) {
+	mpack_writer_init_growable(&message->writer, &message->data, &message->size);
+	MPackStartNotification("redraw", &message->writer);
+	mpack_start_array(&message->writer, event_count);
+}
+
+static void RedrawApply(RedrawMessage *message, GridModel *model) {
+	mpack_finish_array(&message->writer);
+	CHECK(MPackFinishMessage(&message->writer) == mpack_ok);
+
+	mpack_reader_t reader;
+	mpack_reader_init_data(&reader, message->data, message->size);
+	MPackMessageResult result = MPackExtractMessageResult(&reader);
+	CHECK(result.type == MPackMessageType::Notification);
+	GridModelRedraw(model, &reader);
+	mpack_done_array(&reader);
+	CHECK(mpack_reader_destroy(&reader) == mpack_ok);
+	free(message->data);
+}
+
+struct GridModelTestHooks {
+	int window_event_count;
+	int resize_count;
+	int cursor_move_count;
+	int flush_count;
+};
+
+static void TestWindowEvent(void *context, RedrawEvent, mpack_reader_t *reader, uint32_t arg_count) {
+	static_cast<GridModelTestHooks *>(context)->window_event_count++;
+	MPackSkip(reader, arg_count);
+}
+
+static GridCell *TestRow(GridModel *model, int row) {
+	return model->grid_row_cells[row];
+}
+
+static void GridModelLineTest() {
+	GridModelTestHooks counts {};
+	GridModelHooks hooks {
+		.context = &counts,
+		.window_event = TestWindowEvent,
+		.grid_resized = [](void *context) { static_cast<GridModelTestHooks *>(context)->resize_count++; },
+		.cursor_moved = [](void *context) { static_cast<GridModelTestHooks *>(context)->cursor_move_count++; },
+		.flush = [](void *context) { static_cast<GridModelTestHooks *>(context)->flush_count++; }
+	};
+	GridModel model {};
+	GridModelInitialize(&model, &hooks);
+
+	RedrawMessage message;
+	RedrawBegin(&message, 8);
+	mpack_writer_t *writer = &message.writer;
+
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "grid_resize");
+	mpack_start_array(writer, 3);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, 10);
+	mpack_write_int(writer, 4);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "default_colors_set");
+	mpack_start_array(writer, 5);
+	mpack_write_int(writer, 0xFFFFFF);
+	mpack_write_int(writer, 0x000000);
+	mpack_write_int(writer, 0xFF0000);
+	mpack_write_int(writer, 0);
+	mpack_write_int(writer, 0);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "hl_attr_define");
+	mpack_start_array(writer, 4);
+	mpack_write_int(writer, 5);
+	mpack_start_map(writer, 2);
+	mpack_write_cstr(writer, "foreground");
+	mpack_write_int(writer, 0x123456);
+	mpack_write_cstr(writer, "bold");
+	mpack_write_bool(writer, true);
+	mpack_finish_map(writer);
+	mpack_start_map(writer, 0);
+	mpack_finish_map(writer);
+	mpack_start_array(writer, 0);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+
+	// a(5) bbb(5) 中 and its empty right half, e + combining acute, x(0)
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "grid_line");
+	mpack_start_array(writer, 4);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, 0);
+	mpack_write_int(writer, 0);
+	mpack_start_array(writer, 6);
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "a");
+	mpack_write_int(writer, 5);
+	mpack_finish_array(writer);
+	mpack_start_array(writer, 3);
+	mpack_write_cstr(writer, "b");
+	mpack_write_int(writer, 5);
+	mpack_write_int(writer, 3);
+	mpack_finish_array(writer);
+	mpack_start_array(writer, 1);
+	mpack_write_cstr(writer, "\xE4\xB8\xAD");
+	mpack_finish_array(writer);
+	mpack_start_array(writer, 1);
+	mpack_write_cstr(writer, "");
+	mpack_finish_array(writer);
+	mpack_start_array(writer, 1);
+	mpack_write_cstr(writer, "e\xCC\x81");
+	mpack_finish_array(writer);
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "x");
+	mpack_write_int(writer, 0);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "grid_cursor_goto");
+	mpack_start_array(writer, 3);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, 2);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+
+	mpack_start_array(writer, 3);
+	mpack_write_cstr(writer, "set_title");
+	mpack_start_array(writer, 1);
+	mpack_write_cstr(writer, "one");
+	mpack_finish_array(writer);
+	mpack_start_array(writer, 1);
+	mpack_write_cstr(writer, "two");
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "win_viewport");
+	mpack_start_array(writer, 0);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "flush");
+	mpack_start_array(writer, 0);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+	RedrawApply(&message, &model);
+
+	CHECK(model.grid_initialized);
+	CHECK(model.grid_cols == 10 && model.grid_rows == 4);
+	CHECK(model.hl_attribs[0].foreground == 0xFFFFFF);
+	CHECK(model.hl_attribs[0].special == 0xFF0000);
+	uint16_t hl_attrib_id = HighlightRemapGet(&model.hl_remap, 5);
+	CHECK(hl_attrib_id == 1);
+	CHECK(model.hl_attribs[hl_attrib_id].foreground == 0x123456);
+	CHECK(model.hl_attribs[hl_attrib_id].background == DEFAULT_COLOR);
+	CHECK(model.hl_attribs[hl_attrib_id].flags == HL_ATTRIB_BOLD);
+
+	GridCell *row = TestRow(&model, 0);
+	CHECK(row[0].text == 'a' && row[0].hl_attrib_id == 1);
+	CHECK(row[1].text == 'b' && row[3].text == 'b' && row[3].hl_attrib_id == 1);
+	CHECK(row[4].text == 0x4E2D && (row[4].flags & CELL_WIDE_CHAR));
+	CHECK(row[5].text == 0 && row[5].hl_attrib_id == row[4].hl_attrib_id);
+	CHECK(IsGraphemeId(row[6].text));
+	CHECK(memcmp(GraphemeLookup(&model.grapheme_table, row[6].text)->text, "e\xCC\x81", 3) == 0);
+	CHECK(row[7].text == 'x' && row[7].hl_attrib_id == 0);
+	CHECK(row[8].text == ' ' && row[9].text == ' ');
+	CHECK(model.grid_cell_count == 8);
+
+	CHECK(model.cursor.row == 1 && model.cursor.col == 2);
+	CHECK(counts.resize_count == 1);
+	CHECK(counts.cursor_move_count == 1);
+	CHECK(counts.window_event_count == 1);
+	CHECK(counts.flush_count == 1);
+	CHECK(model.flush_count == 1);
+	CHECK(model.unknown_redraw_event_count == 1);
+	// Every argument tuple counts, set_title had two
+	CHECK(model.redraw_event_count == 9);
+	CHECK(model.published_grid_version == model.grid_version);
+
+	GridModelShutdown(&model);
+}
+
+static void WriteScroll(mpack_writer_t *writer, int top, int bottom, int left, int right, int rows) {
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "grid_scroll");
+	mpack_start_array(writer, 7);
+	mpack_write_int(writer, 1);
+	mpack_write_int(writer, top);
+	mpack_write_int(writer, bottom);
+	mpack_write_int(writer, left);
+	mpack_write_int(writer, right);
+	mpack_write_int(writer, rows);
+	mpack_write_int(writer, 0);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+}
+
+// Row i holds the letter 'A' + i in every column
+static void WriteRows(mpack_writer_t *writer, int rows, int cols) {
+	mpack_start_array(writer, 1 + rows);
+	mpack_write_cstr(writer, "grid_line");
+	for (int i = 0; i < rows; ++i) {
+		char text[2] { static_cast<char>('A' + i), '\0' };
+		mpack_start_array(writer, 4);
+		mpack_write_int(writer, 1);
+		mpack_write_int(writer, i);
+		mpack_write_int(writer, 0);
+		mpack_start_array(writer, 1);
+		mpack_start_array(writer, 3);
+		mpack_write_cstr(writer, text);
+		mpack_write_int(writer, 0);
+		mpack_write_int(writer, cols);
+		mpack_finish_array(writer);
+		mpack_finish_array(writer);
+		mpack_finish_array(writer);
+	}
+	mpack_finish_array(writer);
+}
+
+static void GridModelScrollTest() {
+	GridModelHooks hooks {};
+	GridModel model {};
+	GridModelInitialize(&model, &hooks);
+
+	RedrawMessage message;
+	RedrawBegin(&message, 2);
+	mpack_start_array(&message.writer, 2);
+	mpack_write_cstr(&message.writer, "grid_resize");
+	mpack_start_array(&message.writer, 3);
+	mpack_write_int(&message.writer, 1);
+	mpack_write_int(&message.writer, 6);
+	mpack_write_int(&message.writer, 5);
+	mpack_finish_array(&message.writer);
+	mpack_finish_array(&message.writer);
+	WriteRows(&message.writer, 5, 6);
+	RedrawApply(&message, &model);
+
+	// Full width, rows 1..4 move up by one
+	uint64_t version_before = model.grid_version;
+	RedrawBegin(&message, 1);
+	WriteScroll(&message.writer, 1, 5, 0, 6, 1);
+	RedrawApply(&message, &model);
+	CHECK(TestRow(&model, 0)[0].text == 'A');
+	CHECK(TestRow(&model, 1)[0].text == 'C');
+	CHECK(TestRow(&model, 3)[5].text == 'E');
+	CHECK(model.grid_row_versions[0] <= version_before);
+	for (int i = 1; i < 5; ++i) {
+		CHECK(model.grid_row_versions[i] > version_before);
+	}
+
+	// Partial width, columns 2..4 of rows 0..3 move down by one. The
+	// cursor is drawn over the grid, so its row below the region stays clean.
+	version_before = model.grid_version;
+	RedrawBegin(&message, 2);
+	mpack_start_array(&message.writer, 2);
+	mpack_write_cstr(&message.writer, "grid_cursor_goto");
+	mpack_start_array(&message.writer, 3);
+	mpack_write_int(&message.writer, 1);
+	mpack_write_int(&message.writer, 3);
+	mpack_write_int(&message.writer, 0);
+	mpack_finish_array(&message.writer);
+	mpack_finish_array(&message.writer);
+	WriteScroll(&message.writer, 0, 4, 2, 4, -1);
+	RedrawApply(&message, &model);
+	CHECK(model.grid_row_versions[4] <= version_before);
+	CHECK(TestRow(&model, 1)[2].text == 'A' && TestRow(&model, 1)[3].text == 'A');
+	CHECK(TestRow(&model, 1)[1].text == 'C' && TestRow(&model, 1)[4].text == 'C');
+	CHECK(TestRow(&model, 3)[2].text == 'D');
+	CHECK(TestRow(&model, 0)[2].text == 'A');
+
+	GridModelShutdown(&model);
+}
+
+static void WriteHighlight(mpack_writer_t *writer, int nvim_hl_id, uint32_t foreground) {
+	mpack_start_array(writer, 2);
+	mpack_write_cstr(writer, "hl_attr_define");
+	mpack_start_array(writer, 4);
+	mpack_write_int(writer, nvim_hl_id);
+	mpack_start_map(writer, 1);
+	mpack_write_cstr(writer, "foreground");
+	mpack_write_u32(writer, foreground);
+	mpack_finish_map(writer);
+	mpack_start_map(writer, 0);
+	mpack_finish_map(writer);
+	mpack_start_array(writer, 0);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+	mpack_finish_array(writer);
+}
+
+// Only a change to an id that was already defined restyles cached layouts
+static void GridModelHighlightVersionTest() {
+	GridModelHooks hooks {};
+	GridModel model {};
+	GridModelInitialize(&model, &hooks);
+
+	RedrawMessage message;
+	RedrawBegin(&message, 2);
+	WriteHighlight(&message.writer, 7, 0x102030);
+	WriteHighlight(&message.writer, 9, 0x405060);
+	RedrawApply(&message, &model);
+	CHECK(model.hl_style_version == 0);
+	uint64_t hl_version = model.hl_version;
+	CHECK(hl_version > 0);
+
+	// Resent unchanged, as nvim does after a :colorscheme that kept it
+	RedrawBegin(&message, 1);
+	WriteHighlight(&message.writer, 7, 0x102030);
+	RedrawApply(&message, &model);
+	CHECK(model.hl_style_version == 0);
+	CHECK(model.hl_version == hl_version);
+
+	RedrawBegin(&message, 2);
+	WriteHighlight(&message.writer, 9, 0x708090);
+	WriteHighlight(&message.writer, 11, 0x102030);
+	RedrawApply(&message, &model);
+	CHECK(model.hl_style_version == 1);
+	CHECK(model.hl_attribs[HighlightRemapGet(&model.hl_remap, 9)].foreground == 0x708090);
+
+	GridModelShutdown(&model);
+}
+
+static bool HighlightEquals(const HighlightAttributes &a, const HighlightAttributes &b) {
+	return a.foreground == b.foreground && a.background == b.background && a.special == b.special && a.flags == b.flags;
+}
+
+// Ids past the dense ones are parsed into a scratch entry, the defaults
+// in slot 0 they are drawn with must survive their definitions
+static void GridModelHighlightOverflowTest() {
+	GridModelHooks hooks {};
+	GridModel model {};
+	GridModelInitialize(&model, &hooks);
+	// Room for the defaults and two ids
+	HighlightRemapShutdown(&model.hl_remap);
+	HighlightRemapInitialize(&model.hl_remap, 3);
+	model.hl_attribs[0].foreground = 0xEEEEEE;
+	const HighlightAttributes defaults = model.hl_attribs[0];
+
+	RedrawMessage message;
+	RedrawBegin(&message, 2);
+	WriteHighlight(&message.writer, 10, 0x111111);
+	WriteHighlight(&message.writer, 11, 0x222222);
+	RedrawApply(&message, &model);
+	uint64_t hl_version = model.hl_version;
+	CHECK(model.hl_attribs.size() == 3);
+
+	RedrawBegin(&message, 3);
+	WriteHighlight(&message.writer, 12, 0x333333);
+	WriteHighlight(&message.writer, 13, 0x444444);
+	WriteHighlight(&message.writer, -4, 0x555555);
+	RedrawApply(&message, &model);
+	CHECK(HighlightEquals(model.hl_attribs[0], defaults));
+	CHECK(model.hl_attribs.size() == 3);
+	CHECK(model.hl_remap.overflow_count == 2);
+	CHECK(model.hl_version == hl_version && model.hl_style_version == 0);
+
+	// The ids that did fit still take redefinitions
+	RedrawBegin(&message, 1);
+	WriteHighlight(&message.writer, 11, 0x666666);
+	RedrawApply(&message, &model);
+	CHECK(model.hl_attribs[2].foreground == 0x666666);
+	CHECK(model.hl_style_version == 1);
+	CHECK(HighlightEquals(model.hl_attribs[0], defaults));
+
+	GridModelShutdown(&model);
+}
+
+void GridModelTests() {
+	GridModelLineTest();
+	GridModelScrollTest();
+	GridModelHighlightVersionTest();
+	GridModelHighlightOverflowTest();
+}
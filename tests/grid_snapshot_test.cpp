@@ -0,0 +1,145 @@
+#include <chrono>
+#include <thread>
+
+#include "common/triple_buffer.h"
+#include "nvim/synthetic_workload.h"
+#include "nvim/trace.h"
+#include "renderer/grid_model.h"
+#include "test.h"
+
+constexpr const char *SNAPSHOT_TEST_WORKLOADS[] { "repaint", "scroll", "highlight", "wide" };
+
+static uint64_t SnapshotTestMix(uint64_t hash, uint64_t value) {
+	return (hash ^ value) * 0x100000001B3ull;
+}
+
+// Everything a frame is drawn from, graphemes by their text so a wrongly
+// copied table shows up as well as wrongly copied cells
+static uint64_t SnapshotTestHash(int rows, int cols, GridCell *const *row_cells, const GraphemeEntry *graphemes,
+	const HighlightAttributes *hl_attribs, uint32_t hl_count, SnapshotCursor cursor) {
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (int row = 0; row < rows; ++row) {
+		for (int col = 0; col < cols; ++col) {
+			const GridCell &cell = row_cells[row][col];
+			if (IsGraphemeId(cell.text)) {
+				const GraphemeEntry *entry = &graphemes[cell.text & ~GRAPHEME_ID_FLAG];
+				for (uint8_t i = 0; i < entry->length; ++i) {
+					hash = SnapshotTestMix(hash, static_cast<uint8_t>(entry->text[i]));
+				}
+			}
+			else {
+				hash = SnapshotTestMix(hash, cell.text);
+			}
+			hash = SnapshotTestMix(hash, (static_cast<uint64_t>(cell.hl_attrib_id) << 16) | cell.flags);
+		}
+	}
+	for (uint32_t i = 0; i < hl_count; ++i) {
+		hash = SnapshotTestMix(hash, hl_attribs[i].foreground);
+		hash = SnapshotTestMix(hash, hl_attribs[i].background);
+		hash = SnapshotTestMix(hash, hl_attribs[i].flags);
+	}
+	hash = SnapshotTestMix(hash, static_cast<uint64_t>(cursor.row) << 32 | static_cast<uint32_t>(cursor.col));
+	return SnapshotTestMix(hash, cursor.visible);
+}
+
+// The producer side, taking a snapshot at every flush as the renderer does
+struct SnapshotTestProducer {
+	GridModel *model;
+	TripleBuffer<GridSnapshot> *snapshots;
+	// The hash of the model at each flush, Vec never moves its elements so
+	// the consumer can read the ones published while more are pushed
+	Vec<uint64_t> hashes;
+};
+
+static void SnapshotTestFlush(void *context) {
+	auto producer = static_cast<SnapshotTestProducer *>(context);
+	GridModel *model = producer->model;
+	GridSnapshotSource source = GridModelSnapshotSource(model);
+	producer->hashes.push_back(SnapshotTestHash(source.rows, source.cols, source.row_cells,
+		model->grapheme_table.entries, source.hl_attribs, source.hl_count, source.cursor));
+	GridSnapshotUpdate(TripleBufferWriteSlot(producer->snapshots), &source);
+	TripleBufferPublish(producer->snapshots);
+}
+
+// A workload replayed on one thread while a stand-in render thread takes
+// the snapshots, falling behind now and then so snapshots get dropped and
+// the slots it gets back are several flushes out of date. Each snapshot
+// taken has to match the model exactly as it was at its flush.
+static void GridSnapshotStressTest(const char *workload) {
+	Vec<char> trace;
+	SyntheticWorkloadGenerate(SyntheticWorkloadLookup(workload), &trace);
+
+	TripleBuffer<GridSnapshot> snapshots {};
+	TripleBufferInitialize(&snapshots);
+	GridModel model {};
+	SnapshotTestProducer producer {};
+	producer.model = &model;
+	producer.snapshots = &snapshots;
+	GridModelHooks hooks {};
+	hooks.context = &producer;
+	hooks.flush = SnapshotTestFlush;
+	GridModelInitialize(&model, &hooks);
+
+	uint32_t mismatches = 0;
+	uint32_t out_of_order = 0;
+	uint32_t bad_rows = 0;
+	uint64_t last_flush_count = 0;
+	uint64_t taken = 0;
+	std::thread consumer([&]() {
+		while (TripleBufferWait(&snapshots)) {
+			GridSnapshot *snapshot = TripleBufferAcquire(&snapshots);
+			if (!snapshot) continue;
+
+			taken++;
+			out_of_order += taken > 1 && snapshot->flush_count <= last_flush_count;
+			last_flush_count = snapshot->flush_count;
+			if (snapshot->rows > SYNTHETIC_GRID_ROWS) {
+				bad_rows++;
+				continue;
+			}
+			GridCell *rows[SYNTHETIC_GRID_ROWS];
+			for (int row = 0; row < snapshot->rows; ++row) {
+				rows[row] = GridSnapshotRow(snapshot, row);
+			}
+			uint64_t hash = SnapshotTestHash(snapshot->rows, snapshot->cols, rows, snapshot->graphemes,
+				snapshot->hl_attribs, snapshot->hl_count, snapshot->cursor);
+			mismatches += hash != producer.hashes.data()[snapshot->flush_count];
+			if (taken % 3 == 0) {
+				std::this_thread::sleep_for(std::chrono::microseconds(300));
+			}
+		}
+	});
+
+	TraceReader trace_reader;
+	TraceReaderOpenMemory(&trace_reader, trace.data(), trace.size());
+	TraceMessage message;
+	while (TraceReaderNext(&trace_reader, &message)) {
+		mpack_reader_t reader;
+		mpack_reader_init_data(&reader, message.data, message.size);
+		MPackExtractMessageResult(&reader);
+		GridModelRedraw(&model, &reader);
+		mpack_reader_destroy(&reader);
+	}
+	TripleBufferClose(&snapshots);
+	consumer.join();
+
+	TripleBufferStats stats = TripleBufferGetStats(&snapshots);
+	CHECK(stats.published == producer.hashes.size());
+	CHECK(stats.consumed == taken && taken > 0);
+	CHECK(stats.consumed + stats.dropped <= stats.published);
+	CHECK(mismatches == 0);
+	CHECK(out_of_order == 0);
+	CHECK(bad_rows == 0);
+
+	TraceReaderClose(&trace_reader);
+	GridModelShutdown(&model);
+	for (GridSnapshot &snapshot : snapshots.slots) {
+		GridSnapshotShutdown(&snapshot);
+	}
+}
+
+void GridSnapshotTests() {
+	for (const char *workload : SNAPSHOT_TEST_WORKLOADS) {
+		GridSnapshotStressTest(workload);
+	}
+}
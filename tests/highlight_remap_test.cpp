@@ -0,0 +1,109 @@
+#include <climits>
+#include <map>
+
+#include "renderer/highlight_remap.h"
+#include "test.h"
+
+static void HighlightRemapOrderTest() {
+	HighlightRemap remap;
+	HighlightRemapInitialize(&remap, 16);
+	CHECK(HighlightRemapGet(&remap, 0) == 0);
+
+	// Dense ids in order of first appearance, however sparse nvim's are
+	CHECK(HighlightRemapGet(&remap, 500) == 1);
+	CHECK(HighlightRemapGet(&remap, 7) == 2);
+	CHECK(HighlightRemapGet(&remap, 500) == 1);
+	CHECK(HighlightRemapGet(&remap, 500) == 1);
+	CHECK(HighlightRemapGet(&remap, 7) == 2);
+	CHECK(remap.count == 3);
+
+	// Negative ids are never valid and get the defaults without taking an id
+	CHECK(HighlightRemapGet(&remap, -1) == 0);
+	CHECK(HighlightRemapGet(&remap, -12345) == 0);
+	CHECK(HighlightRemapGet(&remap, LLONG_MIN) == 0);
+	CHECK(remap.count == 3 && remap.overflow_count == 0);
+	// -1 marks empty slots, asking for it must not match one
+	CHECK(HighlightRemapGet(&remap, 7) == 2);
+
+	// Huge ones are just ids
+	CHECK(HighlightRemapGet(&remap, LLONG_MAX) == 3);
+	CHECK(HighlightRemapGet(&remap, 1ll << 40) == 4);
+	CHECK(HighlightRemapGet(&remap, 1ll << 41) == 5);
+	CHECK(HighlightRemapGet(&remap, LLONG_MAX) == 3);
+	CHECK(HighlightRemapGet(&remap, 1ll << 40) == 4);
+	HighlightRemapShutdown(&remap);
+}
+
+static void HighlightRemapOverflowTest() {
+	HighlightRemap remap;
+	HighlightRemapInitialize(&remap, 4);
+	CHECK(HighlightRemapGet(&remap, 10) == 1);
+	CHECK(HighlightRemapGet(&remap, 11) == 2);
+	CHECK(HighlightRemapGet(&remap, 12) == 3);
+
+	// Out of dense ids, new ones are drawn with the defaults and counted
+	// every time they show up, known ones keep theirs
+	CHECK(HighlightRemapGet(&remap, 13) == 0);
+	CHECK(HighlightRemapGet(&remap, 13) == 0);
+	CHECK(HighlightRemapGet(&remap, 14) == 0);
+	CHECK(remap.overflow_count == 3 && remap.count == 4);
+	CHECK(HighlightRemapGet(&remap, 11) == 2);
+	CHECK(HighlightRemapGet(&remap, 0) == 0);
+	CHECK(remap.overflow_count == 3);
+	HighlightRemapShutdown(&remap);
+}
+
+constexpr uint32_t REMAP_TEST_MAX_IDS = 3000;
+constexpr int REMAP_TEST_LOOKUPS = 200'000;
+
+static uint32_t RemapTestRandom(uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+// Random lookups against a std::map doing the same assignment. Enough
+// distinct ids that the table grows several times and then runs out.
+static void HighlightRemapReferenceTest() {
+	HighlightRemap remap;
+	HighlightRemapInitialize(&remap, REMAP_TEST_MAX_IDS);
+	std::map<int64_t, uint16_t> reference { { 0, 0 } };
+	uint64_t expected_overflows = 0;
+	uint32_t mismatches = 0;
+	uint32_t state = 99;
+	for (int i = 0; i < REMAP_TEST_LOOKUPS; ++i) {
+		// Mostly recent ids like grid_line, now and then far apart ones
+		int64_t nvim_hl_id = RemapTestRandom(&state) % 8 ? RemapTestRandom(&state) % 6000 :
+			static_cast<int64_t>(RemapTestRandom(&state)) << 24;
+		uint16_t expected = 0;
+		auto found = reference.find(nvim_hl_id);
+		if (found != reference.end()) {
+			expected = found->second;
+		}
+		else if (reference.size() < REMAP_TEST_MAX_IDS) {
+			expected = static_cast<uint16_t>(reference.size());
+			reference[nvim_hl_id] = expected;
+		}
+		else {
+			expected_overflows++;
+		}
+		mismatches += HighlightRemapGet(&remap, nvim_hl_id) != expected;
+	}
+	CHECK(mismatches == 0);
+	CHECK(remap.count == REMAP_TEST_MAX_IDS);
+	CHECK(expected_overflows > 0 && remap.overflow_count == expected_overflows);
+	// Grown from the initial capacity and still at most half full
+	CHECK(remap.capacity > HIGHLIGHT_REMAP_INITIAL_CAPACITY && remap.count * 2 <= remap.capacity);
+
+	// Everything assigned before and during the growth is still there
+	for (const auto &[nvim_hl_id, hl_attrib_id] : reference) {
+		mismatches += HighlightRemapGet(&remap, nvim_hl_id) != hl_attrib_id;
+	}
+	CHECK(mismatches == 0);
+	HighlightRemapShutdown(&remap);
+}
+
+void HighlightRemapTests() {
+	HighlightRemapOrderTest();
+	HighlightRemapOverflowTest();
+	HighlightRemapReferenceTest();
+}
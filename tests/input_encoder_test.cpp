@@ -0,0 +1,63 @@
+#include <cstring>
+
+#include "nvim/input_encoder.h"
+#include "test.h"
+
+// The finished message has to read back as [2, "nvim_input", [keys]]
+static bool InputMessageEquals(const char *data, size_t size, const char *expected_keys) {
+	mpack_reader_t reader;
+	mpack_reader_init_data(&reader, data, size);
+	MPackMessageResult result = MPackExtractMessageResult(&reader);
+	bool matches = result.type == MPackMessageType::Notification &&
+		MPackMatchString(result.notification.name, "nvim_input") &&
+		MPackReadArray(&reader) == 1 &&
+		MPackMatchString(MPackReadString(&reader), expected_keys);
+	mpack_done_array(&reader);
+	mpack_done_array(&reader);
+	return matches && mpack_reader_destroy(&reader) == mpack_ok && mpack_reader_remaining(&reader, nullptr) == 0;
+}
+
+static void InputEncoderBurstTest() {
+	InputEncoder encoder {};
+	const char *data;
+	CHECK(InputEncoderFinish(&encoder, &data) == 0);
+
+	InputEncoderAppend(&encoder, "i", 1);
+	InputEncoderAppend(&encoder, "<C-w>", 5);
+	InputEncoderAppend(&encoder, "\xC3\xA4", 2);
+	size_t size = InputEncoderFinish(&encoder, &data);
+	CHECK(size == INPUT_HEADER_SIZE + 8);
+	CHECK(InputMessageEquals(data, size, "i<C-w>\xC3\xA4"));
+	CHECK(InputEncoderEmpty(&encoder));
+
+	// The next burst starts a message of its own
+	InputEncoderAppend(&encoder, "<Esc>", 5);
+	size = InputEncoderFinish(&encoder, &data);
+	CHECK(InputMessageEquals(data, size, "<Esc>"));
+	CHECK(encoder.key_count == 4);
+	CHECK(encoder.message_count == 2);
+}
+
+constexpr KeyNotationName TEST_KEY_NAMES[] { { 38, "Up" }, { 255, "kMultiply" } };
+constexpr KeyNotationTable TEST_KEY_TABLE = BuildKeyNotationTable(TEST_KEY_NAMES);
+
+static void InputEncoderNotationTest() {
+	CHECK(TEST_KEY_TABLE.keys[38].length == 2 && memcmp(TEST_KEY_TABLE.keys[38].name, "Up", 2) == 0);
+	CHECK(TEST_KEY_TABLE.keys[255].length == 9);
+	CHECK(TEST_KEY_TABLE.keys[37].length == 0);
+
+	InputEncoder encoder {};
+	const KeyName &up = TEST_KEY_TABLE.keys[38];
+	InputEncoderAppendModified(&encoder, 0, up.name, up.length);
+	InputEncoderAppendModified(&encoder, KEY_MODIFIER_CTRL | KEY_MODIFIER_SHIFT, up.name, up.length);
+	InputEncoderAppendModified(&encoder, KEY_MODIFIER_CTRL | KEY_MODIFIER_SHIFT | KEY_MODIFIER_ALT, "x", 1);
+	InputEncoderAppendModified(&encoder, KEY_MODIFIER_ALT, "Space", 5);
+	const char *data;
+	size_t size = InputEncoderFinish(&encoder, &data);
+	CHECK(InputMessageEquals(data, size, "<Up><C-S-Up><C-S-M-x><M-Space>"));
+}
+
+void InputEncoderTests() {
+	InputEncoderBurstTest();
+	InputEncoderNotationTest();
+}
@@ -0,0 +1,113 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "renderer/layout_cache.h"
+#include "test.h"
+
+// Values are heap ints, released values are counted so leaks and double
+// frees show up
+static int layout_test_released = 0;
+
+static void LayoutTestRelease(void *value) {
+	layout_test_released++;
+	free(value);
+}
+
+static void *LayoutTestValue(int value) {
+	int *boxed = static_cast<int *>(malloc(sizeof(int)));
+	*boxed = value;
+	return boxed;
+}
+
+static int LayoutTestLookup(LayoutCache *cache, uint64_t hash, const char *key) {
+	void *value = LayoutCacheLookup(cache, hash, key, strlen(key));
+	return value ? *static_cast<int *>(value) : -1;
+}
+
+static void LayoutCacheLruTest() {
+	layout_test_released = 0;
+	LayoutCache cache {};
+	LayoutCacheInitialize(&cache, 3, 1 << 20, LayoutTestRelease);
+
+	const char *keys[] { "row one", "row two", "row three", "row four" };
+	for (int i = 0; i < 3; ++i) {
+		LayoutCacheInsert(&cache, LayoutCacheHash(keys[i], strlen(keys[i])), keys[i], strlen(keys[i]), LayoutTestValue(i), 0);
+	}
+	// "row one" becomes the most recent, "row two" the one to go
+	CHECK(LayoutTestLookup(&cache, LayoutCacheHash(keys[0], strlen(keys[0])), keys[0]) == 0);
+	LayoutCacheInsert(&cache, LayoutCacheHash(keys[3], strlen(keys[3])), keys[3], strlen(keys[3]), LayoutTestValue(3), 0);
+	CHECK(LayoutTestLookup(&cache, LayoutCacheHash(keys[1], strlen(keys[1])), keys[1]) == -1);
+	CHECK(LayoutTestLookup(&cache, LayoutCacheHash(keys[0], strlen(keys[0])), keys[0]) == 0);
+	CHECK(LayoutTestLookup(&cache, LayoutCacheHash(keys[2], strlen(keys[2])), keys[2]) == 2);
+	CHECK(LayoutTestLookup(&cache, LayoutCacheHash(keys[3], strlen(keys[3])), keys[3]) == 3);
+	CHECK(cache.count == 3 && cache.eviction_count == 1 && layout_test_released == 1);
+	CHECK(cache.hit_count == 4 && cache.miss_count == 1);
+
+	LayoutCacheClear(&cache);
+	CHECK(cache.count == 0 && layout_test_released == 4);
+	CHECK(LayoutTestLookup(&cache, LayoutCacheHash(keys[0], strlen(keys[0])), keys[0]) == -1);
+	LayoutCacheShutdown(&cache);
+}
+
+// Keys sharing a hash still come back by their full contents, and
+// evicting from the middle of a probe chain keeps the rest reachable
+static void LayoutCacheCollisionTest() {
+	layout_test_released = 0;
+	LayoutCache cache {};
+	LayoutCacheInitialize(&cache, 4, 1 << 20, LayoutTestRelease);
+
+	const char *keys[] { "a", "b", "c", "d", "e" };
+	for (int i = 0; i < 4; ++i) {
+		LayoutCacheInsert(&cache, 42, keys[i], 1, LayoutTestValue(i), 0);
+	}
+	for (int i = 0; i < 4; ++i) {
+		CHECK(LayoutTestLookup(&cache, 42, keys[i]) == i);
+	}
+	// "a" was looked up first and is the least recently used
+	LayoutCacheInsert(&cache, 42, keys[4], 1, LayoutTestValue(4), 0);
+	CHECK(LayoutTestLookup(&cache, 42, keys[0]) == -1);
+	for (int i = 1; i < 5; ++i) {
+		CHECK(LayoutTestLookup(&cache, 42, keys[i]) == i);
+	}
+	LayoutCacheShutdown(&cache);
+	CHECK(layout_test_released == 5);
+}
+
+// The memory budget evicts before the entry count does
+static void LayoutCacheBudgetTest() {
+	layout_test_released = 0;
+	LayoutCache cache {};
+	LayoutCacheInitialize(&cache, 16, 1000, LayoutTestRelease);
+
+	char key[8];
+	for (int i = 0; i < 10; ++i) {
+		snprintf(key, sizeof(key), "k%d", i);
+		LayoutCacheInsert(&cache, LayoutCacheHash(key, strlen(key)), key, strlen(key), LayoutTestValue(i), 300);
+		CHECK(cache.memory_used <= cache.memory_budget);
+	}
+	CHECK(cache.count == 3);
+	CHECK(LayoutTestLookup(&cache, LayoutCacheHash("k9", 2), "k9") == 9);
+	CHECK(LayoutTestLookup(&cache, LayoutCacheHash("k6", 2), "k6") == -1);
+	LayoutCacheShutdown(&cache);
+	CHECK(layout_test_released == 10);
+}
+
+// Every tail length of the hash reads only the key's bytes
+static void LayoutCacheHashTest() {
+	char buffer[80];
+	memset(buffer, 'x', sizeof(buffer));
+	for (size_t size = 0; size < 72; ++size) {
+		uint64_t hash = LayoutCacheHash(buffer, size);
+		buffer[size] = 'y';
+		CHECK(LayoutCacheHash(buffer, size) == hash);
+		CHECK(size == 0 || LayoutCacheHash(buffer, size + 1) != hash);
+		buffer[size] = 'x';
+	}
+}
+
+void LayoutCacheTests() {
+	LayoutCacheLruTest();
+	LayoutCacheCollisionTest();
+	LayoutCacheBudgetTest();
+	LayoutCacheHashTest();
+}
@@ -0,0 +1,82 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "common/mpack_helper.h"
+#include "test.h"
+
+// Three messages back to back, with str8, array16 and map headers so
+// length bytes can be split from their type byte
+static size_t FramerTestStream(char **data_out, size_t message_ends_out[3]) {
+	size_t size;
+	mpack_writer_t writer;
+	mpack_writer_init_growable(&writer, data_out, &size);
+
+	MPackStartNotification("redraw", &writer);
+	mpack_start_array(&writer, 20);
+	for (int i = 0; i < 20; ++i) {
+		mpack_write_int(&writer, i * 1000);
+	}
+	mpack_finish_array(&writer);
+	mpack_finish_array(&writer);
+	message_ends_out[0] = mpack_writer_buffer_used(&writer);
+
+	MPackStartNotification("set_title", &writer);
+	mpack_start_array(&writer, 1);
+	mpack_write_cstr(&writer, "a title long enough to need a str8 header, over thirty one bytes");
+	mpack_finish_array(&writer);
+	mpack_finish_array(&writer);
+	message_ends_out[1] = mpack_writer_buffer_used(&writer);
+
+	mpack_start_array(&writer, 4);
+	mpack_write_int(&writer, 1);
+	mpack_write_int(&writer, 7);
+	mpack_write_nil(&writer);
+	mpack_start_map(&writer, 1);
+	mpack_write_cstr(&writer, "value");
+	mpack_write_double(&writer, 1.5);
+	mpack_finish_map(&writer);
+	mpack_finish_array(&writer);
+	CHECK(mpack_writer_destroy(&writer) == mpack_ok);
+	message_ends_out[2] = size;
+	return size;
+}
+
+static void MPackFramerSplitTest() {
+	char *data;
+	size_t message_ends[3];
+	size_t size = FramerTestStream(&data, message_ends);
+
+	// All at once
+	MPackFramer framer;
+	MPackFramerReset(&framer);
+	CHECK(MPackFramerScan(&framer, data, size) == message_ends[0]);
+
+	// A byte at a time, as if every read returned one byte
+	size_t message_start = 0;
+	int messages_found = 0;
+	MPackFramerReset(&framer);
+	for (size_t available = 1; message_start + available <= size; ++available) {
+		size_t message_size = MPackFramerScan(&framer, data + message_start, available);
+		if (message_size == 0) {
+			continue;
+		}
+		CHECK(message_size != SIZE_MAX);
+		CHECK(message_start + message_size == message_ends[messages_found]);
+		message_start += message_size;
+		messages_found++;
+		available = 0;
+		MPackFramerReset(&framer);
+	}
+	CHECK(messages_found == 3);
+
+	// 0xc1 is never used
+	char invalid[] { static_cast<char>(0x92), 0x01, static_cast<char>(0xc1) };
+	MPackFramerReset(&framer);
+	CHECK(MPackFramerScan(&framer, invalid, sizeof(invalid)) == SIZE_MAX);
+
+	free(data);
+}
+
+void MPackFramerTests() {
+	MPackFramerSplitTest();
+}
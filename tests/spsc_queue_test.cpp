@@ -0,0 +1,112 @@
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "common/spsc_queue.h"
+#include "test.h"
+
+constexpr uint32_t SPSC_TEST_MESSAGE_COUNT = 200'000;
+// Every so often a message big enough to grow its slot past the shrink threshold
+constexpr uint32_t SPSC_TEST_LARGE_EVERY = 997;
+constexpr size_t SPSC_TEST_LARGE_SIZE = SPSC_SLOT_SHRINK_THRESHOLD * 2;
+
+static size_t SpscTestMessageSize(uint32_t sequence) {
+	if (sequence % SPSC_TEST_LARGE_EVERY == 0) {
+		return SPSC_TEST_LARGE_SIZE;
+	}
+	return sizeof(uint32_t) + sequence % 300;
+}
+
+// The sequence number followed by bytes derived from it
+static void SpscTestFill(char *data, uint32_t sequence, size_t size) {
+	memcpy(data, &sequence, sizeof(sequence));
+	for (size_t i = sizeof(sequence); i < size; ++i) {
+		data[i] = static_cast<char>(sequence + i);
+	}
+}
+
+static bool SpscTestVerify(const SpscSlot *slot, uint32_t expected_sequence) {
+	uint32_t sequence;
+	memcpy(&sequence, slot->data, sizeof(sequence));
+	if (sequence != expected_sequence || slot->size != SpscTestMessageSize(sequence)) {
+		return false;
+	}
+	for (size_t i = sizeof(sequence); i < slot->size; ++i) {
+		if (slot->data[i] != static_cast<char>(sequence + i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// A producer thread against a small ring, the consumer checks that every
+// message arrives once, in order and intact
+static void SpscQueueOrderingTest() {
+	static SpscQueue<8> queue {};
+	std::thread producer([] {
+		char *message = static_cast<char *>(malloc(SPSC_TEST_LARGE_SIZE));
+		for (uint32_t i = 0; i < SPSC_TEST_MESSAGE_COUNT; ++i) {
+			size_t size = SpscTestMessageSize(i);
+			SpscTestFill(message, i, size);
+			SpscQueuePush(&queue, message, size);
+		}
+		free(message);
+	});
+
+	uint32_t expected_sequence = 0;
+	uint32_t corrupt_count = 0;
+	while (expected_sequence < SPSC_TEST_MESSAGE_COUNT) {
+		SpscSlot *slot = SpscQueueFront(&queue);
+		if (!slot) {
+			std::this_thread::yield();
+			continue;
+		}
+		corrupt_count += !SpscTestVerify(slot, expected_sequence);
+		expected_sequence++;
+		SpscQueuePop(&queue);
+	}
+	producer.join();
+	CHECK(corrupt_count == 0);
+	CHECK(SpscQueueEmpty(&queue));
+
+	SpscQueueStats stats = SpscQueueGetStats(&queue);
+	CHECK(stats.pushed == SPSC_TEST_MESSAGE_COUNT);
+	CHECK(stats.popped == SPSC_TEST_MESSAGE_COUNT);
+	CHECK(stats.max_depth >= 1 && stats.max_depth <= 8);
+
+	// The last messages were small, so every slot that held a large one has shrunk back
+	for (const SpscSlot &slot : queue.slots) {
+		CHECK(slot.capacity <= SPSC_SLOT_SHRINK_THRESHOLD);
+	}
+
+	SpscQueueDestroy(&queue);
+	for (const SpscSlot &slot : queue.slots) {
+		CHECK(slot.data == nullptr && slot.capacity == 0);
+	}
+}
+
+// Closing wakes a producer waiting on a full ring and fails its push
+static void SpscQueueCloseTest() {
+	static SpscQueue<2> queue {};
+	char message[16] {};
+	CHECK(SpscQueuePush(&queue, message, sizeof(message)));
+	CHECK(SpscQueuePush(&queue, message, sizeof(message)));
+
+	bool pushed = true;
+	std::thread producer([&] {
+		pushed = SpscQueuePush(&queue, message, sizeof(message));
+	});
+	while (SpscQueueGetStats(&queue).producer_stalls == 0) {
+		std::this_thread::yield();
+	}
+	SpscQueueClose(&queue);
+	producer.join();
+	CHECK(!pushed);
+	CHECK(SpscQueueSize(&queue) == 2);
+	SpscQueueDestroy(&queue);
+}
+
+void SpscQueueTests() {
+	SpscQueueOrderingTest();
+	SpscQueueCloseTest();
+}
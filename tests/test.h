@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdio>
+
+// Failed checks are reported and counted but don't stop the test, so one
+// run shows every broken expectation of a suite
+inline int test_failure_count = 0;
+
+inline bool TestCheck(bool passed, const char *expression, const char *file, int line) {
+	if (!passed) {
+		fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+		test_failure_count++;
+	}
+	return passed;
+}
+#define CHECK(expression) TestCheck(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+// Each suite is a plain function, registered in TEST_SUITES in test_main.cpp
+typedef void (*TestSuiteFunction)();
+struct TestSuite {
+	const char *name;
+	TestSuiteFunction run;
+};
@@ -0,0 +1,60 @@
+#include <cstring>
+
+#include "test.h"
+
+void BackgroundPlannerTests();
+void DamageTrackerTests();
+void GlyphMetricsTests();
+void GraphemeTableTests();
+void GridModelTests();
+void GridSnapshotTests();
+void HighlightRemapTests();
+void InputEncoderTests();
+void LayoutCacheTests();
+void MPackFramerTests();
+void SpscQueueTests();
+void TransportTests();
+void Utf8Tests();
+void WorkPoolTests();
+
+constexpr TestSuite TEST_SUITES[] {
+	{ "background_planner", BackgroundPlannerTests },
+	{ "damage_tracker", DamageTrackerTests },
+	{ "glyph_metrics", GlyphMetricsTests },
+	{ "grapheme_table", GraphemeTableTests },
+	{ "grid_model", GridModelTests },
+	{ "grid_snapshot", GridSnapshotTests },
+	{ "highlight_remap", HighlightRemapTests },
+	{ "input_encoder", InputEncoderTests },
+	{ "layout_cache", LayoutCacheTests },
+	{ "mpack_framer", MPackFramerTests },
+	{ "spsc_queue", SpscQueueTests },
+	{ "transport", TransportTests },
+	{ "utf8", Utf8Tests },
+	{ "work_pool", WorkPoolTests }
+};
+
+// Runs the suites named on the command line, or all of them
+int main(int argc, char **argv) {
+	int suites_run = 0;
+	for (const TestSuite &suite : TEST_SUITES) {
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; ++i) {
+			selected |= strcmp(argv[i], suite.name) == 0;
+		}
+		if (!selected) {
+			continue;
+		}
+
+		int failures_before = test_failure_count;
+		suite.run();
+		printf("%s: %s\n", suite.name, test_failure_count == failures_before ? "passed" : "FAILED");
+		suites_run++;
+	}
+
+	if (suites_run == 0) {
+		fprintf(stderr, "No test suite matched\n");
+		return 1;
+	}
+	return test_failure_count == 0 ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include <cstring>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "nvim/transport.h"
+#include "test.h"
+
+static int CountOpenFds() {
+	int count = 0;
+	DIR *fd_dir = opendir("/proc/self/fd");
+	if (!fd_dir) {
+		return -1;
+	}
+	while (readdir(fd_dir)) {
+		count++;
+	}
+	closedir(fd_dir);
+	return count;
+}
+
+static int WaitForExit(Transport *transport) {
+	int exit_code = -1;
+	while (!TransportGetExitCode(transport, &exit_code)) {
+		usleep(1000);
+	}
+	return exit_code;
+}
+
+static void TransportEchoTest() {
+	char *const argv[] { const_cast<char *>("cat"), nullptr };
+	Transport transport {};
+	if (!CHECK(TransportSpawn(&transport, argv))) {
+		return;
+	}
+
+	const char message[] = "redraw";
+	CHECK(TransportWrite(&transport, message, sizeof(message)));
+	char buffer[sizeof(message)] {};
+	size_t received = 0;
+	while (received < sizeof(buffer)) {
+		size_t bytes_read = TransportRead(&transport, buffer + received, sizeof(buffer) - received);
+		if (!CHECK(bytes_read != 0)) {
+			break;
+		}
+		received += bytes_read;
+	}
+	CHECK(memcmp(buffer, message, sizeof(message)) == 0);
+
+	int exit_code;
+	CHECK(!TransportGetExitCode(&transport, &exit_code));
+	TransportClose(&transport);
+	CHECK(transport.kind == TransportKind::None);
+}
+
+static void TransportExitCodeTest() {
+	char *const argv[] { const_cast<char *>("sh"), const_cast<char *>("-c"), const_cast<char *>("exit 3"), nullptr };
+	Transport transport {};
+	if (!CHECK(TransportSpawn(&transport, argv))) {
+		return;
+	}
+	CHECK(WaitForExit(&transport) == 3);
+	// The process is already reaped, the exit code has to come from the transport
+	int exit_code = -1;
+	CHECK(TransportGetExitCode(&transport, &exit_code));
+	CHECK(exit_code == 3);
+
+	// Writing to the exited process fails instead of raising SIGPIPE
+	char payload[64 * 1024] {};
+	CHECK(!TransportWrite(&transport, payload, sizeof(payload)));
+	TransportClose(&transport);
+}
+
+static void TransportSpawnFailureTest() {
+	int fds_before = CountOpenFds();
+	char *const argv[] { const_cast<char *>("/nonexistent/nvim"), nullptr };
+	Transport transport {};
+	CHECK(!TransportSpawn(&transport, argv));
+	CHECK(transport.kind == TransportKind::None);
+	CHECK(CountOpenFds() == fds_before);
+}
+
+// A process that never reads its stdin, the write fills the pipe and then
+// waits until it is cancelled
+static void TransportCancelWriteTest() {
+	char *const argv[] { const_cast<char *>("sleep"), const_cast<char *>("10"), nullptr };
+	Transport transport {};
+	if (!CHECK(TransportSpawn(&transport, argv))) {
+		return;
+	}
+
+	static char payload[4 * 1024 * 1024];
+	bool written = true;
+	std::thread writer([&] {
+		written = TransportWrite(&transport, payload, sizeof(payload));
+	});
+	usleep(20 * 1000);
+	TransportCancelWrite(&transport, &writer);
+	writer.join();
+	CHECK(!written);
+	TransportClose(&transport);
+}
+
+static void TransportSocketTest() {
+	char socket_path[64];
+	snprintf(socket_path, sizeof(socket_path), "/tmp/nvy_transport_test_%d", static_cast<int>(getpid()));
+	unlink(socket_path);
+
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address {};
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+	if (!CHECK(bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) ||
+		!CHECK(listen(listen_fd, 1) == 0)) {
+		close(listen_fd);
+		return;
+	}
+
+	// Echoes one message back, like a server answering a request
+	std::thread server([listen_fd]() {
+		int client_fd = accept(listen_fd, nullptr, nullptr);
+		char buffer[16];
+		ssize_t size = read(client_fd, buffer, sizeof(buffer));
+		if (size > 0) {
+			CHECK(write(client_fd, buffer, static_cast<size_t>(size)) == size);
+		}
+		close(client_fd);
+	});
+
+	Transport transport {};
+	if (CHECK(TransportConnect(&transport, socket_path))) {
+		CHECK(TransportWrite(&transport, "ping", 4));
+		char buffer[4] {};
+		CHECK(TransportRead(&transport, buffer, sizeof(buffer)) == 4);
+		CHECK(memcmp(buffer, "ping", 4) == 0);
+		// The server hung up
+		CHECK(TransportRead(&transport, buffer, sizeof(buffer)) == 0);
+
+		int exit_code = -1;
+		CHECK(TransportGetExitCode(&transport, &exit_code));
+		CHECK(exit_code == 0);
+		TransportClose(&transport);
+	}
+	server.join();
+	close(listen_fd);
+	unlink(socket_path);
+
+	Transport missing {};
+	CHECK(!TransportConnect(&missing, socket_path));
+}
+
+void TransportTests() {
+	TransportEchoTest();
+	TransportExitCodeTest();
+	TransportSpawnFailureTest();
+	TransportCancelWriteTest();
+	TransportSocketTest();
+}
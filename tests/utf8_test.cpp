@@ -0,0 +1,169 @@
+#include <clocale>
+#include <cstring>
+#include <cwchar>
+
+#include "common/utf8.h"
+#include "test.h"
+
+constexpr uint32_t UTF8_TEST_FUZZ_RUNS = 2'000'000;
+constexpr size_t UTF8_TEST_MAX_LENGTH = 6;
+
+static uint32_t Utf8TestRandom(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+// Straight from the bit layout, independent of the decoder under test
+static size_t Utf8TestEncode(uint32_t codepoint, uint8_t *out) {
+	if (codepoint < 0x80) {
+		out[0] = static_cast<uint8_t>(codepoint);
+		return 1;
+	}
+	if (codepoint < 0x800) {
+		out[0] = static_cast<uint8_t>(0xC0 | (codepoint >> 6));
+		out[1] = static_cast<uint8_t>(0x80 | (codepoint & 0x3F));
+		return 2;
+	}
+	if (codepoint < 0x10000) {
+		out[0] = static_cast<uint8_t>(0xE0 | (codepoint >> 12));
+		out[1] = static_cast<uint8_t>(0x80 | ((codepoint >> 6) & 0x3F));
+		out[2] = static_cast<uint8_t>(0x80 | (codepoint & 0x3F));
+		return 3;
+	}
+	out[0] = static_cast<uint8_t>(0xF0 | (codepoint >> 18));
+	out[1] = static_cast<uint8_t>(0x80 | ((codepoint >> 12) & 0x3F));
+	out[2] = static_cast<uint8_t>(0x80 | ((codepoint >> 6) & 0x3F));
+	out[3] = static_cast<uint8_t>(0x80 | (codepoint & 0x3F));
+	return 4;
+}
+
+// The first sequence as the C library sees it, 0 if it is malformed. glibc
+// still takes the old 4 byte forms past U+10FFFF, which MultiByteToWideChar
+// and the decoder reject.
+static size_t Utf8TestReference(const uint8_t *text, size_t length, uint32_t *codepoint_out) {
+	mbstate_t state {};
+	wchar_t wide;
+	size_t consumed = mbrtowc(&wide, reinterpret_cast<const char *>(text), length, &state);
+	if (consumed == 0) {
+		*codepoint_out = 0;
+		return 1;
+	}
+	if (consumed > length || static_cast<uint32_t>(wide) > 0x10FFFF) {
+		return 0;
+	}
+	*codepoint_out = static_cast<uint32_t>(wide);
+	return consumed;
+}
+
+// Every scalar value round trips through the cell decoder and UTF-16,
+// every surrogate is rejected
+static void Utf8ExhaustiveTest() {
+	uint32_t mismatches = 0;
+	for (uint32_t codepoint = 0; codepoint <= 0x10FFFF; ++codepoint) {
+		uint8_t text[4];
+		size_t length = Utf8TestEncode(codepoint, text);
+		uint32_t decoded = Utf8DecodeCell(reinterpret_cast<const char *>(text), length);
+
+		bool surrogate = codepoint >= 0xD800 && codepoint <= 0xDFFF;
+		if (surrogate) {
+			mismatches += decoded != UTF8_MULTIPLE_CODEPOINTS;
+			continue;
+		}
+		if (codepoint == 0) {
+			// Empty text is the right half of a wide char, a NUL byte is a NUL
+			mismatches += decoded != 0 || Utf8DecodeCell("", 0) != 0;
+			continue;
+		}
+
+		wchar_t utf16[2];
+		uint32_t units = Utf16Encode(decoded, utf16);
+		uint32_t round_trip = units == 1 ? static_cast<uint32_t>(utf16[0]) :
+			0x10000 + ((static_cast<uint32_t>(utf16[0]) - 0xD800) << 10) + (static_cast<uint32_t>(utf16[1]) - 0xDC00);
+		mismatches += decoded != codepoint || units != Utf16Length(codepoint) || round_trip != codepoint;
+	}
+	CHECK(mismatches == 0);
+}
+
+// Mostly sequences that are nearly valid, a valid encoding with a byte
+// swapped for one from the edges of the lead and continuation ranges, cut
+// short or followed by more
+static size_t Utf8TestFuzzInput(uint32_t *state, uint8_t *out) {
+	constexpr uint8_t EDGE_BYTES[] {
+		0x00, 0x41, 0x7F, 0x80, 0x9F, 0xA0, 0xBF, 0xC0, 0xC1, 0xC2, 0xDF,
+		0xE0, 0xED, 0xEF, 0xF0, 0xF4, 0xF5, 0xF8, 0xFE, 0xFF
+	};
+	uint32_t shape = Utf8TestRandom(state) % 4;
+	if (shape == 0) {
+		size_t length = Utf8TestRandom(state) % (UTF8_TEST_MAX_LENGTH + 1);
+		for (size_t i = 0; i < length; ++i) {
+			out[i] = static_cast<uint8_t>(Utf8TestRandom(state));
+		}
+		return length;
+	}
+
+	size_t length = Utf8TestEncode(Utf8TestRandom(state) % 0x110000, out);
+	if (shape == 1) {
+		out[Utf8TestRandom(state) % length] = EDGE_BYTES[Utf8TestRandom(state) % sizeof(EDGE_BYTES)];
+	} else if (shape == 2) {
+		length -= Utf8TestRandom(state) % length;
+	} else {
+		size_t extra = Utf8TestRandom(state) % (UTF8_TEST_MAX_LENGTH - length + 1);
+		for (size_t i = 0; i < extra; ++i) {
+			out[length++] = EDGE_BYTES[Utf8TestRandom(state) % sizeof(EDGE_BYTES)];
+		}
+	}
+	return length;
+}
+
+// Random cell text through the decoder against mbrtowc, what DrawGridLines
+// got from MultiByteToWideChar before
+static void Utf8FuzzTest() {
+	if (!setlocale(LC_CTYPE, "C.UTF-8")) {
+		fprintf(stderr, "No C.UTF-8 locale, skipping the mbrtowc comparison\n");
+		return;
+	}
+
+	uint32_t state = 0x9E3779B9;
+	uint32_t codepoint_mismatches = 0;
+	uint32_t cell_mismatches = 0;
+	for (uint32_t run = 0; run < UTF8_TEST_FUZZ_RUNS; ++run) {
+		uint8_t text[UTF8_TEST_MAX_LENGTH];
+		size_t length = Utf8TestFuzzInput(&state, text);
+		uint32_t decoded = Utf8DecodeCell(reinterpret_cast<const char *>(text), length);
+		if (length == 0) {
+			cell_mismatches += decoded != 0;
+			continue;
+		}
+
+		uint32_t expected = UTF8_REPLACEMENT_CHAR;
+		size_t expected_length = Utf8TestReference(text, length, &expected);
+		uint32_t codepoint;
+		uint32_t consumed = Utf8DecodeCodepoint(text, length, &codepoint);
+		if (expected_length == 0) {
+			codepoint_mismatches += consumed != 1 || codepoint != UTF8_REPLACEMENT_CHAR;
+		} else {
+			codepoint_mismatches += consumed != expected_length || codepoint != expected;
+		}
+
+		// A cell is one codepoint or it is shown as unsupported
+		uint32_t expected_cell = UTF8_MULTIPLE_CODEPOINTS;
+		if (expected_length == length) {
+			expected_cell = expected;
+		} else if (expected_length == 0 && length == 1) {
+			expected_cell = UTF8_REPLACEMENT_CHAR;
+		}
+		cell_mismatches += decoded != expected_cell;
+	}
+	setlocale(LC_CTYPE, "C");
+	CHECK(codepoint_mismatches == 0);
+	CHECK(cell_mismatches == 0);
+}
+
+void Utf8Tests() {
+	Utf8ExhaustiveTest();
+	Utf8FuzzTest();
+}
@@ -0,0 +1,71 @@
+#include <atomic>
+
+#include "common/work_pool.h"
+#include "test.h"
+
+constexpr uint32_t POOL_TEST_MAX_ITEMS = 4096;
+constexpr uint32_t POOL_TEST_BATCHES = 300;
+constexpr uint32_t POOL_TEST_THREAD_COUNTS[] { 0, 1, 3, 7 };
+
+struct PoolTestContext {
+	std::atomic<uint32_t> runs[POOL_TEST_MAX_ITEMS];
+	uint32_t values[POOL_TEST_MAX_ITEMS]; // Keeps the busy work from being dropped
+	std::atomic<uint32_t> bad_workers;
+	uint32_t worker_count;
+};
+
+// A few items cost far more than the rest, all in the first slice, so
+// the other workers run out early and have to steal
+static void PoolTestTask(void *context, uint32_t index, uint32_t worker) {
+	auto test = static_cast<PoolTestContext *>(context);
+	test->runs[index].fetch_add(1, std::memory_order_relaxed);
+	if (worker >= test->worker_count) {
+		test->bad_workers.fetch_add(1, std::memory_order_relaxed);
+	}
+	uint32_t spins = index < 16 ? 20'000 : 50;
+	uint32_t value = index;
+	for (uint32_t i = 0; i < spins; ++i) {
+		value = value * 1664525u + 1013904223u;
+	}
+	test->values[index] = value;
+}
+
+// Batches of many sizes, the 0 and 1 item ones included, each index has
+// to be run exactly once by a worker of the pool
+static void WorkPoolBatchTest() {
+	static PoolTestContext test;
+	for (uint32_t thread_count : POOL_TEST_THREAD_COUNTS) {
+		WorkPool pool {};
+		WorkPoolInitialize(&pool, thread_count);
+		test.worker_count = pool.worker_count;
+		test.bad_workers.store(0);
+
+		uint32_t bad_items = 0;
+		uint64_t item_total = 0;
+		for (uint32_t batch = 0; batch < POOL_TEST_BATCHES; ++batch) {
+			uint32_t count = batch < 4 ? batch : (batch * 7919u) % POOL_TEST_MAX_ITEMS;
+			for (uint32_t i = 0; i < count; ++i) {
+				test.runs[i].store(0, std::memory_order_relaxed);
+			}
+			WorkPoolRun(&pool, count, PoolTestTask, &test);
+			for (uint32_t i = 0; i < count; ++i) {
+				bad_items += test.runs[i].load(std::memory_order_relaxed) != 1;
+			}
+			item_total += count;
+		}
+
+		WorkPoolStats stats = WorkPoolGetStats(&pool);
+		CHECK(bad_items == 0);
+		CHECK(test.bad_workers.load() == 0);
+		CHECK(stats.batches == POOL_TEST_BATCHES);
+		CHECK(stats.items == item_total);
+		if (thread_count == 0) {
+			CHECK(stats.steals == 0);
+		}
+		WorkPoolShutdown(&pool);
+	}
+}
+
+void WorkPoolTests() {
+	WorkPoolBatchTest();
+}
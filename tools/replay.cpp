@@ -0,0 +1,94 @@
+// Plays a recorded trace into the grid model, with no window or renderer,
+// to time the redraw handling on its own:
+//     nvy_replay [--realtime] <trace>
+// By default messages are applied back to back. --realtime keeps the
+// recorded pacing instead, for looking at a session as it happened.
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "common/mpack_helper.h"
+#include "nvim/trace.h"
+#include "renderer/grid_model.h"
+
+// Stands in for what the window would see, FNV-1a over the rows in screen order
+static uint64_t ReplayGridHash(const GridModel *model) {
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (int i = 0; i < model->grid_rows; ++i) {
+		const uint8_t *bytes = reinterpret_cast<const uint8_t *>(model->grid_row_cells[i]);
+		for (size_t j = 0; j < model->grid_cols * sizeof(GridCell); ++j) {
+			hash = (hash ^ bytes[j]) * 0x100000001B3ull;
+		}
+	}
+	return hash;
+}
+
+int main(int argc, char **argv) {
+	bool realtime = false;
+	const char *trace_path = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--realtime") == 0) {
+			realtime = true;
+		}
+		else {
+			trace_path = argv[i];
+		}
+	}
+	if (!trace_path) {
+		fprintf(stderr, "usage: nvy_replay [--realtime] <trace>\n");
+		return 2;
+	}
+
+	TraceReader trace_reader {};
+	if (!TraceReaderOpen(&trace_reader, trace_path)) {
+		fprintf(stderr, "nvy_replay: can't read a trace from %s\n", trace_path);
+		return 1;
+	}
+
+	GridModel model {};
+	GridModelHooks hooks {};
+	GridModelInitialize(&model, &hooks);
+
+	uint64_t message_count = 0;
+	uint64_t redraw_count = 0;
+	auto start = std::chrono::steady_clock::now();
+	TraceMessage message;
+	while (TraceReaderNext(&trace_reader, &message)) {
+		if (realtime) {
+			std::this_thread::sleep_until(start + std::chrono::nanoseconds(message.timestamp_ns));
+		}
+		message_count++;
+
+		mpack_reader_t reader;
+		mpack_reader_init_data(&reader, message.data, message.size);
+		MPackMessageResult result = MPackExtractMessageResult(&reader);
+		if (result.type == MPackMessageType::Notification &&
+			MPackMatchString(result.notification.name, "redraw")) {
+			GridModelRedraw(&model, &reader);
+			redraw_count++;
+		}
+		mpack_reader_destroy(&reader);
+	}
+	double elapsed_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start).count());
+	double elapsed_s = elapsed_ns / 1e9;
+
+	printf("messages          %llu (%llu redraw)\n",
+		static_cast<unsigned long long>(message_count), static_cast<unsigned long long>(redraw_count));
+	printf("elapsed           %.3f ms%s\n", elapsed_ns / 1e6, realtime ? " (recorded pacing)" : "");
+	printf("events            %llu, %.0f/s\n",
+		static_cast<unsigned long long>(model.redraw_event_count), model.redraw_event_count / elapsed_s);
+	printf("cells             %llu, %.0f/s\n",
+		static_cast<unsigned long long>(model.grid_cell_count), model.grid_cell_count / elapsed_s);
+	printf("flushes           %llu, %.0f ns each\n", static_cast<unsigned long long>(model.flush_count),
+		model.flush_count ? elapsed_ns / model.flush_count : 0.0);
+	printf("redundant draws   %llu\n", static_cast<unsigned long long>(model.redundant_draw_count));
+	printf("unknown events    %llu\n", static_cast<unsigned long long>(model.unknown_redraw_event_count));
+	printf("grid              %dx%d, hash %016llx\n", model.grid_cols, model.grid_rows,
+		static_cast<unsigned long long>(ReplayGridHash(&model)));
+
+	GridModelShutdown(&model);
+	TraceReaderClose(&trace_reader);
+	return 0;
+}